@@ -0,0 +1,258 @@
+/*
+ * domstart.c: Demo program measuring how long starting a domain takes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <libvirt/libvirt.h>
+#include <libvirt/virterror.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_FIELDS 64
+
+#undef ERROR
+#define ERROR(...) \
+do { \
+    fprintf(stderr, "ERROR %s:%d : ", __FUNCTION__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); \
+    fprintf(stderr, "\n"); \
+} while (0)
+
+struct field {
+    char name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    unsigned long long sum;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned int count;
+};
+
+static struct field fields[MAX_FIELDS];
+static size_t nfields;
+
+static void
+print_usage(const char *progname)
+{
+    const char *unified_progname;
+
+    if (!(unified_progname = strrchr(progname, '/')))
+        unified_progname = progname;
+    else
+        unified_progname++;
+
+    printf("\n%s [options] [domain name]\n\n"
+           "  Starts and destroys an inactive domain repeatedly and prints\n"
+           "  how long the starts took, split into phases if the hypervisor\n"
+           "  reports them.\n\n"
+           "  options:\n"
+           "    -h | --help         print this help\n"
+           "    -c | --connect=URI  hypervisor connection URI\n"
+           "    -n | --runs=N       number of starts (default 10)\n",
+           unified_progname);
+}
+
+static int
+parse_argv(int argc, char *argv[],
+           const char **uri,
+           const char **dom_name,
+           unsigned int *runs)
+{
+    int arg;
+    unsigned long val;
+    char *p;
+    struct option opt[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"connect", required_argument, NULL, 'c'},
+        {"runs", required_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0}
+    };
+
+    while ((arg = getopt_long(argc, argv, "+:hc:n:", opt, NULL)) != -1) {
+        switch (arg) {
+        case 'h':
+            print_usage(argv[0]);
+            exit(EXIT_SUCCESS);
+            break;
+        case 'c':
+            *uri = optarg;
+            break;
+        case 'n':
+            /* strtoul man page suggest clearing errno prior to call */
+            errno = 0;
+            val = strtoul(optarg, &p, 10);
+            if (errno || *p || p == optarg || val == 0) {
+                ERROR("Not a number: '%s'", optarg);
+                return -1;
+            }
+            *runs = val;
+            if (*runs != val) {
+                ERROR("Integer overflow: %lu", val);
+                return -1;
+            }
+            break;
+        case ':':
+            ERROR("option '-%c' requires an argument", optopt);
+            return -1;
+        case '?':
+            if (optopt)
+                ERROR("unsupported option '-%c'. See --help.", optopt);
+            else
+                ERROR("unsupported option '%s'. See --help.", argv[optind - 1]);
+            return -1;
+        default:
+            ERROR("unknown option");
+            return -1;
+        }
+    }
+
+    if (argc != optind + 1) {
+        ERROR("exactly one domain name expected. See --help.");
+        return -1;
+    }
+
+    *dom_name = argv[optind];
+    return 0;
+}
+
+static unsigned long long
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+record(const char *name,
+       unsigned long long value)
+{
+    size_t i;
+
+    for (i = 0; i < nfields; i++) {
+        if (strcmp(fields[i].name, name) == 0)
+            break;
+    }
+
+    if (i == nfields) {
+        if (nfields == MAX_FIELDS)
+            return;
+        snprintf(fields[i].name, sizeof(fields[i].name), "%s", name);
+        fields[i].min = value;
+        nfields++;
+    }
+
+    fields[i].sum += value;
+    fields[i].count++;
+    if (value < fields[i].min)
+        fields[i].min = value;
+    if (value > fields[i].max)
+        fields[i].max = value;
+}
+
+static int
+record_startup_stats(virDomainPtr dom)
+{
+    virDomainPtr doms[] = { dom, NULL };
+    virDomainStatsRecordPtr *records = NULL;
+    int nrecords;
+    int i;
+
+    /* Not every hypervisor reports the startup phases, don't fail */
+    if ((nrecords = virDomainListGetStats(doms, VIR_DOMAIN_STATS_STARTUP,
+                                          &records, 0)) < 0)
+        return 0;
+
+    for (i = 0; i < nrecords; i++) {
+        int j;
+
+        for (j = 0; j < records[i]->nparams; j++) {
+            virTypedParameterPtr param = &records[i]->params[j];
+
+            if (param->type == VIR_TYPED_PARAM_ULLONG)
+                record(param->field, param->value.ul);
+        }
+    }
+
+    virDomainStatsRecordListFree(records);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    virConnectPtr conn = NULL;
+    virDomainPtr dom = NULL;
+    const char *uri = NULL;
+    const char *dom_name = NULL;
+    unsigned int runs = 10;
+    unsigned int i;
+    size_t j;
+    int ret = EXIT_FAILURE;
+
+    if (parse_argv(argc, argv, &uri, &dom_name, &runs) < 0)
+        goto cleanup;
+
+    if (!(conn = virConnectOpen(uri))) {
+        ERROR("Unable to connect to hypervisor");
+        goto cleanup;
+    }
+
+    if (!(dom = virDomainLookupByName(conn, dom_name))) {
+        ERROR("Unable to find domain '%s'", dom_name);
+        goto cleanup;
+    }
+
+    for (i = 0; i < runs; i++) {
+        unsigned long long start = now_ns();
+
+        if (virDomainCreate(dom) < 0) {
+            ERROR("Unable to start domain '%s'", dom_name);
+            goto cleanup;
+        }
+
+        record("client.time", now_ns() - start);
+
+        if (record_startup_stats(dom) < 0)
+            goto cleanup;
+
+        if (virDomainDestroy(dom) < 0) {
+            ERROR("Unable to destroy domain '%s'", dom_name);
+            goto cleanup;
+        }
+    }
+
+    /* all the recorded times are in nanoseconds */
+    printf("%-32s %12s %12s %12s\n", "field", "avg [ms]", "min [ms]", "max [ms]");
+    for (j = 0; j < nfields; j++) {
+        printf("%-32s %12.3f %12.3f %12.3f\n",
+               fields[j].name,
+               fields[j].sum / (double)fields[j].count / 1000000,
+               fields[j].min / 1000000.,
+               fields[j].max / 1000000.);
+    }
+
+    ret = EXIT_SUCCESS;
+ cleanup:
+    if (dom)
+        virDomainFree(dom);
+    if (conn)
+        virConnectClose(conn);
+    return ret;
+}
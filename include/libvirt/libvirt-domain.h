@@ -849,6 +849,15 @@ typedef enum {
      */
     VIR_MIGRATE_PARALLEL          = (1 << 17),
 
+    /* Let the hypervisor driver watch the progress of a live migration and
+     * adjust migration parameters when the migration does not converge.
+     * The QEMU driver raises the maximum downtime to a value which lets the
+     * migration finish, up to 2 seconds, and switches to post-copy mode if
+     * that is not enough and VIR_MIGRATE_POSTCOPY was used. Only live
+     * migration can be tuned. The decisions are reported in job statistics.
+     */
+    VIR_MIGRATE_AUTO_TUNE         = (1 << 18),
+
 } virDomainMigrateFlags;
 
 
@@ -1543,6 +1552,29 @@ int     virDomainGetNumaParameters(virDomainPtr domain,
                                    virTypedParameterPtr params,
                                    int *nparams, unsigned int flags);
 
+/**
+ * VIR_DOMAIN_NUMA_REBALANCE_NODESET:
+ *
+ * Macro for typed parameter name that lists the host NUMA nodes a domain
+ * should be moved to, as a string. If omitted, the hypervisor picks the
+ * nodes itself.
+ */
+# define VIR_DOMAIN_NUMA_REBALANCE_NODESET "nodeset"
+
+/**
+ * VIR_DOMAIN_NUMA_REBALANCE_BANDWIDTH:
+ *
+ * Macro for typed parameter name that limits the rate memory of a domain
+ * is moved between NUMA nodes at, in MiB/s, as an unsigned long long.
+ * Zero means no limit.
+ */
+# define VIR_DOMAIN_NUMA_REBALANCE_BANDWIDTH "bandwidth"
+
+int     virDomainNumaRebalance(virDomainPtr domain,
+                               virTypedParameterPtr params,
+                               int nparams,
+                               unsigned int flags);
+
 /*
  * Dynamic control of domains
  */
@@ -2167,6 +2199,9 @@ typedef enum {
     VIR_DOMAIN_STATS_PERF = (1 << 6), /* return domain perf event info */
     VIR_DOMAIN_STATS_IOTHREAD = (1 << 7), /* return iothread poll info */
     VIR_DOMAIN_STATS_MEMORY = (1 << 8), /* return domain memory info */
+    VIR_DOMAIN_STATS_DIRTYRATE = (1 << 9), /* return domain dirty rate info */
+    VIR_DOMAIN_STATS_PRESSURE = (1 << 10), /* return domain pressure stall info */
+    VIR_DOMAIN_STATS_STARTUP = (1 << 11), /* return domain startup latency info */
 } virDomainStatsTypes;
 
 typedef enum {
@@ -3295,6 +3330,7 @@ typedef enum {
     VIR_DOMAIN_JOB_OPERATION_SNAPSHOT_REVERT = 7,
     VIR_DOMAIN_JOB_OPERATION_DUMP = 8,
     VIR_DOMAIN_JOB_OPERATION_BACKUP = 9,
+    VIR_DOMAIN_JOB_OPERATION_NUMA_REBALANCE = 10,
 
 # ifdef VIR_ENUM_SENTINELS
     VIR_DOMAIN_JOB_OPERATION_LAST
@@ -3604,6 +3640,25 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_AUTO_CONVERGE_THROTTLE  "auto_converge_throttle"
 
+/**
+ * VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME:
+ *
+ * virDomainGetJobStats field: the maximum downtime in milliseconds set by
+ * the hypervisor when a migration started with VIR_MIGRATE_AUTO_TUNE did
+ * not converge, as VIR_TYPED_PARAM_ULLONG. Present only when the downtime
+ * was raised.
+ */
+# define VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME  "auto_tune_downtime"
+
+/**
+ * VIR_DOMAIN_JOB_AUTO_TUNE_POSTCOPY:
+ *
+ * virDomainGetJobStats field: present and true when a migration started
+ * with VIR_MIGRATE_AUTO_TUNE was switched to post-copy mode because it did
+ * not converge, as VIR_TYPED_PARAM_BOOLEAN.
+ */
+# define VIR_DOMAIN_JOB_AUTO_TUNE_POSTCOPY  "auto_tune_postcopy"
+
 /**
  * VIR_DOMAIN_JOB_SUCCESS:
  *
@@ -4999,4 +5054,26 @@ int virDomainBackupBegin(virDomainPtr domain,
 char *virDomainBackupGetXMLDesc(virDomainPtr domain,
                                 unsigned int flags);
 
+/**
+ * virDomainDirtyRateStatus:
+ *
+ * Details on the cause of a dirty rate calculation status.
+ */
+typedef enum {
+    VIR_DOMAIN_DIRTYRATE_UNSTARTED = 0, /* the dirtyrate calculation has
+                                           not been started */
+    VIR_DOMAIN_DIRTYRATE_MEASURING = 1, /* the dirtyrate calculation is
+                                           measuring */
+    VIR_DOMAIN_DIRTYRATE_MEASURED  = 2, /* the dirtyrate calculation is
+                                           completed */
+
+# ifdef VIR_ENUM_SENTINELS
+    VIR_DOMAIN_DIRTYRATE_LAST
+# endif
+} virDomainDirtyRateStatus;
+
+int virDomainStartDirtyRateCalc(virDomainPtr domain,
+                                int seconds,
+                                unsigned int flags);
+
 #endif /* LIBVIRT_DOMAIN_H */
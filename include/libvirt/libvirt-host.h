@@ -712,6 +712,11 @@ int                     virNodeGetMemoryStats (virConnectPtr conn,
                                                int *nparams,
                                                unsigned int flags);
 
+int                     virNodeGetPressureStats (virConnectPtr conn,
+                                                 virTypedParameterPtr *params,
+                                                 int *nparams,
+                                                 unsigned int flags);
+
 unsigned long long      virNodeGetFreeMemory    (virConnectPtr conn);
 
 int                     virNodeGetSecurityModel (virConnectPtr conn,
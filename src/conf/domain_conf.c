@@ -20689,6 +20689,66 @@ virDomainResctrlMonDefParse(virDomainDefPtr def,
 }
 
 
+/* Parses the 'auto' attribute of <cachetune> or <memorytune>. Automatic
+ * tuning is driven by the usage reported by the monitor of the very same
+ * group, so such a monitor is required. */
+static int
+virDomainResctrlParseAuto(xmlNodePtr node,
+                          virDomainResctrlDefPtr resctrl,
+                          virResctrlMonitorType tag,
+                          virTristateBool *value)
+{
+    g_autofree char *tmp = NULL;
+    size_t i;
+    int val;
+
+    if (!(tmp = virXMLPropString(node, "auto")))
+        return 0;
+
+    if ((val = virTristateBoolTypeFromString(tmp)) <= 0) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("Invalid %s attribute 'auto' value '%s'"),
+                       (const char *) node->name, tmp);
+        return -1;
+    }
+
+    *value = val;
+
+    if (val != VIR_TRISTATE_BOOL_YES)
+        return 0;
+
+    for (i = 0; i < resctrl->nmonitors; i++) {
+        if (resctrl->monitors[i]->tag == tag &&
+            virBitmapEqual(resctrl->monitors[i]->vcpus, resctrl->vcpus))
+            return 0;
+    }
+
+    virReportError(VIR_ERR_XML_ERROR,
+                   _("Automatic %s requires a monitor with the same vcpus"),
+                   (const char *) node->name);
+    return -1;
+}
+
+
+static int
+virDomainCachetuneCheckAuto(unsigned int level,
+                            virCacheType type,
+                            unsigned int cache G_GNUC_UNUSED,
+                            unsigned long long size G_GNUC_UNUSED,
+                            void *opaque G_GNUC_UNUSED)
+{
+    if (level != VIR_DOMAIN_RESCTRL_MONITOR_CACHELEVEL ||
+        type != VIR_CACHE_TYPE_BOTH) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("Automatic cachetune is supported only for unified "
+                         "level 3 cache allocations"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static virDomainResctrlDefPtr
 virDomainResctrlNew(xmlNodePtr node,
                     virResctrlAllocPtr alloc,
@@ -20793,6 +20853,24 @@ virDomainCachetuneDefParse(virDomainDefPtr def,
                                     resctrl) < 0)
         goto cleanup;
 
+    if (virDomainResctrlParseAuto(node, resctrl,
+                                  VIR_RESCTRL_MONITOR_TYPE_CACHE,
+                                  &resctrl->autoCache) < 0)
+        goto cleanup;
+
+    if (resctrl->autoCache == VIR_TRISTATE_BOOL_YES) {
+        if (n == 0) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("Automatic cachetune requires a cache "
+                             "allocation"));
+            goto cleanup;
+        }
+
+        if (virResctrlAllocForeachCache(alloc, virDomainCachetuneCheckAuto,
+                                        NULL) < 0)
+            goto cleanup;
+    }
+
     /* If no <cache> element or <monitor> element in <cachetune>, do not
      * append any resctrl element */
     if (!resctrl->nmonitors && n == 0) {
@@ -20993,6 +21071,18 @@ virDomainMemorytuneDefParse(virDomainDefPtr def,
                                     resctrl) < 0)
         goto cleanup;
 
+    if (virDomainResctrlParseAuto(node, resctrl,
+                                  VIR_RESCTRL_MONITOR_TYPE_MEMBW,
+                                  &resctrl->autoMemBW) < 0)
+        goto cleanup;
+
+    if (resctrl->autoMemBW == VIR_TRISTATE_BOOL_YES && n == 0) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("Automatic memorytune requires a memory bandwidth "
+                         "allocation"));
+        goto cleanup;
+    }
+
     nmons = resctrl->nmonitors - nmons;
     /* Now @nmons contains the new <monitor> element number found in current
      * <memorytune> element, and @n holds the number of new <node> element,
@@ -28711,6 +28801,10 @@ virDomainCachetuneDefFormat(virBufferPtr buf,
 
     virBufferAsprintf(buf, "<cachetune vcpus='%s'", vcpus);
 
+    if (resctrl->autoCache)
+        virBufferAsprintf(buf, " auto='%s'",
+                          virTristateBoolTypeToString(resctrl->autoCache));
+
     if (!(flags & VIR_DOMAIN_DEF_FORMAT_INACTIVE)) {
         const char *alloc_id = virResctrlAllocGetID(resctrl->alloc);
         if (!alloc_id)
@@ -28771,6 +28865,10 @@ virDomainMemorytuneDefFormat(virBufferPtr buf,
 
     virBufferAsprintf(buf, "<memorytune vcpus='%s'", vcpus);
 
+    if (resctrl->autoMemBW)
+        virBufferAsprintf(buf, " auto='%s'",
+                          virTristateBoolTypeToString(resctrl->autoMemBW));
+
     if (!(flags & VIR_DOMAIN_DEF_FORMAT_INACTIVE)) {
         const char *alloc_id = virResctrlAllocGetID(resctrl->alloc);
         if (!alloc_id)
@@ -2353,6 +2353,9 @@ struct _virDomainResctrlMonDef {
 struct _virDomainResctrlDef {
     virBitmapPtr vcpus;
     virResctrlAllocPtr alloc;
+    /* resize the allocation based on the usage reported by monitors */
+    virTristateBool autoCache;
+    virTristateBool autoMemBW;
 
     virDomainResctrlMonDefPtr *monitors;
     size_t nmonitors;
@@ -1377,6 +1377,23 @@ typedef int
                                        int timeout,
                                        unsigned int flags);
 
+typedef int
+(*virDrvDomainStartDirtyRateCalc)(virDomainPtr domain,
+                                  int seconds,
+                                  unsigned int flags);
+
+typedef int
+(*virDrvDomainNumaRebalance)(virDomainPtr domain,
+                             virTypedParameterPtr params,
+                             int nparams,
+                             unsigned int flags);
+
+typedef int
+(*virDrvNodeGetPressureStats)(virConnectPtr conn,
+                              virTypedParameterPtr *params,
+                              int *nparams,
+                              unsigned int flags);
+
 typedef int
 (*virDrvDomainBackupBegin)(virDomainPtr domain,
                            const char *backupXML,
@@ -1650,4 +1667,7 @@ struct _virHypervisorDriver {
     virDrvDomainAgentSetResponseTimeout domainAgentSetResponseTimeout;
     virDrvDomainBackupBegin domainBackupBegin;
     virDrvDomainBackupGetXMLDesc domainBackupGetXMLDesc;
+    virDrvDomainStartDirtyRateCalc domainStartDirtyRateCalc;
+    virDrvDomainNumaRebalance domainNumaRebalance;
+    virDrvNodeGetPressureStats nodeGetPressureStats;
 };
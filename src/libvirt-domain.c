@@ -2285,6 +2285,74 @@ virDomainGetNumaParameters(virDomainPtr domain,
 }
 
 
+/**
+ * virDomainNumaRebalance:
+ * @domain: pointer to domain object
+ * @params: pointer to rebalance parameter objects, or NULL
+ * @nparams: number of rebalance parameters
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Moves the vCPUs, emulator and I/O threads and the memory of a running
+ * domain to other host NUMA nodes without migrating it to another host.
+ *
+ * The target nodes are given by VIR_DOMAIN_NUMA_REBALANCE_NODESET. If it is
+ * omitted, the hypervisor picks the nodes which suit the domain best at the
+ * moment, which may be the ones the domain already runs on, in which case
+ * nothing is moved. VIR_DOMAIN_NUMA_REBALANCE_BANDWIDTH limits how fast the
+ * memory is moved so that the host and the domain are not stalled by the
+ * copying.
+ *
+ * The domain keeps running while its memory is moved. The operation runs
+ * as a domain job, so its progress can be watched with virDomainGetJobStats()
+ * and it can be cancelled with virDomainAbortJob(), in which case the memory
+ * moved so far stays on the target nodes. The function does not return until
+ * the job finishes.
+ *
+ * The NUMA nodeset of the domain, as reported by virDomainGetNumaParameters()
+ * and the live XML, is updated to the target nodes.
+ *
+ * Returns -1 in case of error, 0 in case of success.
+ */
+int
+virDomainNumaRebalance(virDomainPtr domain,
+                       virTypedParameterPtr params,
+                       int nparams,
+                       unsigned int flags)
+{
+    virConnectPtr conn;
+
+    VIR_DOMAIN_DEBUG(domain, "params=%p, nparams=%d, flags=0x%x",
+                     params, nparams, flags);
+    VIR_TYPED_PARAMS_DEBUG(params, nparams);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    virCheckReadOnlyGoto(domain->conn->flags, error);
+    virCheckNonNegativeArgGoto(nparams, error);
+    if (nparams > 0)
+        virCheckNonNullArgGoto(params, error);
+    if (virTypedParameterValidateSet(domain->conn, params, nparams) < 0)
+        goto error;
+
+    conn = domain->conn;
+
+    if (conn->driver->domainNumaRebalance) {
+        int ret;
+        ret = conn->driver->domainNumaRebalance(domain, params, nparams, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(domain->conn);
+    return -1;
+}
+
+
 /**
  * virDomainSetBlkioParameters:
  * @domain: pointer to domain object
@@ -11458,6 +11526,18 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *     "cpu.user" - user cpu time spent in nanoseconds as unsigned long long.
  *     "cpu.system" - system cpu time spent in nanoseconds as unsigned long
  *                    long.
+ *     "cpu.emulator.time" - cpu time spent by the emulator threads (those
+ *                           not running a vcpu or an iothread) in
+ *                           nanoseconds as unsigned long long.
+ *     "cpu.emulator.periods" - number of CPU bandwidth enforcement periods
+ *                              elapsed for the emulator threads as unsigned
+ *                              long long.
+ *     "cpu.emulator.throttled.periods" - number of periods in which the
+ *                                        emulator threads were throttled as
+ *                                        unsigned long long.
+ *     "cpu.emulator.throttled.time" - total time the emulator threads were
+ *                                     throttled in nanoseconds as unsigned
+ *                                     long long.
  *     "cpu.cache.monitor.count" - the number of cache monitors for this domain
  *     "cpu.cache.monitor.<num>.name" - the name of cache monitor <num>
  *     "cpu.cache.monitor.<num>.vcpus" - vcpu list of cache monitor <num>
@@ -11493,6 +11573,18 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *                          from virVcpuState enum.
  *     "vcpu.<num>.time" - virtual cpu time spent by virtual CPU <num>
  *                         as unsigned long long.
+ *     "vcpu.<num>.delay" - time the virtual CPU <num> spent runnable but
+ *                          waiting for a host CPU in nanoseconds as
+ *                          unsigned long long.
+ *     "vcpu.<num>.periods" - number of CPU bandwidth enforcement periods
+ *                            elapsed for virtual CPU <num> as unsigned
+ *                            long long.
+ *     "vcpu.<num>.throttled.periods" - number of periods in which virtual
+ *                                      CPU <num> was throttled as unsigned
+ *                                      long long.
+ *     "vcpu.<num>.throttled.time" - total time virtual CPU <num> was
+ *                                   throttled in nanoseconds as unsigned
+ *                                   long long.
  *
  * VIR_DOMAIN_STATS_INTERFACE:
  *     Return network interface statistics (from domain point of view).
@@ -11661,6 +11753,16 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *                                 A 0 (zero) indicates to allow the underlying
  *                                 hypervisor to choose how to shrink the
  *                                 polling time.
+ *     "iothread.<id>.time" - cpu time spent by the iothread in nanoseconds
+ *                            as unsigned long long.
+ *     "iothread.<id>.periods" - number of CPU bandwidth enforcement periods
+ *                               elapsed for the iothread as unsigned long
+ *                               long.
+ *     "iothread.<id>.throttled.periods" - number of periods in which the
+ *                                         iothread was throttled as
+ *                                         unsigned long long.
+ *     "iothread.<id>.throttled.time" - total time the iothread was throttled
+ *                                      in nanoseconds as unsigned long long.
  *
  * VIR_DOMAIN_STATS_MEMORY:
  *     Return memory bandwidth statistics and the usage information. The typed
@@ -11683,6 +11785,81 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *                       bytes consumed by @vcpus that passing through all
  *                       memory controllers, either local or remote controller.
  *
+ * VIR_DOMAIN_STATS_DIRTYRATE:
+ *     Return memory dirty rate information. The typed parameter keys are in
+ *     this format:
+ *
+ *     "dirtyrate.calc_status" - the status of last memory dirty rate calculation,
+ *                               returned as int from virDomainDirtyRateStatus
+ *                               enum.
+ *     "dirtyrate.calc_start_time" - the start time of last memory dirty rate
+ *                                   calculation as long long.
+ *     "dirtyrate.calc_period" - the period of last memory dirty rate calculation
+ *                               as int.
+ *     "dirtyrate.megabytes_per_second" - the calculated memory dirty rate in
+ *                                        MiB/s as long long. It is produced
+ *                                        only if the calc_status is measured.
+ *     "dirtyrate.migration.estimated_time" - estimated time in milliseconds a
+ *                                            live migration of the domain would
+ *                                            take, based on the memory size,
+ *                                            the dirty rate, the maximum
+ *                                            downtime and the migration
+ *                                            bandwidth, as unsigned long long.
+ *                                            The bandwidth is the maximum
+ *                                            migration bandwidth or, if it is
+ *                                            not limited, the transfer rate of
+ *                                            the current or last migration.
+ *                                            It is produced only if the dirty
+ *                                            rate was measured, a bandwidth is
+ *                                            known and larger than the dirty
+ *                                            rate.
+ *     "dirtyrate.migration.estimated_downtime" - estimated downtime in
+ *                                                milliseconds of such a
+ *                                                migration as unsigned long
+ *                                                long. It is produced together
+ *                                                with estimated_time.
+ *
+ * VIR_DOMAIN_STATS_PRESSURE:
+ *     Return pressure stall information of the domain, that is how much
+ *     time its tasks spent waiting for a contended host resource. <resource>
+ *     is one of "cpu", "memory" or "io". The typed parameter keys are in
+ *     this format:
+ *
+ *     "pressure.<resource>.some.avg10" - share of the last 10 seconds in
+ *                                        which at least one task of the
+ *                                        domain was stalled on <resource>,
+ *                                        in percent as double.
+ *     "pressure.<resource>.some.avg60" - same as above over the last 60
+ *                                        seconds as double.
+ *     "pressure.<resource>.some.avg300" - same as above over the last 300
+ *                                         seconds as double.
+ *     "pressure.<resource>.some.total" - total time at least one task was
+ *                                        stalled on <resource> in
+ *                                        nanoseconds as unsigned long long.
+ *     "pressure.<resource>.full.avg10" - share of the last 10 seconds in
+ *                                        which all non-idle tasks of the
+ *                                        domain were stalled on <resource>,
+ *                                        in percent as double.
+ *     "pressure.<resource>.full.avg60" - same as above over the last 60
+ *                                        seconds as double.
+ *     "pressure.<resource>.full.avg300" - same as above over the last 300
+ *                                         seconds as double.
+ *     "pressure.<resource>.full.total" - total time all non-idle tasks were
+ *                                        stalled on <resource> in
+ *                                        nanoseconds as unsigned long long.
+ *
+ * VIR_DOMAIN_STATS_STARTUP:
+ *     Return how long the last start of the running domain took and how that
+ *     time was split among the phases of the startup. <phase> is one of
+ *     "caps", "prepare-domain", "prepare-host", "command-line", "launch",
+ *     "cgroup", "security", "monitor", "agent" or "finish"; the set of phases
+ *     is hypervisor specific. The typed parameter keys are in this format:
+ *
+ *     "startup.time" - total time the domain startup took in nanoseconds
+ *                      as unsigned long long.
+ *     "startup.<phase>.time" - time spent in <phase> in nanoseconds as
+ *                              unsigned long long.
+ *
  * Note that entire stats groups or individual stat fields may be missing from
  * the output in case they are not supported by the given hypervisor, are not
  * applicable for the current state of the guest domain, or their retrieval
@@ -12733,3 +12910,49 @@ virDomainBackupGetXMLDesc(virDomainPtr domain,
     virDispatchError(conn);
     return NULL;
 }
+
+
+/**
+ * virDomainStartDirtyRateCalc:
+ * @domain: a domain object
+ * @seconds: specified calculating time in seconds
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Calculate the current domain's memory dirty rate in next @seconds.
+ * The calculated dirty rate information is available by calling
+ * virConnectGetAllDomainStats with VIR_DOMAIN_STATS_DIRTYRATE, which
+ * also reports an estimate of how long a live migration of the domain
+ * would take with the currently configured migration bandwidth.
+ *
+ * Returns 0 in case of success, -1 otherwise.
+ */
+int
+virDomainStartDirtyRateCalc(virDomainPtr domain,
+                            int seconds,
+                            unsigned int flags)
+{
+    virConnectPtr conn;
+
+    VIR_DOMAIN_DEBUG(domain, "seconds=%d, flags=0x%x", seconds, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    conn = domain->conn;
+
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->driver->domainStartDirtyRateCalc) {
+        int ret;
+        ret = conn->driver->domainStartDirtyRateCalc(domain, seconds, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
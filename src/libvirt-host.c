@@ -657,6 +657,75 @@ virNodeGetMemoryStats(virConnectPtr conn,
 }
 
 
+/**
+ * virNodeGetPressureStats:
+ * @conn: pointer to the hypervisor connection
+ * @params: where to store the pressure stall information
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * This function provides the pressure stall information of the node, that
+ * is how much time tasks on the host spent waiting for a contended
+ * resource. Caller is responsible for freeing @params.
+ *
+ * <resource> is one of "cpu", "memory" or "io". Resources the host kernel
+ * does not provide pressure stall information for are omitted. The typed
+ * parameter keys are in this format:
+ *
+ * "<resource>.some.avg10" - share of the last 10 seconds in which at least
+ *                           one task was stalled on <resource>, in percent
+ *                           as double.
+ * "<resource>.some.avg60" - same as above over the last 60 seconds as
+ *                           double.
+ * "<resource>.some.avg300" - same as above over the last 300 seconds as
+ *                            double.
+ * "<resource>.some.total" - cumulative time at least one task was stalled
+ *                           on <resource> since the node booting up, in
+ *                           nanoseconds as unsigned long long.
+ * "<resource>.full.avg10" - share of the last 10 seconds in which all
+ *                           non-idle tasks were stalled on <resource>, in
+ *                           percent as double.
+ * "<resource>.full.avg60" - same as above over the last 60 seconds as
+ *                           double.
+ * "<resource>.full.avg300" - same as above over the last 300 seconds as
+ *                            double.
+ * "<resource>.full.total" - cumulative time all non-idle tasks were stalled
+ *                           on <resource> since the node booting up, in
+ *                           nanoseconds as unsigned long long.
+ *
+ * Returns 0 in case of success, and -1 in case of failure.
+ */
+int
+virNodeGetPressureStats(virConnectPtr conn,
+                        virTypedParameterPtr *params,
+                        int *nparams,
+                        unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if (conn->driver->nodeGetPressureStats) {
+        int ret;
+        ret = conn->driver->nodeGetPressureStats(conn, params, nparams, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virNodeGetFreeMemory:
  * @conn: pointer to the hypervisor connection
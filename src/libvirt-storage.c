@@ -1674,12 +1674,17 @@ virStorageVolDownload(virStorageVolPtr vol,
  * stream APIs is necessary to transfer the actual data,
  * determine how much data is successfully transferred, and
  * detect any errors. The results will be unpredictable if
- * another active stream is writing to the storage volume.
+ * another active stream is writing to the same range of the storage
+ * volume. Several streams may however upload non-overlapping ranges
+ * of one volume concurrently, e.g. to split the transfer of a large
+ * image across multiple connections.
  *
  * When the data stream is closed whether the upload is successful
  * or not an attempt will be made to refresh the target storage pool
- * if an asynchronous build is not running in order to reflect pool
- * and volume changes as a result of the upload. Depending on
+ * if neither an asynchronous build nor another upload is running
+ * in order to reflect pool and volume changes as a result of the
+ * upload. While the stream is open, the pool cannot be refreshed,
+ * destroyed, deleted or undefined. Depending on
  * the target volume storage backend and the source stream type
  * for a successful upload, the target volume may take on the
  * characteristics from the source stream such as format type,
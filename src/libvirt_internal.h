@@ -124,6 +124,14 @@ typedef enum {
      * Support for driver close callback rpc
      */
     VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK = 15,
+
+    /*
+     * Support for stream data packets of up to
+     * VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX bytes. A client asking
+     * the daemon about this feature tells it that it can receive
+     * them too.
+     */
+    VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS = 16,
 } virDrvFeature;
 
 
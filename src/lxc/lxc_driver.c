@@ -49,6 +49,7 @@
 #include "virnetdevopenvswitch.h"
 #include "virhostcpu.h"
 #include "virhostmem.h"
+#include "virpsi.h"
 #include "viruuid.h"
 #include "virhook.h"
 #include "virfile.h"
@@ -1660,6 +1661,7 @@ lxcConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS:
     case VIR_DRV_FEATURE_XML_MIGRATABLE:
     default:
         return 0;
@@ -4737,6 +4739,21 @@ lxcNodeGetMemoryStats(virConnectPtr conn,
 }
 
 
+static int
+lxcNodeGetPressureStats(virConnectPtr conn,
+                        virTypedParameterPtr *params,
+                        int *nparams,
+                        unsigned int flags)
+{
+    virCheckFlags(0, -1);
+
+    if (virNodeGetPressureStatsEnsureACL(conn) < 0)
+        return -1;
+
+    return virPSIGetHostParams(params, nparams);
+}
+
+
 static int
 lxcNodeGetCellsFreeMemory(virConnectPtr conn,
                           unsigned long long *freeMems,
@@ -5162,6 +5179,7 @@ static virHypervisorDriver lxcHypervisorDriver = {
     .nodeGetFreePages = lxcNodeGetFreePages, /* 1.2.6 */
     .nodeAllocPages = lxcNodeAllocPages, /* 1.2.9 */
     .domainHasManagedSaveImage = lxcDomainHasManagedSaveImage, /* 1.2.13 */
+    .nodeGetPressureStats = lxcNodeGetPressureStats, /* 6.5.0 */
 };
 
 static virConnectDriver lxcConnectDriver = {
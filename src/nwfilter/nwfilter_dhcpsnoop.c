@@ -854,9 +854,10 @@ virNWFilterSnoopReqLeaseDel(virNWFilterSnoopReqPtr req,
                           NWFILTER_VARNAME_DHCPSERVER);
 
         if (req->techdriver &&
-            req->techdriver->applyDHCPOnlyRules(req->binding->portdevname,
-                                                &req->binding->mac,
-                                                dhcpsrvrs, false) < 0) {
+            virNWFilterInstallDHCPOnlyRules(req->techdriver,
+                                            req->binding->portdevname,
+                                            &req->binding->mac,
+                                            dhcpsrvrs, false) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("virNWFilterSnoopListDel failed"));
             ret = -1;
@@ -1606,9 +1607,10 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
     dhcpsrvrs = virHashLookup(binding->filterparams,
                               NWFILTER_VARNAME_DHCPSERVER);
 
-    if (techdriver->applyDHCPOnlyRules(req->binding->portdevname,
-                                       &req->binding->mac,
-                                       dhcpsrvrs, false) < 0) {
+    if (virNWFilterInstallDHCPOnlyRules(techdriver,
+                                        req->binding->portdevname,
+                                        &req->binding->mac,
+                                        dhcpsrvrs, false) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("applyDHCPOnlyRules "
                          "failed - spoofing not protected!"));
@@ -36,10 +36,12 @@
 #include "domain_nwfilter.h"
 #include "nwfilter_driver.h"
 #include "nwfilter_gentech_driver.h"
+#include "nwfilter_ebiptables_driver.h"
 #include "configmake.h"
 #include "virfile.h"
 #include "virpidfile.h"
 #include "virstring.h"
+#include "virconf.h"
 #include "viraccessapicheck.h"
 
 #include "nwfilter_ipaddrmap.h"
@@ -50,6 +52,10 @@
 
 VIR_LOG_INIT("nwfilter.nwfilter_driver");
 
+/* threads applying the rules of different interfaces when all
+ * filters are rebuilt, unless set in nwfilter.conf */
+#define NWFILTER_DEFAULT_INSTANTIATE_WORKERS 4
+
 #define DBUS_RULE_FWD_NAMEOWNERCHANGED \
     "type='signal'" \
     ",interface='"DBUS_INTERFACE_DBUS"'" \
@@ -161,6 +167,30 @@ nwfilterDriverInstallDBusMatches(DBusConnection *sysbus G_GNUC_UNUSED)
 
 #endif /* WITH_FIREWALLD */
 
+static int
+nwfilterLoadDriverConfig(const char *filename,
+                         char **backend,
+                         unsigned int *workers)
+{
+    g_autoptr(virConf) conf = NULL;
+
+    /* Avoid error from non-existent or unreadable file. */
+    if (access(filename, R_OK) == -1)
+        return 0;
+
+    conf = virConfReadFile(filename, 0);
+    if (!conf)
+        return -1;
+
+    if (virConfGetValueString(conf, "firewall_backend", backend) < 0)
+        return -1;
+
+    if (virConfGetValueUInt(conf, "instantiate_workers", workers) < 0)
+        return -1;
+
+    return 0;
+}
+
 static int
 virNWFilterTriggerRebuildImpl(void *opaque)
 {
@@ -182,6 +212,8 @@ nwfilterStateInitialize(bool privileged,
                         void *opaque G_GNUC_UNUSED)
 {
     DBusConnection *sysbus = NULL;
+    g_autofree char *backend = NULL;
+    unsigned int workers = NWFILTER_DEFAULT_INSTANTIATE_WORKERS;
 
     if (root != NULL) {
         virReportError(VIR_ERR_INVALID_ARG, "%s",
@@ -231,7 +263,13 @@ nwfilterStateInitialize(bool privileged,
     if (virNWFilterDHCPSnoopInit() < 0)
         goto err_exit_learnshutdown;
 
-    if (virNWFilterTechDriversInit(privileged) < 0)
+    if (nwfilterLoadDriverConfig(SYSCONFDIR "/libvirt/nwfilter.conf",
+                                 &backend, &workers) < 0)
+        goto err_dhcpsnoop_shutdown;
+
+    if (virNWFilterTechDriversInit(privileged,
+                                   backend ? backend : EBIPTABLES_DRIVER_ID,
+                                   workers) < 0)
         goto err_dhcpsnoop_shutdown;
 
     if (virNWFilterConfLayerInit(virNWFilterTriggerRebuildImpl,
@@ -249,7 +287,7 @@ nwfilterStateInitialize(bool privileged,
                        "Disabling nwfilter driver"));
         /*
          * unfortunately this is fatal since virNWFilterTechDriversInit
-         * may have caused the ebiptables driver to use the firewall tool
+         * may have caused the technology driver to use the firewall tool
          * but now that the watches don't work, we just disable the nwfilter
          * driver
          *
@@ -280,6 +318,8 @@ nwfilterStateInitialize(bool privileged,
     if (virNWFilterBindingObjListLoadAllConfigs(driver->bindings, driver->bindingDir) < 0)
         goto error;
 
+    virNWFilterTeardownStaleBackends(driver);
+
     if (virNWFilterBuildAll(driver, false) < 0)
         goto error;
 
@@ -461,6 +461,25 @@ iptablesCreateBaseChainsFW(virFirewallPtr fw,
 }
 
 
+static int
+iptablesCreateBaseChains(bool ipv4, bool ipv6)
+{
+    virFirewallPtr fw = virFirewallNew();
+    int ret;
+
+    virFirewallStartTransaction(fw, 0);
+
+    if (ipv4)
+        iptablesCreateBaseChainsFW(fw, VIR_FIREWALL_LAYER_IPV4);
+    if (ipv6)
+        iptablesCreateBaseChainsFW(fw, VIR_FIREWALL_LAYER_IPV6);
+
+    ret = virFirewallApply(fw);
+    virFirewallFree(fw);
+    return ret;
+}
+
+
 static void
 iptablesCreateTmpRootChainFW(virFirewallPtr fw,
                              virFirewallLayer layer,
@@ -3492,7 +3511,6 @@ ebiptablesApplyNewRules(const char *ifname,
         iptablesUnlinkTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV4, ifname);
         iptablesRemoveTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV4, ifname);
 
-        iptablesCreateBaseChainsFW(fw, VIR_FIREWALL_LAYER_IPV4);
         iptablesCreateTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV4, ifname);
 
         iptablesLinkTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV4, ifname);
@@ -3514,7 +3532,6 @@ ebiptablesApplyNewRules(const char *ifname,
         iptablesUnlinkTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV6, ifname);
         iptablesRemoveTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV6, ifname);
 
-        iptablesCreateBaseChainsFW(fw, VIR_FIREWALL_LAYER_IPV6);
         iptablesCreateTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV6, ifname);
 
         iptablesLinkTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV6, ifname);
@@ -3554,6 +3571,13 @@ ebiptablesApplyNewRules(const char *ifname,
     ebtablesRemoveTmpRootChainFW(fw, true, ifname);
     ebtablesRemoveTmpRootChainFW(fw, false, ifname);
 
+    /* the chains shared by all interfaces are set up separately so that
+     * only the rules of this interface are changed concurrently */
+    if ((haveIptables || haveIp6tables) &&
+        iptablesCreateBaseChains(haveIptables, haveIp6tables) < 0)
+        goto cleanup;
+
+    virFirewallSetConcurrent(fw);
     if (virFirewallApply(fw) < 0)
         goto cleanup;
 
@@ -3594,6 +3618,7 @@ ebiptablesTearNewRules(const char *ifname)
     virFirewallPtr fw = virFirewallNew();
     int ret = -1;
 
+    virFirewallSetConcurrent(fw);
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
 
     ebiptablesTearNewRulesFW(fw, ifname);
@@ -3609,6 +3634,7 @@ ebiptablesTearOldRules(const char *ifname)
     virFirewallPtr fw = virFirewallNew();
     int ret = -1;
 
+    virFirewallSetConcurrent(fw);
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
 
     iptablesUnlinkRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV4, ifname);
@@ -3647,6 +3673,7 @@ ebiptablesAllTeardown(const char *ifname)
     virFirewallPtr fw = virFirewallNew();
     int ret = -1;
 
+    virFirewallSetConcurrent(fw);
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
 
     ebiptablesTearNewRulesFW(fw, ifname);
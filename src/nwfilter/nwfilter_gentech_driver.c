@@ -28,8 +28,10 @@
 #include "virlog.h"
 #include "domain_conf.h"
 #include "virerror.h"
-#include "nwfilter_gentech_driver.h"
+#define LIBVIRT_NWFILTER_GENTECH_DRIVERPRIV_H_ALLOW
+#include "nwfilter_gentech_driverpriv.h"
 #include "nwfilter_ebiptables_driver.h"
+#include "nwfilter_nftables_driver.h"
 #include "nwfilter_dhcpsnoop.h"
 #include "nwfilter_ipaddrmap.h"
 #include "nwfilter_learnipaddr.h"
@@ -37,6 +39,8 @@
 #include "datatypes.h"
 #include "virsocketaddr.h"
 #include "virstring.h"
+#include "vircrypto.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
@@ -48,13 +52,23 @@ VIR_LOG_INIT("nwfilter.nwfilter_gentech_driver");
 #define NWFILTER_DFLT_LEARN  "any"
 
 static int _virNWFilterTeardownFilter(const char *ifname);
+static void virNWFilterBuildWorker(void *jobdata, void *opaque);
 
 
 static virNWFilterTechDriverPtr filter_tech_drivers[] = {
     &ebiptables_driver,
+    &nftables_driver,
     NULL
 };
 
+/* The technology driver instantiating all filters */
+static const char *techDriverName = EBIPTABLES_DRIVER_ID;
+static bool techDriversPrivileged;
+
+/* Threads applying the rules of different interfaces concurrently when
+ * all filters are rebuilt, NULL if that's done by the rebuilding thread */
+static virThreadPoolPtr buildPool;
+
 /* Serializes instantiation of filters. This is necessary
  * to avoid lock ordering deadlocks. eg virNWFilterInstantiateFilterUpdate
  * will hold a lock on a virNWFilterObjPtr. This in turn invokes
@@ -71,18 +85,81 @@ static virNWFilterTechDriverPtr filter_tech_drivers[] = {
  */
 static virMutex updateMutex;
 
-int virNWFilterTechDriversInit(bool privileged)
+/* Digests of the rule sets applied to the interfaces. When a filter
+ * gets updated, interfaces whose newly computed rule set has the same
+ * digest as the active one are left alone.
+ */
+typedef struct _virNWFilterAppliedRules virNWFilterAppliedRules;
+typedef virNWFilterAppliedRules *virNWFilterAppliedRulesPtr;
+struct _virNWFilterAppliedRules {
+    char *active;   /* rules in use */
+    char *pending;  /* rules applied but not switched to yet */
+};
+
+static virHashTablePtr appliedRules; /* ifname -> virNWFilterAppliedRules */
+static virMutex appliedRulesLock;
+
+static void
+virNWFilterAppliedRulesFree(void *payload)
+{
+    virNWFilterAppliedRulesPtr rules = payload;
+
+    if (!rules)
+        return;
+
+    VIR_FREE(rules->active);
+    VIR_FREE(rules->pending);
+    VIR_FREE(rules);
+}
+
+int virNWFilterTechDriversInit(bool privileged,
+                               const char *name,
+                               unsigned int workers)
 {
     size_t i = 0;
-    VIR_DEBUG("Initializing NWFilter technology drivers");
-    if (virMutexInitRecursive(&updateMutex) < 0)
-        return -1;
+    VIR_DEBUG("Initializing NWFilter technology driver %s", name);
 
     while (filter_tech_drivers[i]) {
-        if (!(filter_tech_drivers[i]->flags & TECHDRV_FLAG_INITIALIZED))
-            filter_tech_drivers[i]->init(privileged);
+        if (STREQ(filter_tech_drivers[i]->name, name))
+            break;
         i++;
     }
+
+    if (!filter_tech_drivers[i]) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("unknown firewall backend '%s'"), name);
+        return -1;
+    }
+
+    if (virMutexInitRecursive(&updateMutex) < 0)
+        return -1;
+
+    if (virMutexInit(&appliedRulesLock) < 0) {
+        virMutexDestroy(&updateMutex);
+        return -1;
+    }
+
+    if (!(appliedRules = virHashCreate(0, virNWFilterAppliedRulesFree))) {
+        virMutexDestroy(&appliedRulesLock);
+        virMutexDestroy(&updateMutex);
+        return -1;
+    }
+
+    /* only the selected driver is initialized so that the tools of
+     * the other ones need not be installed */
+    if (!(filter_tech_drivers[i]->flags & TECHDRV_FLAG_INITIALIZED))
+        filter_tech_drivers[i]->init(privileged);
+    techDriverName = filter_tech_drivers[i]->name;
+    techDriversPrivileged = privileged;
+
+    if (workers > 1 &&
+        !(buildPool = virThreadPoolNewFull(0, workers, 0,
+                                           virNWFilterBuildWorker,
+                                           "nwfilter-build", NULL))) {
+        virNWFilterTechDriversShutdown();
+        return -1;
+    }
+
     return 0;
 }
 
@@ -90,11 +167,18 @@ int virNWFilterTechDriversInit(bool privileged)
 void virNWFilterTechDriversShutdown(void)
 {
     size_t i = 0;
+
+    virThreadPoolFree(buildPool);
+    buildPool = NULL;
+
     while (filter_tech_drivers[i]) {
         if ((filter_tech_drivers[i]->flags & TECHDRV_FLAG_INITIALIZED))
             filter_tech_drivers[i]->shutdown();
         i++;
     }
+    virHashFree(appliedRules);
+    appliedRules = NULL;
+    virMutexDestroy(&appliedRulesLock);
     virMutexDestroy(&updateMutex);
 }
 
@@ -217,18 +301,12 @@ virNWFilterCreateVarsFrom(virHashTablePtr vars1,
 }
 
 
-typedef struct _virNWFilterInst virNWFilterInst;
-typedef virNWFilterInst *virNWFilterInstPtr;
-struct _virNWFilterInst {
-    virNWFilterObjPtr *filters;
-    size_t nfilters;
-    virNWFilterRuleInstPtr *rules;
-    size_t nrules;
-};
-
-
+/*
+ * Mutexes can only be unlocked by the thread that locked them, so this
+ * must be called by the thread that computed @inst.
+ */
 static void
-virNWFilterInstReset(virNWFilterInstPtr inst)
+virNWFilterInstUnlockFilters(virNWFilterInstPtr inst)
 {
     size_t i;
 
@@ -236,6 +314,15 @@ virNWFilterInstReset(virNWFilterInstPtr inst)
         virNWFilterObjUnlock(inst->filters[i]);
     VIR_FREE(inst->filters);
     inst->nfilters = 0;
+}
+
+
+static void
+virNWFilterInstReset(virNWFilterInstPtr inst)
+{
+    size_t i;
+
+    virNWFilterInstUnlockFilters(inst);
 
     for (i = 0; i < inst->nrules; i++)
         virNWFilterRuleInstFree(inst->rules[i]);
@@ -486,6 +573,350 @@ virNWFilterDetermineMissingVarsRec(virNWFilterDefPtr filter,
 }
 
 
+/**
+ * virNWFilterInstDigest:
+ * @inst: the instantiated rules of an interface
+ *
+ * Compute a digest over everything the technology drivers use to
+ * build the firewall rules of an interface.
+ *
+ * Returns the digest or NULL on error
+ */
+static char *
+virNWFilterInstDigest(virNWFilterInstPtr inst)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *str = NULL;
+    char *digest = NULL;
+    size_t i;
+
+    for (i = 0; i < inst->nrules; i++) {
+        virNWFilterRuleInstPtr rule = inst->rules[i];
+
+        virBufferAsprintf(&buf, "%d %d\n", rule->chainPriority, rule->priority);
+        if (virNWFilterRuleDefFormat(&buf, rule->def) < 0 ||
+            virNWFilterFormatParamAttributes(&buf, rule->vars,
+                                             rule->chainSuffix) < 0)
+            return NULL;
+    }
+
+    str = virBufferContentAndReset(&buf);
+    if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256, NULLSTR_EMPTY(str),
+                            &digest) < 0)
+        return NULL;
+
+    return digest;
+}
+
+
+static bool
+virNWFilterAppliedRulesUnchanged(const char *ifname,
+                                 const char *digest)
+{
+    virNWFilterAppliedRulesPtr rules;
+    bool ret;
+
+    virMutexLock(&appliedRulesLock);
+    rules = virHashLookup(appliedRules, ifname);
+    ret = rules && rules->active && !rules->pending &&
+          STREQ(rules->active, digest);
+    virMutexUnlock(&appliedRulesLock);
+
+    return ret;
+}
+
+
+static void
+virNWFilterAppliedRulesUpdate(const char *ifname,
+                              const char *digest,
+                              bool pending)
+{
+    virNWFilterAppliedRulesPtr rules;
+
+    virMutexLock(&appliedRulesLock);
+
+    if (!(rules = virHashLookup(appliedRules, ifname))) {
+        if (VIR_ALLOC(rules) < 0 ||
+            virHashAddEntry(appliedRules, ifname, rules) < 0) {
+            /* without an entry the interface is always rebuilt */
+            virResetLastError();
+            VIR_FREE(rules);
+            goto cleanup;
+        }
+    }
+
+    VIR_FREE(rules->pending);
+    if (pending) {
+        rules->pending = g_strdup(digest);
+    } else {
+        VIR_FREE(rules->active);
+        rules->active = g_strdup(digest);
+    }
+
+ cleanup:
+    virMutexUnlock(&appliedRulesLock);
+}
+
+
+/*
+ * Make the pending rules of the interface the active ones if @commit
+ * is true or forget about them otherwise.
+ */
+void
+virNWFilterAppliedRulesSwitch(const char *ifname,
+                              bool commit)
+{
+    virNWFilterAppliedRulesPtr rules;
+
+    virMutexLock(&appliedRulesLock);
+
+    if ((rules = virHashLookup(appliedRules, ifname)) && rules->pending) {
+        if (commit) {
+            VIR_FREE(rules->active);
+            rules->active = g_steal_pointer(&rules->pending);
+        } else {
+            VIR_FREE(rules->pending);
+        }
+    }
+
+    virMutexUnlock(&appliedRulesLock);
+}
+
+
+/**
+ * virNWFilterInvalidateAppliedRules:
+ * @ifname: the name of the interface
+ *
+ * Must be called whenever the rules of @ifname are changed behind the
+ * back of virNWFilterDoInstantiate, e.g. by applying the basic rules
+ * while its IP address is being learned, so that the next update of a
+ * filter rebuilds them.
+ */
+void
+virNWFilterInvalidateAppliedRules(const char *ifname)
+{
+    virMutexLock(&appliedRulesLock);
+    virHashRemoveEntry(appliedRules, ifname);
+    virMutexUnlock(&appliedRulesLock);
+}
+
+
+/*
+ * The rules installed while the IP address of an interface is being
+ * learned replace the ones built from its filter. These wrappers make
+ * sure the next update of the filter rebuilds them.
+ */
+int
+virNWFilterInstallBasicRules(virNWFilterTechDriverPtr techdriver,
+                             const char *ifname,
+                             const virMacAddr *macaddr)
+{
+    virNWFilterInvalidateAppliedRules(ifname);
+    return techdriver->applyBasicRules(ifname, macaddr);
+}
+
+
+int
+virNWFilterInstallDHCPOnlyRules(virNWFilterTechDriverPtr techdriver,
+                                const char *ifname,
+                                const virMacAddr *macaddr,
+                                virNWFilterVarValuePtr dhcpsrvs,
+                                bool leaveTemporary)
+{
+    virNWFilterInvalidateAppliedRules(ifname);
+    return techdriver->applyDHCPOnlyRules(ifname, macaddr, dhcpsrvs,
+                                          leaveTemporary);
+}
+
+
+int
+virNWFilterInstallDropAllRules(virNWFilterTechDriverPtr techdriver,
+                               const char *ifname)
+{
+    virNWFilterInvalidateAppliedRules(ifname);
+    return techdriver->applyDropAllRules(ifname);
+}
+
+
+/*
+ * When all filters are rebuilt, the rules of each interface are still
+ * computed one interface at a time under the filter update lock, but
+ * applying them to the firewall, which is where most of the time is
+ * spent, is handed to a pool of workers. The rules of an interface are
+ * only ever changed while holding the lock of the interface, so jobs of
+ * different interfaces can run concurrently.
+ */
+typedef enum {
+    BUILD_JOB_APPLY,
+    BUILD_JOB_ROLLBACK,
+    BUILD_JOB_SWITCH,
+} virNWFilterBuildJobType;
+
+struct _virNWFilterBuildJobs {
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+    int ret;
+    virErrorPtr err;   /* first error reported by a job */
+};
+
+typedef struct _virNWFilterBuildJob virNWFilterBuildJob;
+typedef virNWFilterBuildJob *virNWFilterBuildJobPtr;
+struct _virNWFilterBuildJob {
+    virNWFilterBuildJobsPtr jobs;
+    virNWFilterBuildJobType type;
+    char *ifname;
+    int ifindex;
+
+    /* BUILD_JOB_APPLY only */
+    virNWFilterTechDriverPtr techdriver;
+    virNWFilterInst inst;   /* only the rules, the filters are unlocked */
+    char *digest;
+    bool teardownOld;
+};
+
+
+static void
+virNWFilterBuildJobFree(virNWFilterBuildJobPtr job)
+{
+    if (!job)
+        return;
+
+    virNWFilterInstReset(&job->inst);
+    VIR_FREE(job->digest);
+    VIR_FREE(job->ifname);
+    VIR_FREE(job);
+}
+
+
+static int
+virNWFilterBuildJobsQueue(virNWFilterBuildJobsPtr jobs,
+                          virNWFilterBuildJobPtr job)
+{
+    job->jobs = jobs;
+
+    virMutexLock(&jobs->lock);
+    jobs->pending++;
+    virMutexUnlock(&jobs->lock);
+
+    if (virThreadPoolSendJob(buildPool, 0, job) < 0) {
+        virMutexLock(&jobs->lock);
+        jobs->pending--;
+        virMutexUnlock(&jobs->lock);
+        virNWFilterBuildJobFree(job);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Apply the rules of @inst to the interface @ifname and, if
+ * @teardownOld is true, make them the active ones.
+ */
+static int
+virNWFilterApplyInst(virNWFilterTechDriverPtr techdriver,
+                     const char *ifname,
+                     int ifindex,
+                     virNWFilterInstPtr inst,
+                     const char *digest,
+                     bool teardownOld)
+{
+    int rc;
+
+    if (virNWFilterLockIface(ifname) < 0)
+        return -1;
+
+    rc = techdriver->applyNewRules(ifname, inst->rules, inst->nrules);
+
+    if (teardownOld && rc == 0)
+        techdriver->tearOldRules(ifname);
+
+    if (rc == 0 && (virNetDevValidateConfig(ifname, NULL, ifindex) <= 0)) {
+        virResetLastError();
+        /* interface changed/disappeared */
+        techdriver->allTeardown(ifname);
+        rc = -1;
+    }
+
+    if (rc == 0)
+        virNWFilterAppliedRulesUpdate(ifname, digest, !teardownOld);
+    else
+        virNWFilterInvalidateAppliedRules(ifname);
+
+    virNWFilterUnlockIface(ifname);
+
+    return rc;
+}
+
+
+/**
+ * virNWFilterInstApply:
+ * @techdriver: the driver to use for instantiation
+ * @ifname: the interface the rules belong to
+ * @ifindex: the index of @ifname
+ * @inst: the instantiated rules, may be taken over by a job
+ * @useNewFilter: whether the rules are only applied if they changed
+ * @foundNewFilter: cleared if the rules didn't change after all
+ * @teardownOld: whether the new rules become the active ones right away
+ * @jobs: if not NULL, the workers to apply the rules through
+ *
+ * Applies the rules of @inst to @ifname, unless a filter got updated
+ * and the digest of the rules equals the one of the rules active on the
+ * interface.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNWFilterInstApply(virNWFilterTechDriverPtr techdriver,
+                     const char *ifname,
+                     int ifindex,
+                     virNWFilterInstPtr inst,
+                     enum instCase useNewFilter,
+                     bool *foundNewFilter,
+                     bool teardownOld,
+                     virNWFilterBuildJobsPtr jobs)
+{
+    g_autofree char *digest = NULL;
+    virNWFilterBuildJobPtr job;
+
+    if (!(digest = virNWFilterInstDigest(inst)))
+        return -1;
+
+    /* the filter changed, but the rules of this interface did not */
+    if (useNewFilter == INSTANTIATE_FOLLOW_NEWFILTER &&
+        virNWFilterAppliedRulesUnchanged(ifname, digest)) {
+        VIR_DEBUG("Rules of interface %s are unchanged", ifname);
+        *foundNewFilter = false;
+        return 0;
+    }
+
+    if (!jobs)
+        return virNWFilterApplyInst(techdriver, ifname, ifindex,
+                                    inst, digest, teardownOld);
+
+    if (VIR_ALLOC(job) < 0)
+        return -1;
+
+    job->type = BUILD_JOB_APPLY;
+    job->ifname = g_strdup(ifname);
+    job->ifindex = ifindex;
+    job->techdriver = techdriver;
+
+    /* The filter definitions referenced by the rules stay valid under the
+     * filter update lock, the filter objects must be unlocked by this
+     * thread though. */
+    virNWFilterInstUnlockFilters(inst);
+    job->inst = *inst;
+    memset(inst, 0, sizeof(*inst));
+    job->digest = g_steal_pointer(&digest);
+    job->teardownOld = teardownOld;
+
+    return virNWFilterBuildJobsQueue(jobs, job);
+}
+
+
 /**
  * virNWFilterDoInstantiate:
  * @techdriver: The driver to use for instantiation
@@ -493,6 +924,7 @@ virNWFilterDetermineMissingVarsRec(virNWFilterDefPtr filter,
  * @filter: The filter to instantiate
  * @forceWithPendingReq: Ignore the check whether a pending learn request
  *  is active; 'true' only when the rules are applied late
+ * @jobs: if not NULL, the workers to apply the rules through
  *
  * Returns 0 on success, a value otherwise.
  *
@@ -512,7 +944,8 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
                          bool *foundNewFilter,
                          bool teardownOld,
                          virNWFilterDriverStatePtr driver,
-                         bool forceWithPendingReq)
+                         bool forceWithPendingReq,
+                         virNWFilterBuildJobsPtr jobs)
 {
     int rc;
     virNWFilterInst inst;
@@ -605,24 +1038,10 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
         break;
     }
 
-    if (instantiate) {
-        if (virNWFilterLockIface(binding->portdevname) < 0)
-            goto err_exit;
-
-        rc = techdriver->applyNewRules(binding->portdevname, inst.rules, inst.nrules);
-
-        if (teardownOld && rc == 0)
-            techdriver->tearOldRules(binding->portdevname);
-
-        if (rc == 0 && (virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0)) {
-            virResetLastError();
-            /* interface changed/disappeared */
-            techdriver->allTeardown(binding->portdevname);
-            rc = -1;
-        }
-
-        virNWFilterUnlockIface(binding->portdevname);
-    }
+    if (instantiate)
+        rc = virNWFilterInstApply(techdriver, binding->portdevname, ifindex,
+                                  &inst, useNewFilter, foundNewFilter,
+                                  teardownOld, jobs);
 
  err_exit:
     virNWFilterInstReset(&inst);
@@ -677,10 +1096,11 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
                                    int ifindex,
                                    enum instCase useNewFilter,
                                    bool forceWithPendingReq,
-                                   bool *foundNewFilter)
+                                   bool *foundNewFilter,
+                                   virNWFilterBuildJobsPtr jobs)
 {
     int rc = -1;
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = techDriverName;
     virNWFilterTechDriverPtr techdriver;
     virNWFilterObjPtr obj;
     virNWFilterDefPtr filter;
@@ -736,7 +1156,7 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
     rc = virNWFilterDoInstantiate(techdriver, binding, filter,
                                   ifindex, useNewFilter, foundNewFilter,
                                   teardownOld, driver,
-                                  forceWithPendingReq);
+                                  forceWithPendingReq, jobs);
 
  err_exit:
     virNWFilterObjUnlock(obj);
@@ -750,7 +1170,8 @@ virNWFilterInstantiateFilterInternal(virNWFilterDriverStatePtr driver,
                                      virNWFilterBindingDefPtr binding,
                                      bool teardownOld,
                                      enum instCase useNewFilter,
-                                     bool *foundNewFilter)
+                                     bool *foundNewFilter,
+                                     virNWFilterBuildJobsPtr jobs)
 {
     int ifindex;
     int rc;
@@ -773,7 +1194,7 @@ virNWFilterInstantiateFilterInternal(virNWFilterDriverStatePtr driver,
                                             binding,
                                             ifindex,
                                             useNewFilter,
-                                            false, foundNewFilter);
+                                            false, foundNewFilter, jobs);
 
  cleanup:
     virMutexUnlock(&updateMutex);
@@ -796,7 +1217,7 @@ virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
     rc = virNWFilterInstantiateFilterUpdate(driver, true,
                                             binding, ifindex,
                                             INSTANTIATE_ALWAYS, true,
-                                            &foundNewFilter);
+                                            &foundNewFilter, NULL);
     if (rc < 0) {
         /* something went wrong... 'DOWN' the interface */
         if ((virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0) ||
@@ -823,30 +1244,14 @@ virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
     return virNWFilterInstantiateFilterInternal(driver, binding,
                                                 1,
                                                 INSTANTIATE_ALWAYS,
-                                                &foundNewFilter);
+                                                &foundNewFilter, NULL);
 }
 
 
-int
-virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
-                                   virNWFilterBindingDefPtr binding,
-                                   bool *skipIface)
-{
-    bool foundNewFilter = false;
-
-    int rc = virNWFilterInstantiateFilterInternal(driver, binding,
-                                                  0,
-                                                  INSTANTIATE_FOLLOW_NEWFILTER,
-                                                  &foundNewFilter);
-
-    *skipIface = !foundNewFilter;
-    return rc;
-}
-
 static int
-virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
+virNWFilterRollbackUpdateFilter(const char *ifname)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = techDriverName;
     int ifindex;
     virNWFilterTechDriverPtr techdriver;
 
@@ -860,19 +1265,21 @@ virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
     }
 
     /* don't tear anything while the address is being learned */
-    if (virNetDevGetIndex(binding->portdevname, &ifindex) < 0)
+    if (virNetDevGetIndex(ifname, &ifindex) < 0)
         virResetLastError();
     else if (virNWFilterHasLearnReq(ifindex))
         return 0;
 
-    return techdriver->tearNewRules(binding->portdevname);
+    virNWFilterAppliedRulesSwitch(ifname, false);
+
+    return techdriver->tearNewRules(ifname);
 }
 
 
 static int
-virNWFilterTearOldFilter(virNWFilterBindingDefPtr binding)
+virNWFilterTearOldFilter(const char *ifname)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = techDriverName;
     int ifindex;
     virNWFilterTechDriverPtr techdriver;
 
@@ -886,19 +1293,21 @@ virNWFilterTearOldFilter(virNWFilterBindingDefPtr binding)
     }
 
     /* don't tear anything while the address is being learned */
-    if (virNetDevGetIndex(binding->portdevname, &ifindex) < 0)
+    if (virNetDevGetIndex(ifname, &ifindex) < 0)
         virResetLastError();
     else if (virNWFilterHasLearnReq(ifindex))
         return 0;
 
-    return techdriver->tearOldRules(binding->portdevname);
+    virNWFilterAppliedRulesSwitch(ifname, true);
+
+    return techdriver->tearOldRules(ifname);
 }
 
 
 static int
 _virNWFilterTeardownFilter(const char *ifname)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = techDriverName;
     virNWFilterTechDriverPtr techdriver;
     techdriver = virNWFilterTechDriverForName(drvname);
 
@@ -918,6 +1327,7 @@ _virNWFilterTeardownFilter(const char *ifname)
         return -1;
 
     techdriver->allTeardown(ifname);
+    virNWFilterInvalidateAppliedRules(ifname);
 
     virNWFilterIPAddrMapDelIPAddr(ifname, NULL);
 
@@ -937,6 +1347,64 @@ virNWFilterTeardownFilter(virNWFilterBindingDefPtr binding)
     return ret;
 }
 
+static int
+virNWFilterTeardownStaleIter(virNWFilterBindingObjPtr binding, void *opaque)
+{
+    virNWFilterTechDriverPtr techdriver = opaque;
+    virNWFilterBindingDefPtr def = virNWFilterBindingObjGetDef(binding);
+
+    if (techdriver->allTeardown(def->portdevname) < 0)
+        virResetLastError();
+
+    return 0;
+}
+
+
+/**
+ * virNWFilterTeardownStaleBackends:
+ * @driver: the driver state with the bindings loaded
+ *
+ * Removes the rules that technology drivers other than the selected one
+ * installed for the bindings, which happens when firewall_backend is
+ * changed while guests are running. Drivers whose tools are not installed
+ * can't have left any rules behind and are skipped. Must be called before
+ * the filters are instantiated.
+ */
+void
+virNWFilterTeardownStaleBackends(virNWFilterDriverStatePtr driver)
+{
+    size_t i;
+
+    if (!techDriversPrivileged)
+        return;
+
+    virMutexLock(&updateMutex);
+
+    for (i = 0; filter_tech_drivers[i]; i++) {
+        virNWFilterTechDriverPtr techdriver = filter_tech_drivers[i];
+
+        if (STREQ(techdriver->name, techDriverName))
+            continue;
+
+        if (techdriver->init(true) < 0 ||
+            !(techdriver->flags & TECHDRV_FLAG_INITIALIZED)) {
+            virResetLastError();
+            continue;
+        }
+
+        VIR_DEBUG("Removing rules of firewall backend %s", techdriver->name);
+
+        virNWFilterBindingObjListForEach(driver->bindings,
+                                         virNWFilterTeardownStaleIter,
+                                         techdriver);
+
+        techdriver->shutdown();
+    }
+
+    virMutexUnlock(&updateMutex);
+}
+
+
 enum {
     STEP_APPLY_NEW,
     STEP_ROLLBACK,
@@ -944,22 +1412,147 @@ enum {
     STEP_APPLY_CURRENT,
 };
 
+
+static void
+virNWFilterBuildWorker(void *jobdata, void *opaque G_GNUC_UNUSED)
+{
+    virNWFilterBuildJobPtr job = jobdata;
+    virNWFilterBuildJobsPtr jobs = job->jobs;
+    int rc = -1;
+
+    switch (job->type) {
+    case BUILD_JOB_APPLY:
+        rc = virNWFilterApplyInst(job->techdriver, job->ifname, job->ifindex,
+                                  &job->inst, job->digest, job->teardownOld);
+        break;
+
+    case BUILD_JOB_ROLLBACK:
+    case BUILD_JOB_SWITCH:
+        /* outside of the filter update lock, so guard against the
+         * learning threads changing the rules of the interface */
+        if (virNWFilterLockIface(job->ifname) < 0)
+            break;
+        if (job->type == BUILD_JOB_ROLLBACK)
+            rc = virNWFilterRollbackUpdateFilter(job->ifname);
+        else
+            rc = virNWFilterTearOldFilter(job->ifname);
+        virNWFilterUnlockIface(job->ifname);
+        break;
+    }
+
+    virMutexLock(&jobs->lock);
+    if (rc < 0) {
+        if (!jobs->err)
+            virErrorPreserveLast(&jobs->err);
+        jobs->ret = -1;
+    }
+    if (--jobs->pending == 0)
+        virCondBroadcast(&jobs->cond);
+    virMutexUnlock(&jobs->lock);
+
+    virNWFilterBuildJobFree(job);
+}
+
+
+/*
+ * Tracks the jobs of a single rebuild, which are run by the workers
+ * started along with the driver.
+ */
+static virNWFilterBuildJobsPtr
+virNWFilterBuildJobsNew(void)
+{
+    virNWFilterBuildJobsPtr jobs;
+
+    if (VIR_ALLOC(jobs) < 0)
+        return NULL;
+
+    if (virMutexInit(&jobs->lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        VIR_FREE(jobs);
+        return NULL;
+    }
+
+    if (virCondInit(&jobs->cond) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize condition"));
+        virMutexDestroy(&jobs->lock);
+        VIR_FREE(jobs);
+        return NULL;
+    }
+
+    return jobs;
+}
+
+
+/*
+ * Wait for all queued jobs to finish. Returns -1 if any of them
+ * failed, with its error set for the calling thread.
+ */
+static int
+virNWFilterBuildJobsWait(virNWFilterBuildJobsPtr jobs)
+{
+    int ret;
+
+    virMutexLock(&jobs->lock);
+    while (jobs->pending > 0)
+        ignore_value(virCondWait(&jobs->cond, &jobs->lock));
+
+    ret = jobs->ret;
+    jobs->ret = 0;
+    if (jobs->err)
+        virErrorRestore(&jobs->err);
+    virMutexUnlock(&jobs->lock);
+
+    return ret;
+}
+
+
+static void
+virNWFilterBuildJobsFree(virNWFilterBuildJobsPtr jobs)
+{
+    if (!jobs)
+        return;
+
+    virNWFilterBuildJobsWait(jobs);
+    virCondDestroy(&jobs->cond);
+    virMutexDestroy(&jobs->lock);
+    VIR_FREE(jobs);
+}
+
+
+static int
+virNWFilterBuildJobsQueueTeardown(virNWFilterBuildJobsPtr jobs,
+                                  virNWFilterBuildJobType type,
+                                  const char *ifname)
+{
+    virNWFilterBuildJobPtr job;
+
+    if (VIR_ALLOC(job) < 0)
+        return -1;
+
+    job->type = type;
+    job->ifname = g_strdup(ifname);
+
+    return virNWFilterBuildJobsQueue(jobs, job);
+}
+
+
 static int
 virNWFilterBuildOne(virNWFilterDriverStatePtr driver,
                     virNWFilterBindingDefPtr binding,
                     virHashTablePtr skipInterfaces,
-                    int step)
+                    int step,
+                    virNWFilterBuildJobsPtr jobs)
 {
-    bool skipIface;
+    bool foundNewFilter = false;
     int ret = 0;
     VIR_DEBUG("Building filter for portdev=%s step=%d", binding->portdevname, step);
 
     switch (step) {
     case STEP_APPLY_NEW:
-        ret = virNWFilterUpdateInstantiateFilter(driver,
-                                                 binding,
-                                                 &skipIface);
-        if (ret == 0 && skipIface) {
+        ret = virNWFilterInstantiateFilterInternal(driver, binding, false,
+                                                   INSTANTIATE_FOLLOW_NEWFILTER,
+                                                   &foundNewFilter, jobs);
+        if (ret == 0 && !foundNewFilter) {
             /* filter tree unchanged -- no update needed */
             ret = virHashAddEntry(skipInterfaces,
                                   binding->portdevname,
@@ -968,18 +1561,29 @@ virNWFilterBuildOne(virNWFilterDriverStatePtr driver,
         break;
 
     case STEP_ROLLBACK:
-        if (!virHashLookup(skipInterfaces, binding->portdevname))
-            ret = virNWFilterRollbackUpdateFilter(binding);
+        if (virHashLookup(skipInterfaces, binding->portdevname))
+            break;
+        if (jobs)
+            ret = virNWFilterBuildJobsQueueTeardown(jobs, BUILD_JOB_ROLLBACK,
+                                                    binding->portdevname);
+        else
+            ret = virNWFilterRollbackUpdateFilter(binding->portdevname);
         break;
 
     case STEP_SWITCH:
-        if (!virHashLookup(skipInterfaces, binding->portdevname))
-            ret = virNWFilterTearOldFilter(binding);
+        if (virHashLookup(skipInterfaces, binding->portdevname))
+            break;
+        if (jobs)
+            ret = virNWFilterBuildJobsQueueTeardown(jobs, BUILD_JOB_SWITCH,
+                                                    binding->portdevname);
+        else
+            ret = virNWFilterTearOldFilter(binding->portdevname);
         break;
 
     case STEP_APPLY_CURRENT:
-        ret = virNWFilterInstantiateFilter(driver,
-                                           binding);
+        ret = virNWFilterInstantiateFilterInternal(driver, binding, true,
+                                                   INSTANTIATE_ALWAYS,
+                                                   &foundNewFilter, jobs);
         break;
     }
 
@@ -991,6 +1595,7 @@ struct virNWFilterBuildData {
     virNWFilterDriverStatePtr driver;
     virHashTablePtr skipInterfaces;
     int step;
+    virNWFilterBuildJobsPtr jobs;
 };
 
 static int
@@ -1000,9 +1605,36 @@ virNWFilterBuildIter(virNWFilterBindingObjPtr binding, void *opaque)
     virNWFilterBindingDefPtr def = virNWFilterBindingObjGetDef(binding);
 
     return virNWFilterBuildOne(data->driver, def,
-                               data->skipInterfaces, data->step);
+                               data->skipInterfaces, data->step,
+                               data->jobs);
 }
 
+
+/*
+ * Run one step over all bindings and wait for the rules queued to the
+ * workers to be applied, so that the next step as well as the caller,
+ * which may replace the filter definitions afterwards, see the result.
+ */
+static int
+virNWFilterBuildStep(virNWFilterDriverStatePtr driver,
+                     struct virNWFilterBuildData *data,
+                     int step)
+{
+    int ret = 0;
+
+    data->step = step;
+    if (virNWFilterBindingObjListForEach(driver->bindings,
+                                         virNWFilterBuildIter,
+                                         data) < 0)
+        ret = -1;
+
+    if (data->jobs && virNWFilterBuildJobsWait(data->jobs) < 0)
+        ret = -1;
+
+    return ret;
+}
+
+
 int
 virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
                     bool newFilters)
@@ -1012,37 +1644,34 @@ virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
     };
     int ret = 0;
 
-    VIR_DEBUG("Build all filters newFilters=%d", newFilters);
+    VIR_DEBUG("Build all filters newFilters=%d workers=%zu",
+              newFilters, buildPool ? virThreadPoolGetMaxWorkers(buildPool) : 0);
+
+    if (buildPool &&
+        !(data.jobs = virNWFilterBuildJobsNew()))
+        return -1;
 
     if (newFilters) {
-        if (!(data.skipInterfaces = virHashCreate(0, NULL)))
-            return -1;
+        if (!(data.skipInterfaces = virHashCreate(0, NULL))) {
+            ret = -1;
+            goto cleanup;
+        }
 
-        data.step = STEP_APPLY_NEW;
-        if (virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data) < 0)
+        if (virNWFilterBuildStep(driver, &data, STEP_APPLY_NEW) < 0)
             ret = -1;
 
-        if (ret == -1) {
-            data.step = STEP_ROLLBACK;
-            virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data);
-        } else  {
-            data.step = STEP_SWITCH;
-            virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data);
-        }
+        if (ret == -1)
+            virNWFilterBuildStep(driver, &data, STEP_ROLLBACK);
+        else
+            virNWFilterBuildStep(driver, &data, STEP_SWITCH);
 
         virHashFree(data.skipInterfaces);
     } else {
-        data.step = STEP_APPLY_CURRENT;
-        if (virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data) < 0)
+        if (virNWFilterBuildStep(driver, &data, STEP_APPLY_CURRENT) < 0)
             ret = -1;
     }
+
+ cleanup:
+    virNWFilterBuildJobsFree(data.jobs);
     return ret;
 }
@@ -28,7 +28,9 @@
 
 virNWFilterTechDriverPtr virNWFilterTechDriverForName(const char *name);
 
-int virNWFilterTechDriversInit(bool privileged);
+int virNWFilterTechDriversInit(bool privileged,
+                               const char *name,
+                               unsigned int workers);
 void virNWFilterTechDriversShutdown(void);
 
 enum instCase {
@@ -39,9 +41,6 @@ enum instCase {
 
 int virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
                                  virNWFilterBindingDefPtr binding);
-int virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
-                                       virNWFilterBindingDefPtr binding,
-                                       bool *skipIface);
 
 int virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
                                      virNWFilterBindingDefPtr binding,
@@ -49,6 +48,21 @@ int virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
 
 int virNWFilterTeardownFilter(virNWFilterBindingDefPtr binding);
 
+void virNWFilterTeardownStaleBackends(virNWFilterDriverStatePtr driver);
+
+void virNWFilterInvalidateAppliedRules(const char *ifname);
+
+int virNWFilterInstallBasicRules(virNWFilterTechDriverPtr techdriver,
+                                 const char *ifname,
+                                 const virMacAddr *macaddr);
+int virNWFilterInstallDHCPOnlyRules(virNWFilterTechDriverPtr techdriver,
+                                    const char *ifname,
+                                    const virMacAddr *macaddr,
+                                    virNWFilterVarValuePtr dhcpsrvs,
+                                    bool leaveTemporary);
+int virNWFilterInstallDropAllRules(virNWFilterTechDriverPtr techdriver,
+                                   const char *ifname);
+
 virHashTablePtr virNWFilterCreateVarHashmap(const char *macaddr,
                                             const virNWFilterVarValue *value);
 
@@ -0,0 +1,51 @@
+/*
+ * nwfilter_gentech_driverpriv.h: private declarations for the generic
+ *                                technology driver
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBVIRT_NWFILTER_GENTECH_DRIVERPRIV_H_ALLOW
+# error "nwfilter_gentech_driverpriv.h may only be included by nwfilter_gentech_driver.c or test suites"
+#endif /* LIBVIRT_NWFILTER_GENTECH_DRIVERPRIV_H_ALLOW */
+
+#pragma once
+
+#include "nwfilter_gentech_driver.h"
+
+typedef struct _virNWFilterInst virNWFilterInst;
+typedef virNWFilterInst *virNWFilterInstPtr;
+struct _virNWFilterInst {
+    virNWFilterObjPtr *filters;
+    size_t nfilters;
+    virNWFilterRuleInstPtr *rules;
+    size_t nrules;
+};
+
+typedef struct _virNWFilterBuildJobs virNWFilterBuildJobs;
+typedef virNWFilterBuildJobs *virNWFilterBuildJobsPtr;
+
+int virNWFilterInstApply(virNWFilterTechDriverPtr techdriver,
+                         const char *ifname,
+                         int ifindex,
+                         virNWFilterInstPtr inst,
+                         enum instCase useNewFilter,
+                         bool *foundNewFilter,
+                         bool teardownOld,
+                         virNWFilterBuildJobsPtr jobs);
+
+void virNWFilterAppliedRulesSwitch(const char *ifname,
+                                   bool commit);
@@ -431,17 +431,19 @@ learnIPAddressThread(void *arg)
     virMacAddrFormat(&req->binding->mac, macaddr);
 
     if (req->howDetect == DETECT_DHCP) {
-        if (techdriver->applyDHCPOnlyRules(req->binding->portdevname,
-                                           &req->binding->mac,
-                                           NULL, false) < 0) {
+        if (virNWFilterInstallDHCPOnlyRules(techdriver,
+                                            req->binding->portdevname,
+                                            &req->binding->mac,
+                                            NULL, false) < 0) {
             VIR_DEBUG("Unable to apply DHCP only rules");
             req->status = EINVAL;
             goto done;
         }
         virBufferAddLit(&buf, "src port 67 and dst port 68");
     } else {
-        if (techdriver->applyBasicRules(req->binding->portdevname,
-                                        &req->binding->mac) < 0) {
+        if (virNWFilterInstallBasicRules(techdriver,
+                                         req->binding->portdevname,
+                                         &req->binding->mac) < 0) {
             VIR_DEBUG("Unable to apply basic rules");
             req->status = EINVAL;
             goto done;
@@ -666,7 +668,7 @@ learnIPAddressThread(void *arg)
                                    "index %d"),
                                  req->binding->portdevname, req->ifindex);
 
-        techdriver->applyDropAllRules(req->binding->portdevname);
+        virNWFilterInstallDropAllRules(techdriver, req->binding->portdevname);
         virNWFilterUnlockIface(req->binding->portdevname);
     }
 
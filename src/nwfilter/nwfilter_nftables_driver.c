@@ -0,0 +1,2161 @@
+/*
+ * nwfilter_nftables_driver.c: driver for nftables on tap devices
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * All filters live in a single table of the bridge family. Its base
+ * chains dispatch packets through verdict maps keyed by the name of
+ * the bridge port, so finding the chains of an interface is a single
+ * lookup no matter how many interfaces are filtered:
+ *
+ *   prerouting  -> iifname vmap @l2-in   -> l2-in-IF   -> libvirt-I-IF
+ *   postrouting -> oifname vmap @l2-out  -> l2-out-IF  -> libvirt-O-IF
+ *   forward     -> iifname vmap @fwd-in  -> fwd-in-IF  -> FI-IF
+ *               -> oifname vmap @fwd-out -> fwd-out-IF -> FO-IF
+ *   input       -> iifname vmap @host-in -> host-in-IF -> HI-IF
+ *
+ * The per interface dispatch chains are stable, only the jumps inside
+ * them change. The chains built by a new filter use the same temporary
+ * names as the ebiptables driver (libvirt-J-IF, FJ-IF, ...) and are
+ * renamed when the old rules are torn down. Every operation is sent to
+ * 'nft -f -' as a single script, which the kernel applies atomically.
+ * The table is listed only when a transaction starts, the chains left
+ * behind by a new filter are remembered for the operation that commits
+ * or rolls it back.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+
+#include "virbuffer.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virerror.h"
+#include "virhash.h"
+#include "nwfilter_conf.h"
+#include "nwfilter_gentech_driver.h"
+#include "nwfilter_nftables_driver.h"
+#include "vircommand.h"
+#include "virmacaddr.h"
+#include "virsocketaddr.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NWFILTER
+
+VIR_LOG_INIT("nwfilter.nwfilter_nftables_driver");
+
+#define NFT_TABLE "bridge libvirt-nwfilter"
+
+/* characters nft accepts in unquoted chain names */
+#define NFT_VALID_NAME \
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-"
+
+/* nftables has no expression for RARP, its ARP header is matched
+ * through raw payload offsets relative to the network header */
+#define RARP_HTYPE "@nh,0,16"
+#define RARP_PTYPE "@nh,16,16"
+#define RARP_OPER  "@nh,48,16"
+
+typedef enum {
+    NFTABLES_HOOK_L2_IN = 0,  /* frames sent by the VM */
+    NFTABLES_HOOK_L2_OUT,     /* frames sent to the VM */
+    NFTABLES_HOOK_FWD_IN,     /* IP traffic forwarded from the VM */
+    NFTABLES_HOOK_FWD_OUT,    /* IP traffic forwarded to the VM */
+    NFTABLES_HOOK_HOST_IN,    /* IP traffic sent by the VM to the host */
+
+    NFTABLES_HOOK_LAST
+} nftablesHook;
+
+typedef struct _nftablesHookDef nftablesHookDef;
+struct _nftablesHookDef {
+    const char *map;
+    const char *root;
+    const char *tmproot;
+    char subprefix;     /* only L2 root chains have sub chains */
+    char tmpsubprefix;
+};
+
+static const nftablesHookDef nftablesHooks[NFTABLES_HOOK_LAST] = {
+    [NFTABLES_HOOK_L2_IN]   = { "l2-in",   "libvirt-I", "libvirt-J", 'I', 'J' },
+    [NFTABLES_HOOK_L2_OUT]  = { "l2-out",  "libvirt-O", "libvirt-P", 'O', 'P' },
+    [NFTABLES_HOOK_FWD_IN]  = { "fwd-in",  "FI", "FJ", 0, 0 },
+    [NFTABLES_HOOK_FWD_OUT] = { "fwd-out", "FO", "FP", 0, 0 },
+    [NFTABLES_HOOK_HOST_IN] = { "host-in", "HI", "HJ", 0, 0 },
+};
+
+typedef struct _nftablesBaseChain nftablesBaseChain;
+struct _nftablesBaseChain {
+    const char *hook;
+    int priority;
+    const char *rules[3];
+};
+
+static const nftablesBaseChain nftablesBaseChains[] = {
+    { "prerouting", -300, { "iifname vmap @l2-in", NULL } },
+    { "input", 0, { "iifname vmap @host-in", NULL } },
+    { "forward", 0, { "iifname vmap @fwd-in", "oifname vmap @fwd-out", NULL } },
+    { "postrouting", 300, { "oifname vmap @l2-out", NULL } },
+};
+
+enum nftablesL2ProtoIdx {
+    NFTABLES_PROTO_IPV4_IDX = 0,
+    NFTABLES_PROTO_IPV6_IDX,
+    NFTABLES_PROTO_ARP_IDX,
+    NFTABLES_PROTO_RARP_IDX,
+    NFTABLES_PROTO_VLAN_IDX,
+    NFTABLES_PROTO_STP_IDX,
+    NFTABLES_PROTO_MAC_IDX,
+    NFTABLES_PROTO_LAST_IDX
+};
+
+/* Same prefix matching of filter names as in the ebiptables driver */
+static const struct {
+    unsigned short ethertype;
+    const char *name;
+} nftablesL2Protocols[NFTABLES_PROTO_LAST_IDX] = {
+    [NFTABLES_PROTO_IPV4_IDX] = { ETHERTYPE_IP,     "ipv4" },
+    [NFTABLES_PROTO_IPV6_IDX] = { ETHERTYPE_IPV6,   "ipv6" },
+    [NFTABLES_PROTO_ARP_IDX]  = { ETHERTYPE_ARP,    "arp" },
+    [NFTABLES_PROTO_RARP_IDX] = { ETHERTYPE_REVARP, "rarp" },
+    [NFTABLES_PROTO_VLAN_IDX] = { ETHERTYPE_VLAN,   "vlan" },
+    [NFTABLES_PROTO_STP_IDX]  = { 0,                "stp" },
+    [NFTABLES_PROTO_MAC_IDX]  = { 0,                "mac" },
+};
+
+VIR_ENUM_DECL(nftablesVerdict);
+VIR_ENUM_IMPL(nftablesVerdict,
+              VIR_NWFILTER_RULE_ACTION_LAST,
+              "drop",
+              "accept",
+              "reject",
+              "return",
+              "continue",
+);
+
+typedef struct _nftablesChains nftablesChains;
+typedef nftablesChains *nftablesChainsPtr;
+struct _nftablesChains {
+    char **dispatch;
+    char **active;
+    char **staged;
+    bool activeRoot[NFTABLES_HOOK_LAST];
+};
+
+/* The chains left behind by nftablesApplyNewRules, keyed by interface
+ * name. They are used by the operation finishing the transaction
+ * (nftablesTearOldRules, nftablesTearNewRules, nftablesAllTeardown)
+ * instead of listing the table once more. */
+static virMutex nftablesTransactionsLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr nftablesTransactions;
+
+static int nftablesAllTeardown(const char *ifname);
+
+
+static void
+nftablesChainsClear(nftablesChainsPtr chains)
+{
+    virStringListFree(chains->dispatch);
+    virStringListFree(chains->active);
+    virStringListFree(chains->staged);
+    memset(chains, 0, sizeof(*chains));
+}
+
+
+static void
+nftablesChainsFree(void *opaque)
+{
+    nftablesChainsPtr chains = opaque;
+
+    if (!chains)
+        return;
+
+    nftablesChainsClear(chains);
+    g_free(chains);
+}
+
+
+static int
+nftablesCheckName(const char *name)
+{
+    if (!*name || name[strspn(name, NFT_VALID_NAME)] != '\0') {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("name '%s' cannot be used by the nftables driver"),
+                       name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static char *
+nftablesDispatchChain(nftablesHook hook, const char *ifname)
+{
+    return g_strdup_printf("%s-%s", nftablesHooks[hook].map, ifname);
+}
+
+
+static char *
+nftablesRootChain(nftablesHook hook, const char *ifname, bool staged)
+{
+    return g_strdup_printf("%s-%s",
+                           staged ? nftablesHooks[hook].tmproot
+                                  : nftablesHooks[hook].root,
+                           ifname);
+}
+
+
+static char *
+nftablesSubChain(nftablesHook hook, const char *ifname,
+                 const char *suffix, bool staged)
+{
+    /* '/' cannot be part of an interface name */
+    return g_strdup_printf("%c-%s/%s",
+                           staged ? nftablesHooks[hook].tmpsubprefix
+                                  : nftablesHooks[hook].subprefix,
+                           ifname, suffix);
+}
+
+
+static int
+nftablesChainsAdd(nftablesChainsPtr chains,
+                  const char *ifname,
+                  const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < NFTABLES_HOOK_LAST; i++) {
+        g_autofree char *dispatch = nftablesDispatchChain(i, ifname);
+        g_autofree char *root = nftablesRootChain(i, ifname, false);
+        g_autofree char *tmproot = nftablesRootChain(i, ifname, true);
+
+        if (STREQ(name, dispatch))
+            return virStringListAdd(&chains->dispatch, name);
+
+        if (STREQ(name, root)) {
+            chains->activeRoot[i] = true;
+            return virStringListAdd(&chains->active, name);
+        }
+
+        if (STREQ(name, tmproot))
+            return virStringListAdd(&chains->staged, name);
+
+        if (nftablesHooks[i].subprefix) {
+            g_autofree char *sub = nftablesSubChain(i, ifname, "", false);
+            g_autofree char *tmpsub = nftablesSubChain(i, ifname, "", true);
+
+            if (STRPREFIX(name, sub))
+                return virStringListAdd(&chains->active, name);
+            if (STRPREFIX(name, tmpsub))
+                return virStringListAdd(&chains->staged, name);
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * nftablesListChains:
+ * @ifname: the name of the interface
+ * @chains: filled with the chains of the interface
+ *
+ * Collect the chains our table holds for @ifname.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+static int
+nftablesListChains(const char *ifname,
+                   nftablesChainsPtr chains)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *output = NULL;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    bool intable = false;
+    size_t i;
+
+    cmd = virCommandNewArgList(NFT_PATH, "list", "chains", "bridge", NULL);
+    virCommandSetOutputBuffer(cmd, &output);
+
+    if (virCommandRun(cmd, NULL) < 0)
+        return -1;
+
+    if (!output)
+        return 0;
+
+    if (!(lines = virStringSplit(output, "\n", 0)))
+        return -1;
+
+    for (i = 0; lines[i]; i++) {
+        const char *line = lines[i];
+        const char *end;
+        g_autofree char *name = NULL;
+
+        virSkipSpaces(&line);
+
+        if (STRPREFIX(line, "table ")) {
+            intable = STREQ(line, "table " NFT_TABLE " {");
+            continue;
+        }
+
+        if (!intable || !STRPREFIX(line, "chain "))
+            continue;
+
+        line += strlen("chain ");
+        if (!(end = strchr(line, ' ')))
+            continue;
+
+        name = g_strndup(line, end - line);
+        if (nftablesChainsAdd(chains, ifname, name) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Remember @chains as the state of @ifname for the operation that
+ * finishes the transaction. The content of @chains is moved. Failing
+ * to remember it only means the table is listed again.
+ */
+static void
+nftablesTransactionSave(const char *ifname,
+                        nftablesChainsPtr chains)
+{
+    nftablesChainsPtr copy = g_new0(nftablesChains, 1);
+
+    *copy = *chains;
+    memset(chains, 0, sizeof(*chains));
+
+    virMutexLock(&nftablesTransactionsLock);
+
+    if (!nftablesTransactions &&
+        !(nftablesTransactions = virHashCreate(10, nftablesChainsFree)))
+        goto cleanup;
+
+    if (virHashUpdateEntry(nftablesTransactions, ifname, copy) < 0)
+        goto cleanup;
+
+    copy = NULL;
+
+ cleanup:
+    virMutexUnlock(&nftablesTransactionsLock);
+    nftablesChainsFree(copy);
+}
+
+
+/*
+ * Forget what the last transaction on @ifname left behind. Returns
+ * true and fills @chains if there was anything.
+ */
+static bool
+nftablesTransactionTake(const char *ifname,
+                        nftablesChainsPtr chains)
+{
+    nftablesChainsPtr saved = NULL;
+
+    virMutexLock(&nftablesTransactionsLock);
+    if (nftablesTransactions)
+        saved = virHashSteal(nftablesTransactions, ifname);
+    virMutexUnlock(&nftablesTransactionsLock);
+
+    if (!saved)
+        return false;
+
+    *chains = *saved;
+    g_free(saved);
+    return true;
+}
+
+
+/*
+ * Get the chains of @ifname from the transaction in progress, or from
+ * the kernel if there is none.
+ */
+static int
+nftablesGetChains(const char *ifname,
+                  nftablesChainsPtr chains)
+{
+    if (nftablesTransactionTake(ifname, chains))
+        return 0;
+
+    return nftablesListChains(ifname, chains);
+}
+
+
+static int
+nftablesRunScript(virBufferPtr buf)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *script = virBufferContentAndReset(buf);
+    g_autofree char *error = NULL;
+    int status;
+
+    if (!script)
+        return 0;
+
+    cmd = virCommandNewArgList(NFT_PATH, "-f", "-", NULL);
+    virCommandSetInputBuffer(cmd, script);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        return -1;
+
+    if (status != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply nftables rules: %s"),
+                       NULLSTR(error));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+nftablesCreateBaseChains(virBufferPtr buf)
+{
+    size_t i, j;
+
+    virBufferAddLit(buf, "add table " NFT_TABLE "\n");
+
+    for (i = 0; i < NFTABLES_HOOK_LAST; i++)
+        virBufferAsprintf(buf,
+                          "add map " NFT_TABLE " %s "
+                          "{ type ifname : verdict; }\n",
+                          nftablesHooks[i].map);
+
+    for (i = 0; i < G_N_ELEMENTS(nftablesBaseChains); i++)
+        virBufferAsprintf(buf,
+                          "add chain " NFT_TABLE " %s "
+                          "{ type filter hook %s priority %d; policy accept; }\n",
+                          nftablesBaseChains[i].hook,
+                          nftablesBaseChains[i].hook,
+                          nftablesBaseChains[i].priority);
+
+    /* the rules of the base chains never change, rewrite them so that
+     * a table modified by somebody else gets repaired */
+    for (i = 0; i < G_N_ELEMENTS(nftablesBaseChains); i++) {
+        virBufferAsprintf(buf, "flush chain " NFT_TABLE " %s\n",
+                          nftablesBaseChains[i].hook);
+        for (j = 0; nftablesBaseChains[i].rules[j]; j++)
+            virBufferAsprintf(buf, "add rule " NFT_TABLE " %s %s\n",
+                              nftablesBaseChains[i].hook,
+                              nftablesBaseChains[i].rules[j]);
+    }
+}
+
+
+static void
+nftablesRemoveChains(virBufferPtr buf, char **chains)
+{
+    size_t i;
+
+    /* flush all of them first, they may jump to each other */
+    for (i = 0; chains && chains[i]; i++)
+        virBufferAsprintf(buf, "flush chain " NFT_TABLE " %s\n", chains[i]);
+    for (i = 0; chains && chains[i]; i++)
+        virBufferAsprintf(buf, "delete chain " NFT_TABLE " %s\n", chains[i]);
+}
+
+
+/*
+ * Make sure the dispatch chains of @ifname exist and are referenced from
+ * the verdict maps, empty them and remove the chains of a previous
+ * filter that was never committed. The chains of the active filter are
+ * removed as well if @removeActive is set.
+ */
+static void
+nftablesPrepareInterface(virBufferPtr buf,
+                         const char *ifname,
+                         nftablesChainsPtr chains,
+                         bool removeActive)
+{
+    size_t i;
+
+    nftablesCreateBaseChains(buf);
+
+    for (i = 0; i < NFTABLES_HOOK_LAST; i++) {
+        g_autofree char *dispatch = nftablesDispatchChain(i, ifname);
+
+        virBufferAsprintf(buf, "add chain " NFT_TABLE " %s\n", dispatch);
+        virBufferAsprintf(buf,
+                          "add element " NFT_TABLE " %s { \"%s\" : jump %s }\n",
+                          nftablesHooks[i].map, ifname, dispatch);
+        virBufferAsprintf(buf, "flush chain " NFT_TABLE " %s\n", dispatch);
+    }
+
+    nftablesRemoveChains(buf, chains->staged);
+    if (removeActive)
+        nftablesRemoveChains(buf, chains->active);
+}
+
+
+static void
+nftablesLinkRootChain(virBufferPtr buf,
+                      nftablesHook hook,
+                      const char *ifname,
+                      bool staged)
+{
+    g_autofree char *dispatch = nftablesDispatchChain(hook, ifname);
+    g_autofree char *root = nftablesRootChain(hook, ifname, staged);
+
+    virBufferAsprintf(buf, "add rule " NFT_TABLE " %s jump %s\n",
+                      dispatch, root);
+}
+
+
+static char *
+nftablesPrintDataType(virNWFilterVarCombIterPtr vars,
+                      nwItemDescPtr item,
+                      bool asHex)
+{
+    char macaddr[VIR_MAC_STRING_BUFLEN];
+
+    if ((item->flags & NWFILTER_ENTRY_ITEM_FLAG_HAS_VAR)) {
+        const char *val;
+
+        /* error has been reported */
+        if (!(val = virNWFilterVarCombIterGetVarValue(vars, item->varAccess)))
+            return NULL;
+
+        return g_strdup(val);
+    }
+
+    switch (item->datatype) {
+    case DATATYPE_IPADDR:
+    case DATATYPE_IPV6ADDR:
+        return virSocketAddrFormat(&item->u.ipaddr);
+
+    case DATATYPE_MACADDR:
+    case DATATYPE_MACMASK:
+        return g_strdup(virMacAddrFormat(&item->u.macaddr, macaddr));
+
+    case DATATYPE_IPV6MASK:
+    case DATATYPE_IPMASK:
+        return g_strdup_printf("%d", item->u.u8);
+
+    case DATATYPE_UINT32:
+    case DATATYPE_UINT32_HEX:
+        return g_strdup_printf(asHex ? "0x%x" : "%u", item->u.u32);
+
+    case DATATYPE_UINT16:
+    case DATATYPE_UINT16_HEX:
+        return g_strdup_printf(asHex ? "0x%x" : "%d", item->u.u16);
+
+    case DATATYPE_UINT8:
+    case DATATYPE_UINT8_HEX:
+        return g_strdup_printf(asHex ? "0x%x" : "%d", item->u.u8);
+
+    case DATATYPE_IPSETNAME:
+    case DATATYPE_IPSETFLAGS:
+    case DATATYPE_STRING:
+    case DATATYPE_STRINGCOPY:
+    case DATATYPE_BOOLEAN:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Cannot print data type %x"), item->datatype);
+        return NULL;
+    case DATATYPE_LAST:
+    default:
+        virReportEnumRangeError(virNWFilterAttrDataType, item->datatype);
+        return NULL;
+    }
+}
+
+
+/*
+ * nftablesHandleItem:
+ * @buf: the buffer holding the matches of the rule
+ * @vars: the variables to resolve
+ * @field: the nft expression the item is matched against
+ * @item: the item to match
+ * @itemHi: optional upper end of a range or prefix length
+ * @sep: separator printed between @item and @itemHi
+ * @asHex: whether to print numbers in hex
+ *
+ * Append a ' field [!=] value' match for @item if it is present.
+ */
+static int
+nftablesHandleItem(virBufferPtr buf,
+                   virNWFilterVarCombIterPtr vars,
+                   const char *field,
+                   nwItemDescPtr item,
+                   nwItemDescPtr itemHi,
+                   const char *sep,
+                   bool asHex)
+{
+    g_autofree char *val = NULL;
+    g_autofree char *valHi = NULL;
+
+    if (!HAS_ENTRY_ITEM(item))
+        return 0;
+
+    if (!(val = nftablesPrintDataType(vars, item, asHex)))
+        return -1;
+
+    if (itemHi && HAS_ENTRY_ITEM(itemHi) &&
+        !(valHi = nftablesPrintDataType(vars, itemHi, asHex)))
+        return -1;
+
+    virBufferAsprintf(buf, " %s %s%s", field,
+                      ENTRY_WANT_NEG_SIGN(item) ? "!= " : "", val);
+    if (valHi)
+        virBufferAsprintf(buf, "%s%s", sep, valHi);
+
+    return 0;
+}
+
+
+static int
+nftablesHandleMACItem(virBufferPtr buf,
+                      virNWFilterVarCombIterPtr vars,
+                      const char *field,
+                      nwItemDescPtr item,
+                      nwItemDescPtr mask)
+{
+    g_autofree char *macaddr = NULL;
+    g_autofree char *macmask = NULL;
+
+    if (!HAS_ENTRY_ITEM(mask))
+        return nftablesHandleItem(buf, vars, field, item, NULL, NULL, false);
+
+    if (!HAS_ENTRY_ITEM(item))
+        return 0;
+
+    if (!(macaddr = nftablesPrintDataType(vars, item, false)) ||
+        !(macmask = nftablesPrintDataType(vars, mask, false)))
+        return -1;
+
+    virBufferAsprintf(buf, " %s & %s %s %s", field, macmask,
+                      ENTRY_WANT_NEG_SIGN(item) ? "!=" : "==", macaddr);
+
+    return 0;
+}
+
+
+static int
+nftablesHandleEthHdr(virBufferPtr buf,
+                     virNWFilterVarCombIterPtr vars,
+                     ethHdrDataDefPtr ethHdr,
+                     bool reverse)
+{
+    if (nftablesHandleMACItem(buf, vars,
+                              reverse ? "ether daddr" : "ether saddr",
+                              &ethHdr->dataSrcMACAddr,
+                              &ethHdr->dataSrcMACMask) < 0 ||
+        nftablesHandleMACItem(buf, vars,
+                              reverse ? "ether saddr" : "ether daddr",
+                              &ethHdr->dataDstMACAddr,
+                              &ethHdr->dataDstMACMask) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+nftablesUnsupported(const char *what)
+{
+    virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                   _("matching on '%s' is not supported by the nftables driver"),
+                   what);
+    return -1;
+}
+
+
+/*
+ * Match an address of the ARP header. For RARP the address is matched
+ * as a raw integer at its offset in the header.
+ */
+static int
+nftablesHandleARPAddr(virBufferPtr buf,
+                      virNWFilterVarCombIterPtr vars,
+                      bool rarp,
+                      bool src,
+                      nwItemDescPtr item,
+                      nwItemDescPtr mask)
+{
+    g_autofree char *val = NULL;
+    g_autofree char *maskval = NULL;
+    const char *neg = ENTRY_WANT_NEG_SIGN(item) ? "!=" : "==";
+
+    if (!HAS_ENTRY_ITEM(item))
+        return 0;
+
+    if (!rarp) {
+        const char *field;
+
+        if (mask)
+            field = src ? "arp saddr ip" : "arp daddr ip";
+        else
+            field = src ? "arp saddr ether" : "arp daddr ether";
+
+        return nftablesHandleItem(buf, vars, field, item, mask, "/", false);
+    }
+
+    if (!(val = nftablesPrintDataType(vars, item, false)))
+        return -1;
+
+    if (mask) {
+        virSocketAddr addr;
+        unsigned int prefix = 32;
+        uint32_t netmask;
+
+        if (HAS_ENTRY_ITEM(mask)) {
+            if (!(maskval = nftablesPrintDataType(vars, mask, false)))
+                return -1;
+            if (virStrToLong_ui(maskval, NULL, 10, &prefix) < 0 ||
+                prefix > 32) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("invalid IPv4 prefix '%s'"), maskval);
+                return -1;
+            }
+        }
+
+        if (virSocketAddrParseIPv4(&addr, val) < 0)
+            return -1;
+
+        netmask = prefix ? 0xffffffffU << (32 - prefix) : 0;
+
+        virBufferAsprintf(buf, " @nh,%d,32 & 0x%08x %s 0x%08x",
+                          src ? 112 : 192, netmask, neg,
+                          ntohl(addr.data.inet4.sin_addr.s_addr) & netmask);
+    } else {
+        virMacAddr mac;
+
+        if (virMacAddrParse(val, &mac) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("invalid MAC address '%s'"), val);
+            return -1;
+        }
+
+        virBufferAsprintf(buf,
+                          " @nh,%d,48 %s 0x%02x%02x%02x%02x%02x%02x",
+                          src ? 64 : 144, neg,
+                          mac.addr[0], mac.addr[1], mac.addr[2],
+                          mac.addr[3], mac.addr[4], mac.addr[5]);
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesHandleL2IPHdr(virBufferPtr buf,
+                      virNWFilterVarCombIterPtr vars,
+                      const char *family,
+                      ipHdrDataDefPtr ipHdr,
+                      portDataDefPtr portData,
+                      bool reverse)
+{
+    g_autofree char *saddr = g_strdup_printf("%s saddr", family);
+    g_autofree char *daddr = g_strdup_printf("%s daddr", family);
+    g_autofree char *proto = NULL;
+    g_autofree char *dscp = g_strdup_printf("%s dscp", family);
+
+    proto = g_strdup_printf("%s %s", family,
+                            STREQ(family, "ip") ? "protocol" : "nexthdr");
+
+    if (nftablesHandleItem(buf, vars, reverse ? daddr : saddr,
+                           &ipHdr->dataSrcIPAddr, &ipHdr->dataSrcIPMask,
+                           "/", false) < 0 ||
+        nftablesHandleItem(buf, vars, reverse ? saddr : daddr,
+                           &ipHdr->dataDstIPAddr, &ipHdr->dataDstIPMask,
+                           "/", false) < 0 ||
+        nftablesHandleItem(buf, vars, proto,
+                           &ipHdr->dataProtocolID, NULL, NULL, false) < 0 ||
+        nftablesHandleItem(buf, vars, reverse ? "th dport" : "th sport",
+                           &portData->dataSrcPortStart,
+                           &portData->dataSrcPortEnd, "-", false) < 0 ||
+        nftablesHandleItem(buf, vars, reverse ? "th sport" : "th dport",
+                           &portData->dataDstPortStart,
+                           &portData->dataDstPortEnd, "-", false) < 0 ||
+        nftablesHandleItem(buf, vars, dscp,
+                           &ipHdr->dataDSCP, NULL, NULL, false) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+nftablesHandleICMPv6Range(virBufferPtr buf,
+                          virNWFilterVarCombIterPtr vars,
+                          const char *field,
+                          nwItemDescPtr start,
+                          nwItemDescPtr end,
+                          bool negate)
+{
+    g_autofree char *lo = NULL;
+    g_autofree char *hi = NULL;
+
+    if (HAS_ENTRY_ITEM(start) && !(lo = nftablesPrintDataType(vars, start, false)))
+        return -1;
+    if (HAS_ENTRY_ITEM(end) && !(hi = nftablesPrintDataType(vars, end, false)))
+        return -1;
+
+    /* same defaults as ebtables: a missing start means 0, a missing
+     * end means the start or 255 */
+    if (!lo && !hi) {
+        lo = g_strdup("0");
+        hi = g_strdup("255");
+    } else if (!lo) {
+        lo = g_strdup("0");
+    }
+
+    virBufferAsprintf(buf, " %s %s%s", field, negate ? "!= " : "", lo);
+    if (hi && STRNEQ(lo, hi))
+        virBufferAsprintf(buf, "-%s", hi);
+
+    return 0;
+}
+
+
+/*
+ * nftablesCreateL2RuleInstance:
+ * @buf: the buffer to append the rule to
+ * @chain: the chain the rule goes to
+ * @rule: The rule of the filter to convert
+ * @vars : A map containing the variables to resolve
+ * @reverse : Whether to reverse src and dst attributes
+ *
+ * Convert a layer 2 rule into an nft rule, following the semantics of
+ * ebtablesCreateRuleInstance.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+nftablesCreateL2RuleInstance(virBufferPtr buf,
+                             const char *chain,
+                             virNWFilterRuleDefPtr rule,
+                             virNWFilterVarCombIterPtr vars,
+                             bool reverse)
+{
+    g_auto(virBuffer) matches = VIR_BUFFER_INITIALIZER;
+    g_autofree char *matchstr = NULL;
+    bool rarp = false;
+    int action;
+
+    switch ((int)rule->prtclType) {
+    case VIR_NWFILTER_RULE_PROTOCOL_MAC:
+        if (nftablesHandleEthHdr(&matches, vars,
+                                 &rule->p.ethHdrFilter.ethHdr, reverse) < 0 ||
+            nftablesHandleItem(&matches, vars, "ether type",
+                               &rule->p.ethHdrFilter.dataProtocolID,
+                               NULL, NULL, true) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_VLAN:
+        if (nftablesHandleEthHdr(&matches, vars,
+                                 &rule->p.vlanHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAddLit(&matches, " ether type vlan");
+
+        if (nftablesHandleItem(&matches, vars, "vlan id",
+                               &rule->p.vlanHdrFilter.dataVlanID,
+                               NULL, NULL, false) < 0 ||
+            nftablesHandleItem(&matches, vars, "vlan type",
+                               &rule->p.vlanHdrFilter.dataVlanEncap,
+                               NULL, NULL, false) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_STP: {
+        stpHdrFilterDefPtr stp = &rule->p.stpHdrFilter;
+
+        /* cannot handle inout direction with srcmask set in reverse dir.
+           since this clashes with the BGA below... */
+        if (reverse && HAS_ENTRY_ITEM(&stp->ethHdr.dataSrcMACAddr)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("STP filtering in %s direction with "
+                             "source MAC address set is not supported"),
+                           virNWFilterRuleDirectionTypeToString(
+                               VIR_NWFILTER_RULE_DIRECTION_INOUT));
+            return -1;
+        }
+
+        if (HAS_ENTRY_ITEM(&stp->dataType) ||
+            HAS_ENTRY_ITEM(&stp->dataFlags) ||
+            HAS_ENTRY_ITEM(&stp->dataRootPri) ||
+            HAS_ENTRY_ITEM(&stp->dataRootAddr) ||
+            HAS_ENTRY_ITEM(&stp->dataRootCost) ||
+            HAS_ENTRY_ITEM(&stp->dataSndrPrio) ||
+            HAS_ENTRY_ITEM(&stp->dataSndrAddr) ||
+            HAS_ENTRY_ITEM(&stp->dataPort) ||
+            HAS_ENTRY_ITEM(&stp->dataAge) ||
+            HAS_ENTRY_ITEM(&stp->dataMaxAge) ||
+            HAS_ENTRY_ITEM(&stp->dataHelloTime) ||
+            HAS_ENTRY_ITEM(&stp->dataFwdDelay))
+            return nftablesUnsupported("stp");
+
+        if (nftablesHandleEthHdr(&matches, vars, &stp->ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAddLit(&matches, " ether daddr " NWFILTER_MAC_BGA);
+        break;
+    }
+
+    case VIR_NWFILTER_RULE_PROTOCOL_RARP:
+        rarp = true;
+        G_GNUC_FALLTHROUGH;
+    case VIR_NWFILTER_RULE_PROTOCOL_ARP: {
+        arpHdrFilterDefPtr arp = &rule->p.arpHdrFilter;
+
+        if (HAS_ENTRY_ITEM(&arp->dataGratuitousARP) &&
+            arp->dataGratuitousARP.u.boolean)
+            return nftablesUnsupported("gratuitous");
+
+        if (nftablesHandleEthHdr(&matches, vars, &arp->ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAsprintf(&matches, " ether type 0x%x",
+                          rarp ? ETHERTYPE_REVARP : ETHERTYPE_ARP);
+
+        if (nftablesHandleItem(&matches, vars,
+                               rarp ? RARP_HTYPE : "arp htype",
+                               &arp->dataHWType, NULL, NULL, false) < 0 ||
+            nftablesHandleItem(&matches, vars,
+                               rarp ? RARP_OPER : "arp operation",
+                               &arp->dataOpcode, NULL, NULL, false) < 0 ||
+            nftablesHandleItem(&matches, vars,
+                               rarp ? RARP_PTYPE : "arp ptype",
+                               &arp->dataProtocolType, NULL, NULL, true) < 0 ||
+            nftablesHandleARPAddr(&matches, vars, rarp, !reverse,
+                                  &arp->dataARPSrcIPAddr,
+                                  &arp->dataARPSrcIPMask) < 0 ||
+            nftablesHandleARPAddr(&matches, vars, rarp, reverse,
+                                  &arp->dataARPDstIPAddr,
+                                  &arp->dataARPDstIPMask) < 0 ||
+            nftablesHandleARPAddr(&matches, vars, rarp, !reverse,
+                                  &arp->dataARPSrcMACAddr, NULL) < 0 ||
+            nftablesHandleARPAddr(&matches, vars, rarp, reverse,
+                                  &arp->dataARPDstMACAddr, NULL) < 0)
+            return -1;
+        break;
+    }
+
+    case VIR_NWFILTER_RULE_PROTOCOL_IP:
+        if (nftablesHandleEthHdr(&matches, vars,
+                                 &rule->p.ipHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAddLit(&matches, " ether type ip");
+
+        if (nftablesHandleL2IPHdr(&matches, vars, "ip",
+                                  &rule->p.ipHdrFilter.ipHdr,
+                                  &rule->p.ipHdrFilter.portData,
+                                  reverse) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_IPV6: {
+        ipv6HdrFilterDefPtr ipv6 = &rule->p.ipv6HdrFilter;
+
+        if (nftablesHandleEthHdr(&matches, vars, &ipv6->ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAddLit(&matches, " ether type ip6");
+
+        if (nftablesHandleL2IPHdr(&matches, vars, "ip6",
+                                  &ipv6->ipHdr, &ipv6->portData,
+                                  reverse) < 0)
+            return -1;
+
+        if (HAS_ENTRY_ITEM(&ipv6->dataICMPTypeStart) ||
+            HAS_ENTRY_ITEM(&ipv6->dataICMPTypeEnd) ||
+            HAS_ENTRY_ITEM(&ipv6->dataICMPCodeStart) ||
+            HAS_ENTRY_ITEM(&ipv6->dataICMPCodeEnd)) {
+            bool negate = ENTRY_WANT_NEG_SIGN(&ipv6->dataICMPTypeStart);
+            bool hasCode = HAS_ENTRY_ITEM(&ipv6->dataICMPCodeStart) ||
+                           HAS_ENTRY_ITEM(&ipv6->dataICMPCodeEnd);
+
+            /* ebtables negates type and code together */
+            if (negate && hasCode)
+                return nftablesUnsupported("icmp-code");
+
+            if (nftablesHandleICMPv6Range(&matches, vars, "icmpv6 type",
+                                          &ipv6->dataICMPTypeStart,
+                                          &ipv6->dataICMPTypeEnd,
+                                          negate) < 0)
+                return -1;
+
+            if (hasCode &&
+                nftablesHandleICMPv6Range(&matches, vars, "icmpv6 code",
+                                          &ipv6->dataICMPCodeStart,
+                                          &ipv6->dataICMPCodeEnd,
+                                          false) < 0)
+                return -1;
+        }
+        break;
+    }
+
+    case VIR_NWFILTER_RULE_PROTOCOL_NONE:
+        break;
+
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected rule protocol %d"),
+                       rule->prtclType);
+        return -1;
+    }
+
+    /* REJECT not supported */
+    action = rule->action;
+    if (action == VIR_NWFILTER_RULE_ACTION_REJECT)
+        action = VIR_NWFILTER_RULE_ACTION_DROP;
+
+    matchstr = virBufferContentAndReset(&matches);
+    virBufferAsprintf(buf, "add rule " NFT_TABLE " %s%s %s\n",
+                      chain, NULLSTR_EMPTY(matchstr),
+                      nftablesVerdictTypeToString(action));
+
+    return 0;
+}
+
+
+static char *
+nftablesPrintStateMatchFlags(int32_t flags)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *match = NULL;
+
+    virNWFilterPrintStateMatchFlags(&buf, "", flags, false);
+
+    if (!(match = virBufferContentAndReset(&buf)))
+        return NULL;
+
+    return g_ascii_strdown(match, -1);
+}
+
+
+/*
+ * nftablesCreateL3RuleInstance:
+ * @buf: the buffer to append the rule to
+ * @hook: the hook whose staged root chain receives the rule
+ * @directionIn: whether the rule applies to traffic towards the VM
+ * @rule: The rule of the filter to convert
+ * @ifname : The name of the interface to apply the rule to
+ * @vars : A map containing the variables to resolve
+ * @match : optional connection states to match
+ * @defMatch: whether @match is the default one of the direction
+ * @accept_target : where to go on accepted traffic, i.e., "return"
+ *    or "accept"
+ * @maySkipICMP : whether this rule may under certain circumstances skip
+ *           the ICMP rule from being created
+ *
+ * Convert an IPv4 or IPv6 rule into an nft rule, following the semantics
+ * of _iptablesCreateRuleInstance.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+nftablesCreateL3RuleInstance(virBufferPtr buf,
+                             nftablesHook hook,
+                             bool directionIn,
+                             virNWFilterRuleDefPtr rule,
+                             const char *ifname,
+                             virNWFilterVarCombIterPtr vars,
+                             const char *match, bool defMatch,
+                             const char *accept_target,
+                             bool maySkipICMP)
+{
+    g_auto(virBuffer) matches = VIR_BUFFER_INITIALIZER;
+    g_autofree char *chain = nftablesRootChain(hook, ifname, true);
+    g_autofree char *matchstr = NULL;
+    bool ipv6 = virNWFilterRuleIsProtocolIPv6(rule);
+    const char *family = ipv6 ? "ip6" : "ip";
+    g_autofree char *saddr = g_strdup_printf("%s saddr", family);
+    g_autofree char *daddr = g_strdup_printf("%s daddr", family);
+    g_autofree char *dscp = g_strdup_printf("%s dscp", family);
+    nwItemDescPtr srcMacAddr = &rule->p.allHdrFilter.dataSrcMACAddr;
+    ipHdrDataDefPtr ipHdr = &rule->p.allHdrFilter.ipHdr;
+    portDataDefPtr portData = NULL;
+    const char *proto = NULL;
+    const char *target;
+    bool srcMacSkipped = false;
+    bool skipMatch = false;
+    bool hasICMPType = false;
+    size_t nmatches;
+
+    switch ((int)rule->prtclType) {
+    case VIR_NWFILTER_RULE_PROTOCOL_TCP:
+    case VIR_NWFILTER_RULE_PROTOCOL_TCPoIPV6:
+        proto = "tcp";
+        portData = &rule->p.tcpHdrFilter.portData;
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_UDP:
+    case VIR_NWFILTER_RULE_PROTOCOL_UDPoIPV6:
+        proto = "udp";
+        portData = &rule->p.udpHdrFilter.portData;
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_UDPLITE:
+    case VIR_NWFILTER_RULE_PROTOCOL_UDPLITEoIPV6:
+        proto = "udplite";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_ESP:
+    case VIR_NWFILTER_RULE_PROTOCOL_ESPoIPV6:
+        proto = "esp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_AH:
+    case VIR_NWFILTER_RULE_PROTOCOL_AHoIPV6:
+        proto = "ah";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_SCTP:
+    case VIR_NWFILTER_RULE_PROTOCOL_SCTPoIPV6:
+        proto = "sctp";
+        portData = &rule->p.sctpHdrFilter.portData;
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_ICMP:
+        proto = "icmp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_ICMPV6:
+        proto = "ipv6-icmp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_IGMP:
+        proto = "igmp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_ALL:
+    case VIR_NWFILTER_RULE_PROTOCOL_ALLoIPV6:
+        break;
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected protocol %d"),
+                       rule->prtclType);
+        return -1;
+    }
+
+    virBufferAsprintf(&matches, " ether type %s", family);
+    if (proto)
+        virBufferAsprintf(&matches, " %s %s",
+                          ipv6 ? "ip6 nexthdr" : "ip protocol", proto);
+    nmatches = virBufferUse(&matches);
+
+    if (HAS_ENTRY_ITEM(srcMacAddr)) {
+        if (directionIn) {
+            srcMacSkipped = true;
+        } else if (nftablesHandleItem(&matches, vars, "ether saddr",
+                                      srcMacAddr, NULL, NULL, false) < 0) {
+            return -1;
+        }
+    }
+
+    if (HAS_ENTRY_ITEM(&ipHdr->dataSrcIPAddr)) {
+        if (nftablesHandleItem(&matches, vars, directionIn ? daddr : saddr,
+                               &ipHdr->dataSrcIPAddr, &ipHdr->dataSrcIPMask,
+                               "/", false) < 0)
+            return -1;
+    } else if (nftablesHandleItem(&matches, vars, directionIn ? daddr : saddr,
+                                  &ipHdr->dataSrcIPFrom, &ipHdr->dataSrcIPTo,
+                                  "-", false) < 0) {
+        return -1;
+    }
+
+    if (HAS_ENTRY_ITEM(&ipHdr->dataDstIPAddr)) {
+        if (nftablesHandleItem(&matches, vars, directionIn ? saddr : daddr,
+                               &ipHdr->dataDstIPAddr, &ipHdr->dataDstIPMask,
+                               "/", false) < 0)
+            return -1;
+    } else if (nftablesHandleItem(&matches, vars, directionIn ? saddr : daddr,
+                                  &ipHdr->dataDstIPFrom, &ipHdr->dataDstIPTo,
+                                  "-", false) < 0) {
+        return -1;
+    }
+
+    if (nftablesHandleItem(&matches, vars, dscp,
+                           &ipHdr->dataDSCP, NULL, NULL, false) < 0)
+        return -1;
+
+    if (rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_TCP ||
+        rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_TCPoIPV6) {
+        nwItemDescPtr flags = &rule->p.tcpHdrFilter.dataTCPFlags;
+
+        if (HAS_ENTRY_ITEM(flags))
+            virBufferAsprintf(&matches, " tcp flags & 0x%x %s 0x%x",
+                              flags->u.tcpFlags.mask,
+                              ENTRY_WANT_NEG_SIGN(flags) ? "!=" : "==",
+                              flags->u.tcpFlags.flags);
+    }
+
+    if (portData &&
+        (nftablesHandleItem(&matches, vars,
+                            directionIn ? "th dport" : "th sport",
+                            &portData->dataSrcPortStart,
+                            &portData->dataSrcPortEnd, "-", false) < 0 ||
+         nftablesHandleItem(&matches, vars,
+                            directionIn ? "th sport" : "th dport",
+                            &portData->dataDstPortStart,
+                            &portData->dataDstPortEnd, "-", false) < 0))
+        return -1;
+
+    if ((rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_ICMP ||
+         rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_ICMPV6) &&
+        HAS_ENTRY_ITEM(&rule->p.icmpHdrFilter.dataICMPType)) {
+        icmpHdrFilterDefPtr icmp = &rule->p.icmpHdrFilter;
+        const char *icmpproto = ipv6 ? "icmpv6" : "icmp";
+        g_autofree char *type = g_strdup_printf("%s type", icmpproto);
+        g_autofree char *code = g_strdup_printf("%s code", icmpproto);
+
+        hasICMPType = true;
+
+        if (maySkipICMP)
+            return 0;
+
+        /* iptables negates type and code together */
+        if (ENTRY_WANT_NEG_SIGN(&icmp->dataICMPType) &&
+            HAS_ENTRY_ITEM(&icmp->dataICMPCode))
+            return nftablesUnsupported("code");
+
+        if (nftablesHandleItem(&matches, vars, type,
+                               &icmp->dataICMPType, NULL, NULL, false) < 0 ||
+            nftablesHandleItem(&matches, vars, code,
+                               &icmp->dataICMPCode, NULL, NULL, false) < 0)
+            return -1;
+    }
+
+    if (srcMacSkipped && virBufferUse(&matches) == nmatches)
+        return 0;
+
+    if (rule->action == VIR_NWFILTER_RULE_ACTION_ACCEPT) {
+        target = accept_target;
+    } else {
+        target = nftablesVerdictTypeToString(rule->action);
+        skipMatch = defMatch;
+    }
+
+    if (match && !skipMatch)
+        virBufferAsprintf(&matches, " ct state %s", match);
+
+    if (defMatch && match != NULL && !skipMatch && !hasICMPType &&
+        rule->tt != VIR_NWFILTER_RULE_DIRECTION_INOUT)
+        virBufferAsprintf(&matches, " ct direction %s",
+                          directionIn ? "reply" : "original");
+
+    matchstr = virBufferContentAndReset(&matches);
+    virBufferAsprintf(buf, "add rule " NFT_TABLE " %s%s %s",
+                      chain, matchstr, target);
+
+    if (HAS_ENTRY_ITEM(&ipHdr->dataComment)) {
+        g_autofree char *comment = g_strdup(ipHdr->dataComment.u.string);
+
+        /* keep comments behind everything else -- nft does not
+           allow double quotes inside of them */
+        g_strdelimit(comment, "\"", '\'');
+        virBufferAsprintf(buf, " comment \"%s\"", comment);
+    }
+
+    virBufferAddLit(buf, "\n");
+
+    return 0;
+}
+
+
+static int
+nftablesCreateL3RuleInstanceStateCtrl(virBufferPtr buf,
+                                      virNWFilterRuleDefPtr rule,
+                                      const char *ifname,
+                                      virNWFilterVarCombIterPtr vars)
+{
+    bool directionIn = false;
+    bool inout = false;
+    g_autofree char *matchState = nftablesPrintStateMatchFlags(rule->flags);
+
+    if ((rule->tt == VIR_NWFILTER_RULE_DIRECTION_IN) ||
+        (rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT)) {
+        directionIn = true;
+        inout = (rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT);
+    }
+
+    if (!directionIn || inout) {
+        if (nftablesCreateL3RuleInstance(buf, NFTABLES_HOOK_FWD_IN,
+                                         directionIn, rule, ifname, vars,
+                                         matchState, false, "return",
+                                         directionIn || inout) < 0)
+            return -1;
+    }
+
+    if (directionIn) {
+        if (nftablesCreateL3RuleInstance(buf, NFTABLES_HOOK_FWD_OUT,
+                                         !directionIn, rule, ifname, vars,
+                                         matchState, false, "accept",
+                                         !directionIn || inout) < 0)
+            return -1;
+    }
+
+    if (!directionIn || inout) {
+        if (nftablesCreateL3RuleInstance(buf, NFTABLES_HOOK_HOST_IN,
+                                         directionIn, rule, ifname, vars,
+                                         matchState, false, "return",
+                                         directionIn) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesCreateL3RuleInstanceAll(virBufferPtr buf,
+                                virNWFilterRuleDefPtr rule,
+                                const char *ifname,
+                                virNWFilterVarCombIterPtr vars)
+{
+    bool directionIn = false;
+    bool needState = true;
+    bool inout = false;
+
+    if (HAS_ENTRY_ITEM(&rule->p.allHdrFilter.ipHdr.dataIPSet))
+        return nftablesUnsupported("ipset");
+    if (HAS_ENTRY_ITEM(&rule->p.allHdrFilter.ipHdr.dataConnlimitAbove))
+        return nftablesUnsupported("connlimit-above");
+    if ((rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_TCP ||
+         rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_TCPoIPV6) &&
+        HAS_ENTRY_ITEM(&rule->p.tcpHdrFilter.dataTCPOption))
+        return nftablesUnsupported("option");
+
+    if (!(rule->flags & RULE_FLAG_NO_STATEMATCH) &&
+         (rule->flags & IPTABLES_STATE_FLAGS))
+        return nftablesCreateL3RuleInstanceStateCtrl(buf, rule, ifname, vars);
+
+    if ((rule->tt == VIR_NWFILTER_RULE_DIRECTION_IN) ||
+        (rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT)) {
+        directionIn = true;
+        inout = (rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT);
+        if (inout)
+            needState = false;
+    }
+
+    if ((rule->flags & RULE_FLAG_NO_STATEMATCH))
+        needState = false;
+
+    if (nftablesCreateL3RuleInstance(buf, NFTABLES_HOOK_FWD_IN,
+                                     directionIn, rule, ifname, vars,
+                                     !needState ? NULL :
+                                     directionIn ? "established"
+                                                 : "new,established",
+                                     true, "return",
+                                     directionIn || inout) < 0)
+        return -1;
+
+    if (nftablesCreateL3RuleInstance(buf, NFTABLES_HOOK_FWD_OUT,
+                                     !directionIn, rule, ifname, vars,
+                                     !needState ? NULL :
+                                     directionIn ? "new,established"
+                                                 : "established",
+                                     true, "accept",
+                                     !directionIn || inout) < 0)
+        return -1;
+
+    if (nftablesCreateL3RuleInstance(buf, NFTABLES_HOOK_HOST_IN,
+                                     directionIn, rule, ifname, vars,
+                                     !needState ? NULL :
+                                     directionIn ? "established"
+                                                 : "new,established",
+                                     true, "return",
+                                     directionIn) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+nftablesCreateRuleInstance(virBufferPtr buf,
+                           const char *chainSuffix,
+                           virNWFilterRuleDefPtr rule,
+                           const char *ifname,
+                           virNWFilterVarCombIterPtr vars)
+{
+    bool root = STREQ(chainSuffix,
+                      virNWFilterChainSuffixTypeToString(
+                          VIR_NWFILTER_CHAINSUFFIX_ROOT));
+
+    if (!virNWFilterRuleIsProtocolEthernet(rule)) {
+        if (!virNWFilterRuleIsProtocolIPv4(rule) &&
+            !virNWFilterRuleIsProtocolIPv6(rule)) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           "%s", _("unexpected protocol type"));
+            return -1;
+        }
+
+        return nftablesCreateL3RuleInstanceAll(buf, rule, ifname, vars);
+    }
+
+    if (rule->tt == VIR_NWFILTER_RULE_DIRECTION_OUT ||
+        rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+        g_autofree char *chain = NULL;
+
+        if (root)
+            chain = nftablesRootChain(NFTABLES_HOOK_L2_IN, ifname, true);
+        else
+            chain = nftablesSubChain(NFTABLES_HOOK_L2_IN, ifname,
+                                     chainSuffix, true);
+
+        if (nftablesCreateL2RuleInstance(buf, chain, rule, vars,
+                                         rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) < 0)
+            return -1;
+    }
+
+    if (rule->tt == VIR_NWFILTER_RULE_DIRECTION_IN ||
+        rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+        g_autofree char *chain = NULL;
+
+        if (root)
+            chain = nftablesRootChain(NFTABLES_HOOK_L2_OUT, ifname, true);
+        else
+            chain = nftablesSubChain(NFTABLES_HOOK_L2_OUT, ifname,
+                                     chainSuffix, true);
+
+        if (nftablesCreateL2RuleInstance(buf, chain, rule, vars, false) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesRuleInstCommand(virBufferPtr buf,
+                        const char *ifname,
+                        virNWFilterRuleInstPtr rule)
+{
+    virNWFilterVarCombIterPtr vciter, tmp;
+    int ret = -1;
+
+    /* rule->vars holds all the variables names that this rule will access.
+     * iterate over all combinations of the variables' values and instantiate
+     * the filtering rule with each combination.
+     */
+    tmp = vciter = virNWFilterVarCombIterCreate(rule->vars,
+                                                rule->def->varAccess,
+                                                rule->def->nVarAccess);
+    if (!vciter)
+        return -1;
+
+    do {
+        if (nftablesCreateRuleInstance(buf,
+                                       rule->chainSuffix,
+                                       rule->def,
+                                       ifname,
+                                       tmp) < 0)
+            goto cleanup;
+        tmp = virNWFilterVarCombIterNext(tmp);
+    } while (tmp != NULL);
+
+    ret = 0;
+ cleanup:
+    virNWFilterVarCombIterFree(vciter);
+    return ret;
+}
+
+
+static int
+nftablesRuleInstSort(const void *a, const void *b)
+{
+    virNWFilterRuleInst * const *insta = a;
+    virNWFilterRuleInst * const *instb = b;
+    const char *root = virNWFilterChainSuffixTypeToString(
+                                     VIR_NWFILTER_CHAINSUFFIX_ROOT);
+    bool root_a = STREQ((*insta)->chainSuffix, root);
+    bool root_b = STREQ((*instb)->chainSuffix, root);
+
+    /* ensure root chain commands appear before all others since
+       we will need them to create the child chains */
+    if (root_a != root_b)
+        return root_a ? -1 : 1;
+
+    /* priorities are limited to range [-1000, 1000] */
+    return (*insta)->priority - (*instb)->priority;
+}
+
+
+typedef struct _nftablesSubChainInst nftablesSubChainInst;
+struct _nftablesSubChainInst {
+    virNWFilterChainPriority priority;
+    nftablesHook hook;
+    enum nftablesL2ProtoIdx protoidx;
+    const char *filtername;
+};
+
+
+static int
+nftablesSubChainInstSort(const void *a, const void *b)
+{
+    const nftablesSubChainInst *insta = a;
+    const nftablesSubChainInst *instb = b;
+
+    /* priorities are limited to range [-1000, 1000] */
+    return insta->priority - instb->priority;
+}
+
+
+static int
+nftablesFilterOrderSort(const virHashKeyValuePair *a,
+                        const virHashKeyValuePair *b)
+{
+    /* elements' values has been limited to range [-1000, 1000] */
+    return *(virNWFilterChainPriority *)a->value -
+           *(virNWFilterChainPriority *)b->value;
+}
+
+
+static int
+nftablesGetSubChainInsts(virHashTablePtr chains,
+                         nftablesHook hook,
+                         nftablesSubChainInst **insts,
+                         size_t *ninsts)
+{
+    g_autofree virHashKeyValuePairPtr filter_names = NULL;
+    size_t i;
+
+    if (!(filter_names = virHashGetItems(chains, nftablesFilterOrderSort)))
+        return -1;
+
+    for (i = 0; filter_names[i].key; i++) {
+        const char *name = filter_names[i].key;
+        nftablesSubChainInst inst = {
+            .priority = *(const virNWFilterChainPriority *)filter_names[i].value,
+            .hook = hook,
+            .protoidx = NFTABLES_PROTO_LAST_IDX,
+            .filtername = name,
+        };
+        size_t j;
+
+        for (j = 0; j < NFTABLES_PROTO_LAST_IDX; j++) {
+            if (STRPREFIX(name, nftablesL2Protocols[j].name)) {
+                inst.protoidx = j;
+                break;
+            }
+        }
+
+        if (inst.protoidx == NFTABLES_PROTO_LAST_IDX)
+            continue;
+
+        if (nftablesCheckName(name) < 0 ||
+            VIR_APPEND_ELEMENT(*insts, *ninsts, inst) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+nftablesCreateSubChain(virBufferPtr buf,
+                       const char *ifname,
+                       nftablesSubChainInst *inst)
+{
+    g_autofree char *root = nftablesRootChain(inst->hook, ifname, true);
+    g_autofree char *chain = nftablesSubChain(inst->hook, ifname,
+                                              inst->filtername, true);
+
+    virBufferAsprintf(buf, "add chain " NFT_TABLE " %s\n", chain);
+    virBufferAsprintf(buf, "add rule " NFT_TABLE " %s", root);
+
+    switch (inst->protoidx) {
+    case NFTABLES_PROTO_MAC_IDX:
+        break;
+    case NFTABLES_PROTO_STP_IDX:
+        virBufferAddLit(buf, " ether daddr " NWFILTER_MAC_BGA);
+        break;
+    default:
+        virBufferAsprintf(buf, " ether type 0x%04x",
+                          nftablesL2Protocols[inst->protoidx].ethertype);
+        break;
+    }
+
+    virBufferAsprintf(buf, " jump %s\n", chain);
+}
+
+
+static int
+nftablesApplyNewRules(const char *ifname,
+                      virNWFilterRuleInstPtr *rules,
+                      size_t nrules)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    nftablesChains chains = { 0 };
+    virHashTablePtr chains_in_set = NULL;
+    virHashTablePtr chains_out_set = NULL;
+    nftablesSubChainInst *subchains = NULL;
+    size_t nsubchains = 0;
+    bool haveL3 = false;
+    size_t i, j;
+    int ret = -1;
+
+    if (nftablesCheckName(ifname) < 0)
+        return -1;
+
+    if (!(chains_in_set = virHashCreate(10, NULL)) ||
+        !(chains_out_set = virHashCreate(10, NULL)))
+        goto cleanup;
+
+    /* a new transaction starts, anything an unfinished one left
+     * behind is stale */
+    if (nftablesTransactionTake(ifname, &chains))
+        nftablesChainsClear(&chains);
+
+    if (nftablesListChains(ifname, &chains) < 0)
+        goto cleanup;
+
+    if (nrules)
+        qsort(rules, nrules, sizeof(rules[0]), nftablesRuleInstSort);
+
+    /* see ebiptablesApplyNewRules: rules of a sub chain are moved up to
+     * the priority of the chain so that the chain is created first */
+    for (i = 0; i < nrules; i++) {
+        if (rules[i]->chainPriority > rules[i]->priority &&
+            !strstr("root", rules[i]->chainSuffix)) {
+
+             rules[i]->priority = rules[i]->chainPriority;
+        }
+    }
+
+    for (i = 0; i < nrules; i++) {
+        const char *name = rules[i]->chainSuffix;
+
+        if (!virNWFilterRuleIsProtocolEthernet(rules[i]->def)) {
+            haveL3 = true;
+            continue;
+        }
+
+        if (rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_OUT ||
+            rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+            if (virHashUpdateEntry(chains_in_set, name,
+                                   &rules[i]->chainPriority) < 0)
+                goto cleanup;
+        }
+        if (rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_IN ||
+            rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+            if (virHashUpdateEntry(chains_out_set, name,
+                                   &rules[i]->chainPriority) < 0)
+                goto cleanup;
+        }
+    }
+
+    if (nftablesGetSubChainInsts(chains_in_set, NFTABLES_HOOK_L2_IN,
+                                 &subchains, &nsubchains) < 0 ||
+        nftablesGetSubChainInsts(chains_out_set, NFTABLES_HOOK_L2_OUT,
+                                 &subchains, &nsubchains) < 0)
+        goto cleanup;
+
+    if (nsubchains > 0)
+        qsort(subchains, nsubchains, sizeof(subchains[0]),
+              nftablesSubChainInstSort);
+
+    nftablesPrepareInterface(&buf, ifname, &chains, false);
+
+    /* all root chains are created, so that tearing down the old rules
+     * always finds something to replace them with */
+    for (i = 0; i < NFTABLES_HOOK_LAST; i++) {
+        g_autofree char *root = nftablesRootChain(i, ifname, true);
+
+        virBufferAsprintf(&buf, "add chain " NFT_TABLE " %s\n", root);
+    }
+
+    /* interleave the rules of the filters with the creation of
+       the sub chains jumped to from the root chains */
+    for (i = 0, j = 0; i < nrules; i++) {
+        if (virNWFilterRuleIsProtocolEthernet(rules[i]->def)) {
+            while (j < nsubchains &&
+                   subchains[j].priority <= rules[i]->priority) {
+                nftablesCreateSubChain(&buf, ifname, &subchains[j]);
+                j++;
+            }
+        }
+
+        if (nftablesRuleInstCommand(&buf, ifname, rules[i]) < 0)
+            goto cleanup;
+    }
+    while (j < nsubchains) {
+        nftablesCreateSubChain(&buf, ifname, &subchains[j]);
+        j++;
+    }
+
+    /* the policy of user defined ebtables chains is ACCEPT */
+    for (i = 0; i < nsubchains; i++) {
+        g_autofree char *chain = nftablesSubChain(subchains[i].hook, ifname,
+                                                  subchains[i].filtername,
+                                                  true);
+
+        virBufferAsprintf(&buf, "add rule " NFT_TABLE " %s accept\n", chain);
+    }
+
+    if (virHashSize(chains_in_set) > 0)
+        nftablesLinkRootChain(&buf, NFTABLES_HOOK_L2_IN, ifname, true);
+    if (virHashSize(chains_out_set) > 0)
+        nftablesLinkRootChain(&buf, NFTABLES_HOOK_L2_OUT, ifname, true);
+    if (haveL3) {
+        nftablesLinkRootChain(&buf, NFTABLES_HOOK_FWD_IN, ifname, true);
+        nftablesLinkRootChain(&buf, NFTABLES_HOOK_FWD_OUT, ifname, true);
+        nftablesLinkRootChain(&buf, NFTABLES_HOOK_HOST_IN, ifname, true);
+    }
+
+    /* what the table holds for @ifname once the script ran: the old
+     * staged chains are replaced by the ones created above */
+    virStringListFree(chains.dispatch);
+    virStringListFree(chains.staged);
+    chains.dispatch = NULL;
+    chains.staged = NULL;
+    for (i = 0; i < NFTABLES_HOOK_LAST; i++) {
+        g_autofree char *dispatch = nftablesDispatchChain(i, ifname);
+        g_autofree char *root = nftablesRootChain(i, ifname, true);
+
+        if (virStringListAdd(&chains.dispatch, dispatch) < 0 ||
+            virStringListAdd(&chains.staged, root) < 0)
+            goto cleanup;
+    }
+    for (i = 0; i < nsubchains; i++) {
+        g_autofree char *chain = nftablesSubChain(subchains[i].hook, ifname,
+                                                  subchains[i].filtername,
+                                                  true);
+
+        if (virStringListAdd(&chains.staged, chain) < 0)
+            goto cleanup;
+    }
+
+    if (nftablesRunScript(&buf) < 0)
+        goto cleanup;
+
+    nftablesTransactionSave(ifname, &chains);
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(subchains);
+    nftablesChainsClear(&chains);
+    virHashFree(chains_in_set);
+    virHashFree(chains_out_set);
+
+    return ret;
+}
+
+
+/*
+ * Point the dispatch chains back to the active filter and remove the
+ * chains of the new one.
+ */
+static int
+nftablesTearNewRules(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    nftablesChains chains = { 0 };
+    size_t i;
+    int ret = -1;
+
+    if (nftablesGetChains(ifname, &chains) < 0)
+        goto cleanup;
+
+    if (!chains.staged) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    for (i = 0; chains.dispatch && chains.dispatch[i]; i++)
+        virBufferAsprintf(&buf, "flush chain " NFT_TABLE " %s\n",
+                          chains.dispatch[i]);
+
+    for (i = 0; i < NFTABLES_HOOK_LAST; i++) {
+        if (chains.activeRoot[i])
+            nftablesLinkRootChain(&buf, i, ifname, false);
+    }
+
+    nftablesRemoveChains(&buf, chains.staged);
+
+    ret = nftablesRunScript(&buf);
+
+ cleanup:
+    nftablesChainsClear(&chains);
+    return ret;
+}
+
+
+/*
+ * Remove the chains of the active filter and give the chains of the
+ * new one their final names. The jumps in the dispatch chains refer
+ * to the chains themselves and survive the renaming.
+ */
+static int
+nftablesTearOldRules(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    nftablesChains chains = { 0 };
+    size_t i, j;
+    int ret = -1;
+
+    if (nftablesGetChains(ifname, &chains) < 0)
+        goto cleanup;
+
+    if (!chains.staged) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    nftablesRemoveChains(&buf, chains.active);
+
+    for (i = 0; chains.staged[i]; i++) {
+        const char *staged = chains.staged[i];
+        g_autofree char *active = NULL;
+
+        for (j = 0; j < NFTABLES_HOOK_LAST && !active; j++) {
+            g_autofree char *tmproot = nftablesRootChain(j, ifname, true);
+
+            if (STREQ(staged, tmproot))
+                active = nftablesRootChain(j, ifname, false);
+            else if (nftablesHooks[j].tmpsubprefix == staged[0])
+                active = g_strdup_printf("%c%s", nftablesHooks[j].subprefix,
+                                         staged + 1);
+        }
+
+        virBufferAsprintf(&buf, "rename chain " NFT_TABLE " %s %s\n",
+                          staged, active);
+    }
+
+    ret = nftablesRunScript(&buf);
+
+ cleanup:
+    nftablesChainsClear(&chains);
+    return ret;
+}
+
+
+/**
+ * nftablesAllTeardown:
+ * @ifname : the name of the interface to which the rules apply
+ *
+ * Remove the interface from the verdict maps and all chains that were
+ * created for it.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+static int
+nftablesAllTeardown(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    nftablesChains chains = { 0 };
+    size_t i;
+    int ret = -1;
+
+    if (nftablesCheckName(ifname) < 0)
+        return -1;
+
+    if (nftablesGetChains(ifname, &chains) < 0)
+        goto cleanup;
+
+    for (i = 0; i < NFTABLES_HOOK_LAST; i++) {
+        g_autofree char *dispatch = nftablesDispatchChain(i, ifname);
+
+        if (!virStringListHasString((const char **)chains.dispatch, dispatch))
+            continue;
+
+        /* adding an existing element is not an error, this makes sure
+         * the delete succeeds */
+        virBufferAsprintf(&buf,
+                          "add element " NFT_TABLE " %s { \"%s\" : jump %s }\n",
+                          nftablesHooks[i].map, ifname, dispatch);
+        virBufferAsprintf(&buf,
+                          "delete element " NFT_TABLE " %s { \"%s\" }\n",
+                          nftablesHooks[i].map, ifname);
+    }
+
+    for (i = 0; chains.dispatch && chains.dispatch[i]; i++)
+        virBufferAsprintf(&buf, "flush chain " NFT_TABLE " %s\n",
+                          chains.dispatch[i]);
+    nftablesRemoveChains(&buf, chains.active);
+    nftablesRemoveChains(&buf, chains.staged);
+    for (i = 0; chains.dispatch && chains.dispatch[i]; i++)
+        virBufferAsprintf(&buf, "delete chain " NFT_TABLE " %s\n",
+                          chains.dispatch[i]);
+
+    ret = nftablesRunScript(&buf);
+
+ cleanup:
+    nftablesChainsClear(&chains);
+    return ret;
+}
+
+
+/*
+ * Replace all chains of @ifname by the root chains of the layer 2 hooks
+ * and link them. The callers fill in the rules.
+ */
+static int
+nftablesPrepareBasicRules(virBufferPtr buf,
+                          const char *ifname,
+                          bool staged)
+{
+    nftablesChains chains = { 0 };
+    size_t i;
+
+    if (nftablesCheckName(ifname) < 0)
+        return -1;
+
+    /* all chains are replaced, a transaction in progress is over */
+    if (nftablesTransactionTake(ifname, &chains))
+        nftablesChainsClear(&chains);
+
+    if (nftablesListChains(ifname, &chains) < 0) {
+        nftablesChainsClear(&chains);
+        return -1;
+    }
+
+    nftablesPrepareInterface(buf, ifname, &chains, true);
+
+    for (i = NFTABLES_HOOK_L2_IN; i <= NFTABLES_HOOK_L2_OUT; i++) {
+        g_autofree char *root = nftablesRootChain(i, ifname, staged);
+
+        virBufferAsprintf(buf, "add chain " NFT_TABLE " %s\n", root);
+        nftablesLinkRootChain(buf, i, ifname, staged);
+    }
+
+    nftablesChainsClear(&chains);
+    return 0;
+}
+
+
+/*
+ * Nothing but the nft tool is needed to run
+ * nftablesApplyBasicRules and nftablesApplyDHCPOnlyRules.
+ */
+static int
+nftablesCanApplyBasicRules(void)
+{
+    return true;
+}
+
+
+/**
+ * nftablesApplyBasicRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ * @macaddr: MAC address the VM is using in packets sent through the
+ *    interface
+ *
+ * Returns 0 on success, -1 on failure with the rules removed
+ *
+ * Apply basic filtering rules on the given interface
+ * - filtering for MAC address spoofing
+ * - allowing IPv4 & ARP traffic
+ */
+static int
+nftablesApplyBasicRules(const char *ifname,
+                        const virMacAddr *macaddr)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *chain = NULL;
+    char macaddr_str[VIR_MAC_STRING_BUFLEN];
+
+    virMacAddrFormat(macaddr, macaddr_str);
+
+    if (nftablesPrepareBasicRules(&buf, ifname, false) < 0)
+        return -1;
+
+    chain = nftablesRootChain(NFTABLES_HOOK_L2_IN, ifname, false);
+    virBufferAsprintf(&buf, "add rule " NFT_TABLE " %s ether saddr != %s drop\n",
+                      chain, macaddr_str);
+    virBufferAsprintf(&buf, "add rule " NFT_TABLE " %s ether type ip accept\n",
+                      chain);
+    virBufferAsprintf(&buf, "add rule " NFT_TABLE " %s ether type arp accept\n",
+                      chain);
+    virBufferAsprintf(&buf, "add rule " NFT_TABLE " %s drop\n", chain);
+
+    if (nftablesRunScript(&buf) < 0) {
+        nftablesAllTeardown(ifname);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * nftablesApplyDHCPOnlyRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ * @macaddr: MAC address the VM is using in packets sent through the
+ *    interface
+ * @dhcpsrvrs: The DHCP server(s) from which the VM may receive traffic
+ *    from; may be NULL
+ * @leaveTemporary: Whether to leave the chains with their temporary
+ *    names (true) or to give them their final names right away (false)
+ *
+ * Returns 0 on success, -1 on failure with the rules removed
+ *
+ * Apply filtering rules so that the VM can only send and receive
+ * DHCP traffic and nothing else.
+ */
+static int
+nftablesApplyDHCPOnlyRules(const char *ifname,
+                           const virMacAddr *macaddr,
+                           virNWFilterVarValuePtr dhcpsrvrs,
+                           bool leaveTemporary)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *chain_in = NULL;
+    g_autofree char *chain_out = NULL;
+    char macaddr_str[VIR_MAC_STRING_BUFLEN];
+    unsigned int idx = 0;
+    unsigned int num_dhcpsrvrs;
+
+    virMacAddrFormat(macaddr, macaddr_str);
+
+    if (nftablesPrepareBasicRules(&buf, ifname, leaveTemporary) < 0)
+        return -1;
+
+    chain_in = nftablesRootChain(NFTABLES_HOOK_L2_IN, ifname, leaveTemporary);
+    chain_out = nftablesRootChain(NFTABLES_HOOK_L2_OUT, ifname, leaveTemporary);
+
+    virBufferAsprintf(&buf,
+                      "add rule " NFT_TABLE " %s ether saddr %s ether type ip "
+                      "ip protocol udp th sport 68 th dport 67 accept\n",
+                      chain_in, macaddr_str);
+    virBufferAsprintf(&buf, "add rule " NFT_TABLE " %s drop\n", chain_in);
+
+    num_dhcpsrvrs = (dhcpsrvrs != NULL)
+                    ? virNWFilterVarValueGetCardinality(dhcpsrvrs)
+                    : 0;
+
+    while (true) {
+        const char *dhcpserver = NULL;
+        int ctr;
+
+        if (idx < num_dhcpsrvrs)
+            dhcpserver = virNWFilterVarValueGetNthValue(dhcpsrvrs, idx);
+
+        /*
+         * create two rules allowing response to MAC address of VM
+         * or to broadcast MAC address
+         */
+        for (ctr = 0; ctr < 2; ctr++) {
+            virBufferAsprintf(&buf,
+                              "add rule " NFT_TABLE " %s ether daddr %s "
+                              "ether type ip ip protocol udp",
+                              chain_out,
+                              (ctr == 0) ? macaddr_str : "ff:ff:ff:ff:ff:ff");
+            if (dhcpserver)
+                virBufferAsprintf(&buf, " ip saddr %s", dhcpserver);
+            virBufferAddLit(&buf, " th sport 67 th dport 68 accept\n");
+        }
+
+        idx++;
+
+        if (idx >= num_dhcpsrvrs)
+            break;
+    }
+
+    virBufferAsprintf(&buf, "add rule " NFT_TABLE " %s drop\n", chain_out);
+
+    if (nftablesRunScript(&buf) < 0) {
+        nftablesAllTeardown(ifname);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * nftablesApplyDropAllRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ *
+ * Returns 0 on success, -1 on failure with the rules removed
+ *
+ * Apply filtering rules so that the VM cannot receive or send traffic.
+ */
+static int
+nftablesApplyDropAllRules(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    if (nftablesPrepareBasicRules(&buf, ifname, false) < 0)
+        return -1;
+
+    for (i = NFTABLES_HOOK_L2_IN; i <= NFTABLES_HOOK_L2_OUT; i++) {
+        g_autofree char *chain = nftablesRootChain(i, ifname, false);
+
+        virBufferAsprintf(&buf, "add rule " NFT_TABLE " %s drop\n", chain);
+    }
+
+    if (nftablesRunScript(&buf) < 0) {
+        nftablesAllTeardown(ifname);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesRemoveBasicRules(const char *ifname)
+{
+    return nftablesAllTeardown(ifname);
+}
+
+
+static int
+nftablesDriverInit(bool privileged)
+{
+    g_autoptr(virCommand) cmd = NULL;
+
+    if (!privileged)
+        return 0;
+
+    cmd = virCommandNewArgList(NFT_PATH, "--version", NULL);
+    if (virCommandRun(cmd, NULL) < 0)
+        return -1;
+
+    nftables_driver.flags = TECHDRV_FLAG_INITIALIZED;
+
+    return 0;
+}
+
+
+static void
+nftablesDriverShutdown(void)
+{
+    virMutexLock(&nftablesTransactionsLock);
+    virHashFree(nftablesTransactions);
+    nftablesTransactions = NULL;
+    virMutexUnlock(&nftablesTransactionsLock);
+
+    nftables_driver.flags = 0;
+}
+
+
+virNWFilterTechDriver nftables_driver = {
+    .name = NFTABLES_DRIVER_ID,
+    .flags = 0,
+
+    .init     = nftablesDriverInit,
+    .shutdown = nftablesDriverShutdown,
+
+    .applyNewRules       = nftablesApplyNewRules,
+    .tearNewRules        = nftablesTearNewRules,
+    .tearOldRules        = nftablesTearOldRules,
+    .allTeardown         = nftablesAllTeardown,
+
+    .canApplyBasicRules  = nftablesCanApplyBasicRules,
+    .applyBasicRules     = nftablesApplyBasicRules,
+    .applyDHCPOnlyRules  = nftablesApplyDHCPOnlyRules,
+    .applyDropAllRules   = nftablesApplyDropAllRules,
+    .removeBasicRules    = nftablesRemoveBasicRules,
+};
@@ -49,9 +49,14 @@
 #include "qemu_process.h"
 #include "qemu_firmware.h"
 #include "virutil.h"
+#include "virthreadpool.h"
 
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
 #include <unistd.h>
 #include <stdarg.h>
 #include <sys/utsname.h>
@@ -593,6 +598,7 @@ VIR_ENUM_IMPL(virQEMUCaps,
 
               /* 375 */
               "migration-param.xbzrle-cache-size",
+              "calc-dirty-rate",
     );
 
 
@@ -674,6 +680,9 @@ struct _virQEMUCaps {
     time_t ctime;
     time_t libvirtCtime;
     bool invalidation;
+    /* watch generation of the cache when files checked by
+     * virQEMUCapsIsValid were last found unchanged, not cached */
+    unsigned long long validGeneration;
 
     virBitmapPtr flags;
 
@@ -1090,6 +1099,74 @@ virQEMUCapsProbeHostCPU(virArch hostArch,
 }
 
 
+/* Upper limit on QEMU binaries probed for capabilities at once */
+#define QEMU_CAPS_PROBE_WORKERS_MAX 8
+
+typedef struct _virQEMUCapsProbeData virQEMUCapsProbeData;
+typedef virQEMUCapsProbeData *virQEMUCapsProbeDataPtr;
+struct _virQEMUCapsProbeData {
+    virFileCachePtr cache;
+    char **binaries;
+};
+
+
+static int
+virQEMUCapsProbeWorker(size_t i,
+                       void *opaque)
+{
+    virQEMUCapsProbeDataPtr data = opaque;
+    virQEMUCapsPtr qemuCaps;
+
+    /* Errors are reported once the capabilities are looked up again */
+    if (!(qemuCaps = virQEMUCapsCacheLookup(data->cache,
+                                            data->binaries[i])))
+        virResetLastError();
+    virObjectUnref(qemuCaps);
+
+    return 0;
+}
+
+
+/*
+ * Fill @cache with the capabilities of all QEMU binaries found for the
+ * guest architectures. Probing a binary takes a while since it has to
+ * be started, so up to QEMU_CAPS_PROBE_WORKERS_MAX binaries are probed
+ * at once rather than one after another while the capabilities of the
+ * host are built.
+ */
+static void
+virQEMUCapsProbeAll(virFileCachePtr cache,
+                    virArch hostarch)
+{
+    virQEMUCapsProbeData data = { .cache = cache };
+    VIR_AUTOSTRINGLIST binaries = NULL;
+    size_t nbinaries;
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        g_autofree char *binary = virQEMUCapsGetDefaultEmulator(hostarch, i);
+
+        if (binary &&
+            !virStringListHasString((const char **)binaries, binary) &&
+            virStringListAdd(&binaries, binary) < 0)
+            return;
+    }
+
+    data.binaries = binaries;
+    nbinaries = virStringListLength((const char **)binaries);
+
+    /* A single binary is probed when the guest list is built */
+    if (nbinaries <= 1)
+        return;
+
+    ignore_value(virThreadPoolRunParallel(nbinaries,
+                                          QEMU_CAPS_PROBE_WORKERS_MAX,
+                                          "qemu-caps-probe",
+                                          virQEMUCapsProbeWorker,
+                                          &data, 0));
+}
+
+
 virCapsPtr
 virQEMUCapsInit(virFileCachePtr cache)
 {
@@ -1119,6 +1196,8 @@ virQEMUCapsInit(virFileCachePtr cache)
     virCapabilitiesAddHostMigrateTransport(caps, "tcp");
     virCapabilitiesAddHostMigrateTransport(caps, "rdma");
 
+    virQEMUCapsProbeAll(cache, hostarch);
+
     /* QEMU can support pretty much every arch that exists,
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
@@ -1163,6 +1242,7 @@ struct virQEMUCapsStringFlags virQEMUCapsCommands[] = {
     { "block-dirty-bitmap-merge", QEMU_CAPS_BITMAP_MERGE },
     { "query-cpu-model-baseline", QEMU_CAPS_QUERY_CPU_MODEL_BASELINE },
     { "query-cpu-model-comparison", QEMU_CAPS_QUERY_CPU_MODEL_COMPARISON },
+    { "calc-dirty-rate", QEMU_CAPS_CALC_DIRTY_RATE },
 };
 
 struct virQEMUCapsStringFlags virQEMUCapsMigration[] = {
@@ -1815,6 +1895,18 @@ virQEMUCapsSetInvalidation(virQEMUCapsPtr qemuCaps,
 }
 
 
+/* Pretends @qemuCaps were probed by this libvirt from a binary
+ * changed at @ctime. */
+void
+virQEMUCapsSetTimestamps(virQEMUCapsPtr qemuCaps,
+                         time_t ctime)
+{
+    qemuCaps->ctime = ctime;
+    qemuCaps->libvirtCtime = virGetSelfLastChanged();
+    qemuCaps->libvirtVersion = LIBVIR_VERSION_NUMBER;
+}
+
+
 static int
 virQEMUCapsHostCPUDataCopy(virQEMUCapsHostCPUDataPtr dst,
                            virQEMUCapsHostCPUDataPtr src)
@@ -4120,6 +4212,13 @@ struct _virQEMUCapsCachePriv {
     /* cache whether /dev/kvm is usable as runUid:runGuid */
     virTristateBool kvmUsable;
     time_t kvmCtime;
+
+    /* inotify instance watching the files checked by virQEMUCapsIsValid,
+     * the generation is increased whenever any of the files changes */
+    int watchFd;
+    virHashTablePtr watchDirs;  /* watch descriptor -> directory */
+    virHashTablePtr watchFiles; /* watched file paths */
+    unsigned long long watchGeneration;
 };
 typedef struct _virQEMUCapsCachePriv virQEMUCapsCachePriv;
 typedef virQEMUCapsCachePriv *virQEMUCapsCachePrivPtr;
@@ -4133,10 +4232,202 @@ virQEMUCapsCachePrivFree(void *privData)
     VIR_FREE(priv->libDir);
     VIR_FREE(priv->kernelVersion);
     VIR_FREE(priv->hostCPUSignature);
+    VIR_FORCE_CLOSE(priv->watchFd);
+    virHashFree(priv->watchDirs);
+    virHashFree(priv->watchFiles);
     VIR_FREE(priv);
 }
 
 
+#ifdef HAVE_SYS_INOTIFY_H
+# define QEMU_CAPS_WATCH_EVENTS \
+    (IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+     IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static int
+virQEMUCapsCacheWatchInit(virQEMUCapsCachePrivPtr priv)
+{
+    if (!(priv->watchDirs = virHashCreate(10, virHashValueFree)) ||
+        !(priv->watchFiles = virHashCreate(10, NULL)))
+        return -1;
+
+    priv->watchGeneration = 1;
+
+    if ((priv->watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        VIR_DEBUG("Cannot watch QEMU binaries, changes will be checked "
+                  "on every lookup: %s", g_strerror(errno));
+    }
+
+    return 0;
+}
+
+
+/* Starts watching @path for changes. Returns false if it can't be
+ * watched, in which case virQEMUCapsIsValid has to check it every time. */
+static bool
+virQEMUCapsCacheWatchFile(virQEMUCapsCachePrivPtr priv,
+                          const char *path)
+{
+    g_autofree char *dir = NULL;
+    g_autofree char *key = NULL;
+    int wd;
+
+    if (priv->watchFd < 0)
+        return false;
+
+    if (virHashLookup(priv->watchFiles, path))
+        return true;
+
+    /* Watch the directory rather than the file itself so that we see
+     * the file being replaced too */
+    dir = g_path_get_dirname(path);
+    if ((wd = inotify_add_watch(priv->watchFd, dir, QEMU_CAPS_WATCH_EVENTS)) < 0) {
+        VIR_DEBUG("Cannot watch '%s': %s", dir, g_strerror(errno));
+        return false;
+    }
+
+    key = g_strdup_printf("%d", wd);
+    if (!virHashLookup(priv->watchDirs, key)) {
+        if (virHashAddEntry(priv->watchDirs, key, dir) < 0)
+            goto error;
+        dir = NULL;
+    }
+
+    if (virHashAddEntry(priv->watchFiles, path, (void *)1) < 0)
+        goto error;
+
+    return true;
+
+ error:
+    virResetLastError();
+    return false;
+}
+
+
+static int
+virQEMUCapsCacheWatchRemove(void *payload G_GNUC_UNUSED,
+                            const void *name,
+                            void *opaque)
+{
+    virQEMUCapsCachePrivPtr priv = opaque;
+    int wd;
+
+    if (virStrToLong_i(name, NULL, 10, &wd) == 0)
+        inotify_rm_watch(priv->watchFd, wd);
+
+    return 0;
+}
+
+
+/* Drops all watches, they will be added again by virQEMUCapsIsValid
+ * once it checked the files. */
+static void
+virQEMUCapsCacheWatchReset(virQEMUCapsCachePrivPtr priv)
+{
+    virHashForEach(priv->watchDirs, virQEMUCapsCacheWatchRemove, priv);
+    virHashRemoveAll(priv->watchDirs);
+    virHashRemoveAll(priv->watchFiles);
+    priv->watchGeneration++;
+}
+
+
+static void
+virQEMUCapsCacheWatchEvent(virQEMUCapsCachePrivPtr priv,
+                           const struct inotify_event *ev)
+{
+    g_autofree char *key = NULL;
+    g_autofree char *path = NULL;
+    const char *dir;
+
+    if (ev->mask & IN_Q_OVERFLOW) {
+        VIR_DEBUG("Lost QEMU binaries watch events");
+        virQEMUCapsCacheWatchReset(priv);
+        return;
+    }
+
+    /* ignore leftover events of watches we dropped */
+    key = g_strdup_printf("%d", ev->wd);
+    if (!(dir = virHashLookup(priv->watchDirs, key)))
+        return;
+
+    if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+        VIR_DEBUG("Watched directory '%s' is gone (mask 0x%x)", dir, ev->mask);
+        virQEMUCapsCacheWatchReset(priv);
+        return;
+    }
+
+    if (ev->len == 0)
+        return;
+
+    path = g_strdup_printf("%s/%s", STREQ(dir, "/") ? "" : dir, ev->name);
+    if (virHashLookup(priv->watchFiles, path)) {
+        VIR_DEBUG("'%s' changed (mask 0x%x)", path, ev->mask);
+        priv->watchGeneration++;
+    }
+}
+
+
+/* Processes all pending changes of the watched files. */
+static void
+virQEMUCapsCacheWatchUpdate(virQEMUCapsCachePrivPtr priv)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    if (priv->watchFd < 0)
+        return;
+
+    while (true) {
+        char *p;
+
+        if ((len = read(priv->watchFd, buf, sizeof(buf))) < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return;
+
+            VIR_WARN("Cannot read QEMU binaries watch, changes will be "
+                     "checked on every lookup: %s", g_strerror(errno));
+            VIR_FORCE_CLOSE(priv->watchFd);
+            priv->watchGeneration++;
+            return;
+        }
+
+        for (p = buf; p < buf + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+
+            virQEMUCapsCacheWatchEvent(priv, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+#else /* !HAVE_SYS_INOTIFY_H */
+
+static int
+virQEMUCapsCacheWatchInit(virQEMUCapsCachePrivPtr priv)
+{
+    priv->watchFd = -1;
+    priv->watchGeneration = 1;
+    return 0;
+}
+
+
+static bool
+virQEMUCapsCacheWatchFile(virQEMUCapsCachePrivPtr priv G_GNUC_UNUSED,
+                          const char *path G_GNUC_UNUSED)
+{
+    return false;
+}
+
+
+static void
+virQEMUCapsCacheWatchUpdate(virQEMUCapsCachePrivPtr priv G_GNUC_UNUSED)
+{
+}
+#endif /* !HAVE_SYS_INOTIFY_H */
+
+
 static int
 virQEMUCapsParseSEVInfo(virQEMUCapsPtr qemuCaps, xmlXPathContextPtr ctxt)
 {
@@ -4665,144 +4956,849 @@ virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps)
 }
 
 
-static int
-virQEMUCapsSaveFile(void *data,
-                    const char *filename,
-                    void *privData G_GNUC_UNUSED)
-{
-    virQEMUCapsPtr qemuCaps = data;
-    char *xml = NULL;
-    int ret = -1;
-
-    xml = virQEMUCapsFormatCache(qemuCaps);
+/*
+ * The capabilities cache files written by the daemon use a compact binary
+ * representation of the same data virQEMUCapsFormatCache stores in XML, so
+ * that loading them on daemon startup doesn't require parsing a large XML
+ * document for every emulator.
+ *
+ * All values are stored in host byte order, strings are prefixed by their
+ * length + 1 with 0 denoting a NULL string. The format is bound to a single
+ * libvirt build, because capabilities flags are stored as their numeric
+ * values; files written by a different build are rejected and the
+ * capabilities are probed again.
+ */
+#define QEMU_CAPS_CACHE_MAGIC "LVQCAPS"
+#define QEMU_CAPS_CACHE_VERSION 1
+
+typedef struct _virQEMUCapsCacheReader virQEMUCapsCacheReader;
+typedef virQEMUCapsCacheReader *virQEMUCapsCacheReaderPtr;
+struct _virQEMUCapsCacheReader {
+    const char *data;
+    size_t len;
+    size_t pos;
+};
 
-    if (virFileWriteStr(filename, xml, 0600) < 0) {
-        virReportSystemError(errno,
-                             _("Failed to save '%s' for '%s'"),
-                             filename, qemuCaps->binary);
-        goto cleanup;
-    }
 
-    VIR_DEBUG("Saved caps '%s' for '%s' with (%lld, %lld)",
-              filename, qemuCaps->binary,
-              (long long)qemuCaps->ctime,
-              (long long)qemuCaps->libvirtCtime);
+static void
+virQEMUCapsCacheWriteUInt(GByteArray *buf,
+                          unsigned int val)
+{
+    uint32_t v = val;
 
-    ret = 0;
- cleanup:
-    VIR_FREE(xml);
-    return ret;
+    g_byte_array_append(buf, (const guint8 *)&v, sizeof(v));
 }
 
 
-/*
- * Check whether IBM Secure Execution (S390) is enabled
- */
-static bool
-virQEMUCapsKVMSupportsSecureGuestS390(void)
+static void
+virQEMUCapsCacheWriteULLong(GByteArray *buf,
+                            unsigned long long val)
 {
+    uint64_t v = val;
 
-    g_autofree char *cmdline = NULL;
-    static const char *kValues[] = {"y", "Y", "on", "ON", "oN", "On", "1"};
-
-    if (!virFileIsDir("/sys/firmware/uv"))
-        return false;
+    g_byte_array_append(buf, (const guint8 *)&v, sizeof(v));
+}
 
-    if (virFileReadValueString(&cmdline, "/proc/cmdline") < 0)
-        return false;
 
-    /* we're prefix matching rather than equality matching here, because kernel
-     * would treat even something like prot_virt='yFOO' as enabled */
-    if (virKernelCmdlineMatchParam(cmdline, "prot_virt", kValues,
-                                   G_N_ELEMENTS(kValues),
-                                   VIR_KERNEL_CMDLINE_FLAGS_SEARCH_FIRST |
-                                   VIR_KERNEL_CMDLINE_FLAGS_CMP_PREFIX))
-        return true;
+static void
+virQEMUCapsCacheWriteBool(GByteArray *buf,
+                          bool val)
+{
+    uint8_t v = val;
 
-    return false;
+    g_byte_array_append(buf, &v, sizeof(v));
 }
 
 
-/*
- * Check whether AMD Secure Encrypted Virtualization (x86) is enabled
- */
-static bool
-virQEMUCapsKVMSupportsSecureGuestAMD(void)
+static void
+virQEMUCapsCacheWriteString(GByteArray *buf,
+                            const char *str)
 {
-    g_autofree char *modValue = NULL;
+    size_t len = str ? strlen(str) : 0;
 
-    if (virFileReadValueString(&modValue, "/sys/module/kvm_amd/parameters/sev") < 0)
-        return false;
+    virQEMUCapsCacheWriteUInt(buf, str ? len + 1 : 0);
+    if (len > 0)
+        g_byte_array_append(buf, (const guint8 *)str, len);
+}
 
-    if (modValue[0] != '1')
-        return false;
 
-    if (virFileExists(QEMU_DEV_SEV))
-        return true;
+static int
+virQEMUCapsCacheReadBytes(virQEMUCapsCacheReaderPtr rd,
+                          void *val,
+                          size_t len)
+{
+    if (len > rd->len - rd->pos) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("truncated QEMU capabilities cache"));
+        return -1;
+    }
 
-    return false;
+    memcpy(val, rd->data + rd->pos, len);
+    rd->pos += len;
+    return 0;
 }
 
 
-/*
- * Check whether the secure guest functionality is enabled.
- * See the specific architecture function for details on the verifications made.
- */
-static bool
-virQEMUCapsKVMSupportsSecureGuest(void)
+static int
+virQEMUCapsCacheReadUInt(virQEMUCapsCacheReaderPtr rd,
+                         unsigned int *val)
 {
-    virArch arch = virArchFromHost();
-
-    if (ARCH_IS_S390(arch))
-        return virQEMUCapsKVMSupportsSecureGuestS390();
+    uint32_t v;
 
-    if (ARCH_IS_X86(arch))
-        return virQEMUCapsKVMSupportsSecureGuestAMD();
+    if (virQEMUCapsCacheReadBytes(rd, &v, sizeof(v)) < 0)
+        return -1;
 
-    return false;
+    *val = v;
+    return 0;
 }
 
 
-/* Check the kernel module parameters 'nested' file to determine if enabled
- *
- *   Intel: 'kvm_intel' uses 'Y'
- *   AMD:   'kvm_amd' uses '1'
- *   PPC64: 'kvm_hv' uses 'Y'
- *   S390:  'kvm' uses '1'
- */
-static bool
-virQEMUCapsKVMSupportsNesting(void)
+/* Reads a number of elements which follow in the cache. Every element
+ * takes at least one byte, which protects us from allocating huge arrays
+ * when reading a corrupted file. */
+static int
+virQEMUCapsCacheReadCount(virQEMUCapsCacheReaderPtr rd,
+                          size_t *count)
 {
-    static char const * const kmod[] = {"kvm_intel", "kvm_amd",
-                                        "kvm_hv", "kvm"};
-    g_autofree char *value = NULL;
-    int rc;
-    size_t i;
+    unsigned int n;
 
-    for (i = 0; i < G_N_ELEMENTS(kmod); i++) {
-        VIR_FREE(value);
-        rc = virFileReadValueString(&value, "/sys/module/%s/parameters/nested",
-                                    kmod[i]);
-        if (rc == -2)
-            continue;
-        if (rc < 0) {
-            virResetLastError();
-            return false;
-        }
+    if (virQEMUCapsCacheReadUInt(rd, &n) < 0)
+        return -1;
 
-        if (value[0] == 'Y' || value[0] == 'y' || value[0] == '1')
-            return true;
+    if (n > rd->len - rd->pos) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("malformed QEMU capabilities cache"));
+        return -1;
     }
 
-    return false;
+    *count = n;
+    return 0;
 }
 
 
-/* Determine whether '/dev/kvm' is usable as QEMU user:QEMU group. */
-static bool
-virQEMUCapsKVMUsable(virQEMUCapsCachePrivPtr priv)
+static int
+virQEMUCapsCacheReadULLong(virQEMUCapsCacheReaderPtr rd,
+                           unsigned long long *val)
 {
-    struct stat sb;
+    uint64_t v;
+
+    if (virQEMUCapsCacheReadBytes(rd, &v, sizeof(v)) < 0)
+        return -1;
+
+    *val = v;
+    return 0;
+}
+
+
+static int
+virQEMUCapsCacheReadBool(virQEMUCapsCacheReaderPtr rd,
+                         bool *val)
+{
+    uint8_t v;
+
+    if (virQEMUCapsCacheReadBytes(rd, &v, sizeof(v)) < 0)
+        return -1;
+
+    if (v > 1) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("malformed QEMU capabilities cache"));
+        return -1;
+    }
+
+    *val = v;
+    return 0;
+}
+
+
+static int
+virQEMUCapsCacheReadString(virQEMUCapsCacheReaderPtr rd,
+                           char **str)
+{
+    unsigned int len;
+
+    *str = NULL;
+
+    if (virQEMUCapsCacheReadUInt(rd, &len) < 0)
+        return -1;
+
+    if (len == 0)
+        return 0;
+
+    if (len - 1 > rd->len - rd->pos) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("truncated QEMU capabilities cache"));
+        return -1;
+    }
+
+    *str = g_strndup(rd->data + rd->pos, len - 1);
+    rd->pos += len - 1;
+    return 0;
+}
+
+
+static void
+virQEMUCapsFormatAccelBinary(virQEMUCapsPtr qemuCaps,
+                             GByteArray *buf,
+                             virDomainVirtType type)
+{
+    virQEMUCapsAccelPtr caps = virQEMUCapsGetAccel(qemuCaps, type);
+    qemuMonitorCPUModelInfoPtr model = caps->hostCPU.info;
+    qemuMonitorCPUDefsPtr defs = caps->cpuModels;
+    size_t i;
+
+    virQEMUCapsCacheWriteBool(buf, !!model);
+    if (model) {
+        virQEMUCapsCacheWriteString(buf, model->name);
+        virQEMUCapsCacheWriteBool(buf, model->migratability);
+        virQEMUCapsCacheWriteUInt(buf, model->nprops);
+
+        for (i = 0; i < model->nprops; i++) {
+            qemuMonitorCPUPropertyPtr prop = model->props + i;
+
+            virQEMUCapsCacheWriteString(buf, prop->name);
+            virQEMUCapsCacheWriteUInt(buf, prop->type);
+
+            switch (prop->type) {
+            case QEMU_MONITOR_CPU_PROPERTY_BOOLEAN:
+                virQEMUCapsCacheWriteBool(buf, prop->value.boolean);
+                break;
+
+            case QEMU_MONITOR_CPU_PROPERTY_STRING:
+                virQEMUCapsCacheWriteString(buf, prop->value.string);
+                break;
+
+            case QEMU_MONITOR_CPU_PROPERTY_NUMBER:
+                virQEMUCapsCacheWriteULLong(buf, prop->value.number);
+                break;
+
+            case QEMU_MONITOR_CPU_PROPERTY_LAST:
+                break;
+            }
+
+            virQEMUCapsCacheWriteUInt(buf, prop->migratable);
+        }
+    }
+
+    virQEMUCapsCacheWriteUInt(buf, defs ? defs->ncpus : 0);
+    for (i = 0; defs && i < defs->ncpus; i++) {
+        qemuMonitorCPUDefInfoPtr cpu = defs->cpus + i;
+
+        virQEMUCapsCacheWriteString(buf, cpu->name);
+        virQEMUCapsCacheWriteString(buf, cpu->type);
+        virQEMUCapsCacheWriteUInt(buf, cpu->usable);
+
+        virQEMUCapsCacheWriteBool(buf, !!cpu->blockers);
+        if (cpu->blockers) {
+            size_t j;
+
+            virQEMUCapsCacheWriteUInt(buf, virStringListLength((const char **)cpu->blockers));
+            for (j = 0; cpu->blockers[j]; j++)
+                virQEMUCapsCacheWriteString(buf, cpu->blockers[j]);
+        }
+    }
+
+    virQEMUCapsCacheWriteUInt(buf, caps->nmachineTypes);
+    for (i = 0; i < caps->nmachineTypes; i++) {
+        virQEMUCapsMachineTypePtr machine = caps->machineTypes + i;
+
+        virQEMUCapsCacheWriteString(buf, machine->name);
+        virQEMUCapsCacheWriteString(buf, machine->alias);
+        virQEMUCapsCacheWriteUInt(buf, machine->maxCpus);
+        virQEMUCapsCacheWriteBool(buf, machine->hotplugCpus);
+        virQEMUCapsCacheWriteBool(buf, machine->qemuDefault);
+        virQEMUCapsCacheWriteString(buf, machine->defaultCPU);
+        virQEMUCapsCacheWriteBool(buf, machine->numaMemSupported);
+    }
+}
+
+
+/**
+ * virQEMUCapsFormatCacheBinary:
+ * @qemuCaps: QEMU capabilities
+ *
+ * Formats @qemuCaps into the binary representation used by the
+ * capabilities cache files.
+ *
+ * Returns a new byte array which the caller has to free.
+ */
+GByteArray *
+virQEMUCapsFormatCacheBinary(virQEMUCapsPtr qemuCaps)
+{
+    GByteArray *buf = g_byte_array_new();
+    size_t i;
+
+    g_byte_array_append(buf, (const guint8 *)QEMU_CAPS_CACHE_MAGIC,
+                        sizeof(QEMU_CAPS_CACHE_MAGIC));
+    virQEMUCapsCacheWriteUInt(buf, QEMU_CAPS_CACHE_VERSION);
+    virQEMUCapsCacheWriteUInt(buf, QEMU_CAPS_LAST);
+
+    virQEMUCapsCacheWriteString(buf, qemuCaps->binary);
+    virQEMUCapsCacheWriteULLong(buf, qemuCaps->ctime);
+    virQEMUCapsCacheWriteULLong(buf, qemuCaps->libvirtCtime);
+    virQEMUCapsCacheWriteUInt(buf, qemuCaps->libvirtVersion);
+
+    virQEMUCapsCacheWriteUInt(buf, virBitmapCountBits(qemuCaps->flags));
+    for (i = 0; i < QEMU_CAPS_LAST; i++) {
+        if (virQEMUCapsGet(qemuCaps, i))
+            virQEMUCapsCacheWriteUInt(buf, i);
+    }
+
+    virQEMUCapsCacheWriteUInt(buf, qemuCaps->version);
+    virQEMUCapsCacheWriteUInt(buf, qemuCaps->kvmVersion);
+    virQEMUCapsCacheWriteUInt(buf, qemuCaps->microcodeVersion);
+    virQEMUCapsCacheWriteString(buf, qemuCaps->hostCPUSignature);
+    virQEMUCapsCacheWriteString(buf, qemuCaps->package);
+    virQEMUCapsCacheWriteString(buf, qemuCaps->kernelVersion);
+    virQEMUCapsCacheWriteString(buf, virArchToString(qemuCaps->arch));
+
+    virQEMUCapsFormatAccelBinary(qemuCaps, buf, VIR_DOMAIN_VIRT_KVM);
+    virQEMUCapsFormatAccelBinary(qemuCaps, buf, VIR_DOMAIN_VIRT_QEMU);
+
+    virQEMUCapsCacheWriteUInt(buf, qemuCaps->ngicCapabilities);
+    for (i = 0; i < qemuCaps->ngicCapabilities; i++) {
+        virQEMUCapsCacheWriteUInt(buf, qemuCaps->gicCapabilities[i].version);
+        virQEMUCapsCacheWriteUInt(buf, qemuCaps->gicCapabilities[i].implementation);
+    }
+
+    virQEMUCapsCacheWriteBool(buf, !!qemuCaps->sevCapabilities);
+    if (qemuCaps->sevCapabilities) {
+        virSEVCapabilityPtr sev = qemuCaps->sevCapabilities;
+
+        virQEMUCapsCacheWriteUInt(buf, sev->cbitpos);
+        virQEMUCapsCacheWriteUInt(buf, sev->reduced_phys_bits);
+        virQEMUCapsCacheWriteString(buf, sev->pdh);
+        virQEMUCapsCacheWriteString(buf, sev->cert_chain);
+    }
+
+    virQEMUCapsCacheWriteBool(buf, qemuCaps->kvmSupportsNesting);
+    virQEMUCapsCacheWriteBool(buf, qemuCaps->kvmSupportsSecureGuest);
+
+    return buf;
+}
+
+
+static int
+virQEMUCapsLoadHostCPUModelInfoBinary(virQEMUCapsAccelPtr caps,
+                                      virQEMUCapsCacheReaderPtr rd)
+{
+    qemuMonitorCPUModelInfoPtr hostCPU = NULL;
+    bool present;
+    size_t i;
+    int ret = -1;
+
+    if (virQEMUCapsCacheReadBool(rd, &present) < 0)
+        return -1;
+
+    if (!present)
+        return 0;
+
+    if (VIR_ALLOC(hostCPU) < 0)
+        goto cleanup;
+
+    if (virQEMUCapsCacheReadString(rd, &hostCPU->name) < 0 ||
+        virQEMUCapsCacheReadBool(rd, &hostCPU->migratability) < 0 ||
+        virQEMUCapsCacheReadCount(rd, &hostCPU->nprops) < 0)
+        goto cleanup;
+
+    if (hostCPU->nprops > 0 &&
+        VIR_ALLOC_N(hostCPU->props, hostCPU->nprops) < 0)
+        goto cleanup;
+
+    for (i = 0; i < hostCPU->nprops; i++) {
+        qemuMonitorCPUPropertyPtr prop = hostCPU->props + i;
+        unsigned long long number;
+        unsigned int val;
+
+        if (virQEMUCapsCacheReadString(rd, &prop->name) < 0 ||
+            virQEMUCapsCacheReadUInt(rd, &val) < 0)
+            goto cleanup;
+
+        if (val >= QEMU_MONITOR_CPU_PROPERTY_LAST) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("invalid CPU model property type "
+                             "in QEMU capabilities cache"));
+            goto cleanup;
+        }
+        prop->type = val;
+
+        switch (prop->type) {
+        case QEMU_MONITOR_CPU_PROPERTY_BOOLEAN:
+            if (virQEMUCapsCacheReadBool(rd, &prop->value.boolean) < 0)
+                goto cleanup;
+            break;
+
+        case QEMU_MONITOR_CPU_PROPERTY_STRING:
+            if (virQEMUCapsCacheReadString(rd, &prop->value.string) < 0)
+                goto cleanup;
+            break;
+
+        case QEMU_MONITOR_CPU_PROPERTY_NUMBER:
+            if (virQEMUCapsCacheReadULLong(rd, &number) < 0)
+                goto cleanup;
+            prop->value.number = number;
+            break;
+
+        case QEMU_MONITOR_CPU_PROPERTY_LAST:
+            break;
+        }
+
+        if (virQEMUCapsCacheReadUInt(rd, &val) < 0)
+            goto cleanup;
+
+        if (val >= VIR_TRISTATE_BOOL_LAST) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("unknown migratable value for '%s' host "
+                             "CPU model property"),
+                           prop->name);
+            goto cleanup;
+        }
+        prop->migratable = val;
+    }
+
+    if (!hostCPU->name) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("missing host CPU model name in QEMU "
+                         "capabilities cache"));
+        goto cleanup;
+    }
+
+    caps->hostCPU.info = g_steal_pointer(&hostCPU);
+    ret = 0;
+
+ cleanup:
+    qemuMonitorCPUModelInfoFree(hostCPU);
+    return ret;
+}
+
+
+static int
+virQEMUCapsLoadCPUModelsBinary(virQEMUCapsAccelPtr caps,
+                               virQEMUCapsCacheReaderPtr rd)
+{
+    g_autoptr(qemuMonitorCPUDefs) defs = NULL;
+    size_t ncpus;
+    size_t i;
+
+    if (virQEMUCapsCacheReadCount(rd, &ncpus) < 0)
+        return -1;
+
+    if (ncpus == 0)
+        return 0;
+
+    if (!(defs = qemuMonitorCPUDefsNew(ncpus)))
+        return -1;
+
+    for (i = 0; i < ncpus; i++) {
+        qemuMonitorCPUDefInfoPtr cpu = defs->cpus + i;
+        unsigned int usable;
+        bool hasBlockers;
+
+        if (virQEMUCapsCacheReadString(rd, &cpu->name) < 0 ||
+            virQEMUCapsCacheReadString(rd, &cpu->type) < 0 ||
+            virQEMUCapsCacheReadUInt(rd, &usable) < 0 ||
+            virQEMUCapsCacheReadBool(rd, &hasBlockers) < 0)
+            return -1;
+
+        if (!cpu->name) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("missing cpu name in QEMU capabilities cache"));
+            return -1;
+        }
+
+        if (usable >= VIR_DOMCAPS_CPU_USABLE_LAST) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("unknown usability of CPU model '%s' in QEMU "
+                             "capabilities cache"), cpu->name);
+            return -1;
+        }
+        cpu->usable = usable;
+
+        if (hasBlockers) {
+            size_t nblockers;
+            size_t j;
+
+            if (virQEMUCapsCacheReadCount(rd, &nblockers) < 0)
+                return -1;
+
+            if (VIR_ALLOC_N(cpu->blockers, nblockers + 1) < 0)
+                return -1;
+
+            for (j = 0; j < nblockers; j++) {
+                if (virQEMUCapsCacheReadString(rd, &cpu->blockers[j]) < 0)
+                    return -1;
+
+                if (!cpu->blockers[j]) {
+                    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                                   _("missing blocker name in QEMU "
+                                     "capabilities cache"));
+                    return -1;
+                }
+            }
+        }
+    }
+
+    caps->cpuModels = g_steal_pointer(&defs);
+    return 0;
+}
+
+
+static int
+virQEMUCapsLoadMachinesBinary(virQEMUCapsAccelPtr caps,
+                              virQEMUCapsCacheReaderPtr rd)
+{
+    size_t n;
+    size_t i;
+
+    if (virQEMUCapsCacheReadCount(rd, &n) < 0)
+        return -1;
+
+    if (n == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(caps->machineTypes, n) < 0)
+        return -1;
+    caps->nmachineTypes = n;
+
+    for (i = 0; i < n; i++) {
+        virQEMUCapsMachineTypePtr machine = caps->machineTypes + i;
+
+        if (virQEMUCapsCacheReadString(rd, &machine->name) < 0 ||
+            virQEMUCapsCacheReadString(rd, &machine->alias) < 0 ||
+            virQEMUCapsCacheReadUInt(rd, &machine->maxCpus) < 0 ||
+            virQEMUCapsCacheReadBool(rd, &machine->hotplugCpus) < 0 ||
+            virQEMUCapsCacheReadBool(rd, &machine->qemuDefault) < 0 ||
+            virQEMUCapsCacheReadString(rd, &machine->defaultCPU) < 0 ||
+            virQEMUCapsCacheReadBool(rd, &machine->numaMemSupported) < 0)
+            return -1;
+
+        if (!machine->name) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("missing machine name in QEMU capabilities cache"));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virQEMUCapsLoadAccelBinary(virQEMUCapsPtr qemuCaps,
+                           virQEMUCapsCacheReaderPtr rd,
+                           virDomainVirtType type)
+{
+    virQEMUCapsAccelPtr caps = virQEMUCapsGetAccel(qemuCaps, type);
+
+    if (virQEMUCapsLoadHostCPUModelInfoBinary(caps, rd) < 0 ||
+        virQEMUCapsLoadCPUModelsBinary(caps, rd) < 0 ||
+        virQEMUCapsLoadMachinesBinary(caps, rd) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virQEMUCapsLoadCacheBinary:
+ * @hostArch: host architecture
+ * @qemuCaps: QEMU capabilities to fill in
+ * @data: binary cache data created by virQEMUCapsFormatCacheBinary
+ * @len: length of @data
+ *
+ * The binary counterpart of virQEMUCapsLoadCache.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virQEMUCapsLoadCacheBinary(virArch hostArch,
+                           virQEMUCapsPtr qemuCaps,
+                           const char *data,
+                           size_t len)
+{
+    virQEMUCapsCacheReader rd = { data, len, 0 };
+    char magic[sizeof(QEMU_CAPS_CACHE_MAGIC)];
+    g_autofree char *str = NULL;
+    unsigned long long ull;
+    unsigned int version;
+    unsigned int capsLast;
+    bool hasSEV;
+    size_t n;
+    size_t i;
+
+    if (virQEMUCapsCacheReadBytes(&rd, magic, sizeof(magic)) < 0 ||
+        memcmp(magic, QEMU_CAPS_CACHE_MAGIC, sizeof(magic)) != 0) {
+        virResetLastError();
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("not a QEMU capabilities cache"));
+        return -1;
+    }
+
+    if (virQEMUCapsCacheReadUInt(&rd, &version) < 0 ||
+        virQEMUCapsCacheReadUInt(&rd, &capsLast) < 0)
+        return -1;
+
+    if (version != QEMU_CAPS_CACHE_VERSION || capsLast != QEMU_CAPS_LAST) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unsupported QEMU capabilities cache format "
+                         "(version %u, %u flags)"), version, capsLast);
+        return -1;
+    }
+
+    if (virQEMUCapsCacheReadString(&rd, &str) < 0)
+        return -1;
+
+    if (STRNEQ_NULLABLE(str, qemuCaps->binary)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Expected caps for '%s' but saw '%s'"),
+                       qemuCaps->binary, NULLSTR(str));
+        return -1;
+    }
+    VIR_FREE(str);
+
+    if (virQEMUCapsCacheReadULLong(&rd, &ull) < 0)
+        return -1;
+    qemuCaps->ctime = (time_t)ull;
+
+    if (virQEMUCapsCacheReadULLong(&rd, &ull) < 0)
+        return -1;
+    qemuCaps->libvirtCtime = (time_t)ull;
+
+    if (virQEMUCapsCacheReadUInt(&rd, &qemuCaps->libvirtVersion) < 0 ||
+        virQEMUCapsCacheReadCount(&rd, &n) < 0)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        unsigned int flag;
+
+        if (virQEMUCapsCacheReadUInt(&rd, &flag) < 0)
+            return -1;
+
+        if (flag >= QEMU_CAPS_LAST) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unknown qemu capabilities flag %u"), flag);
+            return -1;
+        }
+        virQEMUCapsSet(qemuCaps, flag);
+    }
+
+    if (virQEMUCapsCacheReadUInt(&rd, &qemuCaps->version) < 0 ||
+        virQEMUCapsCacheReadUInt(&rd, &qemuCaps->kvmVersion) < 0 ||
+        virQEMUCapsCacheReadUInt(&rd, &qemuCaps->microcodeVersion) < 0 ||
+        virQEMUCapsCacheReadString(&rd, &qemuCaps->hostCPUSignature) < 0 ||
+        virQEMUCapsCacheReadString(&rd, &qemuCaps->package) < 0 ||
+        virQEMUCapsCacheReadString(&rd, &qemuCaps->kernelVersion) < 0 ||
+        virQEMUCapsCacheReadString(&rd, &str) < 0)
+        return -1;
+
+    if (!str || !(qemuCaps->arch = virArchFromString(str))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unknown arch %s in QEMU capabilities cache"),
+                       NULLSTR(str));
+        return -1;
+    }
+
+    if (virQEMUCapsLoadAccelBinary(qemuCaps, &rd, VIR_DOMAIN_VIRT_KVM) < 0 ||
+        virQEMUCapsLoadAccelBinary(qemuCaps, &rd, VIR_DOMAIN_VIRT_QEMU) < 0)
+        return -1;
+
+    if (virQEMUCapsCacheReadCount(&rd, &n) < 0)
+        return -1;
+
+    if (n > 0) {
+        if (VIR_ALLOC_N(qemuCaps->gicCapabilities, n) < 0)
+            return -1;
+        qemuCaps->ngicCapabilities = n;
+
+        for (i = 0; i < n; i++) {
+            virGICCapabilityPtr cap = &qemuCaps->gicCapabilities[i];
+            unsigned int val;
+
+            if (virQEMUCapsCacheReadUInt(&rd, &val) < 0)
+                return -1;
+            cap->version = val;
+
+            if (virQEMUCapsCacheReadUInt(&rd, &val) < 0)
+                return -1;
+            cap->implementation = val;
+        }
+    }
+
+    if (virQEMUCapsCacheReadBool(&rd, &hasSEV) < 0)
+        return -1;
+
+    if (hasSEV) {
+        g_autoptr(virSEVCapability) sev = NULL;
+
+        if (VIR_ALLOC(sev) < 0)
+            return -1;
+
+        if (virQEMUCapsCacheReadUInt(&rd, &sev->cbitpos) < 0 ||
+            virQEMUCapsCacheReadUInt(&rd, &sev->reduced_phys_bits) < 0 ||
+            virQEMUCapsCacheReadString(&rd, &sev->pdh) < 0 ||
+            virQEMUCapsCacheReadString(&rd, &sev->cert_chain) < 0)
+            return -1;
+
+        qemuCaps->sevCapabilities = g_steal_pointer(&sev);
+    }
+
+    if (virQEMUCapsCacheReadBool(&rd, &qemuCaps->kvmSupportsNesting) < 0 ||
+        virQEMUCapsCacheReadBool(&rd, &qemuCaps->kvmSupportsSecureGuest) < 0)
+        return -1;
+
+    if (rd.pos != rd.len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("trailing data in QEMU capabilities cache"));
+        return -1;
+    }
+
+    virQEMUCapsInitHostCPUModel(qemuCaps, hostArch, VIR_DOMAIN_VIRT_KVM);
+    virQEMUCapsInitHostCPUModel(qemuCaps, hostArch, VIR_DOMAIN_VIRT_QEMU);
+
+    return 0;
+}
+
+
+static int
+virQEMUCapsSaveFileWrite(int fd,
+                         const void *opaque)
+{
+    const GByteArray *buf = opaque;
+
+    if (safewrite(fd, buf->data, buf->len) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virQEMUCapsSaveFile(void *data,
+                    const char *filename,
+                    void *privData G_GNUC_UNUSED)
+{
+    virQEMUCapsPtr qemuCaps = data;
+    g_autoptr(GByteArray) buf = virQEMUCapsFormatCacheBinary(qemuCaps);
+
+    if (virFileRewrite(filename, 0600, virQEMUCapsSaveFileWrite, buf) < 0)
+        return -1;
+
+    VIR_DEBUG("Saved caps '%s' for '%s' with (%lld, %lld)",
+              filename, qemuCaps->binary,
+              (long long)qemuCaps->ctime,
+              (long long)qemuCaps->libvirtCtime);
+
+    return 0;
+}
+
+
+/*
+ * Check whether IBM Secure Execution (S390) is enabled
+ */
+static bool
+virQEMUCapsKVMSupportsSecureGuestS390(void)
+{
+
+    g_autofree char *cmdline = NULL;
+    static const char *kValues[] = {"y", "Y", "on", "ON", "oN", "On", "1"};
+
+    if (!virFileIsDir("/sys/firmware/uv"))
+        return false;
+
+    if (virFileReadValueString(&cmdline, "/proc/cmdline") < 0)
+        return false;
+
+    /* we're prefix matching rather than equality matching here, because kernel
+     * would treat even something like prot_virt='yFOO' as enabled */
+    if (virKernelCmdlineMatchParam(cmdline, "prot_virt", kValues,
+                                   G_N_ELEMENTS(kValues),
+                                   VIR_KERNEL_CMDLINE_FLAGS_SEARCH_FIRST |
+                                   VIR_KERNEL_CMDLINE_FLAGS_CMP_PREFIX))
+        return true;
+
+    return false;
+}
+
+
+/*
+ * Check whether AMD Secure Encrypted Virtualization (x86) is enabled
+ */
+static bool
+virQEMUCapsKVMSupportsSecureGuestAMD(void)
+{
+    g_autofree char *modValue = NULL;
+
+    if (virFileReadValueString(&modValue, "/sys/module/kvm_amd/parameters/sev") < 0)
+        return false;
+
+    if (modValue[0] != '1')
+        return false;
+
+    if (virFileExists(QEMU_DEV_SEV))
+        return true;
+
+    return false;
+}
+
+
+/*
+ * Check whether the secure guest functionality is enabled.
+ * See the specific architecture function for details on the verifications made.
+ */
+static bool
+virQEMUCapsKVMSupportsSecureGuest(void)
+{
+    virArch arch = virArchFromHost();
+
+    if (ARCH_IS_S390(arch))
+        return virQEMUCapsKVMSupportsSecureGuestS390();
+
+    if (ARCH_IS_X86(arch))
+        return virQEMUCapsKVMSupportsSecureGuestAMD();
+
+    return false;
+}
+
+
+/* Check the kernel module parameters 'nested' file to determine if enabled
+ *
+ *   Intel: 'kvm_intel' uses 'Y'
+ *   AMD:   'kvm_amd' uses '1'
+ *   PPC64: 'kvm_hv' uses 'Y'
+ *   S390:  'kvm' uses '1'
+ */
+static bool
+virQEMUCapsKVMSupportsNesting(void)
+{
+    static char const * const kmod[] = {"kvm_intel", "kvm_amd",
+                                        "kvm_hv", "kvm"};
+    g_autofree char *value = NULL;
+    int rc;
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(kmod); i++) {
+        VIR_FREE(value);
+        rc = virFileReadValueString(&value, "/sys/module/%s/parameters/nested",
+                                    kmod[i]);
+        if (rc == -2)
+            continue;
+        if (rc < 0) {
+            virResetLastError();
+            return false;
+        }
+
+        if (value[0] == 'Y' || value[0] == 'y' || value[0] == '1')
+            return true;
+    }
+
+    return false;
+}
+
+
+/* Determine whether '/dev/kvm' is usable as QEMU user:QEMU group. */
+static bool
+virQEMUCapsKVMUsable(virQEMUCapsCachePrivPtr priv)
+{
+    struct stat sb;
     static const char *kvm_device = "/dev/kvm";
     virTristateBool value;
     virTristateBool cached_value = priv->kvmUsable;
@@ -4814,6 +5810,8 @@ virQEMUCapsKVMUsable(virQEMUCapsCachePrivPtr priv)
             virReportSystemError(errno,
                                  _("Failed to stat %s"), kvm_device);
         }
+        priv->kvmCtime = 0;
+        priv->kvmUsable = VIR_TRISTATE_BOOL_NO;
         return false;
     }
     kvm_ctime = sb.st_ctime;
@@ -4846,12 +5844,16 @@ virQEMUCapsKVMUsable(virQEMUCapsCachePrivPtr priv)
 }
 
 
-static bool
+bool
 virQEMUCapsIsValid(void *data,
                    void *privData)
 {
     virQEMUCapsPtr qemuCaps = data;
     virQEMUCapsCachePrivPtr priv = privData;
+    g_autofree char *canonical = NULL;
+    unsigned long long generation;
+    bool unchanged;
+    bool watched;
     bool kvmUsable;
     struct stat sb;
     bool kvmSupportsNesting;
@@ -4874,19 +5876,36 @@ virQEMUCapsIsValid(void *data,
         return false;
     }
 
-    if (stat(qemuCaps->binary, &sb) < 0) {
-        VIR_DEBUG("Failed to stat QEMU binary '%s': %s",
-                  qemuCaps->binary,
-                  g_strerror(errno));
-        return false;
-    }
+    /* Files which didn't change since they were last checked don't need
+     * to be checked again. Otherwise they are watched before checking them
+     * so that no change gets lost. */
+    virQEMUCapsCacheWatchUpdate(priv);
+    generation = priv->watchGeneration;
+    unchanged = qemuCaps->validGeneration == generation;
+    watched = true;
 
-    if (sb.st_ctime != qemuCaps->ctime) {
-        VIR_DEBUG("Outdated capabilities for '%s': QEMU binary changed "
-                  "(%lld vs %lld)",
-                  qemuCaps->binary,
-                  (long long)sb.st_ctime, (long long)qemuCaps->ctime);
-        return false;
+    if (!unchanged) {
+        canonical = virFileCanonicalizePath(qemuCaps->binary);
+
+        if (!virQEMUCapsCacheWatchFile(priv, qemuCaps->binary) ||
+            (canonical && STRNEQ(canonical, qemuCaps->binary) &&
+             !virQEMUCapsCacheWatchFile(priv, canonical)))
+            watched = false;
+
+        if (stat(qemuCaps->binary, &sb) < 0) {
+            VIR_DEBUG("Failed to stat QEMU binary '%s': %s",
+                      qemuCaps->binary,
+                      g_strerror(errno));
+            return false;
+        }
+
+        if (sb.st_ctime != qemuCaps->ctime) {
+            VIR_DEBUG("Outdated capabilities for '%s': QEMU binary changed "
+                      "(%lld vs %lld)",
+                      qemuCaps->binary,
+                      (long long)sb.st_ctime, (long long)qemuCaps->ctime);
+            return false;
+        }
     }
 
     if (!virQEMUCapsGuestIsNative(priv->hostArch, qemuCaps->arch)) {
@@ -4894,10 +5913,18 @@ virQEMUCapsIsValid(void *data,
                   "skipping KVM-related checks",
                   virArchToString(qemuCaps->arch),
                   virArchToString(priv->hostArch));
+        if (watched)
+            qemuCaps->validGeneration = generation;
         return true;
     }
 
-    kvmUsable = virQEMUCapsKVMUsable(priv);
+    if (unchanged) {
+        kvmUsable = priv->kvmUsable == VIR_TRISTATE_BOOL_YES;
+    } else {
+        if (!virQEMUCapsCacheWatchFile(priv, "/dev/kvm"))
+            watched = false;
+        kvmUsable = virQEMUCapsKVMUsable(priv);
+    }
 
     if (!virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM) &&
         kvmUsable) {
@@ -4959,6 +5986,9 @@ virQEMUCapsIsValid(void *data,
         }
     }
 
+    if (!unchanged && watched)
+        qemuCaps->validGeneration = generation;
+
     return true;
 }
 
@@ -5384,26 +6414,111 @@ virQEMUCapsInitQMPSingle(virQEMUCapsPtr qemuCaps,
 }
 
 
+typedef struct _virQEMUCapsProcLaunch virQEMUCapsProcLaunch;
+typedef virQEMUCapsProcLaunch *virQEMUCapsProcLaunchPtr;
+struct _virQEMUCapsProcLaunch {
+    qemuProcessQMPPtr proc;
+    int rc;
+};
+
+
+static void
+virQEMUCapsProcLaunchThread(void *opaque)
+{
+    virQEMUCapsProcLaunchPtr launch = opaque;
+
+    if ((launch->rc = qemuProcessQMPLaunchOnly(launch->proc)) < 0) {
+        VIR_DEBUG("Failed to start QEMU for probing TCG: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+    }
+}
+
+
+/* Guesses from its name whether @binary can run guests natively on
+ * @hostArch, as that's all we know about it before it's probed. Binaries
+ * not called qemu-system-$arch (e.g. qemu-kvm) are considered native. */
+static bool
+virQEMUCapsBinaryIsNative(const char *binary,
+                          virArch hostArch)
+{
+    g_autofree char *name = g_path_get_basename(binary);
+    const char *archstr;
+    virArch arch;
+
+    if (!(archstr = STRSKIP(name, "qemu-system-")) ||
+        (arch = virQEMUCapsArchFromString(archstr)) == VIR_ARCH_NONE)
+        return true;
+
+    return virQEMUCapsGuestIsNative(hostArch, arch);
+}
+
+
 static int
 virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
+                   virArch hostArch,
                    const char *libDir,
                    uid_t runUid,
                    gid_t runGid)
 {
-    if (virQEMUCapsInitQMPSingle(qemuCaps, libDir, runUid, runGid, false) < 0)
-        return -1;
+    virQEMUCapsProcLaunch tcg = { .rc = -1 };
+    virThread thread;
+    bool launching = false;
+    int ret = -1;
 
     /*
-     * If KVM was enabled during the first probe, we need to explicitly probe
-     * for TCG capabilities by asking the same binary again and turning KVM
-     * off.
+     * If KVM gets enabled by the first probe, TCG capabilities have to be
+     * probed explicitly by asking the same binary again and turning KVM off.
+     * Starting QEMU is the slow part of a probe, so if KVM may get enabled,
+     * i.e. it is available and the binary emulates the host architecture,
+     * the second QEMU process is started while the first one is being
+     * probed. It is only talked to once the first probe is done so that
+     * the monitor traffic stays the same.
      */
+    if (virFileExists("/dev/kvm") &&
+        virQEMUCapsBinaryIsNative(qemuCaps->binary, hostArch)) {
+        if (!(tcg.proc = qemuProcessQMPNew(qemuCaps->binary, libDir,
+                                           runUid, runGid, true)))
+            return -1;
+
+        if (virThreadCreateFull(&thread, true, virQEMUCapsProcLaunchThread,
+                                "qemu-caps-tcg", false, &tcg) < 0) {
+            VIR_WARN("Failed to start TCG probing thread: %s",
+                     virGetLastErrorMessage());
+            virResetLastError();
+        } else {
+            launching = true;
+        }
+    }
+
+    if (virQEMUCapsInitQMPSingle(qemuCaps, libDir, runUid, runGid, false) < 0)
+        goto cleanup;
+
+    if (launching) {
+        virThreadJoin(&thread);
+        launching = false;
+    }
+
     if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM) &&
-        virQEMUCapsGet(qemuCaps, QEMU_CAPS_TCG) &&
-        virQEMUCapsInitQMPSingle(qemuCaps, libDir, runUid, runGid, true) < 0)
-        return -1;
+        virQEMUCapsGet(qemuCaps, QEMU_CAPS_TCG)) {
+        if (tcg.rc < 0) {
+            if (virQEMUCapsInitQMPSingle(qemuCaps, libDir,
+                                         runUid, runGid, true) < 0)
+                goto cleanup;
+        } else if (qemuProcessQMPConnect(tcg.proc) < 0 ||
+                   virQEMUCapsInitQMPMonitorTCG(qemuCaps, tcg.proc->mon) < 0) {
+            virQEMUCapsLogProbeFailure(qemuCaps->binary);
+            goto cleanup;
+        }
+    }
 
-    return 0;
+    ret = 0;
+
+ cleanup:
+    if (launching)
+        virThreadJoin(&thread);
+    qemuProcessQMPFree(tcg.proc);
+    return ret;
 }
 
 
@@ -5442,7 +6557,7 @@ virQEMUCapsNewForBinaryInternal(virArch hostArch,
         goto error;
     }
 
-    if (virQEMUCapsInitQMP(qemuCaps, libDir, runUid, runGid) < 0)
+    if (virQEMUCapsInitQMP(qemuCaps, hostArch, libDir, runUid, runGid) < 0)
         goto error;
 
     qemuCaps->libvirtCtime = virGetSelfLastChanged();
@@ -5491,20 +6606,42 @@ virQEMUCapsLoadFile(const char *filename,
                     const char *binary,
                     void *privData)
 {
-    virQEMUCapsPtr qemuCaps = virQEMUCapsNewBinary(binary);
+    virQEMUCapsPtr qemuCaps = NULL;
     virQEMUCapsCachePrivPtr priv = privData;
+    VIR_AUTOCLOSE fd = -1;
+    struct stat sb;
+    void *data = MAP_FAILED;
 
-    if (!qemuCaps)
+    if ((fd = open(filename, O_RDONLY)) < 0 ||
+        fstat(fd, &sb) < 0) {
+        virReportSystemError(errno, _("cannot read '%s'"), filename);
         return NULL;
+    }
 
-    if (virQEMUCapsLoadCache(priv->hostArch, qemuCaps, filename) < 0)
-        goto error;
+    if (sb.st_size == 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("empty QEMU capabilities cache '%s'"), filename);
+        return NULL;
+    }
 
-    return qemuCaps;
+    if ((data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE,
+                     fd, 0)) == MAP_FAILED) {
+        virReportSystemError(errno, _("cannot map '%s'"), filename);
+        return NULL;
+    }
 
- error:
-    virObjectUnref(qemuCaps);
-    return NULL;
+    if (!(qemuCaps = virQEMUCapsNewBinary(binary)))
+        goto cleanup;
+
+    if (virQEMUCapsLoadCacheBinary(priv->hostArch, qemuCaps,
+                                   data, sb.st_size) < 0) {
+        virObjectUnref(qemuCaps);
+        qemuCaps = NULL;
+    }
+
+ cleanup:
+    munmap(data, sb.st_size);
+    return qemuCaps;
 }
 
 
@@ -5569,11 +6706,12 @@ virQEMUCapsCacheNew(const char *libDir,
 
     capsCacheDir = g_strdup_printf("%s/capabilities", cacheDir);
 
-    if (!(cache = virFileCacheNew(capsCacheDir, "xml", &qemuCapsCacheHandlers)))
+    if (!(cache = virFileCacheNew(capsCacheDir, "bin", &qemuCapsCacheHandlers)))
         goto error;
 
     if (VIR_ALLOC(priv) < 0)
         goto error;
+    priv->watchFd = -1;
     virFileCacheSetPriv(cache, priv);
 
     priv->libDir = g_strdup(libDir);
@@ -5587,6 +6725,9 @@ virQEMUCapsCacheNew(const char *libDir,
     priv->runGid = runGid;
     priv->kvmUsable = VIR_TRISTATE_BOOL_ABSENT;
 
+    if (virQEMUCapsCacheWatchInit(priv) < 0)
+        goto error;
+
     if (uname(&uts) == 0)
         priv->kernelVersion = g_strdup_printf("%s %s", uts.release, uts.version);
 
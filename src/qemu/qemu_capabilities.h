@@ -573,6 +573,7 @@ typedef enum { /* virQEMUCapsFlags grouping marker for syntax-check */
 
     /* 375 */
     QEMU_CAPS_MIGRATION_PARAM_XBZRLE_CACHE_SIZE, /* xbzrle-cache-size field in migrate-set-parameters */
+    QEMU_CAPS_CALC_DIRTY_RATE, /* accepts calc-dirty-rate */
 
     QEMU_CAPS_LAST /* this must always be the last item */
 } virQEMUCapsFlags;
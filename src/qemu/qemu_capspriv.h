@@ -40,11 +40,23 @@ virQEMUCapsNewForBinaryInternal(virArch hostArch,
 void virQEMUCapsSetInvalidation(virQEMUCapsPtr qemuCaps,
                                 bool enabled);
 
+void virQEMUCapsSetTimestamps(virQEMUCapsPtr qemuCaps,
+                              time_t ctime);
+
+bool virQEMUCapsIsValid(void *data,
+                        void *privData);
+
 int virQEMUCapsLoadCache(virArch hostArch,
                          virQEMUCapsPtr qemuCaps,
                          const char *filename);
 char *virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps);
 
+int virQEMUCapsLoadCacheBinary(virArch hostArch,
+                               virQEMUCapsPtr qemuCaps,
+                               const char *data,
+                               size_t len);
+GByteArray *virQEMUCapsFormatCacheBinary(virQEMUCapsPtr qemuCaps);
+
 int
 virQEMUCapsInitQMPMonitor(virQEMUCapsPtr qemuCaps,
                           qemuMonitorPtr mon);
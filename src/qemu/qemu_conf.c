@@ -276,6 +276,16 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged,
     cfg->logTimestamp = true;
     cfg->glusterDebugLevel = 4;
     cfg->stdioLogD = true;
+#ifdef HAVE_NUMAD
+    cfg->numaPlacementBuiltin = false;
+#else
+    cfg->numaPlacementBuiltin = true;
+#endif
+
+    cfg->resctrlAutoInterval = 10;
+    cfg->resctrlAutoHigh = 90;
+    cfg->resctrlAutoLow = 50;
+    cfg->resctrlAutoCacheMax = 50;
 
     if (!(cfg->namespaces = virBitmapNew(QEMU_DOMAIN_NS_LAST)))
         return NULL;
@@ -609,6 +619,7 @@ virQEMUDriverConfigLoadProcessEntry(virQEMUDriverConfigPtr cfg,
 {
     VIR_AUTOSTRINGLIST hugetlbfs = NULL;
     g_autofree char *stdioHandler = NULL;
+    g_autofree char *numaPlacement = NULL;
     g_autofree char *corestr = NULL;
     size_t i;
 
@@ -687,6 +698,33 @@ virQEMUDriverConfigLoadProcessEntry(virQEMUDriverConfigPtr cfg,
             return -1;
         }
     }
+    if (virConfGetValueString(conf, "numa_placement", &numaPlacement) < 0)
+        return -1;
+    if (numaPlacement) {
+        if (STREQ(numaPlacement, "numad")) {
+            cfg->numaPlacementBuiltin = false;
+        } else if (STREQ(numaPlacement, "builtin")) {
+            cfg->numaPlacementBuiltin = true;
+        } else {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("Unknown NUMA placement backend %s"),
+                           numaPlacement);
+            return -1;
+        }
+    }
+
+    if (virConfGetValueUInt(conf, "resctrl_auto_interval",
+                            &cfg->resctrlAutoInterval) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "resctrl_auto_high_watermark",
+                            &cfg->resctrlAutoHigh) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "resctrl_auto_low_watermark",
+                            &cfg->resctrlAutoLow) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "resctrl_auto_cache_max",
+                            &cfg->resctrlAutoCacheMax) < 0)
+        return -1;
 
     return 0;
 }
@@ -1160,6 +1198,31 @@ virQEMUDriverConfigValidate(virQEMUDriverConfigPtr cfg)
         return -1;
     }
 
+    if (cfg->resctrlAutoLow >= cfg->resctrlAutoHigh ||
+        cfg->resctrlAutoHigh > 100) {
+        virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                       _("resctrl_auto_low_watermark must be lower than "
+                         "resctrl_auto_high_watermark which must not "
+                         "exceed 100"));
+        return -1;
+    }
+
+    if (cfg->resctrlAutoCacheMax == 0 ||
+        cfg->resctrlAutoCacheMax > 100) {
+        virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                       _("resctrl_auto_cache_max must be between 1 and 100"));
+        return -1;
+    }
+
+    /* the interval is turned into a timeout in milliseconds, which must
+     * fit an int */
+    if (cfg->resctrlAutoInterval > QEMU_RESCTRL_AUTO_INTERVAL_MAX) {
+        virReportError(VIR_ERR_CONF_SYNTAX,
+                       _("resctrl_auto_interval must not exceed %u seconds"),
+                       QEMU_RESCTRL_AUTO_INTERVAL_MAX);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -48,9 +48,13 @@
 #include "virfile.h"
 #include "virfilecache.h"
 #include "virfirmware.h"
+#include "virnumaplacement.h"
 
 #define QEMU_DRIVER_NAME "QEMU"
 
+/* longest period of automatic resctrl tuning, in seconds (one day) */
+#define QEMU_RESCTRL_AUTO_INTERVAL_MAX 86400
+
 typedef struct _virQEMUDriver virQEMUDriver;
 typedef virQEMUDriver *virQEMUDriverPtr;
 
@@ -200,6 +204,12 @@ struct _virQEMUDriverConfig {
 
     bool logTimestamp;
     bool stdioLogD;
+    bool numaPlacementBuiltin;
+
+    unsigned int resctrlAutoInterval;
+    unsigned int resctrlAutoHigh;
+    unsigned int resctrlAutoLow;
+    unsigned int resctrlAutoCacheMax;
 
     virFirmwarePtr *firmwares;
     size_t nfirmwares;
@@ -315,6 +325,9 @@ struct _virQEMUDriver {
 
     /* Immutable pointer, self-locking APIs */
     virHashAtomicPtr migrationErrors;
+
+    /* Immutable pointer, self-locking APIs */
+    virNumaPlacementPinsPtr numaPlacementPins;
 };
 
 virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged,
@@ -113,6 +113,7 @@ VIR_ENUM_IMPL(qemuDomainAsyncJob,
               "snapshot",
               "start",
               "backup",
+              "numa rebalance",
 );
 
 VIR_ENUM_IMPL(qemuDomainNamespace,
@@ -120,6 +121,52 @@ VIR_ENUM_IMPL(qemuDomainNamespace,
               "mount",
 );
 
+VIR_ENUM_IMPL(qemuDomainStartPhase,
+              QEMU_DOMAIN_START_PHASE_LAST,
+              "caps",
+              "prepare-domain",
+              "prepare-host",
+              "command-line",
+              "launch",
+              "cgroup",
+              "security",
+              "monitor",
+              "agent",
+              "finish",
+);
+
+
+/**
+ * qemuDomainStartTimesFormatParams:
+ * @times: startup timings of a domain
+ * @params: list to append the "startup" stats group to
+ *
+ * Nothing is added if the domain wasn't started via qemuProcessStart.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainStartTimesFormatParams(const qemuDomainStartTimes *times,
+                                 virTypedParamListPtr params)
+{
+    size_t i;
+
+    if (times->total == 0)
+        return 0;
+
+    if (virTypedParamListAddULLong(params, times->total, "startup.time") < 0)
+        return -1;
+
+    for (i = 0; i < QEMU_DOMAIN_START_PHASE_LAST; i++) {
+        if (virTypedParamListAddULLong(params, times->phases[i],
+                                       "startup.%s.time",
+                                       qemuDomainStartPhaseTypeToString(i)) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
 
 /**
  * qemuDomainObjFromDomain:
@@ -219,6 +266,7 @@ qemuDomainAsyncJobPhaseToString(qemuDomainAsyncJob job,
     case QEMU_ASYNC_JOB_START:
     case QEMU_ASYNC_JOB_NONE:
     case QEMU_ASYNC_JOB_BACKUP:
+    case QEMU_ASYNC_JOB_NUMA_REBALANCE:
         G_GNUC_FALLTHROUGH;
     case QEMU_ASYNC_JOB_LAST:
         break;
@@ -245,6 +293,7 @@ qemuDomainAsyncJobPhaseFromString(qemuDomainAsyncJob job,
     case QEMU_ASYNC_JOB_START:
     case QEMU_ASYNC_JOB_NONE:
     case QEMU_ASYNC_JOB_BACKUP:
+    case QEMU_ASYNC_JOB_NUMA_REBALANCE:
         G_GNUC_FALLTHROUGH;
     case QEMU_ASYNC_JOB_LAST:
         break;
@@ -557,6 +606,12 @@ qemuDomainJobInfoToInfo(qemuDomainJobInfoPtr jobInfo,
         info->fileRemaining = info->fileTotal - info->fileProcessed;
         break;
 
+    case QEMU_DOMAIN_JOB_STATS_TYPE_NUMA:
+        info->memTotal = jobInfo->stats.numa.total;
+        info->memProcessed = jobInfo->stats.numa.moved;
+        info->memRemaining = info->memTotal - info->memProcessed;
+        break;
+
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
         break;
     }
@@ -734,6 +789,18 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                              stats->cpu_throttle_percentage) < 0)
         goto error;
 
+    if (jobInfo->autoTuneDowntime &&
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME,
+                                jobInfo->autoTuneDowntime) < 0)
+        goto error;
+
+    if (jobInfo->autoTunePostcopy &&
+        virTypedParamsAddBoolean(&par, &npar, &maxpar,
+                                 VIR_DOMAIN_JOB_AUTO_TUNE_POSTCOPY,
+                                 true) < 0)
+        goto error;
+
  done:
     *type = qemuDomainJobStatusToType(jobInfo->status);
     *params = par;
@@ -846,6 +913,47 @@ qemuDomainBackupJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
 }
 
 
+static int
+qemuDomainNumaJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
+                              int *type,
+                              virTypedParameterPtr *params,
+                              int *nparams)
+{
+    qemuDomainNumaStats *stats = &jobInfo->stats.numa;
+    g_autoptr(virTypedParamList) par = g_new0(virTypedParamList, 1);
+
+    if (virTypedParamListAddInt(par, jobInfo->operation,
+                                VIR_DOMAIN_JOB_OPERATION) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(par, jobInfo->timeElapsed,
+                                   VIR_DOMAIN_JOB_TIME_ELAPSED) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(par, stats->total,
+                                   VIR_DOMAIN_JOB_MEMORY_TOTAL) < 0 ||
+        virTypedParamListAddULLong(par, stats->moved,
+                                   VIR_DOMAIN_JOB_MEMORY_PROCESSED) < 0 ||
+        virTypedParamListAddULLong(par, stats->total - stats->moved,
+                                   VIR_DOMAIN_JOB_MEMORY_REMAINING) < 0)
+        return -1;
+
+    if (jobInfo->status != QEMU_DOMAIN_JOB_STATUS_ACTIVE &&
+        virTypedParamListAddBoolean(par,
+                                    jobInfo->status == QEMU_DOMAIN_JOB_STATUS_COMPLETED,
+                                    VIR_DOMAIN_JOB_SUCCESS) < 0)
+        return -1;
+
+    if (jobInfo->errmsg &&
+        virTypedParamListAddString(par, jobInfo->errmsg, VIR_DOMAIN_JOB_ERRMSG) < 0)
+        return -1;
+
+    *nparams = virTypedParamListStealParams(par, params);
+    *type = qemuDomainJobStatusToType(jobInfo->status);
+    return 0;
+}
+
+
 int
 qemuDomainJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                           int *type,
@@ -863,6 +971,9 @@ qemuDomainJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
     case QEMU_DOMAIN_JOB_STATS_TYPE_BACKUP:
         return qemuDomainBackupJobInfoToParams(jobInfo, type, params, nparams);
 
+    case QEMU_DOMAIN_JOB_STATS_TYPE_NUMA:
+        return qemuDomainNumaJobInfoToParams(jobInfo, type, params, nparams);
+
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("invalid job statistics type"));
@@ -2269,6 +2380,8 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
     priv->qemuDevices = NULL;
 
     virCgroupFree(&priv->cgroup);
+    virHashFree(priv->threadCgroups);
+    priv->threadCgroups = NULL;
 
     virPerfFree(priv->perf);
     priv->perf = NULL;
@@ -2304,6 +2417,9 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
     virBitmapFree(priv->namespaces);
     priv->namespaces = NULL;
 
+    virProcessNSHelperFree(priv->nsHelper);
+    priv->nsHelper = NULL;
+
     priv->rememberOwner = false;
 
     priv->reconnectBlockjobs = VIR_TRISTATE_BOOL_ABSENT;
@@ -2334,6 +2450,95 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
 }
 
 
+static void
+qemuDomainThreadCgroupFree(void *opaque)
+{
+    qemuDomainThreadCgroupPtr tcg = opaque;
+
+    virCgroupFree(&tcg->cgroup);
+    g_free(tcg);
+}
+
+
+static char *
+qemuDomainThreadCgroupKey(virCgroupThreadName nameval,
+                          int id)
+{
+    return g_strdup_printf("%d:%d", nameval, id);
+}
+
+
+/**
+ * qemuDomainGetThreadCgroup:
+ * @vm: domain object
+ * @nameval: type of the thread
+ * @id: ID of the thread
+ *
+ * Returns the cgroup of a thread of @vm, which is kept open for the whole
+ * life of the domain so that periodic statistics don't have to look it up
+ * and reopen its files every time. If the cgroup doesn't exist, this is
+ * remembered as well and NULL is returned without an error, also in later
+ * calls.
+ */
+qemuDomainThreadCgroupPtr
+qemuDomainGetThreadCgroup(virDomainObjPtr vm,
+                          virCgroupThreadName nameval,
+                          int id)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autofree char *key = qemuDomainThreadCgroupKey(nameval, id);
+    qemuDomainThreadCgroupPtr tcg;
+
+    if (!priv->cgroup)
+        return NULL;
+
+    if (!priv->threadCgroups &&
+        !(priv->threadCgroups = virHashNew(qemuDomainThreadCgroupFree)))
+        return NULL;
+
+    if (!(tcg = virHashLookup(priv->threadCgroups, key))) {
+        tcg = g_new0(qemuDomainThreadCgroup, 1);
+
+        if (virCgroupNewThread(priv->cgroup, nameval, id, false,
+                               &tcg->cgroup) < 0)
+            virResetLastError();
+
+        if (virHashAddEntry(priv->threadCgroups, key, tcg) < 0) {
+            qemuDomainThreadCgroupFree(tcg);
+            virResetLastError();
+            return NULL;
+        }
+    }
+
+    if (!tcg->cgroup)
+        return NULL;
+
+    return tcg;
+}
+
+
+/**
+ * qemuDomainRemoveThreadCgroup:
+ * @vm: domain object
+ * @nameval: type of the thread
+ * @id: ID of the thread
+ *
+ * Forgets the cgroup of a thread of @vm looked up by
+ * qemuDomainGetThreadCgroup(), to be called when the thread is removed.
+ */
+void
+qemuDomainRemoveThreadCgroup(virDomainObjPtr vm,
+                             virCgroupThreadName nameval,
+                             int id)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autofree char *key = qemuDomainThreadCgroupKey(nameval, id);
+
+    if (priv->threadCgroups)
+        virHashRemoveEntry(priv->threadCgroups, key);
+}
+
+
 static void
 qemuDomainObjPrivateFree(void *data)
 {
@@ -12253,6 +12458,11 @@ qemuDomainAttachDeviceMknodRecursive(virQEMUDriverPtr driver,
         }
 
         if (i == ndevMountsPath) {
+            /* Unlike removal, creating the node still forks for each
+             * device even if the domain has a namespace helper:
+             * qemuDomainAttachDeviceMknodHelper lives in this module,
+             * which is not mapped in the helper, and @data carries ACLs
+             * and labels which nobody serializes. */
             if (qemuSecurityPreFork(driver->securityManager) < 0)
                 goto cleanup;
 
@@ -12323,19 +12533,12 @@ qemuDomainAttachDeviceMknod(virQEMUDriverPtr driver,
 
 
 static int
-qemuDomainDetachDeviceUnlinkHelper(pid_t pid G_GNUC_UNUSED,
+qemuDomainDetachDeviceUnlinkHelper(pid_t pid,
                                    void *opaque)
 {
     const char *path = opaque;
 
-    VIR_DEBUG("Unlinking %s", path);
-    if (unlink(path) < 0 && errno != ENOENT) {
-        virReportSystemError(errno,
-                             _("Unable to remove device %s"), path);
-        return -1;
-    }
-
-    return 0;
+    return virFileUnlinkBatch(pid, path, strlen(path) + 1);
 }
 
 
@@ -12357,9 +12560,15 @@ qemuDomainDetachDeviceUnlink(virQEMUDriverPtr driver G_GNUC_UNUSED,
         }
 
         if (i == ndevMountsPath) {
-            if (virProcessRunInMountNamespace(vm->pid,
-                                              qemuDomainDetachDeviceUnlinkHelper,
-                                              (void *)file) < 0)
+            int rc = virProcessRunInMountNamespaceBatch(vm->pid,
+                                                        virFileUnlinkBatch,
+                                                        file, strlen(file) + 1);
+
+            if (rc == -2)
+                rc = virProcessRunInMountNamespace(vm->pid,
+                                                   qemuDomainDetachDeviceUnlinkHelper,
+                                                   (void *)file);
+            if (rc < 0)
                 return -1;
         }
     }
@@ -13396,6 +13605,7 @@ qemuProcessEventFree(struct qemuProcessEvent *event)
         virObjectUnref(event->data);
         break;
     case QEMU_PROCESS_EVENT_PR_DISCONNECT:
+    case QEMU_PROCESS_EVENT_RESCTRL_AUTO:
     case QEMU_PROCESS_EVENT_LAST:
         break;
     }
@@ -42,6 +42,8 @@
 #include "virdomainmomentobjlist.h"
 #include "virenum.h"
 #include "vireventthread.h"
+#include "virprocess.h"
+#include "virtypedparam.h"
 
 #define QEMU_DOMAIN_FORMAT_LIVE_FLAGS \
     (VIR_DOMAIN_XML_SECURE)
@@ -107,6 +109,7 @@ typedef enum {
     QEMU_ASYNC_JOB_SNAPSHOT,
     QEMU_ASYNC_JOB_START,
     QEMU_ASYNC_JOB_BACKUP,
+    QEMU_ASYNC_JOB_NUMA_REBALANCE,
 
     QEMU_ASYNC_JOB_LAST
 } qemuDomainAsyncJob;
@@ -130,6 +133,7 @@ typedef enum {
     QEMU_DOMAIN_JOB_STATS_TYPE_SAVEDUMP,
     QEMU_DOMAIN_JOB_STATS_TYPE_MEMDUMP,
     QEMU_DOMAIN_JOB_STATS_TYPE_BACKUP,
+    QEMU_DOMAIN_JOB_STATS_TYPE_NUMA,
 } qemuDomainJobStatsType;
 
 
@@ -148,6 +152,12 @@ struct _qemuDomainBackupStats {
     unsigned long long tmp_total;
 };
 
+typedef struct _qemuDomainNumaStats qemuDomainNumaStats;
+struct _qemuDomainNumaStats {
+    unsigned long long total; /* bytes to move when the job started */
+    unsigned long long moved;
+};
+
 typedef struct _qemuDomainJobInfo qemuDomainJobInfo;
 typedef qemuDomainJobInfo *qemuDomainJobInfoPtr;
 struct _qemuDomainJobInfo {
@@ -173,9 +183,14 @@ struct _qemuDomainJobInfo {
         qemuMonitorMigrationStats mig;
         qemuMonitorDumpStats dump;
         qemuDomainBackupStats backup;
+        qemuDomainNumaStats numa;
     } stats;
     qemuDomainMirrorStats mirrorStats;
 
+    /* Decisions made by migration auto-tuning */
+    unsigned long long autoTuneDowntime; /* downtime limit set (in ms) */
+    bool autoTunePostcopy; /* migration switched to post-copy */
+
     char *errmsg; /* optional error message for failed completed jobs */
 };
 
@@ -263,6 +278,33 @@ typedef enum {
 } qemuDomainNamespace;
 VIR_ENUM_DECL(qemuDomainNamespace);
 
+/* Phases of the domain startup whose duration is measured */
+typedef enum {
+    QEMU_DOMAIN_START_PHASE_CAPS = 0,       /* QEMU capabilities lookup */
+    QEMU_DOMAIN_START_PHASE_PREPARE_DOMAIN, /* qemuProcessPrepareDomain */
+    QEMU_DOMAIN_START_PHASE_PREPARE_HOST,   /* qemuProcessPrepareHost */
+    QEMU_DOMAIN_START_PHASE_COMMAND_LINE,   /* building QEMU command line */
+    QEMU_DOMAIN_START_PHASE_LAUNCH,         /* spawning QEMU up to the handshake */
+    QEMU_DOMAIN_START_PHASE_CGROUP,         /* cgroup setup */
+    QEMU_DOMAIN_START_PHASE_SECURITY,       /* setting security labels */
+    QEMU_DOMAIN_START_PHASE_MONITOR,        /* waiting for QEMU monitor */
+    QEMU_DOMAIN_START_PHASE_AGENT,          /* connecting to guest agent */
+    QEMU_DOMAIN_START_PHASE_FINISH,         /* refreshing state and resuming */
+
+    QEMU_DOMAIN_START_PHASE_LAST
+} qemuDomainStartPhase;
+VIR_ENUM_DECL(qemuDomainStartPhase);
+
+typedef struct _qemuDomainStartTimes qemuDomainStartTimes;
+struct _qemuDomainStartTimes {
+    /* all in nanoseconds */
+    unsigned long long phases[QEMU_DOMAIN_START_PHASE_LAST];
+    unsigned long long total; /* 0 unless started via qemuProcessStart */
+};
+
+int qemuDomainStartTimesFormatParams(const qemuDomainStartTimes *times,
+                                     virTypedParamListPtr params);
+
 bool qemuDomainNamespaceEnabled(virDomainObjPtr vm,
                                 qemuDomainNamespace ns);
 
@@ -303,6 +345,9 @@ struct _qemuDomainSecretInfo {
     } s;
 };
 
+typedef struct _qemuResctrlAuto qemuResctrlAuto;
+typedef qemuResctrlAuto *qemuResctrlAutoPtr;
+
 typedef struct _qemuDomainObjPrivate qemuDomainObjPrivate;
 typedef qemuDomainObjPrivate *qemuDomainObjPrivatePtr;
 struct _qemuDomainObjPrivate {
@@ -311,6 +356,9 @@ struct _qemuDomainObjPrivate {
     qemuDomainJobObj job;
 
     virBitmapPtr namespaces;
+    virProcessNSHelperPtr nsHelper;
+
+    qemuDomainStartTimes startTimes;
 
     virEventThread *eventThread;
 
@@ -351,6 +399,7 @@ struct _qemuDomainObjPrivate {
     size_t ncleanupCallbacks_max;
 
     virCgroupPtr cgroup;
+    virHashTablePtr threadCgroups; /* qemuDomainThreadCgroup, for statistics */
 
     virPerfPtr perf;
 
@@ -438,6 +487,9 @@ struct _qemuDomainObjPrivate {
     char **dbusVMStateIds;
     /* true if -object dbus-vmstate was added */
     bool dbusVMState;
+
+    /* automatic resizing of resctrl allocations, see qemu_resctrl.c */
+    qemuResctrlAutoPtr resctrlAuto;
 };
 
 #define QEMU_DOMAIN_PRIVATE(vm) \
@@ -607,6 +659,7 @@ typedef enum {
     QEMU_PROCESS_EVENT_PR_DISCONNECT,
     QEMU_PROCESS_EVENT_RDMA_GID_STATUS_CHANGED,
     QEMU_PROCESS_EVENT_GUEST_CRASHLOADED,
+    QEMU_PROCESS_EVENT_RESCTRL_AUTO,
 
     QEMU_PROCESS_EVENT_LAST
 } qemuProcessEventType;
@@ -939,6 +992,21 @@ void qemuDomainCleanupRun(virQEMUDriverPtr driver,
 
 void qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv);
 
+typedef struct _qemuDomainThreadCgroup qemuDomainThreadCgroup;
+typedef qemuDomainThreadCgroup *qemuDomainThreadCgroupPtr;
+struct _qemuDomainThreadCgroup {
+    virCgroupPtr cgroup;
+    bool noUsage; /* CPU time is not available */
+    bool noThrottling; /* CFS throttling counters are not available */
+};
+
+qemuDomainThreadCgroupPtr qemuDomainGetThreadCgroup(virDomainObjPtr vm,
+                                                    virCgroupThreadName nameval,
+                                                    int id);
+void qemuDomainRemoveThreadCgroup(virDomainObjPtr vm,
+                                  virCgroupThreadName nameval,
+                                  int id);
+
 extern virDomainXMLPrivateDataCallbacks virQEMUDriverPrivateDataCallbacks;
 extern virXMLNamespace virQEMUDriverDomainXMLNamespace;
 extern virDomainDefParserConfig virQEMUDriverDomainDefParserConfig;
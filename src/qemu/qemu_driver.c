@@ -50,6 +50,7 @@
 #include "qemu_security.h"
 #include "qemu_checkpoint.h"
 #include "qemu_backup.h"
+#include "qemu_resctrl.h"
 
 #include "virerror.h"
 #include "virlog.h"
@@ -57,6 +58,7 @@
 #include "virbuffer.h"
 #include "virhostcpu.h"
 #include "virhostmem.h"
+#include "virpsi.h"
 #include "virnetdevtap.h"
 #include "virnetdevopenvswitch.h"
 #include "capabilities.h"
@@ -98,6 +100,7 @@
 #include "vircgroup.h"
 #include "virperf.h"
 #include "virnuma.h"
+#include "virnumaplacement.h"
 #include "netdev_bandwidth_conf.h"
 #include "virqemu.h"
 #include "virdomainsnapshotobjlist.h"
@@ -937,6 +940,9 @@ qemuStateInitialize(bool privileged,
     if (!(qemu_driver->closeCallbacks = virCloseCallbacksNew()))
         goto error;
 
+    if (!(qemu_driver->numaPlacementPins = virNumaPlacementPinsNew()))
+        goto error;
+
     /* Get all the running persistent or transient configs first */
     if (virDomainObjListLoadAllConfigs(qemu_driver->domains,
                                        cfg->stateDir,
@@ -1110,6 +1116,7 @@ qemuStateCleanup(void)
         return -1;
 
     virObjectUnref(qemu_driver->migrationErrors);
+    virObjectUnref(qemu_driver->numaPlacementPins);
     virObjectUnref(qemu_driver->closeCallbacks);
     virLockManagerPluginUnref(qemu_driver->lockManager);
     virSysinfoDefFree(qemu_driver->hostsysinfo);
@@ -1237,6 +1244,7 @@ qemuConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS:
     default:
         return 0;
     }
@@ -1325,77 +1333,41 @@ static char *qemuConnectGetCapabilities(virConnectPtr conn) {
 }
 
 
+/* Reads the time a thread spent running and the time it spent runnable but
+ * waiting on a runqueue from the schedstat file, both in nanoseconds. The
+ * file only exists with CONFIG_SCHED_INFO, in which case -2 is returned
+ * without reporting an error. */
 static int
-qemuGetSchedInfo(unsigned long long *cpuWait,
+qemuGetSchedstat(unsigned long long *runTime,
+                 unsigned long long *runDelay,
                  pid_t pid, pid_t tid)
 {
     g_autofree char *proc = NULL;
     g_autofree char *data = NULL;
-    char **lines = NULL;
-    size_t i;
-    int ret = -1;
-    double val;
-
-    *cpuWait = 0;
+    char *tmp;
 
     /* In general, we cannot assume pid_t fits in int; but /proc parsing
      * is specific to Linux where int works fine.  */
     if (tid)
-        proc = g_strdup_printf("/proc/%d/task/%d/sched", (int)pid, (int)tid);
+        proc = g_strdup_printf("/proc/%d/task/%d/schedstat", (int)pid, (int)tid);
     else
-        proc = g_strdup_printf("/proc/%d/sched", (int)pid);
-    if (!proc)
-        goto cleanup;
-    ret = -1;
-
-    /* The file is not guaranteed to exist (needs CONFIG_SCHED_DEBUG) */
-    if (access(proc, R_OK) < 0) {
-        ret = 0;
-        goto cleanup;
-    }
-
-    if (virFileReadAll(proc, (1<<16), &data) < 0)
-        goto cleanup;
-
-    lines = virStringSplit(data, "\n", 0);
-    if (!lines)
-        goto cleanup;
+        proc = g_strdup_printf("/proc/%d/schedstat", (int)pid);
 
-    for (i = 0; lines[i] != NULL; i++) {
-        const char *line = lines[i];
-
-        /* Needs CONFIG_SCHEDSTATS. The second check
-         * is the old name the kernel used in past */
-        if (STRPREFIX(line, "se.statistics.wait_sum") ||
-            STRPREFIX(line, "se.wait_sum")) {
-            line = strchr(line, ':');
-            if (!line) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Missing separator in sched info '%s'"),
-                               lines[i]);
-                goto cleanup;
-            }
-            line++;
-            while (*line == ' ')
-                line++;
+    if (access(proc, R_OK) < 0)
+        return -2;
 
-            if (virStrToDouble(line, NULL, &val) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Unable to parse sched info value '%s'"),
-                               line);
-                goto cleanup;
-            }
+    if (virFileReadAll(proc, 1024, &data) < 0)
+        return -1;
 
-            *cpuWait = (unsigned long long)(val * 1000000);
-            break;
-        }
+    /* format: "<run time ns> <runqueue wait ns> <timeslices>" */
+    if (virStrToLong_ull(data, &tmp, 10, runTime) < 0 ||
+        virStrToLong_ull(tmp, NULL, 10, runDelay) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to parse schedstat info '%s'"), data);
+        return -1;
     }
 
-    ret = 0;
-
- cleanup:
-    virStringListFree(lines);
-    return ret;
+    return 0;
 }
 
 
@@ -1461,7 +1433,6 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
 static int
 qemuDomainHelperGetVcpus(virDomainObjPtr vm,
                          virVcpuInfoPtr info,
-                         unsigned long long *cpuwait,
                          int maxinfo,
                          unsigned char *cpumaps,
                          int maplen)
@@ -1516,11 +1487,6 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
             virBitmapFree(map);
         }
 
-        if (cpuwait) {
-            if (qemuGetSchedInfo(&(cpuwait[ncpuinfo]), vm->pid, vcpupid) < 0)
-                return -1;
-        }
-
         ncpuinfo++;
     }
 
@@ -4938,6 +4904,9 @@ static void qemuProcessEventHandler(void *data, void *opaque)
     case QEMU_PROCESS_EVENT_GUEST_CRASHLOADED:
         processGuestCrashloadedEvent(driver, vm);
         break;
+    case QEMU_PROCESS_EVENT_RESCTRL_AUTO:
+        qemuResctrlAutoTune(driver, vm);
+        break;
     case QEMU_PROCESS_EVENT_LAST:
         break;
     }
@@ -5489,7 +5458,7 @@ qemuDomainGetVcpus(virDomainPtr dom,
         goto cleanup;
     }
 
-    ret = qemuDomainHelperGetVcpus(vm, info, NULL, maxinfo, cpumaps, maplen);
+    ret = qemuDomainHelperGetVcpus(vm, info, maxinfo, cpumaps, maplen);
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -6063,6 +6032,7 @@ qemuDomainHotplugDelIOThread(virQEMUDriverPtr driver,
     }
 
     virDomainIOThreadIDDel(vm->def, iothread_id);
+    qemuDomainRemoveThreadCgroup(vm, VIR_CGROUP_THREAD_IOTHREAD, iothread_id);
 
     if (virCgroupDelThread(priv->cgroup, VIR_CGROUP_THREAD_IOTHREAD,
                            iothread_id) < 0)
@@ -9909,15 +9879,565 @@ qemuDomainGetNumaParameters(virDomainPtr dom,
         }
     }
 
-    if (*nparams > QEMU_NB_NUMA_PARAM)
-        *nparams = QEMU_NB_NUMA_PARAM;
-    ret = 0;
+    if (*nparams > QEMU_NB_NUMA_PARAM)
+        *nparams = QEMU_NB_NUMA_PARAM;
+    ret = 0;
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+/* amount of guest memory moved between checks for abort and throttling,
+ * rounded up to whole pages of the mapping being moved */
+#define QEMU_NUMA_REBALANCE_CHUNK (64 * 1024 * 1024)
+
+static int
+qemuDomainNumaRebalanceCheck(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainDefPtr def = vm->def;
+    virDomainNumatuneMemMode mode;
+    size_t i;
+
+    if (!driver->privileged) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("NUMA rebalancing is not available in session mode"));
+        return -1;
+    }
+
+    if (!virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUSET)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("cgroup cpuset controller is not mounted"));
+        return -1;
+    }
+
+    if (virDomainNumatuneGetMode(def->numa, -1, &mode) == 0 &&
+        mode != VIR_DOMAIN_NUMATUNE_MEM_STRICT) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("NUMA rebalancing requires strict numa mode"));
+        return -1;
+    }
+
+    if (virDomainNumatuneHasPerNodeBinding(def->numa)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("NUMA rebalancing of domains with per guest NUMA "
+                         "node memory binding is not supported"));
+        return -1;
+    }
+
+    /* Explicit pinning is what the user asked for, don't override it */
+    if ((def->placement_mode == VIR_DOMAIN_CPU_PLACEMENT_MODE_STATIC &&
+         def->cpumask) ||
+        def->cputune.emulatorpin)
+        goto pinned;
+
+    for (i = 0; i < virDomainDefGetVcpusMax(def); i++) {
+        if (virDomainDefGetVcpu(def, i)->cpumask)
+            goto pinned;
+    }
+
+    for (i = 0; i < def->niothreadids; i++) {
+        if (def->iothreadids[i]->cpumask)
+            goto pinned;
+    }
+
+    return 0;
+
+ pinned:
+    virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                   _("NUMA rebalancing of domains with explicit CPU pinning "
+                     "is not supported"));
+    return -1;
+}
+
+
+/* Asks the builtin NUMA placement where the domain currently having its
+ * memory on @current would fit best. Returns 1 and fills @target if it
+ * should be moved, 0 if not, -1 on error. */
+static int
+qemuDomainNumaRebalanceAdvise(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm,
+                              virBitmapPtr current,
+                              virBitmapPtr *target)
+{
+    g_autoptr(virNumaPlacementHost) host = NULL;
+    unsigned long long memory = virDomainDefGetMemoryTotal(vm->def);
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+
+    if (!(host = virNumaPlacementHostNew()) ||
+        virNumaPlacementHostUpdateLoad(host) < 0)
+        return -1;
+
+    virNumaPlacementHostAddPins(host, driver->numaPlacementPins, uuidstr);
+    virNumaPlacementHostReleaseDomain(host, current, memory);
+
+    return virNumaPlacementRecommend(host, current,
+                                     virDomainDefGetVcpus(vm->def),
+                                     memory, target);
+}
+
+
+static int
+qemuDomainNumaRebalanceSetCgroup(virCgroupPtr cgroup,
+                                 const char *mems,
+                                 const char *cpus)
+{
+    if (mems && virCgroupSetCpusetMems(cgroup, mems) < 0)
+        return -1;
+
+    if (cpus && virCgroupSetCpusetCpus(cgroup, cpus) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+struct qemuDomainNumaRebalanceCgroup {
+    virCgroupPtr cgroup;
+    bool thread; /* to be freed, unlike the root cgroup */
+    const char *cpus;
+    char *oldMems;
+    char *oldCpus;
+};
+
+
+static void
+qemuDomainNumaRebalanceCgroupsFree(struct qemuDomainNumaRebalanceCgroup *cgroups,
+                                   size_t ncgroups)
+{
+    size_t i;
+
+    for (i = 0; i < ncgroups; i++) {
+        if (cgroups[i].thread)
+            virCgroupFree(&cgroups[i].cgroup);
+        g_free(cgroups[i].oldMems);
+        g_free(cgroups[i].oldCpus);
+    }
+    g_free(cgroups);
+}
+
+
+static int
+qemuDomainNumaRebalanceAddThreadCgroup(virDomainObjPtr vm,
+                                       virCgroupThreadName nameval,
+                                       int id,
+                                       const char *cpus,
+                                       struct qemuDomainNumaRebalanceCgroup **cgroups,
+                                       size_t *ncgroups)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    struct qemuDomainNumaRebalanceCgroup cg = { .thread = true, .cpus = cpus };
+
+    if (virCgroupNewThread(priv->cgroup, nameval, id, false, &cg.cgroup) < 0)
+        return -1;
+
+    ignore_value(VIR_APPEND_ELEMENT(*cgroups, *ncgroups, cg));
+    return 0;
+}
+
+
+/* Sets cpuset.mems and cpuset.cpus of the thread cgroups of @vm to @mems and
+ * @cpus and those of its root cgroup to @mems and @rootCpus. As cgroup v1
+ * requires the sets of children to be subsets of the parent's ones, the
+ * root cgroup is updated first when the sets are being extended (@widen)
+ * and last when they are being reduced. If any cgroup can't be updated,
+ * the ones changed already are reverted in reverse order so that the
+ * domain isn't left with only some of its threads moved. */
+static int
+qemuDomainNumaRebalanceSetCgroups(virDomainObjPtr vm,
+                                  const char *mems,
+                                  const char *cpus,
+                                  const char *rootCpus,
+                                  bool widen)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    struct qemuDomainNumaRebalanceCgroup root = {
+        .cgroup = priv->cgroup, .cpus = rootCpus,
+    };
+    struct qemuDomainNumaRebalanceCgroup *cgroups = NULL;
+    size_t ncgroups = 0;
+    size_t i;
+    int ret = -1;
+
+    if (widen)
+        ignore_value(VIR_APPEND_ELEMENT(cgroups, ncgroups, root));
+
+    if (qemuDomainNumaRebalanceAddThreadCgroup(vm, VIR_CGROUP_THREAD_EMULATOR,
+                                               0, cpus,
+                                               &cgroups, &ncgroups) < 0)
+        goto cleanup;
+
+    for (i = 0; i < virDomainDefGetVcpusMax(vm->def); i++) {
+        virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(vm->def, i);
+
+        if (!vcpu->online)
+            continue;
+
+        if (qemuDomainNumaRebalanceAddThreadCgroup(vm, VIR_CGROUP_THREAD_VCPU,
+                                                   i, cpus,
+                                                   &cgroups, &ncgroups) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < vm->def->niothreadids; i++) {
+        if (qemuDomainNumaRebalanceAddThreadCgroup(vm, VIR_CGROUP_THREAD_IOTHREAD,
+                                                   vm->def->iothreadids[i]->iothread_id,
+                                                   cpus, &cgroups, &ncgroups) < 0)
+            goto cleanup;
+    }
+
+    if (!widen)
+        ignore_value(VIR_APPEND_ELEMENT(cgroups, ncgroups, root));
+
+    for (i = 0; i < ncgroups; i++) {
+        struct qemuDomainNumaRebalanceCgroup *cg = &cgroups[i];
+
+        if ((mems && virCgroupGetCpusetMems(cg->cgroup, &cg->oldMems) < 0) ||
+            (cg->cpus && virCgroupGetCpusetCpus(cg->cgroup, &cg->oldCpus) < 0) ||
+            qemuDomainNumaRebalanceSetCgroup(cg->cgroup, mems, cg->cpus) < 0) {
+            virErrorPtr orig_err;
+
+            virErrorPreserveLast(&orig_err);
+            /* The cgroup which failed may have been changed partially */
+            while (true) {
+                cg = &cgroups[i];
+                if (qemuDomainNumaRebalanceSetCgroup(cg->cgroup, cg->oldMems,
+                                                     cg->oldCpus) < 0)
+                    VIR_WARN("Unable to restore cpuset of domain %s",
+                             vm->def->name);
+                if (i-- == 0)
+                    break;
+            }
+            virErrorRestore(&orig_err);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    qemuDomainNumaRebalanceCgroupsFree(cgroups, ncgroups);
+    return ret;
+}
+
+
+/* Moves the memory of @vm from @sources to @target in chunks, at most at
+ * @bandwidth MiB/s if non-zero. The domain object is unlocked while pages
+ * are being moved. */
+static int
+qemuDomainNumaRebalanceMemory(virDomainObjPtr vm,
+                              virBitmapPtr sources,
+                              virBitmapPtr target,
+                              unsigned long long bandwidth)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainNumaStats *stats = &priv->job.current->stats.numa;
+    g_autofree virNumaMemoryRangePtr ranges = NULL;
+    size_t nranges = 0;
+    pid_t pid = vm->pid;
+    unsigned long long started;
+    size_t i;
+
+    if (virNumaGetProcessRanges(pid, sources, &ranges, &nranges) < 0)
+        return -1;
+
+    if (virTimeMillisNow(&started) < 0)
+        return -1;
+
+    for (i = 0; i < nranges; i++) {
+        unsigned long long start = ranges[i].start;
+
+        while (start < ranges[i].end) {
+            unsigned long long end;
+            unsigned long long moved = 0;
+            int rc;
+
+            if (priv->job.abortJob) {
+                virReportError(VIR_ERR_OPERATION_ABORTED, "%s",
+                               _("NUMA rebalancing canceled by client"));
+                return -1;
+            }
+
+            end = virNumaMemoryRangeNextChunk(&ranges[i], start,
+                                              QEMU_NUMA_REBALANCE_CHUNK);
+
+            virObjectUnlock(vm);
+            rc = virNumaMovePages(pid, start, end, ranges[i].pagesize,
+                                  sources, target, &moved);
+            virObjectLock(vm);
+
+            if (virDomainObjCheckActive(vm) < 0 || rc < 0)
+                return -1;
+
+            start = end;
+            stats->moved += moved;
+            /* the guest may have touched new memory on the old nodes */
+            stats->total = MAX(stats->total, stats->moved);
+
+            if (bandwidth > 0 && moved > 0) {
+                unsigned long long until;
+
+                until = started + stats->moved / (bandwidth * 1024 * 1024 / 1000);
+
+                /* virDomainAbortJob wakes us up */
+                while (!priv->job.abortJob) {
+                    if ((rc = virDomainObjWaitUntil(vm, until)) < 0)
+                        return -1;
+                    if (rc == 1)
+                        break;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainNumaRebalance(virDomainPtr dom,
+                        virTypedParameterPtr params,
+                        int nparams,
+                        unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
+    const char *nodeset = NULL;
+    unsigned long long bandwidth = 0;
+    g_autoptr(virBitmap) target = NULL;
+    g_autoptr(virBitmap) targetCpus = NULL;
+    g_autoptr(virBitmap) hostMemory = NULL;
+    g_autoptr(virBitmap) current = NULL;
+    g_autoptr(virBitmap) sources = NULL;
+    g_autoptr(virBitmap) mems = NULL;
+    g_autoptr(virBitmap) rootCpus = NULL;
+    g_autofree unsigned long long *memory = NULL;
+    size_t nmemory = 0;
+    g_autofree char *memsStr = NULL;
+    g_autofree char *targetStr = NULL;
+    g_autofree char *targetCpusStr = NULL;
+    g_autofree char *rootCpusStr = NULL;
+    virBitmapPtr finalMems;
+    int rc;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (virTypedParamsValidate(params, nparams,
+                               VIR_DOMAIN_NUMA_REBALANCE_NODESET,
+                               VIR_TYPED_PARAM_STRING,
+                               VIR_DOMAIN_NUMA_REBALANCE_BANDWIDTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               NULL) < 0)
+        return -1;
+
+    if (virTypedParamsGetString(params, nparams,
+                                VIR_DOMAIN_NUMA_REBALANCE_NODESET,
+                                &nodeset) < 0 ||
+        virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_NUMA_REBALANCE_BANDWIDTH,
+                                &bandwidth) < 0)
+        return -1;
+
+    if (bandwidth > ULLONG_MAX / (1024 * 1024)) {
+        virReportError(VIR_ERR_OVERFLOW,
+                       _("bandwidth must be less than %llu"),
+                       ULLONG_MAX / (1024 * 1024) + 1);
+        return -1;
+    }
+
+    if (nodeset) {
+        if (virBitmapParse(nodeset, &target, VIR_DOMAIN_CPUMASK_LEN) < 0)
+            return -1;
+
+        if (virBitmapIsAllClear(target)) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("Invalid nodeset: %s"), nodeset);
+            return -1;
+        }
+    }
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    priv = vm->privateData;
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (virDomainNumaRebalanceEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginAsyncJob(driver, vm,
+                                   QEMU_ASYNC_JOB_NUMA_REBALANCE,
+                                   VIR_DOMAIN_JOB_OPERATION_NUMA_REBALANCE,
+                                   flags) < 0)
+        goto cleanup;
+
+    priv->job.current->statsType = QEMU_DOMAIN_JOB_STATS_TYPE_NUMA;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (qemuDomainNumaRebalanceCheck(driver, vm) < 0)
+        goto endjob;
+
+    /* Where the memory of the domain is right now */
+    if (virNumaGetProcessMemory(vm->pid, &memory, &nmemory) < 0)
+        goto endjob;
+
+    current = virBitmapNewEmpty();
+    for (i = 0; i < nmemory; i++) {
+        if (memory[i] > 0 && virBitmapSetBitExpand(current, i) < 0)
+            goto endjob;
+    }
+
+    if (!target) {
+        if ((rc = qemuDomainNumaRebalanceAdvise(driver, vm, current,
+                                                &target)) < 0)
+            goto endjob;
+
+        if (rc == 0) {
+            VIR_DEBUG("Domain %s is placed well already", vm->def->name);
+            ret = 0;
+            goto endjob;
+        }
+    }
+
+    if (!virNumaNodesetIsAvailable(target))
+        goto endjob;
+
+    if (virNumaNodesetToCPUset(target, &targetCpus) < 0)
+        goto endjob;
+
+    /* Nodes without memory can still provide CPUs */
+    if (!(hostMemory = virNumaGetHostMemoryNodeset()))
+        goto endjob;
+    virBitmapIntersect(target, hostMemory);
+
+    if (virBitmapIsAllClear(target) || virBitmapIsAllClear(targetCpus)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("target NUMA nodes must provide both memory "
+                         "and CPUs"));
+        goto endjob;
+    }
+
+    if (!(mems = virBitmapNewCopy(target)))
+        goto endjob;
+    sources = virBitmapNewEmpty();
+
+    for (i = 0; i < nmemory; i++) {
+        if (memory[i] == 0)
+            continue;
+
+        if (virBitmapSetBitExpand(mems, i) < 0)
+            goto endjob;
+
+        if (virBitmapIsBitSet(target, i))
+            continue;
+
+        if (virBitmapSetBitExpand(sources, i) < 0)
+            goto endjob;
+        priv->job.current->stats.numa.total += memory[i];
+    }
+
+    if (virCgroupGetCpusetCpus(priv->cgroup, &rootCpusStr) < 0)
+        goto endjob;
+
+    if (rootCpusStr && *rootCpusStr) {
+        if (virBitmapParse(rootCpusStr, &rootCpus, VIR_DOMAIN_CPUMASK_LEN) < 0 ||
+            virBitmapUnion(rootCpus, targetCpus) < 0)
+            goto endjob;
+        VIR_FREE(rootCpusStr);
+
+        if (!(rootCpusStr = virBitmapFormat(rootCpus)))
+            goto endjob;
+    } else {
+        VIR_FREE(rootCpusStr);
+    }
+
+    if (!(memsStr = virBitmapFormat(mems)) ||
+        !(targetStr = virBitmapFormat(target)) ||
+        !(targetCpusStr = virBitmapFormat(targetCpus)))
+        goto endjob;
+
+    VIR_DEBUG("Moving domain %s to nodes %s (CPUs %s), %llu bytes to move",
+              vm->def->name, targetStr, targetCpusStr,
+              priv->job.current->stats.numa.total);
+
+    /* Allow both the old and new nodes so that the kernel doesn't move all
+     * memory at once, and move the threads so that new allocations of the
+     * guest land on the target nodes. */
+    if (qemuDomainNumaRebalanceSetCgroups(vm, memsStr, targetCpusStr,
+                                          rootCpusStr, true) < 0)
+        goto endjob;
+
+    rc = qemuDomainNumaRebalanceMemory(vm, sources, target, bandwidth);
+
+    if (!virDomainObjIsActive(vm))
+        goto endjob;
+
+    /* Once all memory was moved, restrict the domain to the new nodes. If
+     * the job was aborted or failed keep the old nodes for the memory which
+     * remained there. */
+    finalMems = rc == 0 ? target : mems;
+    VIR_FREE(memsStr);
+    if (!(memsStr = virBitmapFormat(finalMems)))
+        goto endjob;
+
+    if (qemuDomainNumaRebalanceSetCgroups(vm, memsStr, NULL,
+                                          targetCpusStr, false) < 0)
+        goto endjob;
+
+    if (priv->autoNodeset) {
+        virBitmapFree(priv->autoNodeset);
+        virBitmapFree(priv->autoCpuset);
+        priv->autoCpuset = NULL;
+
+        if (!(priv->autoNodeset = virBitmapNewCopy(finalMems)) ||
+            !(priv->autoCpuset = virBitmapNewCopy(targetCpus)))
+            goto endjob;
+
+        qemuProcessPinNUMAPlacement(driver, vm);
+    } else if (virDomainNumatuneSet(vm->def->numa,
+                                    vm->def->placement_mode ==
+                                    VIR_DOMAIN_CPU_PLACEMENT_MODE_STATIC,
+                                    -1, -1, finalMems) < 0) {
+        goto endjob;
+    }
+
+    if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
+        goto endjob;
+
+    if (rc == 0)
+        ret = 0;
+
+ endjob:
+    if (priv->job.current) {
+        qemuDomainJobInfoUpdateTime(priv->job.current);
+        g_clear_pointer(&priv->job.completed, qemuDomainJobInfoFree);
+        priv->job.completed = qemuDomainJobInfoCopy(priv->job.current);
+
+        if (ret == 0)
+            priv->job.completed->status = QEMU_DOMAIN_JOB_STATUS_COMPLETED;
+        else if (priv->job.abortJob)
+            priv->job.completed->status = QEMU_DOMAIN_JOB_STATUS_CANCELED;
+        else
+            priv->job.completed->status = QEMU_DOMAIN_JOB_STATUS_FAILED;
+    }
+    qemuDomainObjEndAsyncJob(driver, vm);
 
  cleanup:
     virDomainObjEndAPI(&vm);
     return ret;
 }
 
+
 static int
 qemuSetGlobalBWLive(virCgroupPtr cgroup, unsigned long long period,
                     long long quota)
@@ -13648,6 +14168,11 @@ qemuDomainGetJobStatsInternal(virQEMUDriverPtr driver,
             goto cleanup;
         break;
 
+    case QEMU_DOMAIN_JOB_STATS_TYPE_NUMA:
+        if (qemuDomainJobInfoUpdateTime(*jobInfo) < 0)
+            goto cleanup;
+        break;
+
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
         break;
     }
@@ -13834,6 +14359,11 @@ static int qemuDomainAbortJob(virDomainPtr dom)
         ret = 0;
         break;
 
+    case QEMU_ASYNC_JOB_NUMA_REBALANCE:
+        qemuDomainObjAbortAsyncJob(vm);
+        ret = 0;
+        break;
+
     case QEMU_ASYNC_JOB_LAST:
     default:
         virReportEnumRangeError(qemuDomainAsyncJob, priv->job.asyncJob);
@@ -20203,6 +20733,21 @@ qemuNodeGetMemoryStats(virConnectPtr conn,
 }
 
 
+static int
+qemuNodeGetPressureStats(virConnectPtr conn,
+                         virTypedParameterPtr *params,
+                         int *nparams,
+                         unsigned int flags)
+{
+    virCheckFlags(0, -1);
+
+    if (virNodeGetPressureStatsEnsureACL(conn) < 0)
+        return -1;
+
+    return virPSIGetHostParams(params, nparams);
+}
+
+
 static int
 qemuNodeGetCellsFreeMemory(virConnectPtr conn,
                            unsigned long long *freeMems,
@@ -21012,6 +21557,93 @@ qemuDomainGetStatsCpuCache(virQEMUDriverPtr driver,
 }
 
 
+/* Tells whether the last error means that a cgroup counter is not provided
+ * at all, in which case it is not worth trying to read it again. */
+static bool
+qemuDomainThreadCgroupUnsupported(void)
+{
+    virErrorPtr err = virGetLastError();
+
+    if (virLastErrorIsSystemErrno(ENOENT))
+        return true;
+
+    return err && err->code == VIR_ERR_OPERATION_UNSUPPORTED;
+}
+
+
+/* Reports CPU time and CFS throttling counters of one of the per-thread
+ * cgroups set up by qemuSetupCgroupForVcpu and friends. A missing cgroup or
+ * an unreadable counter is not an error, the fields are just omitted. The
+ * cgroups are kept open in the domain private data. A counter the host
+ * doesn't provide is not tried again, so that the log isn't flooded with
+ * the same error on every query, while a transient failure is. */
+static int
+qemuDomainGetStatsThreadCgroup(virDomainObjPtr dom,
+                               virCgroupThreadName nameval,
+                               int id,
+                               bool reportTime,
+                               virTypedParamListPtr params,
+                               const char *prefix)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    qemuDomainThreadCgroupPtr tcg;
+    unsigned long long cpu_time = 0;
+    unsigned long long periods = 0;
+    unsigned long long throttled = 0;
+    unsigned long long throttled_time = 0;
+    int ret = -1;
+
+    if (!priv->cgroup ||
+        !virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPU))
+        return 0;
+
+    if (!(tcg = qemuDomainGetThreadCgroup(dom, nameval, id)))
+        return 0;
+
+    if (!virCgroupHasController(tcg->cgroup, VIR_CGROUP_CONTROLLER_CPUACCT))
+        tcg->noUsage = true;
+
+    /* on cgroup v2 both the usage and the throttling counters come from
+     * cpu.stat, which is then read only once */
+    virCgroupBeginStatSnapshot(tcg->cgroup);
+
+    if (reportTime && !tcg->noUsage) {
+        if (virCgroupGetCpuacctUsage(tcg->cgroup, &cpu_time) < 0) {
+            if (qemuDomainThreadCgroupUnsupported())
+                tcg->noUsage = true;
+            virResetLastError();
+        } else if (virTypedParamListAddULLong(params, cpu_time,
+                                              "%s.time", prefix) < 0) {
+            goto cleanup;
+        }
+    }
+
+    if (!tcg->noThrottling) {
+        if (virCgroupGetCpuThrottling(tcg->cgroup, &periods, &throttled,
+                                      &throttled_time) < 0) {
+            if (qemuDomainThreadCgroupUnsupported())
+                tcg->noThrottling = true;
+            virResetLastError();
+        } else if (virTypedParamListAddULLong(params, periods,
+                                              "%s.periods", prefix) < 0 ||
+                   virTypedParamListAddULLong(params, throttled,
+                                              "%s.throttled.periods",
+                                              prefix) < 0 ||
+                   virTypedParamListAddULLong(params, throttled_time,
+                                              "%s.throttled.time",
+                                              prefix) < 0) {
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCgroupEndStatSnapshot(tcg->cgroup);
+    return ret;
+}
+
+
 static int
 qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
                             virTypedParamListPtr params)
@@ -21035,6 +21667,11 @@ qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
     if (!err && virTypedParamListAddULLong(params, sys_time, "cpu.system") < 0)
         return -1;
 
+    if (virDomainObjIsActive(dom) &&
+        qemuDomainGetStatsThreadCgroup(dom, VIR_CGROUP_THREAD_EMULATOR, 0,
+                                       true, params, "cpu.emulator") < 0)
+        return -1;
+
     return 0;
 }
 
@@ -21133,9 +21770,11 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
     virDomainVcpuDefPtr vcpu;
     qemuDomainVcpuPrivatePtr vcpupriv;
     size_t i;
-    int ret = -1;
-    virVcpuInfoPtr cpuinfo = NULL;
-    g_autofree unsigned long long *cpuwait = NULL;
+    unsigned long long runTime;
+    unsigned long long runDelay;
+    char prefix[VIR_TYPED_PARAM_FIELD_LENGTH];
+    bool active = virDomainObjIsActive(dom);
+    bool noSchedstat = false;
 
     if (virTypedParamListAddUInt(params, virDomainDefGetVcpus(dom->def),
                                  "vcpu.current") < 0)
@@ -21145,62 +21784,67 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
                                  "vcpu.maximum") < 0)
         return -1;
 
-    if (VIR_ALLOC_N(cpuinfo, virDomainDefGetVcpus(dom->def)) < 0 ||
-        VIR_ALLOC_N(cpuwait, virDomainDefGetVcpus(dom->def)) < 0)
-        goto cleanup;
+    /* it's ok to be silent and go ahead */
+    if (!qemuDomainHasVcpuPids(dom))
+        return 0;
 
-    if (HAVE_JOB(privflags) && virDomainObjIsActive(dom) &&
+    if (HAVE_JOB(privflags) && active &&
         qemuDomainRefreshVcpuHalted(driver, dom, QEMU_ASYNC_JOB_NONE) < 0) {
             /* it's ok to be silent and go ahead, because halted vcpu info
              * wasn't here from the beginning */
             virResetLastError();
     }
 
-    if (qemuDomainHelperGetVcpus(dom, cpuinfo, cpuwait,
-                                 virDomainDefGetVcpus(dom->def),
-                                 NULL, 0) < 0) {
-        virResetLastError();
-        ret = 0; /* it's ok to be silent and go ahead */
-        goto cleanup;
-    }
+    /* All the times of a vCPU thread come from a single read of its
+     * schedstat file, instead of parsing stat and sched separately. */
+    for (i = 0; i < virDomainDefGetVcpusMax(dom->def); i++) {
+        vcpu = virDomainDefGetVcpu(dom->def, i);
 
-    for (i = 0; i < virDomainDefGetVcpus(dom->def); i++) {
-        if (virTypedParamListAddInt(params, cpuinfo[i].state,
-                                    "vcpu.%u.state", cpuinfo[i].number) < 0)
-            goto cleanup;
+        if (!vcpu->online)
+            continue;
+
+        if (virTypedParamListAddInt(params, VIR_VCPU_RUNNING,
+                                    "vcpu.%zu.state", i) < 0)
+            return -1;
 
         /* stats below are available only if the VM is alive */
-        if (!virDomainObjIsActive(dom))
+        if (!active)
             continue;
 
-        if (virTypedParamListAddULLong(params, cpuinfo[i].cpuTime,
-                                       "vcpu.%u.time", cpuinfo[i].number) < 0)
-            goto cleanup;
+        vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
 
-        if (virTypedParamListAddULLong(params, cpuwait[i],
-                                       "vcpu.%u.wait", cpuinfo[i].number) < 0)
-            goto cleanup;
+        if (vcpupriv->tid > 0 && !noSchedstat) {
+            int rc = qemuGetSchedstat(&runTime, &runDelay,
+                                      dom->pid, vcpupriv->tid);
 
-        /* state below is extracted from the individual vcpu structs */
-        if (!(vcpu = virDomainDefGetVcpu(dom->def, cpuinfo[i].number)))
-            continue;
+            if (rc == -2) {
+                noSchedstat = true;
+            } else if (rc < 0) {
+                virResetLastError();
+            } else if (virTypedParamListAddULLong(params, runTime,
+                                                  "vcpu.%zu.time", i) < 0 ||
+                       virTypedParamListAddULLong(params, runDelay,
+                                                  "vcpu.%zu.wait", i) < 0 ||
+                       virTypedParamListAddULLong(params, runDelay,
+                                                  "vcpu.%zu.delay", i) < 0) {
+                return -1;
+            }
+        }
 
-        vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+        g_snprintf(prefix, sizeof(prefix), "vcpu.%zu", i);
+        if (qemuDomainGetStatsThreadCgroup(dom, VIR_CGROUP_THREAD_VCPU, i,
+                                           false, params, prefix) < 0)
+            return -1;
 
         if (vcpupriv->halted != VIR_TRISTATE_BOOL_ABSENT) {
             if (virTypedParamListAddBoolean(params,
                                             vcpupriv->halted == VIR_TRISTATE_BOOL_YES,
-                                            "vcpu.%u.halted",
-                                            cpuinfo[i].number) < 0)
-                goto cleanup;
+                                            "vcpu.%zu.halted", i) < 0)
+                return -1;
         }
     }
 
-    ret = 0;
-
- cleanup:
-    VIR_FREE(cpuinfo);
-    return ret;
+    return 0;
 }
 
 #define QEMU_ADD_NET_PARAM(params, num, name, value) \
@@ -21634,6 +22278,7 @@ qemuDomainGetStatsIOThread(virQEMUDriverPtr driver,
     size_t i;
     qemuMonitorIOThreadInfoPtr *iothreads = NULL;
     int niothreads;
+    char prefix[VIR_TYPED_PARAM_FIELD_LENGTH];
     int ret = -1;
 
     if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
@@ -21670,6 +22315,13 @@ qemuDomainGetStatsIOThread(virQEMUDriverPtr driver,
                                          iothreads[i]->iothread_id) < 0)
                 goto cleanup;
         }
+
+        g_snprintf(prefix, sizeof(prefix), "iothread.%u",
+                   iothreads[i]->iothread_id);
+        if (qemuDomainGetStatsThreadCgroup(dom, VIR_CGROUP_THREAD_IOTHREAD,
+                                           iothreads[i]->iothread_id, true,
+                                           params, prefix) < 0)
+            goto cleanup;
     }
 
     ret = 0;
@@ -21720,6 +22372,211 @@ qemuDomainGetStatsPerf(virQEMUDriverPtr driver G_GNUC_UNUSED,
     return 0;
 }
 
+/* Bandwidth in MiB/s available for migrating @dom: the configured maximum
+ * or, if it is not limited, the transfer rate of the running or last
+ * completed migration. Returns 0 if no bandwidth is known. */
+static unsigned long long
+qemuDomainGetMigrationBandwidth(virDomainObjPtr dom)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    qemuDomainJobInfoPtr jobs[] = { priv->job.current, priv->job.completed };
+    size_t i;
+
+    if (priv->migMaxBandwidth != QEMU_DOMAIN_MIG_BANDWIDTH_MAX)
+        return priv->migMaxBandwidth;
+
+    for (i = 0; i < G_N_ELEMENTS(jobs); i++) {
+        if (jobs[i] &&
+            jobs[i]->statsType == QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION &&
+            jobs[i]->stats.mig.ram_bps > 0)
+            return jobs[i]->stats.mig.ram_bps / (1024 * 1024);
+    }
+
+    return 0;
+}
+
+
+/* Maximum number of pre-copy passes simulated by
+ * qemuDomainEstimateMigration */
+#define QEMU_DOMAIN_ESTIMATE_MIGRATION_PASSES 1000
+
+/**
+ * qemuDomainEstimateMigration:
+ * @memory: memory size in MiB
+ * @bandwidth: migration bandwidth in MiB/s
+ * @dirtyRate: dirty rate in MiB/s
+ * @downtimeLimit: maximum downtime in milliseconds
+ * @total: filled in with the estimated duration of the migration in ms
+ * @downtime: filled in with the estimated downtime in ms
+ *
+ * Every pass of pre-copy migration sends the memory dirtied during the
+ * previous one. Migration stops once the rest can be sent within
+ * @downtimeLimit while the guest is paused.
+ *
+ * Returns true if migration converges, false otherwise.
+ */
+static bool
+qemuDomainEstimateMigration(unsigned long long memory,
+                            unsigned long long bandwidth,
+                            unsigned long long dirtyRate,
+                            unsigned long long downtimeLimit,
+                            unsigned long long *total,
+                            unsigned long long *downtime)
+{
+    double remaining = memory;
+    double elapsed = 0;
+    size_t i;
+
+    if (bandwidth <= dirtyRate)
+        return false;
+
+    for (i = 0; i < QEMU_DOMAIN_ESTIMATE_MIGRATION_PASSES; i++) {
+        double pass = remaining / bandwidth;
+
+        if (pass * 1000 <= downtimeLimit) {
+            *downtime = pass * 1000;
+            *total = (elapsed + pass) * 1000;
+            return true;
+        }
+
+        elapsed += pass;
+        remaining = pass * dirtyRate;
+    }
+
+    return false;
+}
+
+
+static int
+qemuDomainGetStatsDirtyRate(virQEMUDriverPtr driver,
+                            virDomainObjPtr dom,
+                            virTypedParamListPtr params,
+                            unsigned int privflags)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    g_autoptr(qemuMigrationParams) migParams = NULL;
+    qemuMonitorDirtyRateInfo info;
+    unsigned long long memory;
+    unsigned long long bandwidth;
+    unsigned long long downtimeLimit;
+    unsigned long long total;
+    unsigned long long downtime;
+    int rv;
+
+    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
+        return 0;
+
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CALC_DIRTY_RATE))
+        return 0;
+
+    qemuDomainObjEnterMonitor(driver, dom);
+    rv = qemuMonitorQueryDirtyRate(priv->mon, &info);
+    if (qemuDomainObjExitMonitor(driver, dom) < 0 || rv < 0)
+        return -1;
+
+    if (virTypedParamListAddInt(params, info.status,
+                                "dirtyrate.calc_status") < 0 ||
+        virTypedParamListAddLLong(params, info.startTime,
+                                  "dirtyrate.calc_start_time") < 0 ||
+        virTypedParamListAddInt(params, info.calcTime,
+                                "dirtyrate.calc_period") < 0)
+        return -1;
+
+    if (info.status != VIR_DOMAIN_DIRTYRATE_MEASURED)
+        return 0;
+
+    if (virTypedParamListAddLLong(params, info.dirtyRate,
+                                  "dirtyrate.megabytes_per_second") < 0)
+        return -1;
+
+    bandwidth = qemuDomainGetMigrationBandwidth(dom);
+    if (bandwidth == 0 ||
+        info.dirtyRate < 0 ||
+        bandwidth <= (unsigned long long) info.dirtyRate)
+        return 0;
+
+    if (qemuMigrationParamsFetch(driver, dom, QEMU_ASYNC_JOB_NONE,
+                                 &migParams) < 0)
+        return -1;
+
+    if ((rv = qemuMigrationParamsGetULL(migParams,
+                                        QEMU_MIGRATION_PARAM_DOWNTIME_LIMIT,
+                                        &downtimeLimit)) < 0)
+        return -1;
+
+    if (rv == 1)
+        return 0;
+
+    memory = virDomainDefGetMemoryTotal(dom->def) / 1024;
+
+    if (!qemuDomainEstimateMigration(memory, bandwidth, info.dirtyRate,
+                                     downtimeLimit, &total, &downtime))
+        return 0;
+
+    if (virTypedParamListAddULLong(params, total,
+                                   "dirtyrate.migration.estimated_time") < 0 ||
+        virTypedParamListAddULLong(params, downtime,
+                                   "dirtyrate.migration.estimated_downtime") < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsPressure(virQEMUDriverPtr driver G_GNUC_UNUSED,
+                           virDomainObjPtr dom,
+                           virTypedParamListPtr params,
+                           unsigned int privflags G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    size_t i;
+
+    if (!virDomainObjIsActive(dom) || !priv->cgroup)
+        return 0;
+
+    for (i = 0; i < VIR_PSI_RESOURCE_LAST; i++) {
+        g_autofree char *prefix = NULL;
+        virPSIStats stats;
+        int rc;
+
+        /* pressure stall information is only available with cgroup v2
+         * and a kernel built with CONFIG_PSI, skip it silently otherwise */
+        if ((rc = virCgroupGetPressure(priv->cgroup, i, &stats)) == -2)
+            continue;
+
+        if (rc < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        prefix = g_strdup_printf("pressure.%s", virPSIResourceTypeToString(i));
+
+        if (virPSIAddParams(params, &stats, prefix) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsStartup(virQEMUDriverPtr driver G_GNUC_UNUSED,
+                          virDomainObjPtr dom,
+                          virTypedParamListPtr params,
+                          unsigned int privflags G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+
+    /* Only domains started (rather than migrated in or restored after
+     * daemon restart) have the timings recorded. */
+    if (!virDomainObjIsActive(dom))
+        return 0;
+
+    return qemuDomainStartTimesFormatParams(&priv->startTimes, params);
+}
+
+
 typedef int
 (*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
@@ -21742,6 +22599,9 @@ static struct qemuDomainGetStatsWorker qemuDomainGetStatsWorkers[] = {
     { qemuDomainGetStatsPerf, VIR_DOMAIN_STATS_PERF, false },
     { qemuDomainGetStatsIOThread, VIR_DOMAIN_STATS_IOTHREAD, true },
     { qemuDomainGetStatsMemory, VIR_DOMAIN_STATS_MEMORY, false },
+    { qemuDomainGetStatsDirtyRate, VIR_DOMAIN_STATS_DIRTYRATE, true },
+    { qemuDomainGetStatsPressure, VIR_DOMAIN_STATS_PRESSURE, false },
+    { qemuDomainGetStatsStartup, VIR_DOMAIN_STATS_STARTUP, false },
     { NULL, 0, false }
 };
 
@@ -21795,6 +22655,7 @@ qemuDomainGetStats(virConnectPtr conn,
                    virDomainStatsRecordPtr *record,
                    unsigned int flags)
 {
+    qemuDomainObjPrivatePtr priv = dom->privateData;
     g_autofree virDomainStatsRecordPtr tmp = NULL;
     g_autoptr(virTypedParamList) params = NULL;
     size_t i;
@@ -21802,14 +22663,22 @@ qemuDomainGetStats(virConnectPtr conn,
     if (VIR_ALLOC(params) < 0)
         return -1;
 
+    /* The workers may drop the domain lock while talking to the monitor,
+     * so the cgroup is looked up again to end the snapshot. */
+    virCgroupBeginStatSnapshot(priv->cgroup);
+
     for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
         if (stats & qemuDomainGetStatsWorkers[i].stats) {
             if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, params,
-                                                  flags) < 0)
+                                                  flags) < 0) {
+                virCgroupEndStatSnapshot(priv->cgroup);
                 return -1;
+            }
         }
     }
 
+    virCgroupEndStatSnapshot(priv->cgroup);
+
     if (VIR_ALLOC(tmp) < 0)
         return -1;
 
@@ -23221,6 +24090,61 @@ qemuDomainAgentSetResponseTimeout(virDomainPtr dom,
 }
 
 
+static int
+qemuDomainStartDirtyRateCalc(virDomainPtr dom,
+                             int seconds,
+                             unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (seconds < 1 || seconds > 60) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("seconds=%d is invalid, please choose value within [1, 60]"),
+                       seconds);
+        return -1;
+    }
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainStartDirtyRateCalcEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    priv = vm->privateData;
+
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CALC_DIRTY_RATE)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("QEMU does not support calculating dirty page rate"));
+        goto endjob;
+    }
+
+    VIR_DEBUG("Calculating dirty rate in next %d seconds", seconds);
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorStartDirtyRateCalc(priv->mon, seconds);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
 static virHypervisorDriver qemuHypervisorDriver = {
     .name = QEMU_DRIVER_NAME,
     .connectURIProbe = qemuConnectURIProbe,
@@ -23460,6 +24384,9 @@ static virHypervisorDriver qemuHypervisorDriver = {
     .domainAgentSetResponseTimeout = qemuDomainAgentSetResponseTimeout, /* 5.10.0 */
     .domainBackupBegin = qemuDomainBackupBegin, /* 6.0.0 */
     .domainBackupGetXMLDesc = qemuDomainBackupGetXMLDesc, /* 6.0.0 */
+    .domainStartDirtyRateCalc = qemuDomainStartDirtyRateCalc, /* 6.5.0 */
+    .domainNumaRebalance = qemuDomainNumaRebalance, /* 6.5.0 */
+    .nodeGetPressureStats = qemuNodeGetPressureStats, /* 6.5.0 */
 };
 
 
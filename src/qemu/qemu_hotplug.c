@@ -5999,8 +5999,10 @@ qemuDomainRemoveVcpu(virQEMUDriverPtr driver,
 
     virErrorPreserveLast(&save_error);
 
-    for (i = vcpu; i < vcpu + nvcpus; i++)
+    for (i = vcpu; i < vcpu + nvcpus; i++) {
+        qemuDomainRemoveThreadCgroup(vm, VIR_CGROUP_THREAD_VCPU, i);
         ignore_value(virCgroupDelThread(priv->cgroup, VIR_CGROUP_THREAD_VCPU, i));
+    }
 
     virErrorRestore(&save_error);
 
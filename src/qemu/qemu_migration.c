@@ -26,6 +26,8 @@
 #include <poll.h>
 
 #include "qemu_migration.h"
+#define LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+#include "qemu_migrationpriv.h"
 #include "qemu_migration_cookie.h"
 #include "qemu_migration_params.h"
 #include "qemu_monitor.h"
@@ -62,6 +64,7 @@
 #include "virdomainsnapshotobjlist.h"
 #include "virsocket.h"
 #include "virutil.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -295,6 +298,35 @@ qemuMigrationAnyCopyDisk(virDomainDiskDef const *disk,
 }
 
 
+/* Upper limit on threads creating storage volumes for incoming migration */
+#define QEMU_MIGRATION_PRECREATE_WORKERS_MAX 8
+
+typedef struct _qemuMigrationDstPrecreateData qemuMigrationDstPrecreateData;
+typedef qemuMigrationDstPrecreateData *qemuMigrationDstPrecreateDataPtr;
+struct _qemuMigrationDstPrecreateData {
+    virConnectPtr conn;
+    virDomainDiskDefPtr *disks;
+    unsigned long long *capacities;
+    size_t ndisks;
+};
+
+
+/*
+ * Create the volume of a single disk of @opaque. Volume creation may take
+ * a while, e.g. with preallocation or on a slow pool, so up to
+ * QEMU_MIGRATION_PRECREATE_WORKERS_MAX volumes are created at once.
+ */
+static int
+qemuMigrationDstPrecreateWorker(size_t i,
+                                void *opaque)
+{
+    qemuMigrationDstPrecreateDataPtr data = opaque;
+
+    return qemuMigrationDstPrecreateDisk(data->conn, data->disks[i],
+                                         data->capacities[i]);
+}
+
+
 static int
 qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
                                  qemuMigrationCookieNBDPtr nbd,
@@ -305,6 +337,7 @@ qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
     int ret = -1;
     size_t i = 0;
     virConnectPtr conn;
+    qemuMigrationDstPrecreateData data = { 0 };
 
     if (!nbd || !nbd->ndisks)
         return 0;
@@ -312,6 +345,10 @@ qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
     if (!(conn = virGetConnectStorage()))
         return -1;
 
+    data.conn = conn;
+    data.disks = g_new0(virDomainDiskDefPtr, nbd->ndisks);
+    data.capacities = g_new0(unsigned long long, nbd->ndisks);
+
     for (i = 0; i < nbd->ndisks; i++) {
         virDomainDiskDefPtr disk;
         const char *diskSrcPath;
@@ -349,12 +386,23 @@ qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
 
         VIR_DEBUG("Proceeding with disk source %s", NULLSTR(diskSrcPath));
 
-        if (qemuMigrationDstPrecreateDisk(conn, disk, nbd->disks[i].capacity) < 0)
-            goto cleanup;
+        data.disks[data.ndisks] = disk;
+        data.capacities[data.ndisks] = nbd->disks[i].capacity;
+        data.ndisks++;
     }
 
+    /* Don't start any more volumes once something failed */
+    if (virThreadPoolRunParallel(data.ndisks,
+                                 QEMU_MIGRATION_PRECREATE_WORKERS_MAX,
+                                 "mig-precreate",
+                                 qemuMigrationDstPrecreateWorker, &data,
+                                 VIR_THREAD_POOL_PARALLEL_STOP_ON_ERROR) < 0)
+        goto cleanup;
+
     ret = 0;
  cleanup:
+    VIR_FREE(data.disks);
+    VIR_FREE(data.capacities);
     virObjectUnref(conn);
     return ret;
 }
@@ -1524,6 +1572,8 @@ qemuMigrationJobName(virDomainObjPtr vm)
         return _("start job");
     case QEMU_ASYNC_JOB_BACKUP:
         return _("backup job");
+    case QEMU_ASYNC_JOB_NUMA_REBALANCE:
+        return _("NUMA rebalance job");
     case QEMU_ASYNC_JOB_LAST:
     default:
         return _("job");
@@ -1590,6 +1640,8 @@ enum qemuMigrationCompletedFlags {
     QEMU_MIGRATION_COMPLETED_CHECK_STORAGE  = (1 << 1),
     QEMU_MIGRATION_COMPLETED_POSTCOPY       = (1 << 2),
     QEMU_MIGRATION_COMPLETED_PRE_SWITCHOVER = (1 << 3),
+    /* This flag should only be set when run on src host */
+    QEMU_MIGRATION_COMPLETED_AUTO_TUNE      = (1 << 4),
 };
 
 
@@ -1687,6 +1739,237 @@ qemuMigrationAnyCompleted(virQEMUDriverPtr driver,
 }
 
 
+/* How often (in ms) the progress of an auto-tuned migration is checked */
+#define QEMU_MIGRATION_AUTO_TUNE_INTERVAL 1000
+
+/* QEMU's default downtime limit (in ms) */
+#define QEMU_MIGRATION_DOWNTIME_DEFAULT 300
+
+
+/**
+ * qemuMigrationAutoTuneStalled:
+ * @tune: auto-tuning state
+ * @stats: current migration statistics
+ *
+ * Account a new memory pass reported in @stats. A pass stalls when the
+ * guest dirties memory at least as fast as it is transferred or when the
+ * remaining memory did not shrink since the previous pass.
+ *
+ * Returns true once QEMU_MIGRATION_AUTO_TUNE_STALLED consecutive passes
+ * stalled, false otherwise.
+ */
+bool
+qemuMigrationAutoTuneStalled(qemuMigrationAutoTunePtr tune,
+                             qemuMonitorMigrationStatsPtr stats)
+{
+    if (stats->status != QEMU_MONITOR_MIGRATION_STATUS_ACTIVE ||
+        stats->ram_iteration <= tune->iteration ||
+        stats->ram_bps == 0)
+        return false;
+
+    if (stats->ram_dirty_rate * stats->ram_page_size >= stats->ram_bps ||
+        (tune->iteration > 0 && stats->ram_remaining >= tune->remaining))
+        tune->stalled++;
+    else
+        tune->stalled = 0;
+
+    tune->iteration = stats->ram_iteration;
+    tune->remaining = stats->ram_remaining;
+
+    if (tune->stalled < QEMU_MIGRATION_AUTO_TUNE_STALLED)
+        return false;
+
+    tune->stalled = 0;
+    return true;
+}
+
+
+/**
+ * qemuMigrationAutoTuneDecide:
+ * @tune: auto-tuning state with a known downtime limit
+ * @stats: current migration statistics
+ * @postcopy: whether post-copy was enabled for the migration
+ * @downtime: filled in with the downtime (in ms) needed to finish
+ *
+ * Decide what to do with a migration which stalled. The downtime needed
+ * to send the remaining memory is estimated from the transfer rate with
+ * a 25% reserve.
+ *
+ * Returns the action to take.
+ */
+qemuMigrationAutoTuneAction
+qemuMigrationAutoTuneDecide(qemuMigrationAutoTunePtr tune,
+                            qemuMonitorMigrationStatsPtr stats,
+                            bool postcopy,
+                            unsigned long long *downtime)
+{
+    unsigned long long needed;
+
+    needed = stats->ram_remaining * 1000 / stats->ram_bps;
+    needed += needed / 4;
+    *downtime = needed;
+
+    /* Migration should complete once QEMU finishes the current pass */
+    if (needed <= tune->downtime)
+        return QEMU_MIGRATION_AUTO_TUNE_NONE;
+
+    if (needed <= QEMU_MIGRATION_AUTO_TUNE_DOWNTIME_MAX)
+        return QEMU_MIGRATION_AUTO_TUNE_DOWNTIME;
+
+    if (postcopy)
+        return QEMU_MIGRATION_AUTO_TUNE_POSTCOPY;
+
+    return QEMU_MIGRATION_AUTO_TUNE_GIVE_UP;
+}
+
+
+static int
+qemuMigrationSrcAutoTuneDowntime(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 qemuDomainAsyncJob asyncJob,
+                                 qemuMigrationAutoTunePtr tune,
+                                 unsigned long long downtime)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virJSONValuePtr params = NULL;
+    int rc;
+
+    if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_PARAM_DOWNTIME) &&
+        virJSONValueObjectCreate(&params,
+                                 "U:downtime-limit", downtime,
+                                 NULL) < 0)
+        return -1;
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0) {
+        virJSONValueFree(params);
+        return -1;
+    }
+
+    if (params)
+        rc = qemuMonitorSetMigrationParams(priv->mon, params);
+    else
+        rc = qemuMonitorSetMigrationDowntime(priv->mon, downtime);
+
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+        return -1;
+
+    tune->downtime = downtime;
+    return 0;
+}
+
+
+/**
+ * qemuMigrationSrcAutoTune:
+ *
+ * Check whether a running migration still converges and adjust its
+ * parameters if it does not. When the guest keeps dirtying memory at least
+ * as fast as it can be transferred for several passes, the downtime limit
+ * is raised so that the remaining memory can be sent while the guest is
+ * paused. If that would need an unreasonably long downtime and post-copy
+ * was enabled for the migration (@postcopy), we switch to post-copy.
+ * The decisions are recorded in the job statistics.
+ *
+ * Failures are not fatal, the migration just continues untuned.
+ */
+static void
+qemuMigrationSrcAutoTune(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm,
+                         qemuDomainAsyncJob asyncJob,
+                         qemuMigrationAutoTunePtr tune,
+                         bool postcopy)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobInfoPtr jobInfo = priv->job.current;
+    qemuMonitorMigrationStatsPtr stats = &jobInfo->stats.mig;
+    unsigned long long now;
+    unsigned long long needed;
+    qemuMigrationAutoTuneAction action;
+
+    if (tune->done ||
+        virTimeMillisNow(&now) < 0 ||
+        now - tune->lastCheck < QEMU_MIGRATION_AUTO_TUNE_INTERVAL)
+        return;
+
+    tune->lastCheck = now;
+
+    /* Without migration events stats are refreshed on every check of the
+     * migration status */
+    if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT) &&
+        qemuMigrationAnyFetchStats(driver, vm, asyncJob, jobInfo, NULL) < 0)
+        goto error;
+
+    if (!qemuMigrationAutoTuneStalled(tune, stats))
+        return;
+
+    if (tune->downtime == 0) {
+        g_autoptr(qemuMigrationParams) migParams = NULL;
+        int rc;
+
+        if (qemuMigrationParamsFetch(driver, vm, asyncJob, &migParams) < 0 ||
+            (rc = qemuMigrationParamsGetULL(migParams,
+                                            QEMU_MIGRATION_PARAM_DOWNTIME_LIMIT,
+                                            &tune->downtime)) < 0)
+            goto error;
+
+        if (rc == 1 || tune->downtime == 0)
+            tune->downtime = QEMU_MIGRATION_DOWNTIME_DEFAULT;
+    }
+
+    action = qemuMigrationAutoTuneDecide(tune, stats, postcopy, &needed);
+
+    switch (action) {
+    case QEMU_MIGRATION_AUTO_TUNE_NONE:
+        return;
+
+    case QEMU_MIGRATION_AUTO_TUNE_DOWNTIME:
+        VIR_INFO("Migration of domain %s does not converge, raising "
+                 "downtime limit from %llums to %llums",
+                 vm->def->name, tune->downtime, needed);
+
+        if (qemuMigrationSrcAutoTuneDowntime(driver, vm, asyncJob,
+                                             tune, needed) < 0)
+            goto error;
+
+        jobInfo->autoTuneDowntime = needed;
+        return;
+
+    case QEMU_MIGRATION_AUTO_TUNE_GIVE_UP:
+        VIR_INFO("Migration of domain %s does not converge and would need "
+                 "downtime of %llums", vm->def->name, needed);
+        tune->done = true;
+        return;
+
+    case QEMU_MIGRATION_AUTO_TUNE_POSTCOPY:
+        break;
+    }
+
+    tune->done = true;
+
+    VIR_INFO("Migration of domain %s does not converge, switching to "
+             "post-copy mode", vm->def->name);
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        goto error;
+
+    if (qemuMonitorMigrateStartPostCopy(priv->mon) < 0) {
+        ignore_value(qemuDomainObjExitMonitor(driver, vm));
+        goto error;
+    }
+
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        goto error;
+
+    jobInfo->autoTunePostcopy = true;
+    return;
+
+ error:
+    VIR_WARN("Failed to auto-tune migration of domain %s: %s",
+             vm->def->name, virGetLastErrorMessage());
+    virResetLastError();
+    tune->done = true;
+}
+
+
 /* Returns 0 on success, -2 when migration needs to be cancelled, or -1 when
  * QEMU reports failed migration.
  */
@@ -1700,6 +1983,8 @@ qemuMigrationSrcWaitForCompletion(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv = vm->privateData;
     qemuDomainJobInfoPtr jobInfo = priv->job.current;
     bool events = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT);
+    bool autoTune = !!(flags & QEMU_MIGRATION_COMPLETED_AUTO_TUNE);
+    qemuMigrationAutoTune tune = { 0 };
     int rv;
 
     jobInfo->status = QEMU_DOMAIN_JOB_STATUS_MIGRATING;
@@ -1709,7 +1994,21 @@ qemuMigrationSrcWaitForCompletion(virQEMUDriverPtr driver,
         if (rv < 0)
             return rv;
 
-        if (events) {
+        if (autoTune)
+            qemuMigrationSrcAutoTune(driver, vm, asyncJob, &tune,
+                                     flags & QEMU_MIGRATION_COMPLETED_POSTCOPY);
+
+        if (events && autoTune) {
+            unsigned long long now;
+
+            /* Wake up regularly to check migration progress */
+            if (virTimeMillisNow(&now) < 0 ||
+                virDomainObjWaitUntil(vm, now + QEMU_MIGRATION_AUTO_TUNE_INTERVAL) < 0) {
+                if (virDomainObjIsActive(vm))
+                    jobInfo->status = QEMU_DOMAIN_JOB_STATUS_FAILED;
+                return -2;
+            }
+        } else if (events) {
             if (virDomainObjWait(vm) < 0) {
                 if (virDomainObjIsActive(vm))
                     jobInfo->status = QEMU_DOMAIN_JOB_STATUS_FAILED;
@@ -2097,6 +2396,15 @@ qemuMigrationSrcBeginPhase(virQEMUDriverPtr driver,
         goto cleanup;
     }
 
+    if (flags & VIR_MIGRATE_AUTO_TUNE &&
+        (flags & VIR_MIGRATE_OFFLINE ||
+         !(flags & VIR_MIGRATE_LIVE))) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("migration auto-tuning is not supported with "
+                         "offline or non-live migration"));
+        goto cleanup;
+    }
+
     if (flags & (VIR_MIGRATE_NON_SHARED_DISK | VIR_MIGRATE_NON_SHARED_INC)) {
         if (nmigrate_disks) {
             size_t i, j;
@@ -3179,7 +3487,11 @@ struct _qemuMigrationSpec {
     } fwd;
 };
 
-#define TUNNEL_SEND_BUF_SIZE 65536
+/* Size of the pipe QEMU writes the tunnelled migration stream into and
+ * of the buffer used to forward it. The pipe lets QEMU keep writing
+ * while the previous chunk is being sent to the destination and one
+ * read drains whatever has accumulated in it. */
+#define TUNNEL_SEND_BUF_SIZE (1024 * 1024)
 
 typedef struct _qemuMigrationIOThread qemuMigrationIOThread;
 typedef qemuMigrationIOThread *qemuMigrationIOThreadPtr;
@@ -3253,9 +3565,14 @@ static void qemuMigrationSrcIOFunc(void *arg)
         }
 
         if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
-            int nbytes;
+            ssize_t nbytes;
+
+            /* Send whatever is available rather than waiting for QEMU
+             * to fill the whole buffer. */
+            do {
+                nbytes = read(data->sock, buffer, TUNNEL_SEND_BUF_SIZE);
+            } while (nbytes < 0 && errno == EINTR);
 
-            nbytes = saferead(data->sock, buffer, TUNNEL_SEND_BUF_SIZE);
             if (nbytes > 0) {
                 if (virStreamSend(data->st, buffer, nbytes) < 0)
                     goto error;
@@ -3717,6 +4034,8 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
         waitFlags |= QEMU_MIGRATION_COMPLETED_CHECK_STORAGE;
     if (flags & VIR_MIGRATE_POSTCOPY)
         waitFlags |= QEMU_MIGRATION_COMPLETED_POSTCOPY;
+    if (flags & VIR_MIGRATE_AUTO_TUNE)
+        waitFlags |= QEMU_MIGRATION_COMPLETED_AUTO_TUNE;
 
     rc = qemuMigrationSrcWaitForCompletion(driver, vm,
                                            QEMU_ASYNC_JOB_MIGRATION_OUT,
@@ -3969,6 +4288,12 @@ qemuMigrationSrcPerformTunnel(virQEMUDriverPtr driver,
     spec.dest.fd.qemu = fds[1];
     spec.dest.fd.local = fds[0];
 
+#ifdef F_SETPIPE_SZ
+    /* Best effort, the default pipe size only works slower */
+    if (fcntl(fds[0], F_SETPIPE_SZ, TUNNEL_SEND_BUF_SIZE) < 0)
+        VIR_DEBUG("Unable to enlarge migration pipe: %s", g_strerror(errno));
+#endif /* F_SETPIPE_SZ */
+
     if (spec.dest.fd.qemu == -1 ||
         qemuSecuritySetImageFDLabel(driver->securityManager, vm->def,
                                     spec.dest.fd.qemu) < 0) {
@@ -0,0 +1,61 @@
+/*
+ * qemu_migrationpriv.h: private declarations for QEMU migration handling
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+# error "qemu_migrationpriv.h may only be included by qemu_migration.c or test suites"
+#endif /* LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW */
+
+#pragma once
+
+#include "qemu_monitor.h"
+
+/* Number of consecutive memory passes which did not get any closer to the
+ * end of migration before auto-tuning steps in */
+#define QEMU_MIGRATION_AUTO_TUNE_STALLED 3
+
+/* Auto-tuning never raises the downtime limit above this value (in ms) */
+#define QEMU_MIGRATION_AUTO_TUNE_DOWNTIME_MAX 2000
+
+typedef struct _qemuMigrationAutoTune qemuMigrationAutoTune;
+typedef qemuMigrationAutoTune *qemuMigrationAutoTunePtr;
+struct _qemuMigrationAutoTune {
+    unsigned long long lastCheck; /* when stats were last checked */
+    unsigned long long iteration; /* the last memory pass evaluated */
+    unsigned long long remaining; /* memory left after that pass */
+    unsigned int stalled; /* consecutive passes with no progress */
+    unsigned long long downtime; /* current downtime limit, 0 if unknown */
+    bool done; /* nothing else can be tuned */
+};
+
+typedef enum {
+    QEMU_MIGRATION_AUTO_TUNE_NONE = 0, /* leave migration alone */
+    QEMU_MIGRATION_AUTO_TUNE_DOWNTIME, /* raise the downtime limit */
+    QEMU_MIGRATION_AUTO_TUNE_POSTCOPY, /* switch to post-copy */
+    QEMU_MIGRATION_AUTO_TUNE_GIVE_UP, /* nothing can be tuned */
+} qemuMigrationAutoTuneAction;
+
+bool
+qemuMigrationAutoTuneStalled(qemuMigrationAutoTunePtr tune,
+                             qemuMonitorMigrationStatsPtr stats);
+
+qemuMigrationAutoTuneAction
+qemuMigrationAutoTuneDecide(qemuMigrationAutoTunePtr tune,
+                            qemuMonitorMigrationStatsPtr stats,
+                            bool postcopy,
+                            unsigned long long *downtime);
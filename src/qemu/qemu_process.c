@@ -59,6 +59,7 @@
 #include "qemu_firmware.h"
 #include "qemu_backup.h"
 #include "qemu_dbus.h"
+#include "qemu_resctrl.h"
 
 #include "cpu/cpu.h"
 #include "cpu/cpu_x86.h"
@@ -81,6 +82,7 @@
 #include "virnetdevmidonet.h"
 #include "virbitmap.h"
 #include "virnuma.h"
+#include "virnumaplacement.h"
 #include "virstring.h"
 #include "virhostdev.h"
 #include "virsecret.h"
@@ -92,6 +94,11 @@
 #include "viridentity.h"
 #include "virthreadjob.h"
 #include "virutil.h"
+#include "virprobe.h"
+
+#ifdef WITH_DTRACE_PROBES
+# include "libvirt_qemu_probes.h"
+#endif
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -2686,6 +2693,9 @@ qemuProcessSetupPid(virDomainObjPtr vm,
         if (virCgroupNewThread(priv->cgroup, nameval, id, true, &cgroup) < 0)
             goto cleanup;
 
+        /* Statistics may have found the cgroup missing before */
+        qemuDomainRemoveThreadCgroup(vm, nameval, id);
+
         if (virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUSET)) {
             if (use_cpumask &&
                 qemuSetupCgroupCpusetCpus(cgroup, use_cpumask) < 0)
@@ -2948,6 +2958,28 @@ qemuProcessStartManagedPRDaemon(virDomainObjPtr vm)
 }
 
 
+/* Starts the helper which performs operations inside the mount namespace
+ * of @vm, so that they don't fork the daemon. Domains without a helper
+ * simply keep forking. */
+static void
+qemuProcessStartNSHelper(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    if (priv->nsHelper ||
+        !qemuDomainNamespaceEnabled(vm, QEMU_DOMAIN_NS_MOUNT) ||
+        !virProcessNSHelperAvailable())
+        return;
+
+    VIR_DEBUG("Starting namespace helper");
+    if (!(priv->nsHelper = virProcessNSHelperNew(vm->pid))) {
+        VIR_WARN("Unable to start namespace helper for domain %s: %s",
+                 vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+}
+
+
 static int
 qemuProcessInitPasswords(virQEMUDriverPtr driver,
                          virDomainObjPtr vm,
@@ -3617,6 +3649,13 @@ qemuProcessRecoverJob(virQEMUDriverPtr driver,
         /* Already handled in VIR_DOMAIN_PAUSED_STARTING_UP check. */
         break;
 
+    case QEMU_ASYNC_JOB_NUMA_REBALANCE:
+        /* The memory moved so far stays where it is, the domain was never
+         * paused and the cgroup settings allow both the old and new nodes. */
+        VIR_WARN("NUMA rebalancing of domain '%s' was interrupted",
+                 vm->def->name);
+        break;
+
     case QEMU_ASYNC_JOB_BACKUP:
         ignore_value(virTimeMillisNow(&now));
 
@@ -5448,6 +5487,34 @@ qemuProcessStartUpdateCustomCaps(virDomainObjPtr vm)
 }
 
 
+/**
+ * qemuProcessStartPhaseDone:
+ * @vm: domain object
+ * @phase: startup phase which just finished
+ * @since: monotonic time the phase started at
+ *
+ * Accounts time spent in @phase of the domain startup so that it can be
+ * reported via the bulk stats API and fires a probe for tracing.
+ */
+static void
+qemuProcessStartPhaseDone(virDomainObjPtr vm,
+                          qemuDomainStartPhase phase,
+                          unsigned long long since)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    /* the monotonic clock is in microseconds, the stats and probes are
+     * in nanoseconds */
+    unsigned long long duration = (g_get_monotonic_time() - since) * 1000;
+
+    priv->startTimes.phases[phase] += duration;
+
+    PROBE(QEMU_PROCESS_START_PHASE,
+          "vm=%p name=%s phase=%s duration=%llu",
+          vm, vm->def->name, qemuDomainStartPhaseTypeToString(phase),
+          duration);
+}
+
+
 /**
  * qemuProcessPrepareQEMUCaps:
  * @vm: domain object
@@ -5511,6 +5578,7 @@ qemuProcessInit(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv = vm->privateData;
     int stopFlags;
     virCPUDefPtr origCPU = NULL;
+    unsigned long long then;
     int ret = -1;
 
     VIR_DEBUG("vm=%p name=%s id=%d migration=%d",
@@ -5534,9 +5602,13 @@ qemuProcessInit(virQEMUDriverPtr driver,
             goto cleanup;
     }
 
+    memset(&priv->startTimes, 0, sizeof(priv->startTimes));
+
     VIR_DEBUG("Determining emulator version");
+    then = g_get_monotonic_time();
     if (qemuProcessPrepareQEMUCaps(vm, driver->qemuCapsCache, flags) < 0)
         goto cleanup;
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_CAPS, then);
 
     if (qemuDomainUpdateCPU(vm, updatedCPU, &origCPU) < 0)
         goto cleanup;
@@ -6072,48 +6144,119 @@ qemuProcessUpdateGuestCPU(virDomainDefPtr def,
 }
 
 
+/**
+ * qemuProcessGetNUMAPlacementAdvice:
+ * @driver: qemu driver
+ * @vm: domain object
+ *
+ * Asks the placement backend configured in qemu.conf on which host NUMA
+ * nodes @vm should run. The nodeset may contain nodes without memory.
+ *
+ * Returns the nodeset or NULL on error.
+ */
+virBitmapPtr
+qemuProcessGetNUMAPlacementAdvice(virQEMUDriverPtr driver,
+                                  virDomainObjPtr vm)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autoptr(virNumaPlacementHost) host = NULL;
+    g_autofree char *nodeset = NULL;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virBitmapPtr ret = NULL;
+
+    if (!cfg->numaPlacementBuiltin) {
+        nodeset = virNumaGetAutoPlacementAdvice(virDomainDefGetVcpus(vm->def),
+                                                virDomainDefGetMemoryTotal(vm->def));
+        if (!nodeset)
+            return NULL;
+
+        VIR_DEBUG("Nodeset returned from numad: %s", nodeset);
+
+        if (virBitmapParse(nodeset, &ret, VIR_DOMAIN_CPUMASK_LEN) < 0)
+            return NULL;
+
+        return ret;
+    }
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+
+    if (!(host = virNumaPlacementHostNew()) ||
+        virNumaPlacementHostUpdateLoad(host) < 0)
+        return NULL;
+
+    virNumaPlacementHostAddPins(host, driver->numaPlacementPins, uuidstr);
+
+    return virNumaPlacementAdvise(host,
+                                  virDomainDefGetVcpus(vm->def),
+                                  virDomainDefGetMemoryTotal(vm->def));
+}
+
+
+/**
+ * qemuProcessPinNUMAPlacement:
+ * @driver: qemu driver
+ * @vm: domain object
+ *
+ * Records the automatic NUMA placement of @vm so that the builtin placement
+ * of other domains can account for its vCPUs.
+ */
+void
+qemuProcessPinNUMAPlacement(virQEMUDriverPtr driver,
+                            virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    if (!priv->autoNodeset)
+        return;
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+
+    if (virNumaPlacementPinsAdd(driver->numaPlacementPins, uuidstr,
+                                priv->autoNodeset,
+                                virDomainDefGetVcpus(vm->def)) < 0) {
+        VIR_WARN("Unable to record NUMA placement of domain %s",
+                 vm->def->name);
+        virResetLastError();
+    }
+}
+
+
 static int
 qemuProcessPrepareDomainNUMAPlacement(virQEMUDriverPtr driver,
                                       virDomainObjPtr vm)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
-    g_autofree char *nodeset = NULL;
-    g_autoptr(virBitmap) numadNodeset = NULL;
+    g_autoptr(virBitmap) autoNodeset = NULL;
     g_autoptr(virBitmap) hostMemoryNodeset = NULL;
     g_autoptr(virCapsHostNUMA) caps = NULL;
 
-    /* Get the advisory nodeset from numad if 'placement' of
-     * either <vcpu> or <numatune> is 'auto'.
+    /* Get the advisory nodeset if 'placement' of either <vcpu> or
+     * <numatune> is 'auto'.
      */
     if (!virDomainDefNeedsPlacementAdvice(vm->def))
         return 0;
 
-    nodeset = virNumaGetAutoPlacementAdvice(virDomainDefGetVcpus(vm->def),
-                                            virDomainDefGetMemoryTotal(vm->def));
-
-    if (!nodeset)
+    if (!(autoNodeset = qemuProcessGetNUMAPlacementAdvice(driver, vm)))
         return -1;
 
     if (!(hostMemoryNodeset = virNumaGetHostMemoryNodeset()))
         return -1;
 
-    VIR_DEBUG("Nodeset returned from numad: %s", nodeset);
-
-    if (virBitmapParse(nodeset, &numadNodeset, VIR_DOMAIN_CPUMASK_LEN) < 0)
-        return -1;
-
     if (!(caps = virQEMUDriverGetHostNUMACaps(driver)))
         return -1;
 
     /* numad may return a nodeset that only contains cpus but cgroups don't play
      * well with that. Set the autoCpuset from all cpus from that nodeset, but
      * assign autoNodeset only with nodes containing memory. */
-    if (!(priv->autoCpuset = virCapabilitiesHostNUMAGetCpus(caps, numadNodeset)))
+    if (!(priv->autoCpuset = virCapabilitiesHostNUMAGetCpus(caps, autoNodeset)))
         return -1;
 
-    virBitmapIntersect(numadNodeset, hostMemoryNodeset);
+    virBitmapIntersect(autoNodeset, hostMemoryNodeset);
 
-    priv->autoNodeset = g_steal_pointer(&numadNodeset);
+    priv->autoNodeset = g_steal_pointer(&autoNodeset);
+
+    qemuProcessPinNUMAPlacement(driver, vm);
 
     return 0;
 }
@@ -6658,6 +6801,7 @@ qemuProcessLaunch(virConnectPtr conn,
     g_autoptr(virQEMUDriverConfig) cfg = NULL;
     size_t nnicindexes = 0;
     g_autofree int *nicindexes = NULL;
+    unsigned long long then;
     size_t i;
 
     VIR_DEBUG("conn=%p driver=%p vm=%p name=%s if=%d asyncJob=%d "
@@ -6716,6 +6860,7 @@ qemuProcessLaunch(virConnectPtr conn,
         goto cleanup;
 
     VIR_DEBUG("Building emulator command line");
+    then = g_get_monotonic_time();
     if (!(cmd = qemuBuildCommandLine(driver,
                                      qemuDomainLogContextGetManager(logCtxt),
                                      driver->securityManager,
@@ -6726,6 +6871,7 @@ qemuProcessLaunch(virConnectPtr conn,
                                      qemuCheckFips(),
                                      &nnicindexes, &nicindexes, 0)))
         goto cleanup;
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_COMMAND_LINE, then);
 
     if (incoming && incoming->fd != -1)
         virCommandPassFD(cmd, incoming->fd, 0);
@@ -6771,6 +6917,7 @@ qemuProcessLaunch(virConnectPtr conn,
 
     if (qemuSecurityPreFork(driver->securityManager) < 0)
         goto cleanup;
+    then = g_get_monotonic_time();
     rv = virCommandRun(cmd, NULL);
     qemuSecurityPostFork(driver->securityManager);
 
@@ -6801,10 +6948,13 @@ qemuProcessLaunch(virConnectPtr conn,
                                   _("Process exited prior to exec"));
         goto cleanup;
     }
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_LAUNCH, then);
 
     VIR_DEBUG("Setting up domain cgroup (if required)");
+    then = g_get_monotonic_time();
     if (qemuSetupCgroup(vm, nnicindexes, nicindexes) < 0)
         goto cleanup;
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_CGROUP, then);
 
     if (!(priv->perf = virPerfNew()))
         goto cleanup;
@@ -6832,17 +6982,24 @@ qemuProcessLaunch(virConnectPtr conn,
     if (qemuProcessResctrlCreate(driver, vm) < 0)
         goto cleanup;
 
+    if (qemuResctrlAutoStart(driver, vm) < 0)
+        goto cleanup;
+
     VIR_DEBUG("Setting up managed PR daemon");
     if (virDomainDefHasManagedPR(vm->def) &&
         qemuProcessStartManagedPRDaemon(vm) < 0)
         goto cleanup;
 
+    qemuProcessStartNSHelper(vm);
+
     VIR_DEBUG("Setting domain security labels");
+    then = g_get_monotonic_time();
     if (qemuSecuritySetAllLabel(driver,
                                 vm,
                                 incoming ? incoming->path : NULL,
                                 incoming != NULL) < 0)
         goto cleanup;
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_SECURITY, then);
 
     /* Security manager labeled all devices, therefore
      * if any operation from now on fails, we need to ask the caller to
@@ -6884,11 +7041,15 @@ qemuProcessLaunch(virConnectPtr conn,
         goto cleanup;
 
     VIR_DEBUG("Waiting for monitor to show up");
+    then = g_get_monotonic_time();
     if (qemuProcessWaitForMonitor(driver, vm, asyncJob, logCtxt) < 0)
         goto cleanup;
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_MONITOR, then);
 
+    then = g_get_monotonic_time();
     if (qemuConnectAgent(driver, vm) < 0)
         goto cleanup;
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_AGENT, then);
 
     VIR_DEBUG("Verifying and updating provided guest CPU");
     if (qemuProcessUpdateAndVerifyCPU(driver, vm, asyncJob) < 0)
@@ -7073,6 +7234,8 @@ qemuProcessStart(virConnectPtr conn,
     qemuProcessIncomingDefPtr incoming = NULL;
     unsigned int stopFlags;
     bool relabel = false;
+    unsigned long long start = g_get_monotonic_time();
+    unsigned long long then;
     int ret = -1;
     int rv;
 
@@ -7103,11 +7266,15 @@ qemuProcessStart(virConnectPtr conn,
             goto stop;
     }
 
+    then = g_get_monotonic_time();
     if (qemuProcessPrepareDomain(driver, vm, flags) < 0)
         goto stop;
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_PREPARE_DOMAIN, then);
 
+    then = g_get_monotonic_time();
     if (qemuProcessPrepareHost(driver, vm, flags) < 0)
         goto stop;
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_PREPARE_HOST, then);
 
     if ((rv = qemuProcessLaunch(conn, driver, vm, asyncJob, incoming,
                                 snapshot, vmop, flags)) < 0) {
@@ -7117,6 +7284,8 @@ qemuProcessStart(virConnectPtr conn,
     }
     relabel = true;
 
+    then = g_get_monotonic_time();
+
     if (incoming) {
         if (incoming->deferredURI &&
             qemuMigrationDstRun(driver, vm, incoming->deferredURI, asyncJob) < 0)
@@ -7142,6 +7311,13 @@ qemuProcessStart(virConnectPtr conn,
         qemuMonitorSetDomainLog(priv->mon, NULL, NULL, NULL);
     }
 
+    qemuProcessStartPhaseDone(vm, QEMU_DOMAIN_START_PHASE_FINISH, then);
+
+    priv->startTimes.total = (g_get_monotonic_time() - start) * 1000;
+    PROBE(QEMU_PROCESS_START_DONE,
+          "vm=%p name=%s duration=%llu",
+          vm, vm->def->name, priv->startTimes.total);
+
     ret = 0;
 
  cleanup:
@@ -7392,6 +7568,11 @@ void qemuProcessStop(virQEMUDriverPtr driver,
                                  VIR_QEMU_PROCESS_KILL_FORCE|
                                  VIR_QEMU_PROCESS_KILL_NOCHECK));
 
+    /* The helper would keep the namespace around and its pid
+     * might get reused. */
+    virProcessNSHelperFree(priv->nsHelper);
+    priv->nsHelper = NULL;
+
     qemuDomainCleanupRun(driver, vm);
 
     qemuExtDevicesStop(driver, vm);
@@ -7509,6 +7690,8 @@ void qemuProcessStop(virQEMUDriverPtr driver,
                  vm->def->name);
     }
 
+    qemuResctrlAutoStop(vm);
+
     /* Remove resctrl allocation after cgroups are cleaned up which makes it
      * kind of safer (although removing the allocation should work even with
      * pids in tasks file */
@@ -7594,6 +7777,13 @@ void qemuProcessStop(virQEMUDriverPtr driver,
         }
     }
 
+    if (priv->autoNodeset) {
+        char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+        virUUIDFormat(vm->def->uuid, uuidstr);
+        virNumaPlacementPinsRemove(driver->numaPlacementPins, uuidstr);
+    }
+
     /* clear all private data entries which are no longer needed */
     qemuDomainObjPrivateDataClear(priv);
 
@@ -7991,6 +8181,9 @@ qemuProcessReconnect(void *opaque)
     if (qemuConnectMonitor(driver, obj, QEMU_ASYNC_JOB_NONE, retry, NULL) < 0)
         goto error;
 
+    /* helpers don't survive the daemon */
+    qemuProcessStartNSHelper(obj);
+
     priv->machineName = qemuDomainGetMachineName(obj);
     if (!priv->machineName)
         goto error;
@@ -8001,6 +8194,8 @@ qemuProcessReconnect(void *opaque)
     if (qemuDomainPerfRestart(obj) < 0)
         goto error;
 
+    qemuProcessPinNUMAPlacement(driver, obj);
+
     /* recreate the pflash storage sources */
     if (qemuDomainInitializePflashStorageSource(obj) < 0)
         goto error;
@@ -8153,6 +8348,9 @@ qemuProcessReconnect(void *opaque)
         }
     }
 
+    if (qemuResctrlAutoStart(driver, obj) < 0)
+        goto error;
+
     /* update domain state XML with possibly updated state in virDomainObj */
     if (virDomainObjSave(obj, driver->xmlopt, cfg->stateDir) < 0)
         goto error;
@@ -8613,14 +8811,45 @@ qemuProcessQMPStart(qemuProcessQMPPtr proc)
 {
     VIR_DEBUG("proc=%p, emulator=%s", proc, proc->binary);
 
-    if (qemuProcessQMPInit(proc) < 0)
+    if (qemuProcessQMPLaunchOnly(proc) < 0)
         return -1;
 
-    if (qemuProcessQMPLaunch(proc) < 0)
+    if (qemuProcessQMPConnect(proc) < 0)
         return -1;
 
-    if (qemuProcessQMPConnectMonitor(proc) < 0)
+    return 0;
+}
+
+
+/**
+ * qemuProcessQMPLaunchOnly:
+ * @proc: QEMU process and connection state created by qemuProcessQMPNew()
+ *
+ * Start QEMU binary without connecting to its monitor. Together with
+ * qemuProcessQMPConnect() this does the same as qemuProcessQMPStart(),
+ * but allows starting QEMU from a different thread than the one which
+ * connects to and queries the monitor.
+ */
+int
+qemuProcessQMPLaunchOnly(qemuProcessQMPPtr proc)
+{
+    VIR_DEBUG("proc=%p, emulator=%s", proc, proc->binary);
+
+    if (qemuProcessQMPInit(proc) < 0)
         return -1;
 
-    return 0;
+    return qemuProcessQMPLaunch(proc);
+}
+
+
+/**
+ * qemuProcessQMPConnect:
+ * @proc: QEMU process started by qemuProcessQMPLaunchOnly()
+ *
+ * Connect to the monitor of @proc so QMP queries can be made.
+ */
+int
+qemuProcessQMPConnect(qemuProcessQMPPtr proc)
+{
+    return qemuProcessQMPConnectMonitor(proc);
 }
@@ -115,6 +115,12 @@ int qemuProcessPrepareDomain(virQEMUDriverPtr driver,
                              virDomainObjPtr vm,
                              unsigned int flags);
 
+virBitmapPtr qemuProcessGetNUMAPlacementAdvice(virQEMUDriverPtr driver,
+                                               virDomainObjPtr vm);
+
+void qemuProcessPinNUMAPlacement(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm);
+
 int qemuProcessOpenVhostVsock(virDomainVsockDefPtr vsock);
 
 int qemuProcessPrepareHost(virQEMUDriverPtr driver,
@@ -236,3 +242,7 @@ qemuProcessQMPPtr qemuProcessQMPNew(const char *binary,
 void qemuProcessQMPFree(qemuProcessQMPPtr proc);
 
 int qemuProcessQMPStart(qemuProcessQMPPtr proc);
+
+int qemuProcessQMPLaunchOnly(qemuProcessQMPPtr proc);
+
+int qemuProcessQMPConnect(qemuProcessQMPPtr proc);
@@ -0,0 +1,487 @@
+/*
+ * qemu_resctrl.c: QEMU automatic resctrl tuning
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_resctrl.h"
+
+#include "viralloc.h"
+#include "virerror.h"
+#include "virevent.h"
+#include "virlog.h"
+#include "virthreadpool.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_resctrl");
+
+/* Domains marked with <cachetune auto='yes'/> or <memorytune auto='yes'/>
+ * are latency sensitive and get their allocations resized periodically
+ * according to the usage reported by the monitor covering the same vCPUs.
+ *
+ * Cache allocations are compared against the LLC occupancy of the group.
+ * Memory bandwidth is a percentage limit, so the throughput reported by
+ * MBM is related to the highest throughput per percent of the limit ever
+ * seen for the node, which is what the group manages to use when it is
+ * not limited by anything else. */
+
+typedef struct _qemuResctrlAutoSample qemuResctrlAutoSample;
+typedef qemuResctrlAutoSample *qemuResctrlAutoSamplePtr;
+struct _qemuResctrlAutoSample {
+    size_t resctrl;
+    unsigned int id;
+    unsigned long long bytes;
+    long long timestamp; /* monotonic, in microseconds */
+    double peak; /* highest bytes per second per percent of the limit */
+};
+
+struct _qemuResctrlAuto {
+    int timer;
+    bool pending;
+
+    qemuResctrlAutoSamplePtr samples;
+    size_t nsamples;
+};
+
+typedef struct _qemuResctrlAutoData qemuResctrlAutoData;
+typedef qemuResctrlAutoData *qemuResctrlAutoDataPtr;
+struct _qemuResctrlAutoData {
+    virQEMUDriverConfigPtr cfg;
+    virResctrlInfoPtr info;
+    qemuResctrlAutoPtr state;
+    size_t resctrl;
+    virResctrlAllocPtr alloc;
+    virResctrlMonitorStatsPtr *stats;
+    size_t nstats;
+};
+
+
+static void
+qemuResctrlAutoFree(qemuResctrlAutoPtr state)
+{
+    if (!state)
+        return;
+
+    if (state->timer > 0)
+        virEventRemoveTimeout(state->timer);
+
+    VIR_FREE(state->samples);
+    VIR_FREE(state);
+}
+
+
+static bool
+qemuResctrlAutoWanted(virDomainDefPtr def)
+{
+    size_t i;
+
+    for (i = 0; i < def->nresctrls; i++) {
+        if (def->resctrls[i]->autoCache == VIR_TRISTATE_BOOL_YES ||
+            def->resctrls[i]->autoMemBW == VIR_TRISTATE_BOOL_YES)
+            return true;
+    }
+
+    return false;
+}
+
+
+static void
+qemuResctrlAutoTimer(int timer G_GNUC_UNUSED,
+                     void *opaque)
+{
+    virDomainObjPtr vm = opaque;
+    qemuDomainObjPrivatePtr priv;
+    struct qemuProcessEvent *processEvent = NULL;
+
+    virObjectLock(vm);
+    priv = vm->privateData;
+
+    if (!virDomainObjIsActive(vm) ||
+        !priv->resctrlAuto ||
+        priv->resctrlAuto->pending)
+        goto cleanup;
+
+    if (VIR_ALLOC(processEvent) < 0)
+        goto cleanup;
+
+    processEvent->eventType = QEMU_PROCESS_EVENT_RESCTRL_AUTO;
+    processEvent->vm = virObjectRef(vm);
+
+    if (virThreadPoolSendJob(priv->driver->workerPool, 0, processEvent) < 0) {
+        virObjectUnref(vm);
+        qemuProcessEventFree(processEvent);
+        goto cleanup;
+    }
+
+    priv->resctrlAuto->pending = true;
+
+ cleanup:
+    virObjectUnlock(vm);
+}
+
+
+/**
+ * qemuResctrlAutoStart:
+ * @driver: qemu driver
+ * @vm: domain object
+ *
+ * Starts periodic resizing of the resctrl allocations of @vm which are
+ * marked for automatic tuning. Does nothing if there are none or if the
+ * tuning is disabled in qemu.conf.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuResctrlAutoStart(virQEMUDriverPtr driver,
+                     virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuResctrlAutoPtr state = NULL;
+
+    if (priv->resctrlAuto ||
+        cfg->resctrlAutoInterval == 0 ||
+        !qemuResctrlAutoWanted(vm->def))
+        return 0;
+
+    if (VIR_ALLOC(state) < 0)
+        return -1;
+
+    if ((state->timer = virEventAddTimeout(cfg->resctrlAutoInterval * 1000,
+                                           qemuResctrlAutoTimer,
+                                           virObjectRef(vm),
+                                           virObjectFreeCallback)) < 0) {
+        virObjectUnref(vm);
+        VIR_FREE(state);
+        return -1;
+    }
+
+    VIR_DEBUG("Automatic resctrl tuning of domain %s every %us",
+              vm->def->name, cfg->resctrlAutoInterval);
+
+    priv->resctrlAuto = state;
+    return 0;
+}
+
+
+/**
+ * qemuResctrlAutoStop:
+ * @vm: domain object
+ *
+ * Stops the automatic resctrl tuning of @vm, if any.
+ */
+void
+qemuResctrlAutoStop(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    qemuResctrlAutoFree(g_steal_pointer(&priv->resctrlAuto));
+}
+
+
+static virDomainResctrlMonDefPtr
+qemuResctrlAutoFindMonitor(virDomainResctrlDefPtr resctrl,
+                           virResctrlMonitorType tag)
+{
+    size_t i;
+
+    for (i = 0; i < resctrl->nmonitors; i++) {
+        virDomainResctrlMonDefPtr mon = resctrl->monitors[i];
+
+        if (mon->tag == tag && virBitmapEqual(mon->vcpus, resctrl->vcpus))
+            return mon;
+    }
+
+    return NULL;
+}
+
+
+static bool
+qemuResctrlAutoFindStat(qemuResctrlAutoDataPtr data,
+                        unsigned int id,
+                        unsigned long long *value)
+{
+    size_t i;
+
+    for (i = 0; i < data->nstats; i++) {
+        if (data->stats[i]->id == id && data->stats[i]->nvals > 0) {
+            *value = data->stats[i]->vals[0];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static int
+qemuResctrlAutoGetStats(virDomainResctrlDefPtr resctrl,
+                        virResctrlMonitorType tag,
+                        const char *feature,
+                        qemuResctrlAutoDataPtr data)
+{
+    virDomainResctrlMonDefPtr mon = qemuResctrlAutoFindMonitor(resctrl, tag);
+    const char *features[] = { feature, NULL };
+
+    if (!mon) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("missing resctrl monitor for automatic tuning of "
+                         "allocation '%s'"),
+                       virResctrlAllocGetID(resctrl->alloc));
+        return -1;
+    }
+
+    return virResctrlMonitorGetStats(mon->instance, features,
+                                     &data->stats, &data->nstats);
+}
+
+
+static void
+qemuResctrlAutoDataClear(qemuResctrlAutoDataPtr data)
+{
+    size_t i;
+
+    for (i = 0; i < data->nstats; i++)
+        virResctrlMonitorStatsFree(data->stats[i]);
+
+    VIR_FREE(data->stats);
+    data->nstats = 0;
+}
+
+
+static int
+qemuResctrlAutoTuneCache(unsigned int level,
+                         virCacheType type,
+                         unsigned int cache,
+                         unsigned long long size G_GNUC_UNUSED,
+                         void *opaque)
+{
+    qemuResctrlAutoDataPtr data = opaque;
+    unsigned long long occupancy;
+    unsigned long long current;
+    unsigned long long usage;
+    int delta;
+    int rc;
+
+    if (level != 3 || type != VIR_CACHE_TYPE_BOTH ||
+        !qemuResctrlAutoFindStat(data, cache, &occupancy))
+        return 0;
+
+    if (virResctrlAllocGetCurrentCacheSize(data->info, data->alloc,
+                                           level, type, cache, &current) < 0)
+        return -1;
+
+    if (current == 0)
+        return 0;
+
+    usage = occupancy * 100 / current;
+    if (usage >= data->cfg->resctrlAutoHigh)
+        delta = 1;
+    else if (usage <= data->cfg->resctrlAutoLow)
+        delta = -1;
+    else
+        return 0;
+
+    if ((rc = virResctrlAllocResizeCache(data->info, data->alloc,
+                                         level, type, cache, delta,
+                                         data->cfg->resctrlAutoCacheMax)) < 0)
+        return -1;
+
+    if (rc > 0)
+        VIR_DEBUG("Resized L3 cache %u of allocation '%s' by %d at %llu%% "
+                  "occupancy", cache, virResctrlAllocGetID(data->alloc),
+                  delta, usage);
+
+    return 0;
+}
+
+
+static qemuResctrlAutoSamplePtr
+qemuResctrlAutoGetSample(qemuResctrlAutoPtr state,
+                         size_t resctrl,
+                         unsigned int id)
+{
+    qemuResctrlAutoSample sample = { .resctrl = resctrl, .id = id };
+    size_t i;
+
+    for (i = 0; i < state->nsamples; i++) {
+        if (state->samples[i].resctrl == resctrl &&
+            state->samples[i].id == id)
+            return &state->samples[i];
+    }
+
+    if (VIR_APPEND_ELEMENT(state->samples, state->nsamples, sample) < 0)
+        return NULL;
+
+    return &state->samples[state->nsamples - 1];
+}
+
+
+static int
+qemuResctrlAutoTuneMemory(unsigned int id,
+                          unsigned int size G_GNUC_UNUSED,
+                          void *opaque)
+{
+    qemuResctrlAutoDataPtr data = opaque;
+    qemuResctrlAutoSamplePtr sample = NULL;
+    unsigned long long bytes;
+    unsigned int limit;
+    long long now = g_get_monotonic_time();
+    double rate;
+    double usage;
+    int delta;
+    int rc;
+
+    if (!qemuResctrlAutoFindStat(data, id, &bytes))
+        return 0;
+
+    if (!(sample = qemuResctrlAutoGetSample(data->state, data->resctrl, id)))
+        return -1;
+
+    /* The counter is reset whenever the group is re-created */
+    if (sample->timestamp == 0 || bytes < sample->bytes ||
+        now <= sample->timestamp) {
+        sample->bytes = bytes;
+        sample->timestamp = now;
+        return 0;
+    }
+
+    rate = (double) (bytes - sample->bytes) * 1000000 /
+        (now - sample->timestamp);
+    sample->bytes = bytes;
+    sample->timestamp = now;
+
+    if (virResctrlAllocGetCurrentMemoryBandwidth(data->info, data->alloc,
+                                                 id, &limit) < 0)
+        return -1;
+
+    if (limit == 0)
+        return 0;
+
+    sample->peak = MAX(sample->peak, rate / limit);
+    if (sample->peak == 0)
+        return 0;
+
+    usage = rate * 100 / (sample->peak * limit);
+    if (usage >= data->cfg->resctrlAutoHigh)
+        delta = 1;
+    else if (usage <= data->cfg->resctrlAutoLow)
+        delta = -1;
+    else
+        return 0;
+
+    if ((rc = virResctrlAllocResizeMemoryBandwidth(data->info, data->alloc,
+                                                   id, delta)) < 0)
+        return -1;
+
+    if (rc > 0)
+        VIR_DEBUG("Changed memory bandwidth %u of allocation '%s' by %d "
+                  "at %.0f%% usage", id, virResctrlAllocGetID(data->alloc),
+                  delta, usage);
+
+    return 0;
+}
+
+
+static int
+qemuResctrlAutoTuneOne(qemuResctrlAutoDataPtr data,
+                       virDomainResctrlDefPtr resctrl)
+{
+    int ret = -1;
+
+    data->alloc = resctrl->alloc;
+
+    if (resctrl->autoCache == VIR_TRISTATE_BOOL_YES) {
+        if (qemuResctrlAutoGetStats(resctrl, VIR_RESCTRL_MONITOR_TYPE_CACHE,
+                                    "llc_occupancy", data) < 0 ||
+            virResctrlAllocForeachCache(resctrl->alloc,
+                                        qemuResctrlAutoTuneCache, data) < 0)
+            goto cleanup;
+
+        qemuResctrlAutoDataClear(data);
+    }
+
+    if (resctrl->autoMemBW == VIR_TRISTATE_BOOL_YES) {
+        if (qemuResctrlAutoGetStats(resctrl, VIR_RESCTRL_MONITOR_TYPE_MEMBW,
+                                    "mbm_total_bytes", data) < 0 ||
+            virResctrlAllocForeachMemory(resctrl->alloc,
+                                         qemuResctrlAutoTuneMemory, data) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    qemuResctrlAutoDataClear(data);
+    return ret;
+}
+
+
+/**
+ * qemuResctrlAutoTune:
+ * @driver: qemu driver
+ * @vm: domain object
+ *
+ * Resizes the automatically tuned resctrl allocations of @vm by a single
+ * step according to their current usage. Called from the worker pool with
+ * @vm locked; failures are only logged so that a single error does not stop
+ * the tuning.
+ *
+ * The tuning neither talks to the monitor nor unlocks @vm, so no job is
+ * needed as long as no other job is running. Busy domains are skipped
+ * silently and tuned on the next tick instead of waiting for their job,
+ * which would block a worker and report a timeout for every long job.
+ */
+void
+qemuResctrlAutoTune(virQEMUDriverPtr driver,
+                    virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autoptr(virCaps) caps = NULL;
+    qemuResctrlAutoData data = { .cfg = cfg };
+    size_t i;
+
+    if (priv->resctrlAuto)
+        priv->resctrlAuto->pending = false;
+
+    if (priv->job.active != QEMU_JOB_NONE ||
+        priv->job.asyncJob != QEMU_ASYNC_JOB_NONE)
+        return;
+
+    if (!virDomainObjIsActive(vm) || !priv->resctrlAuto)
+        return;
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
+        return;
+
+    data.info = caps->host.resctrl;
+    data.state = priv->resctrlAuto;
+
+    for (i = 0; i < vm->def->nresctrls; i++) {
+        virDomainResctrlDefPtr resctrl = vm->def->resctrls[i];
+
+        data.resctrl = i;
+
+        if (qemuResctrlAutoTuneOne(&data, resctrl) < 0) {
+            VIR_WARN("Unable to tune resctrl allocation '%s' of domain %s: %s",
+                     virResctrlAllocGetID(resctrl->alloc), vm->def->name,
+                     virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+}
@@ -978,6 +978,20 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+#ifdef WITH_NS_HELPER_ZYGOTE
+    /* Namespace helpers of QEMU domains are forked by a zygote which must
+     * not inherit locks or driver state. Start it now, while the daemon
+     * is still single threaded: setting up logging and daemonizing don't
+     * create any thread and no driver is loaded yet. Domains simply don't
+     * use helpers if this fails. */
+    if (privileged &&
+        virProcessNSHelperZygoteStart() < 0) {
+        VIR_WARN("Unable to start namespace helper zygote: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
+#endif /* WITH_NS_HELPER_ZYGOTE */
+
     /* Ensure the rundir exists (on tmpfs on some systems) */
     if (privileged) {
         run_dir = g_strdup(RUNSTATEDIR "/libvirt");
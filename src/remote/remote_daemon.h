@@ -60,6 +60,7 @@ struct daemonClientPrivate {
     daemonClientEventCallbackPtr *secretEventCallbacks;
     size_t nsecretEventCallbacks;
     bool closeRegistered;
+    bool largeStreamPackets;
 
 #if WITH_SASL
     virNetSASLSessionPtr sasl;
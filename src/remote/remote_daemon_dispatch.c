@@ -4998,6 +4998,18 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server G_GNUC_UN
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
         supported = 1;
         break;
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS: {
+        struct daemonClientPrivate *priv =
+            virNetServerClientGetPrivateData(client);
+
+        /* Only clients which know about large packets ask about
+         * them, so from now on we can send them to this one. */
+        virMutexLock(&priv->lock);
+        priv->largeStreamPackets = true;
+        virMutexUnlock(&priv->lock);
+        supported = 1;
+        break;
+    }
     case VIR_DRV_FEATURE_MIGRATION_V1:
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_MIGRATION_V2:
@@ -5331,6 +5343,42 @@ remoteDispatchNodeGetSevInfo(virNetServerPtr server G_GNUC_UNUSED,
 }
 
 
+static int
+remoteDispatchNodeGetPressureStats(virNetServerPtr server G_GNUC_UNUSED,
+                                   virNetServerClientPtr client,
+                                   virNetMessagePtr msg G_GNUC_UNUSED,
+                                   virNetMessageErrorPtr rerr,
+                                   remote_node_get_pressure_stats_args *args,
+                                   remote_node_get_pressure_stats_ret *ret)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int rv = -1;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (virNodeGetPressureStats(conn, &params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                REMOTE_NODE_PRESSURE_STATS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len,
+                                args->flags) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+
 static int
 remoteDispatchNodeGetMemoryParameters(virNetServerPtr server G_GNUC_UNUSED,
                                       virNetServerClientPtr client,
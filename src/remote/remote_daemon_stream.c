@@ -33,6 +33,12 @@
 
 VIR_LOG_INIT("daemon.stream");
 
+/* How many outgoing packets of a stream may wait for the client at once.
+ * A packet can hold up to VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX bytes for
+ * clients that negotiated large packets, so this bounds the memory a
+ * fast stream with a slow client makes the daemon hold. */
+#define DAEMON_STREAM_MAX_TX_PENDING 1
+
 struct daemonClientStream {
     daemonClientPrivatePtr priv;
     int refs;
@@ -50,6 +56,7 @@ struct daemonClientStream {
 
     virNetMessagePtr rx;
     bool tx;
+    size_t txPending; /* Outgoing packets not yet sent to the client */
 
     bool allowSkip;
     size_t dataLen; /* How much data is there remaining until we see a hole */
@@ -82,7 +89,8 @@ daemonStreamUpdateEvents(daemonClientStream *stream)
         return;
     if (stream->rx)
         newEvents |= VIR_STREAM_EVENT_WRITABLE;
-    if (stream->tx && !stream->recvEOF)
+    if (stream->tx && !stream->recvEOF &&
+        stream->txPending < DAEMON_STREAM_MAX_TX_PENDING)
         newEvents |= VIR_STREAM_EVENT_READABLE;
 
     virStreamEventUpdateCallback(stream->st, newEvents);
@@ -90,7 +98,8 @@ daemonStreamUpdateEvents(daemonClientStream *stream)
 
 /*
  * Invoked when an outgoing data packet message has been fully sent.
- * This simply re-enables TX of further data.
+ * This simply re-enables TX of further data once fewer than
+ * DAEMON_STREAM_MAX_TX_PENDING packets are waiting.
  *
  * The idea is to stop the daemon growing without bound due to
  * fast stream, but slow client
@@ -103,7 +112,7 @@ daemonStreamMessageFinished(virNetMessagePtr msg,
     VIR_DEBUG("stream=%p proc=%d serial=%u",
               stream, msg->header.proc, msg->header.serial);
 
-    stream->tx = true;
+    stream->txPending--;
     daemonStreamUpdateEvents(stream);
 
     daemonFreeClientStream(NULL, stream);
@@ -201,7 +210,6 @@ daemonStreamEvent(virStreamPtr st, int events, void *opaque)
         (events & VIR_STREAM_EVENT_HANGUP)) {
         virNetMessagePtr msg;
         events &= ~(VIR_STREAM_EVENT_HANGUP);
-        stream->tx = false;
         stream->recvEOF = true;
         if (!(msg = virNetMessageNew(false))) {
             daemonRemoveClientStream(client, stream);
@@ -211,6 +219,7 @@ daemonStreamEvent(virStreamPtr st, int events, void *opaque)
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
+        stream->txPending++;
         if (virNetServerProgramSendStreamData(stream->prog,
                                               client,
                                               msg,
@@ -824,6 +833,7 @@ static int
 daemonStreamHandleRead(virNetServerClientPtr client,
                        daemonClientStream *stream)
 {
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
     virNetMessagePtr msg = NULL;
     virNetMessageError rerr;
     char *buffer;
@@ -833,8 +843,8 @@ daemonStreamHandleRead(virNetServerClientPtr client,
     int inData = 0;
     long long length = 0;
 
-    VIR_DEBUG("client=%p, stream=%p tx=%d closed=%d",
-              client, stream, stream->tx, stream->closed);
+    VIR_DEBUG("client=%p, stream=%p tx=%d txPending=%zu closed=%d",
+              client, stream, stream->tx, stream->txPending, stream->closed);
 
     /* We might have had an event pending before we shut
      * down the stream, so if we're marked as closed,
@@ -844,12 +854,18 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         return 0;
 
     /* Shouldn't ever be called unless we're marked able to
-     * transmit, but doesn't hurt to check */
-    if (!stream->tx)
+     * transmit and the client keeps up, but doesn't hurt to check */
+    if (!stream->tx ||
+        stream->txPending >= DAEMON_STREAM_MAX_TX_PENDING)
         return 0;
 
     memset(&rerr, 0, sizeof(rerr));
 
+    virMutexLock(&priv->lock);
+    if (priv->largeStreamPackets)
+        bufferLen = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
+    virMutexUnlock(&priv->lock);
+
     if (VIR_ALLOC_N(buffer, bufferLen) < 0)
         return -1;
 
@@ -878,10 +894,10 @@ daemonStreamHandleRead(virNetServerClientPtr client,
             goto done;
         } else {
             if (!inData && length) {
-                stream->tx = false;
                 msg->cb = daemonStreamMessageFinished;
                 msg->opaque = stream;
                 stream->refs++;
+                stream->txPending++;
                 if (virNetServerProgramSendStreamHole(stream->prog,
                                                       client,
                                                       msg,
@@ -925,13 +941,13 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         if (stream->allowSkip)
             stream->dataLen -= rv;
 
-        stream->tx = false;
         if (rv == 0)
             stream->recvEOF = true;
 
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
+        stream->txPending++;
         if (virNetServerProgramSendStreamData(stream->prog,
                                               client,
                                               msg,
@@ -134,6 +134,7 @@ struct private_data {
     bool serverKeepAlive;       /* Does server support keepalive protocol? */
     bool serverEventFilter;     /* Does server support modern event filtering */
     bool serverCloseCallback;   /* Does server support driver close callback */
+    size_t streamPacketMax;     /* Largest stream packet the server accepts */
 
     virObjectEventStatePtr eventState;
     virConnectCloseCallbackDataPtr closeCallback;
@@ -1366,6 +1367,15 @@ doRemoteOpen(virConnectPtr conn,
                  "by the remote side.");
     }
 
+    if (remoteConnectSupportsFeatureUnlocked(conn, priv,
+                                             VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS)) {
+        priv->streamPacketMax = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
+    } else {
+        VIR_INFO("Large stream packets aren't supported "
+                 "by the remote side.");
+        priv->streamPacketMax = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    }
+
     return VIR_DRV_OPEN_SUCCESS;
 
  failed:
@@ -5695,17 +5705,33 @@ remoteStreamSend(virStreamPtr st,
     VIR_DEBUG("st=%p data=%p nbytes=%zu", st, data, nbytes);
     struct private_data *priv = st->conn->privateData;
     virNetClientStreamPtr privst = st->privateData;
-    int rv;
+    size_t packetMax;
+    size_t sent = 0;
+    int rv = 0;
 
     remoteDriverLock(priv);
     priv->localUses++;
+    packetMax = priv->streamPacketMax;
     remoteDriverUnlock(priv);
 
-    rv = virNetClientStreamSendPacket(privst,
-                                      priv->client,
-                                      VIR_NET_CONTINUE,
-                                      data,
-                                      nbytes);
+    /* Split the data into packets the server is able to process. If a
+     * later packet fails, report the data queued so far; the failure is
+     * reported again by the next call. */
+    do {
+        size_t len = MIN(nbytes - sent, packetMax);
+
+        if (virNetClientStreamSendPacket(privst,
+                                         priv->client,
+                                         VIR_NET_CONTINUE,
+                                         data + sent,
+                                         len) < 0) {
+            rv = sent > 0 ? sent : -1;
+            break;
+        }
+
+        sent += len;
+        rv = sent;
+    } while (sent < nbytes);
 
     remoteDriverLock(priv);
     priv->localUses--;
@@ -6920,6 +6946,44 @@ remoteNodeGetSEVInfo(virConnectPtr conn,
 }
 
 
+static int
+remoteNodeGetPressureStats(virConnectPtr conn,
+                           virTypedParameterPtr *params,
+                           int *nparams,
+                           unsigned int flags)
+{
+    int rv = -1;
+    remote_node_get_pressure_stats_args args;
+    remote_node_get_pressure_stats_ret ret;
+    struct private_data *priv = conn->privateData;
+
+    remoteDriverLock(priv);
+
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_NODE_GET_PRESSURE_STATS,
+             (xdrproc_t) xdr_remote_node_get_pressure_stats_args, (char *) &args,
+             (xdrproc_t) xdr_remote_node_get_pressure_stats_ret, (char *) &ret) == -1)
+        goto done;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  REMOTE_NODE_PRESSURE_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    xdr_free((xdrproc_t) xdr_remote_node_get_pressure_stats_ret, (char *) &ret);
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
 static int
 remoteNodeGetCPUMap(virConnectPtr conn,
                     unsigned char **cpumap,
@@ -8684,6 +8748,9 @@ static virHypervisorDriver hypervisor_driver = {
     .domainAgentSetResponseTimeout = remoteDomainAgentSetResponseTimeout, /* 5.10.0 */
     .domainBackupBegin = remoteDomainBackupBegin, /* 6.0.0 */
     .domainBackupGetXMLDesc = remoteDomainBackupGetXMLDesc, /* 6.0.0 */
+    .domainStartDirtyRateCalc = remoteDomainStartDirtyRateCalc, /* 6.5.0 */
+    .domainNumaRebalance = remoteDomainNumaRebalance, /* 6.5.0 */
+    .nodeGetPressureStats = remoteNodeGetPressureStats, /* 6.5.0 */
 };
 
 static virNetworkDriver network_driver = {
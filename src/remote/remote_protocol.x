@@ -269,6 +269,9 @@ const REMOTE_DOMAIN_IOTHREAD_PARAMS_MAX = 64;
 /* Upper limit on number of SEV parameters */
 const REMOTE_NODE_SEV_INFO_MAX = 64;
 
+/* Upper limit on number of node pressure stall parameters */
+const REMOTE_NODE_PRESSURE_STATS_MAX = 64;
+
 /* Upper limit on number of launch security information entries */
 const REMOTE_DOMAIN_LAUNCH_SECURITY_INFO_PARAMS_MAX = 64;
 
@@ -3771,6 +3774,26 @@ struct remote_domain_backup_get_xml_desc_ret {
     remote_nonnull_string xml;
 };
 
+struct remote_domain_start_dirty_rate_calc_args {
+    remote_nonnull_domain dom;
+    int seconds;
+    unsigned int flags;
+};
+
+struct remote_domain_numa_rebalance_args {
+    remote_nonnull_domain dom;
+    remote_typed_param params<REMOTE_DOMAIN_NUMA_PARAMETERS_MAX>;
+    unsigned int flags;
+};
+
+struct remote_node_get_pressure_stats_args {
+    unsigned int flags;
+};
+
+struct remote_node_get_pressure_stats_ret {
+    remote_typed_param params<REMOTE_NODE_PRESSURE_STATS_MAX>;
+};
+
 /*----- Protocol. -----*/
 
 /* Define the program number, protocol version and procedure numbers here. */
@@ -6664,5 +6687,23 @@ enum remote_procedure {
      * @priority: high
      * @acl: domain:read
      */
-    REMOTE_PROC_DOMAIN_BACKUP_GET_XML_DESC = 422
+    REMOTE_PROC_DOMAIN_BACKUP_GET_XML_DESC = 422,
+
+    /**
+     * @generate: both
+     * @acl: domain:read
+     */
+    REMOTE_PROC_DOMAIN_START_DIRTY_RATE_CALC = 423,
+
+    /**
+     * @generate: both
+     * @acl: domain:write
+     */
+    REMOTE_PROC_DOMAIN_NUMA_REBALANCE = 424,
+
+    /**
+     * @generate: none
+     * @acl: connect:read
+     */
+    REMOTE_PROC_NODE_GET_PRESSURE_STATS = 425
 };
@@ -37,6 +37,14 @@ const VIR_NET_MESSAGE_INITIAL = 65536;
  */
 const VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX = 262120;
 
+/*
+ * Max payload of a single stream data packet once both sides
+ * have agreed on it via VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS.
+ * Larger packets mean fewer round trips through the RPC layer per
+ * byte transferred on fast links.
+ */
+const VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX = 4194304;
+
 /* Maximum total message size (serialised). */
 const VIR_NET_MESSAGE_MAX = 33554432;
 
@@ -90,6 +90,7 @@ struct _virSecurityDACChownList {
     virSecurityDACChownItemPtr *items;
     size_t nItems;
     bool lock;
+    bool parallel; /* whether items may be processed by several threads */
 };
 
 
@@ -201,6 +202,30 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
                                                   const virStorageSource *src,
                                                   const char *path,
                                                   bool recall);
+static int
+virSecurityDACTransactionRunItem(size_t i,
+                                 void *opaque)
+{
+    virSecurityDACChownListPtr list = opaque;
+    virSecurityDACChownItemPtr item = list->items[i];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecurityDACSetOwnership(list->manager,
+                                          item->src,
+                                          item->path,
+                                          item->uid,
+                                          item->gid,
+                                          remember);
+    }
+
+    return virSecurityDACRestoreFileLabelInternal(list->manager,
+                                                  item->src,
+                                                  item->path,
+                                                  remember);
+}
+
+
 /**
  * virSecurityDACTransactionRun:
  * @pid: process pid
@@ -208,8 +233,10 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
  *
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
- * the list. Depending on security manager configuration it might lock paths
- * we will relabel.
+ * the list, several of them at once unless it runs in a forked child of
+ * the daemon. Depending on security manager configuration it might lock
+ * paths we will relabel. If relabeling any of the paths fails, those
+ * relabeled already are restored.
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -222,6 +249,8 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    g_autofree const char **itemPaths = NULL;
+    g_autofree int *results = NULL;
     size_t i;
     int rv = 0;
     int ret = -1;
@@ -256,32 +285,28 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
-    for (i = 0; i < list->nItems; i++) {
-        virSecurityDACChownItemPtr item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecurityDACSetOwnership(list->manager,
-                                            item->src,
-                                            item->path,
-                                            item->uid,
-                                            item->gid,
-                                            remember);
-        } else {
-            rv = virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                        item->src,
-                                                        item->path,
-                                                        remember);
-        }
+    results = g_new0(int, list->nItems);
+    itemPaths = g_new0(const char *, list->nItems);
+    for (i = 0; i < list->nItems; i++)
+        itemPaths[i] = list->items[i]->path;
 
-        if (rv < 0)
-            break;
-    }
+    if (list->parallel)
+        rv = virSecurityTransactionRunParallel(itemPaths, list->nItems,
+                                               virSecurityDACTransactionRunItem,
+                                               list, results);
+    else
+        rv = virSecurityTransactionRunSerial(list->nItems,
+                                             virSecurityDACTransactionRunItem,
+                                             list, results);
 
-    for (; rv < 0 && i > 0; i--) {
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecurityDACChownItemPtr item = list->items[i - 1];
         const bool remember = item->remember && list->lock;
 
+        /* Roll back only what was actually done. */
+        if (results[i - 1] != 0)
+            continue;
+
         if (!item->restore) {
             virSecurityDACRestoreFileLabelInternal(list->manager,
                                                    item->src,
@@ -306,6 +331,120 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
 }
 
 
+/**
+ * virSecurityDACChownListSerialize:
+ * @list: transaction list
+ *
+ * Serializes @list so that it can be passed to
+ * virSecurityDACTransactionRunBatch().
+ *
+ * Returns: serialized transaction,
+ *          NULL if the transaction can't be serialized.
+ */
+static GByteArray *
+virSecurityDACChownListSerialize(virSecurityDACChownListPtr list)
+{
+    virSecurityTransactionBatch batch = {
+        .virtDriver = virSecurityManagerGetVirtDriver(list->manager),
+        .privileged = virSecurityManagerGetPrivileged(list->manager),
+        .lock = list->lock,
+        .nitems = list->nItems,
+    };
+    g_autofree virSecurityTransactionBatchItemPtr items = NULL;
+    g_auto(GStrv) labels = NULL;
+    size_t i;
+
+    items = g_new0(virSecurityTransactionBatchItem, list->nItems);
+    labels = g_new0(char *, list->nItems + 1);
+
+    for (i = 0; i < list->nItems; i++) {
+        virSecurityDACChownItemPtr item = list->items[i];
+
+        /* Non-local sources are chowned through the chown callback
+         * which needs the full storage source. */
+        if (item->src && !virStorageSourceIsLocalStorage(item->src))
+            return NULL;
+
+        labels[i] = g_strdup_printf("+%u:+%u",
+                                    (unsigned int)item->uid,
+                                    (unsigned int)item->gid);
+
+        items[i].path = item->path;
+        items[i].label = labels[i];
+        items[i].remember = item->remember;
+        items[i].restore = item->restore;
+    }
+
+    batch.items = items;
+    return virSecurityTransactionBatchEncode(&batch);
+}
+
+
+/**
+ * virSecurityDACTransactionRunBatch:
+ * @pid: process pid
+ * @data: serialized transaction
+ * @len: length of @data
+ *
+ * Deserializes transaction produced by virSecurityDACChownListSerialize()
+ * and runs it via virSecurityDACTransactionRun(). This runs in a
+ * namespace helper which has no security manager of its own, so one is
+ * created from the configuration passed along.
+ *
+ * Returns: 0 on success
+ *         -1 otherwise.
+ */
+static int
+virSecurityDACTransactionRunBatch(pid_t pid,
+                                  const char *data,
+                                  size_t len)
+{
+    virSecurityTransactionBatch batch;
+    virSecurityDACChownListPtr list = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (virSecurityTransactionBatchDecode(data, len, &batch) < 0)
+        return -1;
+
+    if (VIR_ALLOC(list) < 0)
+        goto cleanup;
+
+    if (!(list->manager = virSecurityManagerNewDAC(batch.virtDriver, 0, 0,
+                                                   batch.privileged ?
+                                                   VIR_SECURITY_MANAGER_PRIVILEGED : 0,
+                                                   NULL)))
+        goto cleanup;
+
+    list->lock = batch.lock;
+    list->parallel = true;
+
+    for (i = 0; i < batch.nitems; i++) {
+        virSecurityTransactionBatchItemPtr item = &batch.items[i];
+        uid_t uid;
+        gid_t gid;
+
+        if (!item->label ||
+            virParseOwnershipIds(item->label, &uid, &gid) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("malformed security transaction"));
+            goto cleanup;
+        }
+
+        if (virSecurityDACChownListAppend(list, item->path, NULL, uid, gid,
+                                          item->remember, item->restore) < 0)
+            goto cleanup;
+    }
+
+    ret = virSecurityDACTransactionRun(pid, list);
+
+ cleanup:
+    virSecurityDACChownListFree(list);
+    VIR_FREE(batch.items);
+    return ret;
+}
+
+
 /* returns -1 on error, 0 on success */
 int
 virSecurityDACSetUserAndGroup(virSecurityManagerPtr mgr,
@@ -641,9 +780,18 @@ virSecurityDACTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
     list->lock = lock;
 
     if (pid != -1) {
-        rc = virProcessRunInMountNamespace(pid,
-                                           virSecurityDACTransactionRun,
-                                           list);
+        g_autoptr(GByteArray) batch = NULL;
+
+        rc = -2;
+        if ((batch = virSecurityDACChownListSerialize(list)))
+            rc = virProcessRunInMountNamespaceBatch(pid,
+                                                    virSecurityDACTransactionRunBatch,
+                                                    (const char *)batch->data,
+                                                    batch->len);
+        if (rc == -2)
+            rc = virProcessRunInMountNamespace(pid,
+                                               virSecurityDACTransactionRun,
+                                               list);
         if (rc < 0) {
             if (virGetLastErrorCode() == VIR_ERR_SYSTEM_ERROR)
                 pid = -1;
@@ -653,10 +801,12 @@ virSecurityDACTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
     }
 
     if (pid == -1) {
-        if (lock)
+        if (lock) {
             rc = virProcessRunInFork(virSecurityDACTransactionRun, list);
-        else
+        } else {
+            list->parallel = true;
             rc = virSecurityDACTransactionRun(pid, list);
+        }
     }
 
     if (rc < 0)
@@ -88,6 +88,7 @@ struct _virSecuritySELinuxContextList {
     virSecuritySELinuxContextItemPtr *items;
     size_t nItems;
     bool lock;
+    bool parallel; /* whether items may be processed by several threads */
 };
 
 #define SECURITY_SELINUX_VOID_DOI       "0"
@@ -233,6 +234,27 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManagerPtr mgr,
                                               bool recall);
 
 
+static int
+virSecuritySELinuxTransactionRunItem(size_t i,
+                                     void *opaque)
+{
+    virSecuritySELinuxContextListPtr list = opaque;
+    virSecuritySELinuxContextItemPtr item = list->items[i];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecuritySELinuxSetFilecon(list->manager,
+                                            item->path,
+                                            item->tcon,
+                                            remember);
+    }
+
+    return virSecuritySELinuxRestoreFileLabel(list->manager,
+                                              item->path,
+                                              remember);
+}
+
+
 /**
  * virSecuritySELinuxTransactionRun:
  * @pid: process pid
@@ -240,7 +262,9 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManagerPtr mgr,
  *
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
- * the list.
+ * the list, several of them at once unless it runs in a forked child of
+ * the daemon. If relabeling any of the paths fails, those relabeled
+ * already are restored.
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -253,6 +277,8 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    g_autofree const char **itemPaths = NULL;
+    g_autofree int *results = NULL;
     size_t i;
     int rv;
     int ret = -1;
@@ -287,30 +313,28 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
-    rv = 0;
-    for (i = 0; i < list->nItems; i++) {
-        virSecuritySELinuxContextItemPtr item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecuritySELinuxSetFilecon(list->manager,
-                                              item->path,
-                                              item->tcon,
-                                              remember);
-        } else {
-            rv = virSecuritySELinuxRestoreFileLabel(list->manager,
-                                                    item->path,
-                                                    remember);
-        }
+    results = g_new0(int, list->nItems);
+    itemPaths = g_new0(const char *, list->nItems);
+    for (i = 0; i < list->nItems; i++)
+        itemPaths[i] = list->items[i]->path;
 
-        if (rv < 0)
-            break;
-    }
+    if (list->parallel)
+        rv = virSecurityTransactionRunParallel(itemPaths, list->nItems,
+                                               virSecuritySELinuxTransactionRunItem,
+                                               list, results);
+    else
+        rv = virSecurityTransactionRunSerial(list->nItems,
+                                             virSecuritySELinuxTransactionRunItem,
+                                             list, results);
 
-    for (; rv < 0 && i > 0; i--) {
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecuritySELinuxContextItemPtr item = list->items[i - 1];
         const bool remember = item->remember && list->lock;
 
+        /* Roll back only what was actually done. */
+        if (results[i - 1] != 0)
+            continue;
+
         if (!item->restore) {
             virSecuritySELinuxRestoreFileLabel(list->manager,
                                                item->path,
@@ -333,6 +357,115 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
 }
 
 
+static GByteArray *
+virSecuritySELinuxContextListSerialize(virSecuritySELinuxContextListPtr list)
+{
+    virSecurityTransactionBatch batch = {
+        .virtDriver = virSecurityManagerGetVirtDriver(list->manager),
+        .privileged = virSecurityManagerGetPrivileged(list->manager),
+        .lock = list->lock,
+        .nitems = list->nItems,
+    };
+    g_autofree virSecurityTransactionBatchItemPtr items = NULL;
+    size_t i;
+
+    items = g_new0(virSecurityTransactionBatchItem, list->nItems);
+
+    for (i = 0; i < list->nItems; i++) {
+        items[i].path = list->items[i]->path;
+        items[i].label = list->items[i]->tcon;
+        items[i].remember = list->items[i]->remember;
+        items[i].restore = list->items[i]->restore;
+    }
+
+    batch.items = items;
+    return virSecurityTransactionBatchEncode(&batch);
+}
+
+
+/* Manager of the namespace helper running the batches. Creating it
+ * loads the file contexts of the policy, therefore it is kept for as
+ * long as the helper lives. The helper handles one request at a time. */
+static virSecurityManagerPtr virSecuritySELinuxBatchManager;
+
+static virSecurityManagerPtr
+virSecuritySELinuxGetBatchManager(const char *virtDriver,
+                                  bool privileged)
+{
+    virSecurityManagerPtr mgr = virSecuritySELinuxBatchManager;
+
+    if (mgr &&
+        (STRNEQ_NULLABLE(virSecurityManagerGetVirtDriver(mgr), virtDriver) ||
+         virSecurityManagerGetPrivileged(mgr) != privileged)) {
+        virObjectUnref(mgr);
+        mgr = virSecuritySELinuxBatchManager = NULL;
+    }
+
+    if (!mgr &&
+        !(mgr = virSecurityManagerNew(SECURITY_SELINUX_NAME, virtDriver,
+                                      privileged ?
+                                      VIR_SECURITY_MANAGER_PRIVILEGED : 0)))
+        return NULL;
+
+    virSecuritySELinuxBatchManager = mgr;
+    return virObjectRef(mgr);
+}
+
+
+/**
+ * virSecuritySELinuxTransactionRunBatch:
+ * @pid: process pid
+ * @data: serialized transaction
+ * @len: length of @data
+ *
+ * Deserializes transaction produced by
+ * virSecuritySELinuxContextListSerialize() and runs it via
+ * virSecuritySELinuxTransactionRun().
+ *
+ * Returns: 0 on success
+ *         -1 otherwise.
+ */
+static int
+virSecuritySELinuxTransactionRunBatch(pid_t pid,
+                                      const char *data,
+                                      size_t len)
+{
+    virSecurityTransactionBatch batch;
+    virSecuritySELinuxContextListPtr list = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (virSecurityTransactionBatchDecode(data, len, &batch) < 0)
+        return -1;
+
+    if (VIR_ALLOC(list) < 0)
+        goto cleanup;
+
+    if (!(list->manager = virSecuritySELinuxGetBatchManager(batch.virtDriver,
+                                                            batch.privileged)))
+        goto cleanup;
+
+    list->lock = batch.lock;
+    list->parallel = true;
+
+    for (i = 0; i < batch.nitems; i++) {
+        virSecurityTransactionBatchItemPtr item = &batch.items[i];
+
+        if (virSecuritySELinuxContextListAppend(list, item->path, item->label,
+                                                item->remember,
+                                                item->restore) < 0)
+            goto cleanup;
+    }
+
+    ret = virSecuritySELinuxTransactionRun(pid, list);
+
+ cleanup:
+    virSecuritySELinuxContextListFree(list);
+    VIR_FREE(batch.items);
+    return ret;
+}
+
+
 /*
  * Returns 0 on success, 1 if already reserved, or -1 on fatal error
  */
@@ -1162,9 +1295,16 @@ virSecuritySELinuxTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
     list->lock = lock;
 
     if (pid != -1) {
-        rc = virProcessRunInMountNamespace(pid,
-                                           virSecuritySELinuxTransactionRun,
-                                           list);
+        g_autoptr(GByteArray) batch = virSecuritySELinuxContextListSerialize(list);
+
+        rc = virProcessRunInMountNamespaceBatch(pid,
+                                                virSecuritySELinuxTransactionRunBatch,
+                                                (const char *)batch->data,
+                                                batch->len);
+        if (rc == -2)
+            rc = virProcessRunInMountNamespace(pid,
+                                               virSecuritySELinuxTransactionRun,
+                                               list);
         if (rc < 0) {
             if (virGetLastErrorCode() == VIR_ERR_SYSTEM_ERROR)
                 pid = -1;
@@ -1174,10 +1314,12 @@ virSecuritySELinuxTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
     }
 
     if (pid == -1) {
-        if (lock)
+        if (lock) {
             rc = virProcessRunInFork(virSecuritySELinuxTransactionRun, list);
-        else
+        } else {
+            list->parallel = true;
             rc = virSecuritySELinuxTransactionRun(pid, list);
+        }
     }
 
     if (rc < 0)
@@ -18,6 +18,8 @@
 
 #include <config.h>
 
+#include <sys/stat.h>
+
 #include "viralloc.h"
 #include "virfile.h"
 #include "virstring.h"
@@ -25,6 +27,8 @@
 #include "virlog.h"
 #include "viruuid.h"
 #include "virhostuptime.h"
+#include "virhash.h"
+#include "virthreadpool.h"
 
 #include "security_util.h"
 
@@ -525,3 +529,360 @@ virSecurityMoveRememberedLabel(const char *name,
 
     return 0;
 }
+
+
+/* Upper limit on transaction items relabeled at once */
+#define VIR_SECURITY_TRANSACTION_WORKERS_MAX 8
+
+typedef struct _virSecurityTransactionUnit virSecurityTransactionUnit;
+typedef virSecurityTransactionUnit *virSecurityTransactionUnitPtr;
+struct _virSecurityTransactionUnit {
+    size_t *items;
+    size_t nitems;
+};
+
+typedef struct _virSecurityTransactionData virSecurityTransactionData;
+typedef virSecurityTransactionData *virSecurityTransactionDataPtr;
+struct _virSecurityTransactionData {
+    virSecurityTransactionUnitPtr *units;
+    size_t nunits;
+
+    virSecurityTransactionItemCallback cb;
+    void *opaque;
+    int *results;
+};
+
+
+static void
+virSecurityTransactionUnitFree(virSecurityTransactionUnitPtr unit)
+{
+    if (!unit)
+        return;
+
+    g_free(unit->items);
+    g_free(unit);
+}
+
+
+static int
+virSecurityTransactionWorker(size_t u,
+                             void *opaque)
+{
+    virSecurityTransactionDataPtr data = opaque;
+    virSecurityTransactionUnitPtr unit = data->units[u];
+    size_t i;
+
+    for (i = 0; i < unit->nitems; i++) {
+        size_t item = unit->items[i];
+
+        if ((data->results[item] = data->cb(item, data->opaque)) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* Items are grouped by the file they touch rather than by their path, as
+ * different paths may lead to the same file (symlinks, hard links, bind
+ * mounts, /dev/disk/by-id/ aliases) and remembering its label would race.
+ * Paths which don't exist are grouped by the path itself. */
+static char *
+virSecurityTransactionItemKey(const char *path)
+{
+    struct stat sb;
+
+    if (stat(path, &sb) == 0)
+        return g_strdup_printf("file:%llu:%llu",
+                               (unsigned long long) sb.st_dev,
+                               (unsigned long long) sb.st_ino);
+
+    return g_strdup_printf("path:%s", path);
+}
+
+
+/**
+ * virSecurityTransactionRunParallel:
+ * @paths: paths touched by the transaction items
+ * @nitems: number of items (and @paths)
+ * @cb: callback processing a single item
+ * @opaque: opaque data passed to @cb
+ * @results: array of @nitems values filled with return values of @cb
+ *
+ * Calls @cb for each item of a security transaction, using up to
+ * VIR_SECURITY_TRANSACTION_WORKERS_MAX threads. Relabeling is
+ * dominated by waiting for the filesystem (NFS in particular), hence
+ * processing paths concurrently shortens the transaction. Items
+ * touching the same file, even through different paths, are processed
+ * in their original order by the same thread, as remembering labels is
+ * not atomic. A NULL path is considered unique.
+ *
+ * Once an item fails no further items are started. Those that were
+ * not processed have their @results entry set to 1 so that the
+ * caller can roll back exactly the items that succeeded.
+ *
+ * Returns: 0 if all items succeeded,
+ *         -1 otherwise, with the error of the failed item that comes
+ *         first in the transaction among those touching different files.
+ */
+int
+virSecurityTransactionRunParallel(const char **paths,
+                                  size_t nitems,
+                                  virSecurityTransactionItemCallback cb,
+                                  void *opaque,
+                                  int *results)
+{
+    virSecurityTransactionData data = { .cb = cb, .opaque = opaque,
+                                        .results = results };
+    g_autoptr(virHashTable) byFile = NULL;
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < nitems; i++)
+        results[i] = 1;
+
+    if (!(byFile = virHashNew(NULL)))
+        return -1;
+
+    data.units = g_new0(virSecurityTransactionUnitPtr, nitems);
+
+    for (i = 0; i < nitems; i++) {
+        virSecurityTransactionUnitPtr unit = NULL;
+        g_autofree char *key = NULL;
+
+        if (paths[i]) {
+            key = virSecurityTransactionItemKey(paths[i]);
+            unit = virHashLookup(byFile, key);
+        }
+
+        if (!unit) {
+            unit = g_new0(virSecurityTransactionUnit, 1);
+            data.units[data.nunits++] = unit;
+
+            if (key &&
+                virHashAddEntry(byFile, key, unit) < 0)
+                goto cleanup;
+        }
+
+        if (VIR_APPEND_ELEMENT_COPY(unit->items, unit->nitems, i) < 0)
+            goto cleanup;
+    }
+
+    if (virThreadPoolRunParallel(data.nunits,
+                                 VIR_SECURITY_TRANSACTION_WORKERS_MAX,
+                                 "security-relabel",
+                                 virSecurityTransactionWorker, &data,
+                                 VIR_THREAD_POOL_PARALLEL_STOP_ON_ERROR) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < data.nunits; i++)
+        virSecurityTransactionUnitFree(data.units[i]);
+    g_free(data.units);
+    return ret;
+}
+
+
+/**
+ * virSecurityTransactionRunSerial:
+ * @nitems: number of items
+ * @cb: callback processing a single item
+ * @opaque: opaque data passed to @cb
+ * @results: array of @nitems values filled with return values of @cb
+ *
+ * Calls @cb for each item of a security transaction in order, in the
+ * calling thread. This is what a forked child of the daemon has to use:
+ * it must not create threads as locks held by other threads of the
+ * daemon at fork time are never released in the child. Items after the
+ * first failure are not processed and have their @results entry set to 1.
+ *
+ * Returns: 0 if all items succeeded,
+ *         -1 otherwise, with the error of the failed item.
+ */
+int
+virSecurityTransactionRunSerial(size_t nitems,
+                                virSecurityTransactionItemCallback cb,
+                                void *opaque,
+                                int *results)
+{
+    size_t i;
+
+    for (i = 0; i < nitems; i++)
+        results[i] = 1;
+
+    for (i = 0; i < nitems; i++) {
+        if ((results[i] = cb(i, opaque)) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * A transaction run by the namespace helper of a domain (see
+ * virProcessRunInMountNamespaceBatch()) is passed to it in a flat
+ * form, as the helper doesn't share any data with the daemon:
+ *
+ *   header: virtDriver '\0' flags
+ *   item:   flags [path '\0'] [label '\0']
+ *
+ * where flags is a single byte. The items follow the header up to the
+ * end of the data.
+ */
+enum {
+    VIR_SECURITY_TRANSACTION_BATCH_PRIVILEGED = 1 << 0,
+    VIR_SECURITY_TRANSACTION_BATCH_LOCK = 1 << 1,
+};
+
+enum {
+    VIR_SECURITY_TRANSACTION_BATCH_REMEMBER = 1 << 0,
+    VIR_SECURITY_TRANSACTION_BATCH_RESTORE = 1 << 1,
+    VIR_SECURITY_TRANSACTION_BATCH_PATH = 1 << 2,
+    VIR_SECURITY_TRANSACTION_BATCH_LABEL = 1 << 3,
+};
+
+
+static void
+virSecurityTransactionBatchAppendString(GByteArray *buf,
+                                        const char *str)
+{
+    g_byte_array_append(buf, (const guint8 *)str, strlen(str) + 1);
+}
+
+
+/**
+ * virSecurityTransactionBatchEncode:
+ * @batch: transaction to encode
+ *
+ * Encodes @batch so that it can be sent to a namespace helper and
+ * decoded there by virSecurityTransactionBatchDecode().
+ *
+ * Returns: the encoded transaction.
+ */
+GByteArray *
+virSecurityTransactionBatchEncode(const virSecurityTransactionBatch *batch)
+{
+    GByteArray *buf = g_byte_array_new();
+    guint8 flags = 0;
+    size_t i;
+
+    if (batch->privileged)
+        flags |= VIR_SECURITY_TRANSACTION_BATCH_PRIVILEGED;
+    if (batch->lock)
+        flags |= VIR_SECURITY_TRANSACTION_BATCH_LOCK;
+
+    virSecurityTransactionBatchAppendString(buf, batch->virtDriver);
+    g_byte_array_append(buf, &flags, 1);
+
+    for (i = 0; i < batch->nitems; i++) {
+        const virSecurityTransactionBatchItem *item = &batch->items[i];
+
+        flags = 0;
+        if (item->remember)
+            flags |= VIR_SECURITY_TRANSACTION_BATCH_REMEMBER;
+        if (item->restore)
+            flags |= VIR_SECURITY_TRANSACTION_BATCH_RESTORE;
+        if (item->path)
+            flags |= VIR_SECURITY_TRANSACTION_BATCH_PATH;
+        if (item->label)
+            flags |= VIR_SECURITY_TRANSACTION_BATCH_LABEL;
+
+        g_byte_array_append(buf, &flags, 1);
+        if (item->path)
+            virSecurityTransactionBatchAppendString(buf, item->path);
+        if (item->label)
+            virSecurityTransactionBatchAppendString(buf, item->label);
+    }
+
+    return buf;
+}
+
+
+static const char *
+virSecurityTransactionBatchNextString(const char *data,
+                                      size_t len,
+                                      size_t *pos)
+{
+    const char *ret = data + *pos;
+    const char *end;
+
+    if (*pos >= len ||
+        !(end = memchr(ret, '\0', len - *pos)))
+        return NULL;
+
+    *pos += end - ret + 1;
+    return ret;
+}
+
+
+/**
+ * virSecurityTransactionBatchDecode:
+ * @data: transaction encoded by virSecurityTransactionBatchEncode()
+ * @len: length of @data
+ * @batch: decoded transaction
+ *
+ * Decodes @data into @batch. The strings of @batch point into @data,
+ * the array of items has to be freed by the caller.
+ *
+ * Returns: 0 on success,
+ *         -1 if @data is malformed, with error reported.
+ */
+int
+virSecurityTransactionBatchDecode(const char *data,
+                                  size_t len,
+                                  virSecurityTransactionBatchPtr batch)
+{
+    size_t pos = 0;
+    guint8 flags;
+
+    memset(batch, 0, sizeof(*batch));
+
+    if (!(batch->virtDriver = virSecurityTransactionBatchNextString(data, len, &pos)) ||
+        pos >= len)
+        goto malformed;
+
+    flags = data[pos++];
+    if (flags & ~(VIR_SECURITY_TRANSACTION_BATCH_PRIVILEGED |
+                  VIR_SECURITY_TRANSACTION_BATCH_LOCK))
+        goto malformed;
+
+    batch->privileged = flags & VIR_SECURITY_TRANSACTION_BATCH_PRIVILEGED;
+    batch->lock = flags & VIR_SECURITY_TRANSACTION_BATCH_LOCK;
+
+    while (pos < len) {
+        virSecurityTransactionBatchItem item = { 0 };
+
+        flags = data[pos++];
+        if (flags & ~(VIR_SECURITY_TRANSACTION_BATCH_REMEMBER |
+                      VIR_SECURITY_TRANSACTION_BATCH_RESTORE |
+                      VIR_SECURITY_TRANSACTION_BATCH_PATH |
+                      VIR_SECURITY_TRANSACTION_BATCH_LABEL))
+            goto malformed;
+
+        item.remember = flags & VIR_SECURITY_TRANSACTION_BATCH_REMEMBER;
+        item.restore = flags & VIR_SECURITY_TRANSACTION_BATCH_RESTORE;
+
+        if (flags & VIR_SECURITY_TRANSACTION_BATCH_PATH &&
+            !(item.path = virSecurityTransactionBatchNextString(data, len, &pos)))
+            goto malformed;
+
+        if (flags & VIR_SECURITY_TRANSACTION_BATCH_LABEL &&
+            !(item.label = virSecurityTransactionBatchNextString(data, len, &pos)))
+            goto malformed;
+
+        if (VIR_APPEND_ELEMENT(batch->items, batch->nitems, item) < 0)
+            goto error;
+    }
+
+    return 0;
+
+ malformed:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("malformed security transaction"));
+ error:
+    VIR_FREE(batch->items);
+    batch->nitems = 0;
+    return -1;
+}
@@ -32,3 +32,54 @@ int
 virSecurityMoveRememberedLabel(const char *name,
                                const char *src,
                                const char *dst);
+
+/**
+ * virSecurityTransactionItemCallback:
+ * @item: index of the transaction item to process
+ * @opaque: opaque data
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise, with error reported.
+ */
+typedef int (*virSecurityTransactionItemCallback)(size_t item,
+                                                  void *opaque);
+
+int
+virSecurityTransactionRunParallel(const char **paths,
+                                  size_t nitems,
+                                  virSecurityTransactionItemCallback cb,
+                                  void *opaque,
+                                  int *results);
+
+int
+virSecurityTransactionRunSerial(size_t nitems,
+                                virSecurityTransactionItemCallback cb,
+                                void *opaque,
+                                int *results);
+
+typedef struct _virSecurityTransactionBatchItem virSecurityTransactionBatchItem;
+typedef virSecurityTransactionBatchItem *virSecurityTransactionBatchItemPtr;
+struct _virSecurityTransactionBatchItem {
+    const char *path;
+    const char *label; /* in the format of the security driver */
+    bool remember;
+    bool restore;
+};
+
+typedef struct _virSecurityTransactionBatch virSecurityTransactionBatch;
+typedef virSecurityTransactionBatch *virSecurityTransactionBatchPtr;
+struct _virSecurityTransactionBatch {
+    const char *virtDriver;
+    bool privileged;
+    bool lock;
+    virSecurityTransactionBatchItemPtr items;
+    size_t nitems;
+};
+
+GByteArray *
+virSecurityTransactionBatchEncode(const virSecurityTransactionBatch *batch);
+
+int
+virSecurityTransactionBatchDecode(const char *data,
+                                  size_t len,
+                                  virSecurityTransactionBatchPtr batch);
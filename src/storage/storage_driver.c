@@ -2322,18 +2322,26 @@ virStorageVolPoolRefreshThread(void *opaque)
     virStoragePoolDefPtr def;
     virStorageBackendPtr backend;
     virObjectEventPtr event = NULL;
+    int rc = 0;
+
+    if (cbdata->vol_path)
+        rc = virStorageBackendPloopRestoreDesc(cbdata->vol_path);
 
-    if (cbdata->vol_path) {
-        if (virStorageBackendPloopRestoreDesc(cbdata->vol_path) < 0)
-            goto cleanup;
-    }
     if (!(obj = virStoragePoolObjFindByName(driver->pools,
                                             cbdata->pool_name)))
         goto cleanup;
     def = virStoragePoolObjGetDef(obj);
 
-    /* If some thread is building a new volume in the pool, then we cannot
-     * clear out all vols and refresh the pool. So we'll just pass. */
+    /* The upload held an async job since storageVolUpload. */
+    virStoragePoolObjDecrAsyncjobs(obj);
+
+    if (rc < 0)
+        goto cleanup;
+
+    /* If some thread is building a new volume in the pool or other
+     * uploads are still in flight, then we cannot clear out all vols
+     * and refresh the pool. So we'll just pass and let the last job
+     * to finish do the refresh. */
     if (virStoragePoolObjGetAsyncjobs(obj) > 0) {
         VIR_DEBUG("Asyncjob in process, cannot refresh storage pool");
         goto cleanup;
@@ -2364,6 +2372,8 @@ static void
 virStorageVolFDStreamCloseCb(virStreamPtr st G_GNUC_UNUSED,
                              void *opaque)
 {
+    virStorageVolStreamInfoPtr cbdata = opaque;
+    virStoragePoolObjPtr obj;
     virThread thread;
 
     if (virThreadCreateFull(&thread, false, virStorageVolPoolRefreshThread,
@@ -2375,7 +2385,13 @@ virStorageVolFDStreamCloseCb(virStreamPtr st G_GNUC_UNUSED,
     return; /* Thread will free opaque data */
 
  error:
-    virStorageVolPoolRefreshDataFree(opaque);
+    /* The refresh thread would have ended the async job of the upload */
+    if ((obj = virStoragePoolObjFindByName(driver->pools,
+                                           cbdata->pool_name))) {
+        virStoragePoolObjDecrAsyncjobs(obj);
+        virStoragePoolObjEndAPI(&obj);
+    }
+    virStorageVolPoolRefreshDataFree(cbdata);
 }
 
 static int
@@ -2442,13 +2458,18 @@ storageVolUpload(virStorageVolPtr vol,
 
     virObjectLock(obj);
     voldef->in_use--;
-    virStoragePoolObjDecrAsyncjobs(obj);
 
-    if (rc < 0)
+    if (rc < 0) {
+        virStoragePoolObjDecrAsyncjobs(obj);
         goto cleanup;
+    }
 
     /* Add cleanup callback - call after uploadVol since the stream
-     * is then fully set up
+     * is then fully set up. The async job is kept until the callback
+     * runs, so that the pool is neither refreshed nor torn down while
+     * data is still being written and several streams can upload
+     * disjoint ranges of the volume at once with a single refresh
+     * after the last one finishes.
      */
     virFDStreamSetInternalCloseCb(stream,
                                   virStorageVolFDStreamCloseCb,
@@ -74,6 +74,7 @@
 #include "virxml.h"
 #include "virfdstream.h"
 #include "virutil.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -101,6 +102,9 @@ virStorageBackendNamespaceInit(int poolType,
 #define READ_BLOCK_SIZE_DEFAULT  (1024 * 1024)
 #define WRITE_BLOCK_SIZE_DEFAULT (4 * 1024)
 
+/* Upper limit on threads probing volumes of a directory pool at once */
+#define REFRESH_LOCAL_WORKERS_MAX 8
+
 /*
  * Perform the O(1) btrfs clone operation, if possible.
  * Upon success, return 0.  Otherwise, return -1 and set errno.
@@ -3483,6 +3487,36 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol)
 }
 
 
+typedef struct _virStorageBackendRefreshLocalData virStorageBackendRefreshLocalData;
+typedef virStorageBackendRefreshLocalData *virStorageBackendRefreshLocalDataPtr;
+struct _virStorageBackendRefreshLocalData {
+    virStorageVolDefPtr *vols;
+    int *rc; /* result of virStorageBackendRefreshVolTargetUpdate per vol */
+    size_t nvols;
+};
+
+
+/*
+ * Probe a single volume of @opaque. Opening each volume and reading its
+ * header is mostly waiting for I/O, which on network file systems takes
+ * a while, so volumes are probed by several threads at once.
+ */
+static int
+virStorageBackendRefreshLocalProbe(size_t i,
+                                   void *opaque)
+{
+    virStorageBackendRefreshLocalDataPtr data = opaque;
+
+    data->rc[i] = virStorageBackendRefreshVolTargetUpdate(data->vols[i]);
+
+    /* Non-regular files are ignored rather than failing the refresh */
+    if (data->rc[i] == -1)
+        return -1;
+
+    return 0;
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
@@ -3500,13 +3534,13 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     g_autoptr(virStorageVolDef) vol = NULL;
     VIR_AUTOCLOSE fd = -1;
     g_autoptr(virStorageSource) target = NULL;
+    virStorageBackendRefreshLocalData data = { 0 };
+    size_t i;
 
     if (virDirOpen(&dir, def->target.path) < 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &ent, def->target.path)) > 0) {
-        int err;
-
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file '%s' with control characters under '%s'",
                      ent->d_name, def->target.path);
@@ -3523,25 +3557,32 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
 
         vol->key = g_strdup(vol->target.path);
 
-        if ((err = virStorageBackendRefreshVolTargetUpdate(vol)) < 0) {
-            if (err == -2) {
-                /* Silently ignore non-regular files,
-                 * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
-                continue;
-            }
-            goto cleanup;
-        }
-
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
+        if (VIR_APPEND_ELEMENT(data.vols, data.nvols, vol) < 0)
             goto cleanup;
-        vol = NULL;
     }
     if (direrr < 0)
         goto cleanup;
     VIR_DIR_CLOSE(dir);
 
+    data.rc = g_new0(int, data.nvols);
+
+    if (virThreadPoolRunParallel(data.nvols, REFRESH_LOCAL_WORKERS_MAX,
+                                 "vol-probe",
+                                 virStorageBackendRefreshLocalProbe,
+                                 &data, 0) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data.nvols; i++) {
+        /* Silently ignore non-regular files,
+         * eg 'lost+found', dangling symbolic link */
+        if (data.rc[i] == -2)
+            continue;
+
+        if (virStoragePoolObjAddVol(pool, data.vols[i]) < 0)
+            goto cleanup;
+        data.vols[i] = NULL;
+    }
+
     if (!(target = virStorageSourceNew()))
         goto cleanup;
 
@@ -3585,6 +3626,10 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     ret = 0;
  cleanup:
     VIR_DIR_CLOSE(dir);
+    for (i = 0; i < data.nvols; i++)
+        virStorageVolDefFree(data.vols[i]);
+    VIR_FREE(data.vols);
+    VIR_FREE(data.rc);
     return ret;
 }
 
@@ -21,12 +21,14 @@
  *   - Read existing file
  *   - Write existing file
  *   - Create & write new file
+ *   - Create new file as sparse, skipping all-zero blocks
  */
 
 #include <config.h>
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include "virthread.h"
 #include "virfile.h"
@@ -42,6 +44,63 @@
 # define O_DIRECT 0
 #endif
 
+static bool
+runIOIsZero(const char *buf, size_t len)
+{
+    return buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0;
+}
+
+
+/*
+ * Write @len bytes of @buf into @fd, but instead of writing blocks of
+ * @blksz bytes consisting only of zeros, seek over them so that the
+ * file system can leave a hole in their place. The caller is
+ * responsible for extending the file to its final size afterwards,
+ * should it end with a hole. Both @len and the current offset are
+ * expected to be multiple of @blksz, except for the very last block.
+ */
+static ssize_t
+runIOWriteSparse(int fd, const char *buf, size_t len, size_t blksz)
+{
+    size_t off = 0;
+
+    while (off < len) {
+        size_t run = 0;
+        bool zero = runIOIsZero(buf + off, MIN(blksz, len - off));
+
+        /* Merge consecutive blocks of the same kind into a single
+         * write() or lseek() call. */
+        do {
+            run += MIN(blksz, len - off - run);
+        } while (off + run < len &&
+                 runIOIsZero(buf + off + run,
+                             MIN(blksz, len - off - run)) == zero);
+
+        if (zero) {
+            if (lseek(fd, run, SEEK_CUR) < 0)
+                return -1;
+        } else {
+            if (safewrite(fd, buf + off, run) < 0)
+                return -1;
+        }
+
+        off += run;
+    }
+
+    return len;
+}
+
+
+static ssize_t
+runIOWrite(int fd, const char *buf, size_t len, size_t blksz, bool sparse)
+{
+    if (sparse)
+        return runIOWriteSparse(fd, buf, len, blksz);
+
+    return safewrite(fd, buf, len);
+}
+
+
 static int
 runIO(const char *path, int fd, int oflags)
 {
@@ -54,7 +113,9 @@ runIO(const char *path, int fd, int oflags)
     const char *fdinname, *fdoutname;
     unsigned long long total = 0;
     bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
+    bool sparse = false;
     off_t end = 0;
+    struct stat sb;
 
 #if HAVE_POSIX_MEMALIGN
     if (posix_memalign(&base, alignMask + 1, buflen)) {
@@ -95,6 +156,13 @@ runIO(const char *path, int fd, int oflags)
                                  _("O_DIRECT write needs empty seekable file"));
             goto cleanup;
         }
+        /* Zero blocks (e.g. unused guest memory or the padding after
+         * the domain XML in save images) can be left as holes, but
+         * only if there is no previous content we would have to
+         * overwrite. */
+        if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) &&
+            sb.st_size == 0 && lseek(fd, 0, SEEK_CUR) == 0)
+            sparse = true;
         break;
 
     case O_RDWR:
@@ -137,7 +205,8 @@ runIO(const char *path, int fd, int oflags)
 
             memset(buf + got, 0, aligned_got - got);
 
-            if (safewrite(fdout, buf, aligned_got) < 0) {
+            if (runIOWrite(fdout, buf, aligned_got,
+                           alignMask + 1, sparse) < 0) {
                 virReportSystemError(errno, _("Unable to write %s"), fdoutname);
                 goto cleanup;
             }
@@ -150,12 +219,19 @@ runIO(const char *path, int fd, int oflags)
             break;
         }
 
-        if (safewrite(fdout, buf, got) < 0) {
+        if (runIOWrite(fdout, buf, got, alignMask + 1, sparse) < 0) {
             virReportSystemError(errno, _("Unable to write %s"), fdoutname);
             goto cleanup;
         }
     }
 
+    /* If the data ended with zeros we only seeked past them, so
+     * make sure the file has the right size. */
+    if (sparse && ftruncate(fd, total) < 0) {
+        virReportSystemError(errno, _("Unable to truncate %s"), fdoutname);
+        goto cleanup;
+    }
+
     /* Ensure all data is written */
     if (virFileDataSync(fdout) < 0) {
         if (errno != EINVAL && errno != EROFS) {
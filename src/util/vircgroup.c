@@ -30,6 +30,7 @@
 # include <signal.h>
 # include <dirent.h>
 # include <unistd.h>
+# include <sys/resource.h>
 #endif /* __linux__ */
 
 #define LIBVIRT_VIRCGROUPPRIV_H_ALLOW
@@ -53,6 +54,9 @@ VIR_LOG_INIT("util.cgroup");
 
 #define VIR_FROM_THIS VIR_FROM_CGROUP
 
+/* Largest cgroup file we are willing to read */
+#define CGROUP_READ_MAX (1024 * 1024)
+
 #define CGROUP_NB_TOTAL_CPU_STAT_PARAM 3
 #define CGROUP_NB_PER_CPU_STAT_PARAM   1
 
@@ -102,6 +106,50 @@ virCgroupGetDevicePermsString(int perms)
 }
 
 
+/* Statistics files kept open by virCgroupGetStatValueStr in all cgroups.
+ * The daemon keeps the cgroups of every domain and of its threads, so on
+ * a host with many domains the descriptors would add up and starve
+ * clients, disks and monitors. At most a quarter of RLIMIT_NOFILE is used
+ * for them; files beyond that are opened for every read instead. */
+static virMutex virCgroupStatFilesLock = VIR_MUTEX_INITIALIZER;
+static size_t virCgroupStatFilesOpen;
+static size_t virCgroupStatFilesMax;
+static bool virCgroupStatFilesMaxSet;
+
+/* Used if the number of open files is not limited */
+#define CGROUP_STAT_FILES_MAX_DEFAULT 4096
+
+
+/**
+ * virCgroupSetStatFilesMax:
+ * @max: maximum number of statistics files kept open
+ *
+ * Overrides the limit derived from RLIMIT_NOFILE, meant for tests.
+ */
+void
+virCgroupSetStatFilesMax(size_t max)
+{
+    virMutexLock(&virCgroupStatFilesLock);
+    virCgroupStatFilesMax = max;
+    virCgroupStatFilesMaxSet = true;
+    virMutexUnlock(&virCgroupStatFilesLock);
+}
+
+
+static void
+virCgroupStatFileClose(virCgroupStatFilePtr file)
+{
+    if (file->fd < 0)
+        return;
+
+    VIR_FORCE_CLOSE(file->fd);
+
+    virMutexLock(&virCgroupStatFilesLock);
+    virCgroupStatFilesOpen--;
+    virMutexUnlock(&virCgroupStatFilesLock);
+}
+
+
 #ifdef __linux__
 bool
 virCgroupAvailable(void)
@@ -479,7 +527,7 @@ virCgroupGetValueRaw(const char *path,
 
     VIR_DEBUG("Get value %s", path);
 
-    if ((rc = virFileReadAll(path, 1024*1024, value)) < 0) {
+    if ((rc = virFileReadAll(path, CGROUP_READ_MAX, value)) < 0) {
         virReportSystemError(errno,
                              _("Unable to read from '%s'"), path);
         return -1;
@@ -523,6 +571,245 @@ virCgroupGetValueStr(virCgroupPtr group,
 }
 
 
+/*
+ * Read whole content of @fd from the beginning of the file into
+ * a newly allocated, NUL terminated @buf.
+ *
+ * Returns number of bytes read, -1 on error with errno set.
+ */
+static ssize_t
+virCgroupPreadAll(int fd,
+                  char **buf)
+{
+    g_autofree char *tmp = NULL;
+    size_t size = 4096;
+    size_t len = 0;
+
+    tmp = g_new0(char, size + 1);
+
+    while (true) {
+        ssize_t got = pread(fd, tmp + len, size - len, len);
+
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        if (got == 0)
+            break;
+
+        len += got;
+
+        if (len == size) {
+            if (size >= CGROUP_READ_MAX) {
+                errno = EOVERFLOW;
+                return -1;
+            }
+            size *= 2;
+            tmp = g_renew(char, tmp, size + 1);
+        }
+    }
+
+    tmp[len] = '\0';
+    *buf = g_steal_pointer(&tmp);
+    return len;
+}
+
+
+static bool
+virCgroupStatFilesReserve(void)
+{
+    bool ret = false;
+
+    virMutexLock(&virCgroupStatFilesLock);
+
+    if (!virCgroupStatFilesMaxSet) {
+        struct rlimit rlim;
+
+        if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+            rlim.rlim_cur != RLIM_INFINITY)
+            virCgroupStatFilesMax = rlim.rlim_cur / 4;
+        else
+            virCgroupStatFilesMax = CGROUP_STAT_FILES_MAX_DEFAULT;
+        virCgroupStatFilesMaxSet = true;
+    }
+
+    if (virCgroupStatFilesOpen < virCgroupStatFilesMax) {
+        virCgroupStatFilesOpen++;
+        ret = true;
+    }
+
+    virMutexUnlock(&virCgroupStatFilesLock);
+    return ret;
+}
+
+
+static void
+virCgroupStatFileRemove(virCgroupPtr group,
+                        size_t i)
+{
+    virCgroupStatFileClose(&group->statFiles[i]);
+    VIR_FREE(group->statFiles[i].path);
+    VIR_FREE(group->statFiles[i].snapshot);
+    VIR_DELETE_ELEMENT(group->statFiles, i, group->nstatFiles);
+}
+
+
+static int
+virCgroupGetStatValueStrInternal(virCgroupPtr group,
+                                 int controller,
+                                 const char *key,
+                                 bool optional,
+                                 char **value)
+{
+    g_autofree char *keypath = NULL;
+    virCgroupStatFilePtr file = NULL;
+    ssize_t len;
+    size_t i;
+    int ret = -1;
+
+    *value = NULL;
+
+    if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
+        return -1;
+
+    VIR_DEBUG("Get stat value %s", keypath);
+
+    virMutexLock(&group->statLock);
+
+    for (i = 0; i < group->nstatFiles; i++) {
+        if (STREQ(group->statFiles[i].path, keypath)) {
+            file = &group->statFiles[i];
+            break;
+        }
+    }
+
+    if (!file) {
+        virCgroupStatFile newfile = { NULL, -1, false, NULL };
+        VIR_AUTOCLOSE fd = -1;
+
+        if ((fd = open(keypath, O_RDONLY | O_CLOEXEC)) < 0) {
+            if (errno != ENOENT || !optional) {
+                virReportSystemError(errno,
+                                     _("Unable to read from '%s'"), keypath);
+                goto cleanup;
+            }
+
+            /* Remember that the file is missing, it does not consume
+             * a descriptor */
+            newfile.missing = true;
+        } else if (!virCgroupStatFilesReserve()) {
+            if ((len = virCgroupPreadAll(fd, value)) < 0) {
+                virReportSystemError(errno,
+                                     _("Unable to read from '%s'"), keypath);
+                goto cleanup;
+            }
+            goto done;
+        }
+
+        newfile.fd = fd;
+        fd = -1;
+        newfile.path = g_strdup(keypath);
+
+        if (VIR_APPEND_ELEMENT(group->statFiles, group->nstatFiles, newfile) < 0) {
+            virCgroupStatFileClose(&newfile);
+            VIR_FREE(newfile.path);
+            goto cleanup;
+        }
+
+        i = group->nstatFiles - 1;
+        file = &group->statFiles[i];
+    }
+
+    if (file->missing) {
+        if (optional) {
+            ret = -2;
+        } else {
+            virReportSystemError(ENOENT,
+                                 _("Unable to read from '%s'"), keypath);
+        }
+        goto cleanup;
+    }
+
+    if (file->snapshot) {
+        *value = g_strdup(file->snapshot);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if ((len = virCgroupPreadAll(file->fd, value)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read from '%s'"), keypath);
+
+        /* The cgroup may have been removed meanwhile, open it again
+         * next time */
+        virCgroupStatFileRemove(group, i);
+        goto cleanup;
+    }
+
+ done:
+
+    /* Terminated with '\n' has sometimes harmful effects to the caller */
+    if (len > 0 && (*value)[len - 1] == '\n')
+        (*value)[len - 1] = '\0';
+
+    if (file && group->statSnapshots > 0)
+        file->snapshot = g_strdup(*value);
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&group->statLock);
+    return ret;
+}
+
+
+/**
+ * virCgroupGetStatValueStr:
+ *
+ * Same as virCgroupGetValueStr, but meant for statistics files which are
+ * read over and over again. The file is opened on the first call only and
+ * kept open in @group; subsequent calls just re-read it from the beginning.
+ * Once too many files are kept open, see virCgroupStatFilesReserve, new
+ * files are opened and closed on every call.
+ *
+ * Within a snapshot, see virCgroupBeginStatSnapshot, the file is read only
+ * once and later calls get the same content.
+ */
+int
+virCgroupGetStatValueStr(virCgroupPtr group,
+                         int controller,
+                         const char *key,
+                         char **value)
+{
+    return virCgroupGetStatValueStrInternal(group, controller, key,
+                                            false, value);
+}
+
+
+/**
+ * virCgroupGetOptionalStatValueStr:
+ *
+ * Same as virCgroupGetStatValueStr, but for files which may not exist at
+ * all, e.g. because the kernel was built without the feature they report.
+ * A missing file is remembered in @group so that later calls don't look
+ * for it again.
+ *
+ * Returns 0 on success, -2 if the file does not exist (without reporting
+ * an error), -1 on other errors.
+ */
+int
+virCgroupGetOptionalStatValueStr(virCgroupPtr group,
+                                 int controller,
+                                 const char *key,
+                                 char **value)
+{
+    return virCgroupGetStatValueStrInternal(group, controller, key,
+                                            true, value);
+}
+
+
 int
 virCgroupGetValueForBlkDev(const char *str,
                            const char *path,
@@ -669,6 +956,13 @@ virCgroupNew(pid_t pid,
     if (VIR_ALLOC((*group)) < 0)
         goto error;
 
+    if (virMutexInit(&(*group)->statLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        VIR_FREE(*group);
+        goto error;
+    }
+
     if (path[0] == '/' || !parent) {
         (*group)->path = g_strdup(path);
     } else {
@@ -2681,6 +2975,71 @@ virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
 }
 
 
+/**
+ * virCgroupGetCpuThrottling:
+ *
+ * @group: The cgroup to query
+ * @periods: filled with the number of elapsed enforcement periods
+ * @throttled: filled with the number of periods the group was throttled
+ * @throttledTime: filled with the total time spent throttled in nanoseconds
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+virCgroupGetCpuThrottling(virCgroupPtr group,
+                          unsigned long long *periods,
+                          unsigned long long *throttled,
+                          unsigned long long *throttledTime)
+{
+    VIR_CGROUP_BACKEND_CALL(group, VIR_CGROUP_CONTROLLER_CPU,
+                            getCpuThrottling, -1,
+                            periods, throttled, throttledTime);
+}
+
+
+/**
+ * virCgroupGetPressure:
+ *
+ * @group: The cgroup to query
+ * @resource: The resource to get pressure stall information for
+ * @stats: filled with the pressure stall information
+ *
+ * Only supported if the controller of @resource is managed by cgroup v2
+ * and the kernel provides pressure stall information.
+ *
+ * Returns: 0 on success, -2 if pressure stall information of @resource is
+ * not available (no error is reported in that case), -1 on error
+ */
+int
+virCgroupGetPressure(virCgroupPtr group,
+                     virPSIResource resource,
+                     virPSIStatsPtr stats)
+{
+    virCgroupBackendPtr backend;
+    int controller = VIR_CGROUP_CONTROLLER_CPU;
+
+    switch (resource) {
+    case VIR_PSI_RESOURCE_CPU:
+        controller = VIR_CGROUP_CONTROLLER_CPU;
+        break;
+    case VIR_PSI_RESOURCE_MEMORY:
+        controller = VIR_CGROUP_CONTROLLER_MEMORY;
+        break;
+    case VIR_PSI_RESOURCE_IO:
+        controller = VIR_CGROUP_CONTROLLER_BLKIO;
+        break;
+    case VIR_PSI_RESOURCE_LAST:
+        break;
+    }
+
+    backend = virCgroupBackendForController(group, controller);
+    if (!backend || !backend->getPressure)
+        return -2;
+
+    return backend->getPressure(group, resource, stats);
+}
+
+
 int
 virCgroupSetFreezerState(virCgroupPtr group, const char *state)
 {
@@ -3441,6 +3800,29 @@ virCgroupGetCpuacctStat(virCgroupPtr group G_GNUC_UNUSED,
 }
 
 
+int
+virCgroupGetCpuThrottling(virCgroupPtr group G_GNUC_UNUSED,
+                          unsigned long long *periods G_GNUC_UNUSED,
+                          unsigned long long *throttled G_GNUC_UNUSED,
+                          unsigned long long *throttledTime G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
+int
+virCgroupGetPressure(virCgroupPtr group G_GNUC_UNUSED,
+                     virPSIResource resource G_GNUC_UNUSED,
+                     virPSIStatsPtr stats G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
 int
 virCgroupGetDomainTotalCpuStats(virCgroupPtr group G_GNUC_UNUSED,
                                 virTypedParameterPtr params G_GNUC_UNUSED,
@@ -3555,11 +3937,67 @@ virCgroupFree(virCgroupPtr *group)
     VIR_FREE((*group)->unified.mountPoint);
     VIR_FREE((*group)->unified.placement);
 
+    for (i = 0; i < (*group)->nstatFiles; i++) {
+        virCgroupStatFileClose(&(*group)->statFiles[i]);
+        VIR_FREE((*group)->statFiles[i].path);
+        VIR_FREE((*group)->statFiles[i].snapshot);
+    }
+    VIR_FREE((*group)->statFiles);
+    virMutexDestroy(&(*group)->statLock);
+
     VIR_FREE((*group)->path);
     VIR_FREE(*group);
 }
 
 
+/**
+ * virCgroupBeginStatSnapshot:
+ * @group: the cgroup, may be NULL
+ *
+ * Starts a sampling pass over the statistics of @group. Until the matching
+ * virCgroupEndStatSnapshot, every statistics file is read only once and
+ * all callbacks parsing it see the same content; e.g. the CPU usage and
+ * the user/system times of cgroup v2 both come from cpu.stat. Snapshots
+ * may nest, the content is dropped when the last one ends.
+ */
+void
+virCgroupBeginStatSnapshot(virCgroupPtr group)
+{
+    if (!group)
+        return;
+
+    virMutexLock(&group->statLock);
+    group->statSnapshots++;
+    virMutexUnlock(&group->statLock);
+}
+
+
+/**
+ * virCgroupEndStatSnapshot:
+ * @group: the cgroup, may be NULL
+ *
+ * Ends a sampling pass started by virCgroupBeginStatSnapshot.
+ */
+void
+virCgroupEndStatSnapshot(virCgroupPtr group)
+{
+    size_t i;
+
+    if (!group)
+        return;
+
+    virMutexLock(&group->statLock);
+
+    if (group->statSnapshots > 0 &&
+        --group->statSnapshots == 0) {
+        for (i = 0; i < group->nstatFiles; i++)
+            VIR_FREE(group->statFiles[i].snapshot);
+    }
+
+    virMutexUnlock(&group->statLock);
+}
+
+
 int
 virCgroupDelThread(virCgroupPtr cgroup,
                    virCgroupThreadName nameval,
@@ -23,6 +23,7 @@
 
 #include "virbitmap.h"
 #include "virenum.h"
+#include "virpsi.h"
 
 struct _virCgroup;
 typedef struct _virCgroup virCgroup;
@@ -109,6 +110,9 @@ bool virCgroupNewIgnoreError(void);
 
 void virCgroupFree(virCgroupPtr *group);
 
+void virCgroupBeginStatSnapshot(virCgroupPtr group);
+void virCgroupEndStatSnapshot(virCgroupPtr group);
+
 bool virCgroupHasController(virCgroupPtr cgroup, int controller);
 int virCgroupPathOfController(virCgroupPtr group,
                               unsigned int controller,
@@ -238,6 +242,14 @@ int virCgroupGetCpuacctUsage(virCgroupPtr group, unsigned long long *usage);
 int virCgroupGetCpuacctPercpuUsage(virCgroupPtr group, char **usage);
 int virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
                             unsigned long long *sys);
+int virCgroupGetCpuThrottling(virCgroupPtr group,
+                              unsigned long long *periods,
+                              unsigned long long *throttled,
+                              unsigned long long *throttledTime);
+
+int virCgroupGetPressure(virCgroupPtr group,
+                         virPSIResource resource,
+                         virPSIStatsPtr stats);
 
 int virCgroupSetFreezerState(virCgroupPtr group, const char *state);
 int virCgroupGetFreezerState(virCgroupPtr group, char **state);
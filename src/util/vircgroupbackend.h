@@ -328,6 +328,17 @@ typedef int
                              unsigned long long *user,
                              unsigned long long *sys);
 
+typedef int
+(*virCgroupGetCpuThrottlingCB)(virCgroupPtr group,
+                               unsigned long long *periods,
+                               unsigned long long *throttled,
+                               unsigned long long *throttledTime);
+
+typedef int
+(*virCgroupGetPressureCB)(virCgroupPtr group,
+                          virPSIResource resource,
+                          virPSIStatsPtr stats);
+
 typedef int
 (*virCgroupSetFreezerStateCB)(virCgroupPtr group,
                               const char *state);
@@ -427,6 +438,9 @@ struct _virCgroupBackend {
     virCgroupGetCpuacctUsageCB getCpuacctUsage;
     virCgroupGetCpuacctPercpuUsageCB getCpuacctPercpuUsage;
     virCgroupGetCpuacctStatCB getCpuacctStat;
+    virCgroupGetCpuThrottlingCB getCpuThrottling;
+
+    virCgroupGetPressureCB getPressure;
 
     virCgroupSetFreezerStateCB setFreezerState;
     virCgroupGetFreezerStateCB getFreezerState;
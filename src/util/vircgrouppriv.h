@@ -27,6 +27,7 @@
 
 #include "vircgroup.h"
 #include "vircgroupbackend.h"
+#include "virthread.h"
 
 struct _virCgroupV1Controller {
     int type;
@@ -59,6 +60,15 @@ struct _virCgroupV2Controller {
 typedef struct _virCgroupV2Controller virCgroupV2Controller;
 typedef virCgroupV2Controller *virCgroupV2ControllerPtr;
 
+struct _virCgroupStatFile {
+    char *path;
+    int fd; /* -1 if the file does not exist */
+    bool missing; /* the file does not exist */
+    char *snapshot; /* content read during the current snapshot */
+};
+typedef struct _virCgroupStatFile virCgroupStatFile;
+typedef virCgroupStatFile *virCgroupStatFilePtr;
+
 struct _virCgroup {
     char *path;
 
@@ -66,6 +76,12 @@ struct _virCgroup {
 
     virCgroupV1Controller legacy[VIR_CGROUP_CONTROLLER_LAST];
     virCgroupV2Controller unified;
+
+    /* statistics files kept open by virCgroupGetStatValueStr */
+    virMutex statLock;
+    virCgroupStatFilePtr statFiles;
+    size_t nstatFiles;
+    size_t statSnapshots; /* number of callers sharing a snapshot */
 };
 
 int virCgroupSetValueRaw(const char *path,
@@ -84,6 +100,16 @@ int virCgroupGetValueStr(virCgroupPtr group,
                          const char *key,
                          char **value);
 
+int virCgroupGetStatValueStr(virCgroupPtr group,
+                             int controller,
+                             const char *key,
+                             char **value);
+
+int virCgroupGetOptionalStatValueStr(virCgroupPtr group,
+                                     int controller,
+                                     const char *key,
+                                     char **value);
+
 int virCgroupSetValueU64(virCgroupPtr group,
                          int controller,
                          const char *key,
@@ -133,6 +159,8 @@ int virCgroupNewDomainPartition(virCgroupPtr partition,
 
 int virCgroupRemoveRecursively(char *grppath);
 
+void virCgroupSetStatFilesMax(size_t max);
+
 
 int virCgroupKillRecursiveInternal(virCgroupPtr group,
                                    int signum,
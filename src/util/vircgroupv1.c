@@ -1033,14 +1033,14 @@ virCgroupV1GetBlkioIoServiced(virCgroupPtr group,
     *requests_read = 0;
     *requests_write = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_service_bytes", &str1) < 0)
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "blkio.throttle.io_service_bytes", &str1) < 0)
         return -1;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_serviced", &str2) < 0)
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "blkio.throttle.io_serviced", &str2) < 0)
         return -1;
 
     /* sum up all entries of the same kind, from all devices */
@@ -1123,14 +1123,14 @@ virCgroupV1GetBlkioIoDeviceServiced(virCgroupPtr group,
         requests_write
     };
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_service_bytes", &str1) < 0)
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "blkio.throttle.io_service_bytes", &str1) < 0)
         return -1;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_serviced", &str2) < 0)
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "blkio.throttle.io_serviced", &str2) < 0)
         return -1;
 
     if (!(str3 = virCgroupGetBlockDevString(path)))
@@ -1546,10 +1546,10 @@ virCgroupV1GetMemoryStat(virCgroupPtr group,
     unsigned long long inactiveFileVal = 0;
     unsigned long long unevictableVal = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_MEMORY,
-                             "memory.stat",
-                             &stat) < 0) {
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_MEMORY,
+                                 "memory.stat",
+                                 &stat) < 0) {
         return -1;
     }
 
@@ -1948,9 +1948,19 @@ static int
 virCgroupV1GetCpuacctUsage(virCgroupPtr group,
                            unsigned long long *usage)
 {
-    return virCgroupGetValueU64(group,
-                                VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage", usage);
+    g_autofree char *str = NULL;
+
+    if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                 "cpuacct.usage", &str) < 0)
+        return -1;
+
+    if (virStrToLong_ull(str, NULL, 10, usage) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to parse '%s' as an integer"), str);
+        return -1;
+    }
+
+    return 0;
 }
 
 
@@ -1958,8 +1968,8 @@ static int
 virCgroupV1GetCpuacctPercpuUsage(virCgroupPtr group,
                                  char **usage)
 {
-    return virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage_percpu", usage);
+    return virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                    "cpuacct.usage_percpu", usage);
 }
 
 
@@ -1972,8 +1982,8 @@ virCgroupV1GetCpuacctStat(virCgroupPtr group,
     char *p;
     static double scale = -1.0;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpuacct.stat", &str) < 0)
+    if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                 "cpuacct.stat", &str) < 0)
         return -1;
 
     if (!(p = STRSKIP(str, "user ")) ||
@@ -2009,6 +2019,34 @@ virCgroupV1GetCpuacctStat(virCgroupPtr group,
 }
 
 
+static int
+virCgroupV1GetCpuThrottling(virCgroupPtr group,
+                            unsigned long long *periods,
+                            unsigned long long *throttled,
+                            unsigned long long *throttledTime)
+{
+    g_autofree char *str = NULL;
+    char *p;
+
+    if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPU,
+                                 "cpu.stat", &str) < 0)
+        return -1;
+
+    if (!(p = STRSKIP(str, "nr_periods ")) ||
+        virStrToLong_ull(p, &p, 10, periods) < 0 ||
+        !(p = STRSKIP(p, "\nnr_throttled ")) ||
+        virStrToLong_ull(p, &p, 10, throttled) < 0 ||
+        !(p = STRSKIP(p, "\nthrottled_time ")) ||
+        virStrToLong_ull(p, NULL, 10, throttledTime) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Cannot parse cpu throttling stat '%s'"), str);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virCgroupV1SetFreezerState(virCgroupPtr group,
                            const char *state)
@@ -2163,6 +2201,7 @@ virCgroupBackend virCgroupV1Backend = {
     .getCpuacctUsage = virCgroupV1GetCpuacctUsage,
     .getCpuacctPercpuUsage = virCgroupV1GetCpuacctPercpuUsage,
     .getCpuacctStat = virCgroupV1GetCpuacctStat,
+    .getCpuThrottling = virCgroupV1GetCpuThrottling,
 
     .setFreezerState = virCgroupV1SetFreezerState,
     .getFreezerState = virCgroupV1GetFreezerState,
@@ -712,9 +712,9 @@ virCgroupV2GetBlkioIoServiced(virCgroupPtr group,
     *requests_read = 0;
     *requests_write = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "io.stat", &str1) < 0) {
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "io.stat", &str1) < 0) {
         return -1;
     }
 
@@ -772,9 +772,9 @@ virCgroupV2GetBlkioIoDeviceServiced(virCgroupPtr group,
         requests_write
     };
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "io.stat", &str1) < 0) {
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "io.stat", &str1) < 0) {
         return -1;
     }
 
@@ -1199,10 +1199,10 @@ virCgroupV2GetMemoryStat(virCgroupPtr group,
     unsigned long long inactiveFileVal = 0;
     unsigned long long unevictableVal = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_MEMORY,
-                             "memory.stat",
-                             &stat) < 0) {
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_MEMORY,
+                                 "memory.stat",
+                                 &stat) < 0) {
         return -1;
     }
 
@@ -1609,8 +1609,8 @@ virCgroupV2GetCpuacctUsage(virCgroupPtr group,
     g_autofree char *str = NULL;
     char *tmp;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpu.stat", &str) < 0) {
+    if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                 "cpu.stat", &str) < 0) {
         return -1;
     }
 
@@ -1643,8 +1643,8 @@ virCgroupV2GetCpuacctStat(virCgroupPtr group,
     unsigned long long userVal = 0;
     unsigned long long sysVal = 0;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpu.stat", &str) < 0) {
+    if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                 "cpu.stat", &str) < 0) {
         return -1;
     }
 
@@ -1681,6 +1681,74 @@ virCgroupV2GetCpuacctStat(virCgroupPtr group,
 }
 
 
+static int
+virCgroupV2GetCpuThrottling(virCgroupPtr group,
+                            unsigned long long *periods,
+                            unsigned long long *throttled,
+                            unsigned long long *throttledTime)
+{
+    g_autofree char *str = NULL;
+    const char *keys[] = { "nr_periods ", "nr_throttled ", "throttled_usec " };
+    unsigned long long *values[] = { periods, throttled, throttledTime };
+    size_t i;
+
+    /* The throttling counters are only present in cpu.stat when the cpu
+     * controller is enabled for the group. */
+    if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPU,
+                                 "cpu.stat", &str) < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(keys); i++) {
+        char *tmp;
+
+        if (!(tmp = strstr(str, keys[i]))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("cannot parse cpu throttling stat '%s'"), str);
+            return -1;
+        }
+        tmp += strlen(keys[i]);
+
+        if (virStrToLong_ull(tmp, &tmp, 10, values[i]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to parse value '%s' as number."), tmp);
+            return -1;
+        }
+    }
+
+    *throttledTime *= 1000;
+
+    return 0;
+}
+
+
+static int
+virCgroupV2GetPressure(virCgroupPtr group,
+                       virPSIResource resource,
+                       virPSIStatsPtr stats)
+{
+    g_autofree char *key = NULL;
+    g_autofree char *str = NULL;
+    int controller = VIR_CGROUP_CONTROLLER_CPU;
+    int rc;
+
+    if (resource == VIR_PSI_RESOURCE_MEMORY)
+        controller = VIR_CGROUP_CONTROLLER_MEMORY;
+    else if (resource == VIR_PSI_RESOURCE_IO)
+        controller = VIR_CGROUP_CONTROLLER_BLKIO;
+
+    key = g_strdup_printf("%s.pressure", virPSIResourceTypeToString(resource));
+
+    /* the kernel was built without CONFIG_PSI or booted with psi=0; this
+     * is remembered so the file isn't looked up again on every sample */
+    if ((rc = virCgroupGetOptionalStatValueStr(group, controller,
+                                               key, &str)) < 0)
+        return rc;
+
+    return virPSIParse(str, stats);
+}
+
+
 static int
 virCgroupV2SetCpusetMems(virCgroupPtr group,
                          const char *mems)
@@ -1902,6 +1970,9 @@ virCgroupBackend virCgroupV2Backend = {
 
     .getCpuacctUsage = virCgroupV2GetCpuacctUsage,
     .getCpuacctStat = virCgroupV2GetCpuacctStat,
+    .getCpuThrottling = virCgroupV2GetCpuThrottling,
+
+    .getPressure = virCgroupV2GetPressure,
 
     .setCpusetMems = virCgroupV2SetCpusetMems,
     .getCpusetMems = virCgroupV2GetCpusetMems,
@@ -32,6 +32,9 @@
 #endif
 #include <fcntl.h>
 #include <unistd.h>
+#if HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+# include <spawn.h>
+#endif
 
 #if WITH_CAPNG
 # include <cap-ng.h>
@@ -548,6 +551,74 @@ virCommandMassClose(virCommandPtr cmd,
 
 # else /* ! __FreeBSD__ */
 
+static int
+virCommandCompareFD(const void *a,
+                    const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+
+/* Closes all FDs except those we need with virCloseRange. This doesn't
+ * depend on procfs and avoids a close() call for every single FD the
+ * daemon has open.
+ *
+ * Returns 0 on success, 1 if closing ranges of FDs is not supported,
+ * -1 on error.
+ */
+static int
+virCommandMassCloseRange(virCommandPtr cmd,
+                         int childin,
+                         int childout,
+                         int childerr)
+{
+    g_autofree int *keep = NULL;
+    size_t nkeep = 0;
+    int first = STDERR_FILENO + 1;
+    size_t i;
+
+    keep = g_new0(int, cmd->npassfd + 3);
+    keep[nkeep++] = childin;
+    keep[nkeep++] = childout;
+    keep[nkeep++] = childerr;
+    for (i = 0; i < cmd->npassfd; i++)
+        keep[nkeep++] = cmd->passfd[i].fd;
+
+    qsort(keep, nkeep, sizeof(*keep), virCommandCompareFD);
+
+    for (i = 0; i < nkeep; i++) {
+        int fd = keep[i];
+
+        if (fd < 0 || fd < first)
+            continue;
+
+        if (fd > first && virCloseRange(first, fd - 1) < 0)
+            goto error;
+
+        if (fd != childin && fd != childout && fd != childerr &&
+            virSetInherit(fd, true) < 0) {
+            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
+            return -1;
+        }
+
+        first = fd + 1;
+    }
+
+    if (virCloseRange(first, ~0U) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    /* nothing was closed if the range can't be closed at all */
+    if (errno == ENOSYS)
+        return 1;
+
+    virReportSystemError(errno, "%s", _("failed to close file descriptors"));
+    return -1;
+}
+
+
 static int
 virCommandMassClose(virCommandPtr cmd,
                     int childin,
@@ -557,6 +628,10 @@ virCommandMassClose(virCommandPtr cmd,
     g_autoptr(virBitmap) fds = NULL;
     int openmax = sysconf(_SC_OPEN_MAX);
     int fd = -1;
+    int rc;
+
+    if ((rc = virCommandMassCloseRange(cmd, childin, childout, childerr)) <= 0)
+        return rc;
 
     /* In general, it is not safe to call malloc() between fork() and exec()
      * because the child might have forked at the worst possible time, i.e.
@@ -600,6 +675,142 @@ virCommandMassClose(virCommandPtr cmd,
 
 # endif /* ! __FreeBSD__ */
 
+# if HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+/* Some UNIX lack it in headers & it doesn't hurt to redeclare */
+extern char **environ;
+
+/*
+ * Whether @cmd can be started without running any of our code in the
+ * child process, i.e. everything virExec does between fork() and exec()
+ * can be expressed as posix_spawn() file actions and attributes.
+ */
+static bool
+virExecCanSpawn(virCommandPtr cmd)
+{
+    if (cmd->hook || cmd->handshake || cmd->pidfile ||
+        cmd->flags & (VIR_EXEC_DAEMON | VIR_EXEC_CLEAR_CAPS))
+        return false;
+
+    if (cmd->uid != (uid_t)-1 || cmd->gid != (gid_t)-1 ||
+        cmd->capabilities)
+        return false;
+
+    if (cmd->maxMemLock || cmd->maxProcesses || cmd->maxFiles ||
+        cmd->setMaxCore || cmd->mask || cmd->pwd)
+        return false;
+
+#  if defined(WITH_SECDRIVER_SELINUX)
+    if (cmd->seLinuxLabel)
+        return false;
+#  endif
+#  if defined(WITH_SECDRIVER_APPARMOR)
+    if (cmd->appArmorProfile)
+        return false;
+#  endif
+
+    /* passed FDs keep their numbers, closefrom can't preserve them */
+    return cmd->npassfd == 0;
+}
+
+
+static int
+virExecSpawnStdFd(posix_spawn_file_actions_t *actions,
+                  int fd,
+                  int std)
+{
+    /* dup2 of an FD onto itself clears FD_CLOEXEC only since
+     * POSIX.1-2024, do it explicitly */
+    if (fd == std)
+        return virSetInherit(fd, true) < 0 ? errno : 0;
+
+    return posix_spawn_file_actions_adddup2(actions, fd, std);
+}
+
+
+/*
+ * virExecSpawn:
+ *
+ * Starts @cmd using posix_spawn() which doesn't have to copy the page
+ * tables of the daemon unlike fork(). The signal handling and FD setup
+ * are equal to virFork() and the child part of virExec().
+ *
+ * Returns the PID of the child, or -1 if the child could not be
+ * started, in which case the caller falls back to virFork() which takes
+ * care of reporting the error. No error is reported here.
+ */
+static pid_t
+virExecSpawn(virCommandPtr cmd,
+             const char *binary,
+             int childin,
+             int childout,
+             int childerr)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigs;
+    pid_t pid = -1;
+    int rc;
+
+    if ((rc = posix_spawn_file_actions_init(&actions)) != 0) {
+        VIR_DEBUG("Unable to initialize spawn actions: %s", g_strerror(rc));
+        return -1;
+    }
+
+    if ((rc = posix_spawnattr_init(&attr)) != 0) {
+        VIR_DEBUG("Unable to initialize spawn attributes: %s", g_strerror(rc));
+        posix_spawn_file_actions_destroy(&actions);
+        return -1;
+    }
+
+    sigfillset(&sigs);
+    if ((rc = posix_spawnattr_setsigdefault(&attr, &sigs)) != 0)
+        goto cleanup;
+
+    sigemptyset(&sigs);
+    if ((rc = posix_spawnattr_setsigmask(&attr, &sigs)) != 0 ||
+        (rc = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF |
+                                       POSIX_SPAWN_SETSIGMASK)) != 0)
+        goto cleanup;
+
+    if ((rc = virExecSpawnStdFd(&actions, childin, STDIN_FILENO)) != 0 ||
+        (rc = virExecSpawnStdFd(&actions, childout, STDOUT_FILENO)) != 0 ||
+        (rc = virExecSpawnStdFd(&actions, childerr, STDERR_FILENO)) != 0 ||
+        (rc = posix_spawn_file_actions_addclosefrom_np(&actions,
+                                                       STDERR_FILENO + 1)) != 0)
+        goto cleanup;
+
+    if ((rc = posix_spawn(&pid, binary, &actions, &attr, cmd->args,
+                          cmd->env ? cmd->env : environ)) != 0)
+        pid = -1;
+
+ cleanup:
+    if (rc != 0)
+        VIR_DEBUG("Unable to spawn %s: %s", binary, g_strerror(rc));
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return pid;
+}
+
+# else /* !HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
+static bool
+virExecCanSpawn(virCommandPtr cmd G_GNUC_UNUSED)
+{
+    return false;
+}
+
+
+static pid_t
+virExecSpawn(virCommandPtr cmd G_GNUC_UNUSED,
+             const char *binary G_GNUC_UNUSED,
+             int childin G_GNUC_UNUSED,
+             int childout G_GNUC_UNUSED,
+             int childerr G_GNUC_UNUSED)
+{
+    return -1;
+}
+# endif /* !HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
 /*
  * virExec:
  * @cmd virCommandPtr containing all information about the program to
@@ -620,7 +831,7 @@ virExec(virCommandPtr cmd)
     const char *binary = NULL;
     int ret;
     g_autofree gid_t *groups = NULL;
-    int ngroups;
+    int ngroups = 0;
 
     if (cmd->args[0][0] != '/') {
         if (!(binary = binarystr = virFindFileInPath(cmd->args[0]))) {
@@ -685,10 +896,19 @@ virExec(virCommandPtr cmd)
         childerr = null;
     }
 
-    if ((ngroups = virGetGroupList(cmd->uid, cmd->gid, &groups)) < 0)
-        goto cleanup;
+    /* Avoid fork() of the whole daemon if there's nothing to do in the
+     * child. If spawning fails, e.g. because the binary can't be
+     * executed, fork() is used to get the usual error handling. */
+    pid = -1;
+    if (virExecCanSpawn(cmd))
+        pid = virExecSpawn(cmd, binary, childin, childout, childerr);
+
+    if (pid < 0) {
+        if ((ngroups = virGetGroupList(cmd->uid, cmd->gid, &groups)) < 0)
+            goto cleanup;
 
-    pid = virFork();
+        pid = virFork();
+    }
 
     if (pid < 0)
         goto cleanup;
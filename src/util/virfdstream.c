@@ -27,6 +27,7 @@
 #include <unistd.h>
 #ifndef WIN32
 # include <termios.h>
+# include <signal.h>
 #endif
 
 #include "virfdstream.h"
@@ -46,6 +47,10 @@
 
 VIR_LOG_INIT("fdstream");
 
+/* Preferred pipe buffer size for streams using splice(). 1MiB is
+ * the default limit for unprivileged processes on Linux. */
+#define VIR_FDSTREAM_PIPE_SIZE (1024 * 1024)
+
 #ifndef WIN32
 typedef enum {
     VIR_FDSTREAM_MSG_TYPE_DATA,
@@ -108,6 +113,8 @@ struct virFDStreamData {
     bool threadQuit;
     bool threadAbort;
     bool threadDoRead;
+    bool threadSplice; /* data flows through @fd itself, see
+                          virFDStreamSpliceThread() */
     virFDStreamMsgPtr msg;
 };
 
@@ -396,6 +403,7 @@ struct _virFDStreamThreadData {
     size_t length;
     bool doRead;
     bool sparse;
+    bool splice;
     int fdin;
     char *fdinname;
     int fdout;
@@ -648,6 +656,108 @@ virFDStreamThread(void *opaque)
 }
 
 
+#if HAVE_SPLICE
+/*
+ * For non-sparse streams there is no need to pass messages between
+ * the worker and the stream. Instead, the pipe between them carries
+ * the data itself and the worker moves it between the pipe and the
+ * file using splice(), so that it never has to be copied into and
+ * out of userspace buffers. The worker quits once it reaches EOF on
+ * its input, the stream closes its end of the pipe or the stream is
+ * aborted.
+ */
+static void
+virFDStreamSpliceThread(void *opaque)
+{
+    virFDStreamThreadDataPtr data = opaque;
+    virStreamPtr st = data->st;
+    virFDStreamDataPtr fdst = st->privateData;
+    size_t length = data->length;
+    size_t buflen = 256 * 1024;
+    size_t total = 0;
+    g_autofree char *buf = NULL;
+    sigset_t sigs;
+
+    virObjectRef(fdst);
+
+    /* Writing into a pipe closed by the stream must not kill the
+     * whole process. */
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGPIPE);
+    ignore_value(pthread_sigmask(SIG_BLOCK, &sigs, NULL));
+
+    while (!length || total < length) {
+        size_t want = buflen;
+        ssize_t got;
+        bool aborted;
+
+        virObjectLock(fdst);
+        aborted = fdst->threadAbort;
+        virObjectUnlock(fdst);
+
+        /* Whatever is left in the pipe must not reach the file. */
+        if (aborted)
+            break;
+
+        if (length && want > length - total)
+            want = length - total;
+
+        if (!buf) {
+            got = splice(data->fdin, NULL, data->fdout, NULL,
+                         want, SPLICE_F_MOVE);
+
+            if (got < 0 && total == 0 &&
+                (errno == EINVAL || errno == ENOSYS)) {
+                /* Not every file system supports splice(), fall back
+                 * to copying through a buffer. */
+                buf = g_new0(char, buflen);
+                continue;
+            }
+        } else {
+            got = saferead(data->fdin, buf, want);
+            if (got > 0 && safewrite(data->fdout, buf, got) < 0)
+                got = -1;
+        }
+
+        if (got < 0) {
+            int err = errno;
+
+            if (err == EINTR)
+                continue;
+
+            virObjectLock(fdst);
+            /* The stream closed the pipe, nothing to report. */
+            if (!fdst->threadAbort &&
+                (err != EPIPE || !fdst->threadQuit)) {
+                virReportSystemError(err,
+                                     _("Unable to transfer data between %s and %s"),
+                                     data->fdinname, data->fdoutname);
+                fdst->threadErr = virSaveLastError();
+            }
+            virObjectUnlock(fdst);
+            break;
+        }
+
+        if (got == 0)
+            break;
+
+        total += got;
+    }
+
+    virObjectLock(fdst);
+    fdst->threadQuit = true;
+    virObjectUnlock(fdst);
+    virFDStreamDataDisposed = false;
+    virObjectUnref(fdst);
+    if (virFDStreamDataDisposed)
+        st->privateData = NULL;
+    VIR_FORCE_CLOSE(data->fdin);
+    VIR_FORCE_CLOSE(data->fdout);
+    virFDStreamThreadDataFree(data);
+}
+#endif /* HAVE_SPLICE */
+
+
 static int
 virFDStreamJoinWorker(virFDStreamDataPtr fdst,
                       bool streamAbort)
@@ -660,6 +770,11 @@ virFDStreamJoinWorker(virFDStreamDataPtr fdst,
     fdst->threadQuit = true;
     virCondSignal(&fdst->threadCond);
 
+    /* The splice worker sleeps in I/O on the pipe rather than on the
+     * condition. Closing our end of the pipe is what wakes it up. */
+    if (fdst->threadSplice)
+        VIR_FORCE_CLOSE(fdst->fd);
+
     /* Give the thread a chance to lock the FD stream object. */
     virObjectUnlock(fdst);
     virThreadJoin(fdst->thread);
@@ -793,7 +908,7 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadSplice) {
         char *buf;
 
         if (fdst->threadQuit || fdst->threadErr) {
@@ -829,6 +944,9 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
                 ret = -2;
             } else if (errno == EINTR) {
                 goto retry;
+            } else if (fdst->threadErr) {
+                ret = -1;
+                virSetError(fdst->threadErr);
             } else {
                 ret = -1;
                 virReportSystemError(errno, "%s",
@@ -876,7 +994,7 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadSplice) {
         virFDStreamMsgPtr msg = NULL;
 
         while (!(msg = fdst->msg)) {
@@ -947,6 +1065,13 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             }
             goto cleanup;
         }
+
+        /* EOF on the pipe might be the splice worker giving up. */
+        if (ret == 0 && fdst->threadErr) {
+            ret = -1;
+            virSetError(fdst->threadErr);
+            goto cleanup;
+        }
     }
 
     if (fdst->length)
@@ -1126,6 +1251,7 @@ static int virFDStreamOpenInternal(virStreamPtr st,
 
     if (threadData) {
         fdst->threadDoRead = threadData->doRead;
+        fdst->threadSplice = threadData->splice;
 
         /* Create the thread after fdst and st were initialized.
          * The thread worker expects them to be that way. */
@@ -1140,6 +1266,10 @@ static int virFDStreamOpenInternal(virStreamPtr st,
 
         if (virThreadCreateFull(fdst->thread,
                                 true,
+#if HAVE_SPLICE
+                                threadData->splice ?
+                                virFDStreamSpliceThread :
+#endif /* HAVE_SPLICE */
                                 virFDStreamThread,
                                 "fd-stream",
                                 false,
@@ -1289,6 +1419,19 @@ virFDStreamOpenFileInternal(virStreamPtr st,
         threadData->st = virObjectRef(st);
         threadData->length = length;
         threadData->sparse = sparse;
+#if HAVE_SPLICE
+        /* Holes have to be passed around as messages, but plain
+         * data can be moved without copying it. */
+        threadData->splice = !sparse;
+# ifdef F_SETPIPE_SZ
+        /* Let the pipe hold as much as a stream packet can carry, so
+         * that a single read produces a full sized packet. This is
+         * best effort as the size might be capped by the system. */
+        if (threadData->splice)
+            ignore_value(fcntl(pipefds[0], F_SETPIPE_SZ,
+                               VIR_FDSTREAM_PIPE_SIZE));
+# endif /* F_SETPIPE_SZ */
+#endif /* HAVE_SPLICE */
 
         if ((oflags & O_ACCMODE) == O_RDONLY) {
             threadData->fdin = fd;
@@ -161,6 +161,33 @@ int virFileFclose(FILE **file, bool preserve_errno)
 }
 
 
+/**
+ * virCloseRange:
+ * @first: first FD to close
+ * @last: last FD to close
+ *
+ * Closes all open FDs between @first and @last (both included) in a
+ * single system call. This is async-signal-safe and thus can be used
+ * between fork() and exec().
+ *
+ * Returns 0 on success, -1 with errno set otherwise. If closing ranges
+ * of FDs is not supported by the kernel or C library, errno is ENOSYS.
+ */
+int
+virCloseRange(unsigned int first,
+              unsigned int last)
+{
+#if HAVE_CLOSE_RANGE
+    return close_range(first, last, 0);
+#elif defined(__linux__) && defined(__NR_close_range)
+    return syscall(__NR_close_range, first, last, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
 FILE *virFileFdopen(int *fdptr, const char *mode)
 {
     FILE *file = NULL;
@@ -2856,6 +2883,49 @@ virFileRemove(const char *path,
 }
 #endif /* WIN32 */
 
+
+/**
+ * virFileUnlinkBatch:
+ * @pid: unused
+ * @data: NUL terminated paths, one after another
+ * @len: length of @data
+ *
+ * Removes each path in @data, paths which don't exist are skipped.
+ * Meant to be run in the namespace of a process through
+ * virProcessRunInMountNamespaceBatch().
+ *
+ * Returns 0 on success, -1 with error reported otherwise.
+ */
+int
+virFileUnlinkBatch(pid_t pid G_GNUC_UNUSED,
+                   const char *data,
+                   size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        const char *path = data + pos;
+        const char *end = memchr(path, '\0', len - pos);
+
+        if (!end) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("path to unlink is not terminated"));
+            return -1;
+        }
+
+        VIR_DEBUG("Unlinking %s", path);
+        if (unlink(path) < 0 && errno != ENOENT) {
+            virReportSystemError(errno,
+                                 _("Unable to remove %s"), path);
+            return -1;
+        }
+
+        pos += end - path + 1;
+    }
+
+    return 0;
+}
+
 static int
 virDirOpenInternal(DIR **dirp, const char *name, bool ignoreENOENT, bool quiet)
 {
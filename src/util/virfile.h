@@ -50,6 +50,8 @@ int virFileClose(int *fdptr, virFileCloseFlags flags)
 int virFileFclose(FILE **file, bool preserve_errno) G_GNUC_WARN_UNUSED_RESULT;
 FILE *virFileFdopen(int *fdptr, const char *mode) G_GNUC_WARN_UNUSED_RESULT;
 
+int virCloseRange(unsigned int first, unsigned int last);
+
 static inline void virForceCloseHelper(int *fd)
 {
     ignore_value(virFileClose(fd, VIR_FILE_CLOSE_PRESERVE_ERRNO));
@@ -246,6 +248,7 @@ int virFileOpenAs(const char *path, int openflags, mode_t mode,
                   unsigned int flags)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
 int virFileRemove(const char *path, uid_t uid, gid_t gid);
+int virFileUnlinkBatch(pid_t pid, const char *data, size_t len);
 
 int virFileChownFiles(const char *name, uid_t uid, gid_t gid)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
@@ -34,6 +34,7 @@
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -49,6 +50,10 @@ struct _virFileCache {
 
     virHashTablePtr table;
 
+    /* names whose data is being created with the cache unlocked */
+    virHashTablePtr pending;
+    virCond pendingCond;
+
     char *dir;
     char *suffix;
 
@@ -78,6 +83,8 @@ virFileCacheDispose(void *obj)
     VIR_FREE(cache->suffix);
 
     virHashFree(cache->table);
+    virHashFree(cache->pending);
+    virCondDestroy(&cache->pendingCond);
 
     virFileCachePrivFree(cache);
 }
@@ -191,6 +198,12 @@ virFileCacheSave(virFileCachePtr cache,
 }
 
 
+/*
+ * Creating new data may take long, e.g. it means running the QEMU
+ * binary for capabilities, so it is done with the cache unlocked and
+ * @name marked as pending. Lookups of other names can proceed
+ * meanwhile, lookups of @name wait for the result.
+ */
 static void *
 virFileCacheNewData(virFileCachePtr cache,
                     const char *name)
@@ -202,13 +215,21 @@ virFileCacheNewData(virFileCachePtr cache,
         return NULL;
 
     if (rv == 0) {
-        if (!(data = cache->handlers.newData(name, cache->priv)))
+        if (virHashAddEntry(cache->pending, name, (void *)1) < 0)
             return NULL;
 
-        if (virFileCacheSave(cache, name, data) < 0) {
+        virObjectUnlock(cache);
+
+        if ((data = cache->handlers.newData(name, cache->priv)) &&
+            virFileCacheSave(cache, name, data) < 0) {
             virObjectUnref(data);
             data = NULL;
         }
+
+        virObjectLock(cache);
+
+        virHashRemoveEntry(cache->pending, name);
+        virCondBroadcast(&cache->pendingCond);
     }
 
     return data;
@@ -242,6 +263,15 @@ virFileCacheNew(const char *dir,
     if (!(cache->table = virHashCreate(10, virObjectFreeHashData)))
         goto cleanup;
 
+    if (!(cache->pending = virHashCreate(10, NULL)))
+        goto cleanup;
+
+    if (virCondInit(&cache->pendingCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        goto cleanup;
+    }
+
     cache->dir = g_strdup(dir);
 
     cache->suffix = g_strdup(suffix);
@@ -303,6 +333,9 @@ virFileCacheLookup(virFileCachePtr cache,
 
     virObjectLock(cache);
 
+    while (virHashLookup(cache->pending, name))
+        ignore_value(virCondWait(&cache->pendingCond, &cache->parent.lock));
+
     data = virHashLookup(cache->table, name);
     virFileCacheValidate(cache, name, &data);
 
@@ -334,6 +367,10 @@ virFileCacheLookupByFunc(virFileCachePtr cache,
 
     virObjectLock(cache);
 
+    /* the data being created might be the one we are looking for */
+    while (virHashSize(cache->pending) > 0)
+        ignore_value(virCondWait(&cache->pendingCond, &cache->parent.lock));
+
     data = virHashSearch(cache->table, iter, iterData, (void **)&name);
     virFileCacheValidate(cache, name, &data);
 
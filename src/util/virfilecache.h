@@ -51,6 +51,9 @@ typedef bool
  * Creates a new data based on the @name.  The returned data must be
  * an instance of virObject.
  *
+ * The cache is not locked while the data is created, so this may be
+ * called concurrently for different names.
+ *
  * Returns data object or NULL on error.
  */
 typedef void *
@@ -48,6 +48,14 @@ VIR_ENUM_IMPL(virFirewallLayerCommand,
               IP6TABLES_PATH,
 );
 
+VIR_ENUM_DECL(virFirewallLayerRestoreCommand);
+VIR_ENUM_IMPL(virFirewallLayerRestoreCommand,
+              VIR_FIREWALL_LAYER_LAST,
+              EBTABLES_PATH "-restore",
+              IPTABLES_PATH "-restore",
+              IP6TABLES_PATH "-restore",
+);
+
 struct _virFirewallRule {
     virFirewallLayer layer;
 
@@ -73,6 +81,17 @@ struct _virFirewallGroup {
     bool addingRollback;
 };
 
+/* Consecutive rules of a single layer collected for one *-restore
+ * invocation */
+typedef struct _virFirewallBatch virFirewallBatch;
+typedef virFirewallBatch *virFirewallBatchPtr;
+struct _virFirewallBatch {
+    virFirewallLayer layer;
+    virBuffer buf;
+    const char *table;
+    size_t nrules;
+};
+
 
 struct _virFirewall {
     int err;
@@ -80,10 +99,18 @@ struct _virFirewall {
     size_t ngroups;
     virFirewallGroupPtr *groups;
     size_t currentGroup;
+
+    bool concurrent;
 };
 
 static virFirewallBackend currentBackend = VIR_FIREWALL_BACKEND_AUTOMATIC;
-static virMutex ruleLock = VIR_MUTEX_INITIALIZER;
+/* taken for writing by rulesets which may change any chain, and for
+ * reading by concurrent ones, see virFirewallSetConcurrent */
+static virRWLock ruleLock = VIR_RWLOCK_INITIALIZER;
+/* serialize the commands of a layer whose tools do not lock themselves */
+static virMutex layerLocks[VIR_FIREWALL_LAYER_LAST] = {
+    VIR_MUTEX_INITIALIZER, VIR_MUTEX_INITIALIZER, VIR_MUTEX_INITIALIZER,
+};
 
 static int
 virFirewallValidateBackend(virFirewallBackend backend);
@@ -99,14 +126,26 @@ VIR_ONCE_GLOBAL_INIT(virFirewall);
 static bool iptablesUseLock;
 static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
+static bool iptablesRestoreUseLock;
+static bool ip6tablesRestoreUseLock;
 static bool lockOverride; /* true to avoid lock probes */
 
+/* layers whose rules can be applied through the *-restore tools */
+static bool batchLayers[VIR_FIREWALL_LAYER_LAST];
+static bool batchOverride; /* true to batch all layers without probing */
+
 void
 virFirewallSetLockOverride(bool avoid)
 {
     lockOverride = avoid;
 }
 
+void
+virFirewallSetBatchOverride(bool force)
+{
+    batchOverride = force;
+}
+
 static void
 virFirewallCheckUpdateLock(bool *lockflag,
                            const char *const*args)
@@ -143,6 +182,42 @@ virFirewallCheckUpdateLocking(void)
                                ebtablesArgs);
 }
 
+static void
+virFirewallCheckUpdateBatching(void)
+{
+    const char *iptablesRestoreArgs[] = {
+        IPTABLES_PATH "-restore", "-w", "--test", NULL,
+    };
+    const char *ip6tablesRestoreArgs[] = {
+        IP6TABLES_PATH "-restore", "-w", "--test", NULL,
+    };
+    size_t i;
+
+    if (lockOverride)
+        return;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        const char *bin = virFirewallLayerRestoreCommandTypeToString(i);
+
+        batchLayers[i] = virFileIsExecutable(bin);
+        VIR_INFO("%s rules of layer %zu through %s",
+                 batchLayers[i] ? "batching" : "not batching", i, bin);
+    }
+
+    /* The restore tools got their own locking later than the plain ones */
+    if (batchLayers[VIR_FIREWALL_LAYER_IPV4])
+        virFirewallCheckUpdateLock(&iptablesRestoreUseLock,
+                                   iptablesRestoreArgs);
+    if (batchLayers[VIR_FIREWALL_LAYER_IPV6])
+        virFirewallCheckUpdateLock(&ip6tablesRestoreUseLock,
+                                   ip6tablesRestoreArgs);
+
+    if (iptablesUseLock && !iptablesRestoreUseLock)
+        batchLayers[VIR_FIREWALL_LAYER_IPV4] = false;
+    if (ip6tablesUseLock && !ip6tablesRestoreUseLock)
+        batchLayers[VIR_FIREWALL_LAYER_IPV6] = false;
+}
+
 static int
 virFirewallValidateBackend(virFirewallBackend backend)
 {
@@ -191,6 +266,8 @@ virFirewallValidateBackend(virFirewallBackend backend)
     currentBackend = backend;
 
     virFirewallCheckUpdateLocking();
+    if (backend == VIR_FIREWALL_BACKEND_DIRECT)
+        virFirewallCheckUpdateBatching();
 
     return 0;
 }
@@ -653,6 +730,51 @@ virFirewallRuleToString(virFirewallRulePtr rule)
     return virBufferContentAndReset(&buf);
 }
 
+/*
+ * Rules of firewalls marked concurrent are applied while holding the
+ * global rule lock for reading only. The commands of a layer must still
+ * not race with each other when the tools of the layer do not take the
+ * xtables or ebtables lock themselves, which is never the case for
+ * ebtables-restore.
+ */
+static bool
+virFirewallLayerNeedsLock(virFirewallLayer layer)
+{
+    switch (layer) {
+    case VIR_FIREWALL_LAYER_ETHERNET:
+        return !ebtablesUseLock || batchOverride || batchLayers[layer];
+    case VIR_FIREWALL_LAYER_IPV4:
+        return !iptablesUseLock ||
+            ((batchOverride || batchLayers[layer]) && !iptablesRestoreUseLock);
+    case VIR_FIREWALL_LAYER_IPV6:
+        return !ip6tablesUseLock ||
+            ((batchOverride || batchLayers[layer]) && !ip6tablesRestoreUseLock);
+    case VIR_FIREWALL_LAYER_LAST:
+        break;
+    }
+
+    return false;
+}
+
+
+static int
+virFirewallRunLayerCommand(virFirewallLayer layer,
+                           virCommandPtr cmd,
+                           int *status)
+{
+    bool lock = virFirewallLayerNeedsLock(layer);
+    int ret;
+
+    if (lock)
+        virMutexLock(&layerLocks[layer]);
+    ret = virCommandRun(cmd, status);
+    if (lock)
+        virMutexUnlock(&layerLocks[layer]);
+
+    return ret;
+}
+
+
 static int
 virFirewallApplyRuleDirect(virFirewallRulePtr rule,
                            bool ignoreErrors,
@@ -679,7 +801,7 @@ virFirewallApplyRuleDirect(virFirewallRulePtr rule,
     virCommandSetOutputBuffer(cmd, output);
     virCommandSetErrorBuffer(cmd, &error);
 
-    if (virCommandRun(cmd, &status) < 0)
+    if (virFirewallRunLayerCommand(rule->layer, cmd, &status) < 0)
         return -1;
 
     if (status != 0) {
@@ -761,25 +883,179 @@ virFirewallApplyRule(virFirewallPtr firewall,
     return 0;
 }
 
+/*
+ * With the direct backend, consecutive rules of a transaction that belong
+ * to the same layer are applied by a single iptables-restore,
+ * ip6tables-restore or ebtables-restore process instead of forking one
+ * process per rule. The restore tools commit each table at once and fail
+ * as a whole, so only rules which must not fail and whose output is not
+ * needed are batched. Any other rule, as well as a rule of another layer,
+ * first flushes the rules collected so far to keep the order of the
+ * transaction.
+ */
+static bool
+virFirewallRuleCanBatch(virFirewallRulePtr rule,
+                        bool ignoreErrors)
+{
+    if (currentBackend != VIR_FIREWALL_BACKEND_DIRECT)
+        return false;
+
+    if (!batchOverride && !batchLayers[rule->layer])
+        return false;
+
+    return !rule->queryCB && !rule->ignoreErrors && !ignoreErrors;
+}
+
+
+static void
+virFirewallBatchAddArg(virBufferPtr buf,
+                       const char *arg)
+{
+    if (!*arg || strpbrk(arg, " \t\"\\'")) {
+        virBufferAddChar(buf, '"');
+        virBufferEscape(buf, '\\', "\"\\", "%s", arg);
+        virBufferAddChar(buf, '"');
+    } else {
+        virBufferAdd(buf, arg, -1);
+    }
+}
+
+
+static void
+virFirewallBatchAddRule(virFirewallBatchPtr batch,
+                        virFirewallRulePtr rule)
+{
+    const char *table = "filter";
+    size_t i;
+    bool first = true;
+
+    batch->layer = rule->layer;
+
+    for (i = 0; i < rule->argsLen; i++) {
+        if ((STREQ(rule->args[i], "-t") || STREQ(rule->args[i], "--table")) &&
+            i + 1 < rule->argsLen) {
+            table = rule->args[i + 1];
+            break;
+        }
+    }
+
+    if (!batch->table || STRNEQ(batch->table, table)) {
+        if (batch->table)
+            virBufferAddLit(&batch->buf, "COMMIT\n");
+        virBufferAsprintf(&batch->buf, "*%s\n", table);
+        batch->table = table;
+    }
+
+    for (i = 0; i < rule->argsLen; i++) {
+        /* the lock is taken by the restore tool as a whole */
+        if (first &&
+            (STREQ(rule->args[i], "-w") || STREQ(rule->args[i], "--concurrent")))
+            continue;
+
+        if ((STREQ(rule->args[i], "-t") || STREQ(rule->args[i], "--table")) &&
+            i + 1 < rule->argsLen) {
+            i++;
+            continue;
+        }
+
+        if (!first)
+            virBufferAddChar(&batch->buf, ' ');
+        virFirewallBatchAddArg(&batch->buf, rule->args[i]);
+        first = false;
+    }
+    virBufferAddChar(&batch->buf, '\n');
+
+    batch->nrules++;
+}
+
+
+static int
+virFirewallBatchApply(virFirewallBatchPtr batch)
+{
+    virFirewallLayer layer = batch->layer;
+    const char *bin = virFirewallLayerRestoreCommandTypeToString(layer);
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *input = NULL;
+    g_autofree char *error = NULL;
+    size_t nrules = batch->nrules;
+    int status;
+
+    if (nrules == 0)
+        return 0;
+
+    virBufferAddLit(&batch->buf, "COMMIT\n");
+    input = virBufferContentAndReset(&batch->buf);
+    batch->table = NULL;
+    batch->nrules = 0;
+
+    cmd = virCommandNew(bin);
+    if ((layer == VIR_FIREWALL_LAYER_IPV4 && iptablesRestoreUseLock) ||
+        (layer == VIR_FIREWALL_LAYER_IPV6 && ip6tablesRestoreUseLock))
+        virCommandAddArg(cmd, "-w");
+    virCommandAddArg(cmd, "--noflush");
+
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    VIR_INFO("Applying %zu rules through %s", nrules, bin);
+
+    if (virFirewallRunLayerCommand(layer, cmd, &status) < 0)
+        return -1;
+
+    if (status != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply firewall rules through %s: %s"),
+                       bin, NULLSTR(error));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virFirewallApplyGroup(virFirewallPtr firewall,
                       size_t idx)
 {
     virFirewallGroupPtr group = firewall->groups[idx];
     bool ignoreErrors = (group->actionFlags & VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+    virFirewallBatch batch;
     size_t i;
+    int ret = -1;
+
+    memset(&batch, 0, sizeof(batch));
 
     VIR_INFO("Starting transaction for firewall=%p group=%p flags=0x%x",
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
     for (i = 0; i < group->naction; i++) {
-        if (virFirewallApplyRule(firewall,
-                                 group->action[i],
-                                 ignoreErrors) < 0)
-            return -1;
+        virFirewallRulePtr rule = group->action[i];
+
+        if (virFirewallRuleCanBatch(rule, ignoreErrors)) {
+            g_autofree char *str = virFirewallRuleToString(rule);
+
+            if (batch.nrules > 0 && batch.layer != rule->layer &&
+                virFirewallBatchApply(&batch) < 0)
+                goto cleanup;
+
+            VIR_INFO("Batching rule '%s'", NULLSTR(str));
+            virFirewallBatchAddRule(&batch, rule);
+            continue;
+        }
+
+        if (virFirewallBatchApply(&batch) < 0 ||
+            virFirewallApplyRule(firewall, rule, ignoreErrors) < 0)
+            goto cleanup;
     }
-    return 0;
+
+    if (virFirewallBatchApply(&batch) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&batch.buf);
+    return ret;
 }
 
 
@@ -801,13 +1077,44 @@ virFirewallRollbackGroup(virFirewallPtr firewall,
 }
 
 
+/**
+ * virFirewallSetConcurrent:
+ * @firewall: firewall ruleset to mark
+ *
+ * Mark @firewall as only changing rules private to one user, e.g. the
+ * rules of a single network interface, so that it can be applied
+ * concurrently with other rulesets marked the same way.
+ *
+ * A concurrent ruleset may create, flush and delete chains owned by its
+ * user only. It may also add and remove rules in chains shared with other
+ * users, like PREROUTING or libvirt-in, as long as each of those rules
+ * matches traffic of its user only (e.g. jumps to the chain of one
+ * interface), so that the order in which concurrent rulesets change the
+ * shared chain does not matter. Every such change is a single command
+ * serialized with all other commands of the layer. Creating, flushing or
+ * deleting shared chains must be done through a ruleset which is not
+ * marked concurrent. Such rulesets are never applied at the same time as
+ * any other ruleset.
+ */
+void
+virFirewallSetConcurrent(virFirewallPtr firewall)
+{
+    VIR_FIREWALL_RETURN_IF_ERROR(firewall);
+
+    firewall->concurrent = true;
+}
+
+
 int
 virFirewallApply(virFirewallPtr firewall)
 {
     size_t i, j;
     int ret = -1;
 
-    virMutexLock(&ruleLock);
+    if (firewall && firewall->concurrent)
+        virRWLockRead(&ruleLock);
+    else
+        virRWLockWrite(&ruleLock);
 
     if (currentBackend == VIR_FIREWALL_BACKEND_AUTOMATIC) {
         /* a specific backend should have been set when the firewall
@@ -863,6 +1170,6 @@ virFirewallApply(virFirewallPtr firewall)
 
     ret = 0;
  cleanup:
-    virMutexUnlock(&ruleLock);
+    virRWLockUnlock(&ruleLock);
     return ret;
 }
@@ -109,6 +109,8 @@ typedef enum {
 void virFirewallStartRollback(virFirewallPtr firewall,
                               unsigned int flags);
 
+void virFirewallSetConcurrent(virFirewallPtr firewall);
+
 int virFirewallApply(virFirewallPtr firewall);
 
 void virFirewallSetLockOverride(bool avoid);
@@ -26,6 +26,7 @@
 #if WITH_NUMACTL
 # define NUMA_VERSION1_COMPATIBILITY 1
 # include <numa.h>
+# include <numaif.h>
 
 # if LIBNUMA_API_VERSION > 1
 #  undef NUMA_MAX_N_CPUS
@@ -492,6 +493,100 @@ virNumaGetDistances(int node,
     return 0;
 }
 
+
+/**
+ * virNumaMovePages:
+ * @pid: process to move memory of
+ * @start: first address of the range to move
+ * @end: address after the last byte of the range to move
+ * @pagesize: size of the pages backing the range, in bytes
+ * @from: nodes to move the memory from
+ * @to: nodes to move the memory to
+ * @moved: incremented by the number of bytes moved
+ *
+ * Moves the pages of @pid in the given address range which reside on any of
+ * @from to @to, spreading them evenly if @to contains more than one node.
+ * Pages elsewhere, pages not faulted in yet and pages the kernel refuses to
+ * move (e.g. because they are shared or pinned) are left alone. The range
+ * must consist of whole pages of @pagesize, see virNumaMemoryRangeNextChunk().
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaMovePages(pid_t pid,
+                 unsigned long long start,
+                 unsigned long long end,
+                 unsigned long long pagesize,
+                 virBitmapPtr from,
+                 virBitmapPtr to,
+                 unsigned long long *moved)
+{
+    unsigned long npages = (end - start) / pagesize;
+    unsigned long nmove = 0;
+    g_autofree void **pages = NULL;
+    g_autofree int *nodes = NULL;
+    g_autofree int *status = NULL;
+    ssize_t node = -1;
+    size_t i;
+
+    if (pagesize == 0 || start % pagesize != 0 || end % pagesize != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("memory range %llx-%llx is not aligned to "
+                         "page size %llu"),
+                       start, end, pagesize);
+        return -1;
+    }
+
+    if (npages == 0)
+        return 0;
+
+    pages = g_new0(void *, npages);
+    nodes = g_new0(int, npages);
+    status = g_new0(int, npages);
+
+    for (i = 0; i < npages; i++)
+        pages[i] = (void *)(uintptr_t)(start + i * pagesize);
+
+    /* Find out where the pages are first, so that pages which are fine
+     * already are not moved between the target nodes */
+    if (numa_move_pages(pid, npages, pages, NULL, status, 0) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to query memory of process %lld"),
+                             (long long) pid);
+        return -1;
+    }
+
+    for (i = 0; i < npages; i++) {
+        if (status[i] < 0 || !virBitmapIsBitSet(from, status[i]))
+            continue;
+
+        if ((node = virBitmapNextSetBit(to, node)) < 0 &&
+            (node = virBitmapNextSetBit(to, -1)) < 0)
+            return 0;
+
+        pages[nmove] = pages[i];
+        nodes[nmove] = node;
+        nmove++;
+    }
+
+    if (nmove == 0)
+        return 0;
+
+    if (numa_move_pages(pid, nmove, pages, nodes, status, MPOL_MF_MOVE) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to move memory of process %lld"),
+                             (long long) pid);
+        return -1;
+    }
+
+    for (i = 0; i < nmove; i++) {
+        if (status[i] >= 0)
+            *moved += pagesize;
+    }
+
+    return 0;
+}
+
 #else /* !(WITH_NUMACTL && HAVE_NUMA_BITMASK_ISBITSET) */
 
 bool
@@ -517,6 +612,22 @@ virNumaGetDistances(int node G_GNUC_UNUSED,
     VIR_DEBUG("NUMA distance information isn't available on this host");
     return 0;
 }
+
+
+int
+virNumaMovePages(pid_t pid G_GNUC_UNUSED,
+                 unsigned long long start G_GNUC_UNUSED,
+                 unsigned long long end G_GNUC_UNUSED,
+                 unsigned long long pagesize G_GNUC_UNUSED,
+                 virBitmapPtr from G_GNUC_UNUSED,
+                 virBitmapPtr to G_GNUC_UNUSED,
+                 unsigned long long *moved G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("moving memory between NUMA nodes is not supported "
+                     "on this host"));
+    return -1;
+}
 #endif /* !(WITH_NUMACTL && HAVE_NUMA_BITMASK_ISBITSET) */
 
 
@@ -951,6 +1062,252 @@ virNumaSetPagePoolSize(int node,
 }
 
 
+typedef struct _virNumaMapsEntry virNumaMapsEntry;
+typedef virNumaMapsEntry *virNumaMapsEntryPtr;
+struct _virNumaMapsEntry {
+    unsigned long long start;
+    unsigned long long pagesize; /* in bytes */
+    unsigned long long *pages; /* indexed by node */
+    size_t npages;
+};
+
+
+static void
+virNumaMapsEntriesFree(virNumaMapsEntryPtr entries,
+                       size_t nentries)
+{
+    size_t i;
+
+    for (i = 0; i < nentries; i++)
+        VIR_FREE(entries[i].pages);
+    VIR_FREE(entries);
+}
+
+
+/*
+ * Parses /proc/<pid>/numa_maps, one line per mapping:
+ *
+ *   7f0e4c000000 default anon=1024 dirty=1024 N0=512 N1=512 kernelpagesize_kB=4
+ */
+static int
+virNumaReadProcessMaps(pid_t pid,
+                       virNumaMapsEntryPtr *entries,
+                       size_t *nentries)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *data = NULL;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    virNumaMapsEntryPtr ents = NULL;
+    size_t nents = 0;
+    size_t i;
+
+    path = g_strdup_printf("/proc/%lld/numa_maps", (long long) pid);
+
+    if (virFileReadAll(path, 64 * 1024 * 1024, &data) < 0)
+        return -1;
+
+    if (!(lines = virStringSplit(data, "\n", 0)))
+        return -1;
+
+    for (i = 0; lines[i]; i++) {
+        VIR_AUTOSTRINGLIST fields = NULL;
+        virNumaMapsEntry ent = { 0 };
+        size_t j;
+
+        if (!*lines[i])
+            continue;
+
+        if (!(fields = virStringSplit(lines[i], " ", 0)))
+            goto error;
+
+        if (virStrToLong_ull(fields[0], NULL, 16, &ent.start) < 0)
+            goto parse_error;
+
+        ent.pagesize = 4096;
+
+        for (j = 1; fields[j]; j++) {
+            unsigned long long value;
+            unsigned int node;
+            const char *tmp;
+            char *end;
+
+            if ((tmp = STRSKIP(fields[j], "kernelpagesize_kB="))) {
+                if (virStrToLong_ull(tmp, NULL, 10, &value) < 0)
+                    goto parse_error;
+                ent.pagesize = value * 1024;
+                continue;
+            }
+
+            if (fields[j][0] != 'N' ||
+                virStrToLong_ui(fields[j] + 1, &end, 10, &node) < 0 ||
+                *end != '=')
+                continue;
+
+            if (virStrToLong_ull(end + 1, NULL, 10, &value) < 0)
+                goto parse_error;
+
+            if (node >= ent.npages &&
+                VIR_EXPAND_N(ent.pages, ent.npages, node + 1 - ent.npages) < 0)
+                goto error;
+
+            ent.pages[node] = value;
+        }
+
+        if (VIR_APPEND_ELEMENT(ents, nents, ent) < 0) {
+            VIR_FREE(ent.pages);
+            goto error;
+        }
+    }
+
+    *entries = ents;
+    *nentries = nents;
+    return 0;
+
+ parse_error:
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("Unable to parse '%s'"), path);
+ error:
+    virNumaMapsEntriesFree(ents, nents);
+    return -1;
+}
+
+
+/**
+ * virNumaGetProcessMemory:
+ * @pid: process to query
+ * @memory: filled with an array of bytes of memory per node
+ * @nmemory: filled with the size of @memory
+ *
+ * Sums up the memory of @pid resident on each NUMA node, as reported by
+ * /proc/<pid>/numa_maps. Note that the kernel walks the page tables of the
+ * whole process to report it, which takes a while for large processes.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaGetProcessMemory(pid_t pid,
+                        unsigned long long **memory,
+                        size_t *nmemory)
+{
+    virNumaMapsEntryPtr ents = NULL;
+    size_t nents = 0;
+    g_autofree unsigned long long *mem = NULL;
+    size_t nmem = 0;
+    int ret = -1;
+    size_t i;
+    size_t j;
+
+    if (virNumaReadProcessMaps(pid, &ents, &nents) < 0)
+        return -1;
+
+    for (i = 0; i < nents; i++) {
+        if (ents[i].npages > nmem &&
+            VIR_EXPAND_N(mem, nmem, ents[i].npages - nmem) < 0)
+            goto cleanup;
+
+        for (j = 0; j < ents[i].npages; j++)
+            mem[j] += ents[i].pages[j] * ents[i].pagesize;
+    }
+
+    *memory = g_steal_pointer(&mem);
+    *nmemory = nmem;
+    ret = 0;
+
+ cleanup:
+    virNumaMapsEntriesFree(ents, nents);
+    return ret;
+}
+
+
+/**
+ * virNumaGetProcessRanges:
+ * @pid: process to query
+ * @nodes: NUMA nodes of interest
+ * @ranges: filled with an array of address ranges
+ * @nranges: filled with the size of @ranges
+ *
+ * Lists the mappings of @pid which have memory resident on any of @nodes,
+ * so that it can be moved with virNumaMovePages().
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaGetProcessRanges(pid_t pid,
+                        virBitmapPtr nodes,
+                        virNumaMemoryRangePtr *ranges,
+                        size_t *nranges)
+{
+    virNumaMapsEntryPtr ents = NULL;
+    size_t nents = 0;
+    g_autofree char *path = NULL;
+    g_autofree char *data = NULL;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    virNumaMemoryRangePtr rngs = NULL;
+    size_t nrngs = 0;
+    size_t ent = 0;
+    int ret = -1;
+    size_t i;
+
+    if (virNumaReadProcessMaps(pid, &ents, &nents) < 0)
+        return -1;
+
+    path = g_strdup_printf("/proc/%lld/maps", (long long) pid);
+
+    if (virFileReadAll(path, 64 * 1024 * 1024, &data) < 0)
+        goto cleanup;
+
+    if (!(lines = virStringSplit(data, "\n", 0)))
+        goto cleanup;
+
+    /* Both files list the mappings ordered by their start address */
+    for (i = 0; lines[i] && ent < nents; i++) {
+        virNumaMemoryRange rng = { 0 };
+        char *end;
+        ssize_t node = -1;
+        bool found = false;
+
+        if (!*lines[i])
+            continue;
+
+        if (virStrToLong_ull(lines[i], &end, 16, &rng.start) < 0 ||
+            *end != '-' ||
+            virStrToLong_ull(end + 1, NULL, 16, &rng.end) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to parse '%s'"), path);
+            goto cleanup;
+        }
+
+        while (ent < nents && ents[ent].start < rng.start)
+            ent++;
+
+        if (ent == nents || ents[ent].start != rng.start)
+            continue;
+
+        while ((node = virBitmapNextSetBit(nodes, node)) >= 0) {
+            if (node < ents[ent].npages && ents[ent].pages[node] > 0)
+                found = true;
+        }
+
+        if (!found)
+            continue;
+
+        rng.pagesize = ents[ent].pagesize;
+
+        if (VIR_APPEND_ELEMENT(rngs, nrngs, rng) < 0)
+            goto cleanup;
+    }
+
+    *ranges = g_steal_pointer(&rngs);
+    *nranges = nrngs;
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(rngs);
+    virNumaMapsEntriesFree(ents, nents);
+    return ret;
+}
+
+
 #else /* #ifdef __linux__ */
 int
 virNumaGetPageInfo(int node G_GNUC_UNUSED,
@@ -988,8 +1345,59 @@ virNumaSetPagePoolSize(int node G_GNUC_UNUSED,
                    _("page pool allocation is not supported on this platform"));
     return -1;
 }
+
+
+int
+virNumaGetProcessMemory(pid_t pid G_GNUC_UNUSED,
+                        unsigned long long **memory G_GNUC_UNUSED,
+                        size_t *nmemory G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("process NUMA memory is not available on this platform"));
+    return -1;
+}
+
+
+int
+virNumaGetProcessRanges(pid_t pid G_GNUC_UNUSED,
+                        virBitmapPtr nodes G_GNUC_UNUSED,
+                        virNumaMemoryRangePtr *ranges G_GNUC_UNUSED,
+                        size_t *nranges G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("process NUMA memory is not available on this platform"));
+    return -1;
+}
 #endif /* #ifdef __linux__ */
 
+
+/**
+ * virNumaMemoryRangeNextChunk:
+ * @range: range of memory being moved
+ * @start: start of the chunk within @range
+ * @chunk: preferred size of the chunk, in bytes
+ *
+ * Splits @range into chunks which can be moved one by one with
+ * virNumaMovePages(). The chunk is rounded up to whole pages of @range so
+ * that mappings backed by pages larger than @chunk (e.g. 1 GiB huge pages)
+ * are moved too rather than skipped.
+ *
+ * Returns the end of the chunk starting at @start.
+ */
+unsigned long long
+virNumaMemoryRangeNextChunk(const virNumaMemoryRange *range,
+                            unsigned long long start,
+                            unsigned long long chunk)
+{
+    unsigned long long len = VIR_ROUND_UP(MAX(chunk, 1), range->pagesize);
+
+    if (range->end - start <= len)
+        return range->end;
+
+    return start + len;
+}
+
+
 bool
 virNumaNodesetIsAvailable(virBitmapPtr nodeset)
 {
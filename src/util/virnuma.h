@@ -60,6 +60,32 @@ int virNumaGetPages(int node,
                     unsigned long long **pages_free,
                     size_t *npages)
     ATTRIBUTE_NONNULL(5) G_GNUC_NO_INLINE;
+typedef struct _virNumaMemoryRange virNumaMemoryRange;
+typedef virNumaMemoryRange *virNumaMemoryRangePtr;
+struct _virNumaMemoryRange {
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long pagesize; /* in bytes */
+};
+
+int virNumaGetProcessMemory(pid_t pid,
+                            unsigned long long **memory,
+                            size_t *nmemory);
+int virNumaGetProcessRanges(pid_t pid,
+                            virBitmapPtr nodes,
+                            virNumaMemoryRangePtr *ranges,
+                            size_t *nranges);
+unsigned long long virNumaMemoryRangeNextChunk(const virNumaMemoryRange *range,
+                                               unsigned long long start,
+                                               unsigned long long chunk);
+int virNumaMovePages(pid_t pid,
+                     unsigned long long start,
+                     unsigned long long end,
+                     unsigned long long pagesize,
+                     virBitmapPtr from,
+                     virBitmapPtr to,
+                     unsigned long long *moved);
+
 int virNumaSetPagePoolSize(int node,
                            unsigned int page_size,
                            unsigned long long page_count,
@@ -0,0 +1,755 @@
+/*
+ * virnumaplacement.c: automatic NUMA placement of domains
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virnumaplacement.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virhash.h"
+#include "virlog.h"
+#include "virnuma.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.numaplacement");
+
+#define PROCSTAT_PATH "/proc/stat"
+
+/* minimal number of clock ticks per CPU between two samples of the host
+ * CPU load, shorter intervals reuse the load computed previously */
+#define NUMA_PLACEMENT_LOAD_MIN_TICKS 10
+
+/* minimal score improvement for recommending a new placement of a running
+ * domain, the score of a node is between -0.5 and 1 */
+#define NUMA_PLACEMENT_REPLACE_THRESHOLD 0.15
+
+/* distance reported for remote nodes if the host doesn't provide any */
+#define NUMA_PLACEMENT_DISTANCE_LOCAL 10
+#define NUMA_PLACEMENT_DISTANCE_REMOTE 20
+
+
+typedef struct _virNumaPlacementPin virNumaPlacementPin;
+typedef virNumaPlacementPin *virNumaPlacementPinPtr;
+struct _virNumaPlacementPin {
+    virBitmapPtr nodeset;
+    unsigned int vcpus;
+};
+
+struct _virNumaPlacementPins {
+    virObjectLockable parent;
+
+    /* domain ID -> virNumaPlacementPin */
+    virHashTablePtr pins;
+};
+
+static virClassPtr virNumaPlacementPinsClass;
+
+/* The last sample of the host CPU times, indexed by CPU id. The load of
+ * each CPU is computed from the difference to the next sample, so that
+ * placing a domain doesn't have to wait for the CPUs to do some work. */
+static virMutex virNumaPlacementLoadLock = VIR_MUTEX_INITIALIZER;
+static unsigned long long *virNumaPlacementLoadBusy;
+static unsigned long long *virNumaPlacementLoadTotal;
+static double *virNumaPlacementLoad;
+static size_t virNumaPlacementLoadCPUs;
+
+static void
+virNumaPlacementPinsDispose(void *obj)
+{
+    virNumaPlacementPinsPtr pins = obj;
+
+    virHashFree(pins->pins);
+}
+
+static int
+virNumaPlacementOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(virNumaPlacementPins, virClassForObjectLockable()))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNumaPlacement);
+
+
+static void
+virNumaPlacementPinFree(void *opaque)
+{
+    virNumaPlacementPinPtr pin = opaque;
+
+    if (!pin)
+        return;
+
+    virBitmapFree(pin->nodeset);
+    VIR_FREE(pin);
+}
+
+
+/**
+ * virNumaPlacementPinsNew:
+ *
+ * Creates a self-locking record of the NUMA nodes running domains were
+ * placed on, so that the placement of further domains can take them into
+ * account.
+ *
+ * Returns the new object or NULL on error.
+ */
+virNumaPlacementPinsPtr
+virNumaPlacementPinsNew(void)
+{
+    virNumaPlacementPinsPtr pins;
+
+    if (virNumaPlacementInitialize() < 0)
+        return NULL;
+
+    if (!(pins = virObjectLockableNew(virNumaPlacementPinsClass)))
+        return NULL;
+
+    if (!(pins->pins = virHashCreate(32, virNumaPlacementPinFree))) {
+        virObjectUnref(pins);
+        return NULL;
+    }
+
+    return pins;
+}
+
+
+/**
+ * virNumaPlacementPinsAdd:
+ * @pins: the record
+ * @id: unique ID of the domain (e.g. its UUID)
+ * @nodeset: nodes the domain was placed on
+ * @vcpus: number of vCPUs of the domain
+ *
+ * Records that the domain @id runs @vcpus on @nodeset, replacing any
+ * previous record of the same domain.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaPlacementPinsAdd(virNumaPlacementPinsPtr pins,
+                        const char *id,
+                        virBitmapPtr nodeset,
+                        unsigned int vcpus)
+{
+    virNumaPlacementPinPtr pin = NULL;
+    int ret = -1;
+
+    if (VIR_ALLOC(pin) < 0)
+        return -1;
+
+    if (!(pin->nodeset = virBitmapNewCopy(nodeset)))
+        goto cleanup;
+    pin->vcpus = vcpus;
+
+    virObjectLock(pins);
+    if (virHashUpdateEntry(pins->pins, id, pin) == 0) {
+        pin = NULL;
+        ret = 0;
+    }
+    virObjectUnlock(pins);
+
+ cleanup:
+    virNumaPlacementPinFree(pin);
+    return ret;
+}
+
+
+/**
+ * virNumaPlacementPinsRemove:
+ * @pins: the record
+ * @id: unique ID of the domain
+ *
+ * Forgets the placement of domain @id. It's fine to call this for domains
+ * which were never added.
+ */
+void
+virNumaPlacementPinsRemove(virNumaPlacementPinsPtr pins,
+                           const char *id)
+{
+    virObjectLock(pins);
+    ignore_value(virHashRemoveEntry(pins->pins, id));
+    virObjectUnlock(pins);
+}
+
+
+static virNumaPlacementNodePtr
+virNumaPlacementHostGetNode(virNumaPlacementHostPtr host,
+                            int id)
+{
+    size_t i;
+
+    for (i = 0; i < host->nnodes; i++) {
+        if (host->nodes[i].id == id)
+            return &host->nodes[i];
+    }
+
+    return NULL;
+}
+
+
+void
+virNumaPlacementHostFree(virNumaPlacementHostPtr host)
+{
+    size_t i;
+
+    if (!host)
+        return;
+
+    for (i = 0; i < host->nnodes; i++) {
+        virBitmapFree(host->nodes[i].cpus);
+        VIR_FREE(host->nodes[i].distances);
+    }
+    VIR_FREE(host->nodes);
+    VIR_FREE(host);
+}
+
+
+/**
+ * virNumaPlacementHostNew:
+ *
+ * Collects the NUMA topology of the host together with the current amount
+ * of free memory on each node. The CPU load of the nodes is zero until
+ * virNumaPlacementHostUpdateLoad() is called.
+ *
+ * Returns the host data or NULL on error.
+ */
+virNumaPlacementHostPtr
+virNumaPlacementHostNew(void)
+{
+    g_autoptr(virNumaPlacementHost) host = NULL;
+    int max_node;
+    int i;
+
+    if (!virNumaIsAvailable()) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("NUMA isn't available on this host"));
+        return NULL;
+    }
+
+    if ((max_node = virNumaGetMaxNode()) < 0)
+        return NULL;
+
+    if (VIR_ALLOC(host) < 0 ||
+        VIR_ALLOC_N(host->nodes, max_node + 1) < 0)
+        return NULL;
+
+    for (i = 0; i <= max_node; i++) {
+        virNumaPlacementNodePtr node = &host->nodes[host->nnodes];
+        unsigned long long memTotal;
+        unsigned long long memFree;
+        int ncpus;
+
+        if (!virNumaNodeIsAvailable(i))
+            continue;
+
+        if (virNumaGetNodeMemory(i, &memTotal, &memFree) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to get memory of NUMA node %d"), i);
+            return NULL;
+        }
+
+        if ((ncpus = virNumaGetNodeCPUs(i, &node->cpus)) < 0)
+            return NULL;
+
+        if (virNumaGetDistances(i, &node->distances, &node->ndistances) < 0)
+            return NULL;
+
+        node->id = i;
+        node->memTotal = memTotal / 1024;
+        node->memFree = memFree / 1024;
+        node->ncpus = ncpus;
+        host->nnodes++;
+    }
+
+    return g_steal_pointer(&host);
+}
+
+
+/* Fills @busy and @total with the time each CPU was busy and the total time
+ * accounted to each CPU, indexed by CPU id, up to @ncpus. */
+static int
+virNumaPlacementReadCPUTimes(size_t ncpus,
+                             unsigned long long *busy,
+                             unsigned long long *total)
+{
+    g_autofree char *data = NULL;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    size_t i;
+
+    if (virFileReadAll(PROCSTAT_PATH, 1024 * 1024, &data) < 0)
+        return -1;
+
+    if (!(lines = virStringSplit(data, "\n", 0)))
+        return -1;
+
+    for (i = 0; lines[i]; i++) {
+        unsigned long long usr = 0, ni = 0, sys = 0, idle = 0, iowait = 0;
+        unsigned long long irq = 0, softirq = 0, steal = 0;
+        unsigned int cpu;
+
+        if (!STRPREFIX(lines[i], "cpu") || lines[i][3] == ' ')
+            continue;
+
+        if (sscanf(lines[i], "cpu%u %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &cpu, &usr, &ni, &sys, &idle, &iowait,
+                   &irq, &softirq, &steal) < 5 ||
+            cpu >= ncpus)
+            continue;
+
+        busy[cpu] = usr + ni + sys + irq + softirq + steal;
+        total[cpu] = busy[cpu] + idle + iowait;
+    }
+
+    return 0;
+}
+
+
+/* Replaces the stored sample with @busy and @total. The load of each CPU
+ * is the busy share of the time since the previous sample, or since boot
+ * if there's none. Must be called with virNumaPlacementLoadLock held. */
+static void
+virNumaPlacementLoadUpdate(size_t ncpus,
+                           unsigned long long **busy,
+                           unsigned long long **total)
+{
+    unsigned long long elapsed = 0;
+    size_t i;
+
+    if (virNumaPlacementLoadCPUs != ncpus) {
+        VIR_FREE(virNumaPlacementLoadBusy);
+        VIR_FREE(virNumaPlacementLoadTotal);
+        VIR_FREE(virNumaPlacementLoad);
+        virNumaPlacementLoadCPUs = 0;
+    }
+
+    if (!virNumaPlacementLoad) {
+        virNumaPlacementLoad = g_new0(double, ncpus);
+        virNumaPlacementLoadBusy = g_new0(unsigned long long, ncpus);
+        virNumaPlacementLoadTotal = g_new0(unsigned long long, ncpus);
+        virNumaPlacementLoadCPUs = ncpus;
+    } else {
+        for (i = 0; i < ncpus; i++) {
+            if ((*total)[i] > virNumaPlacementLoadTotal[i])
+                elapsed += (*total)[i] - virNumaPlacementLoadTotal[i];
+        }
+
+        /* keep the load of the previous interval rather than computing
+         * it from a handful of ticks */
+        if (elapsed < ncpus * NUMA_PLACEMENT_LOAD_MIN_TICKS)
+            return;
+    }
+
+    for (i = 0; i < ncpus; i++) {
+        unsigned long long busyDelta;
+        unsigned long long totalDelta;
+
+        /* a CPU which went offline in the meantime starts over */
+        if ((*total)[i] < virNumaPlacementLoadTotal[i] ||
+            (*busy)[i] < virNumaPlacementLoadBusy[i]) {
+            virNumaPlacementLoadTotal[i] = 0;
+            virNumaPlacementLoadBusy[i] = 0;
+        }
+
+        busyDelta = (*busy)[i] - virNumaPlacementLoadBusy[i];
+        totalDelta = (*total)[i] - virNumaPlacementLoadTotal[i];
+
+        if (totalDelta > 0)
+            virNumaPlacementLoad[i] = (double) busyDelta / totalDelta;
+    }
+
+    VIR_FREE(virNumaPlacementLoadBusy);
+    VIR_FREE(virNumaPlacementLoadTotal);
+    virNumaPlacementLoadBusy = g_steal_pointer(busy);
+    virNumaPlacementLoadTotal = g_steal_pointer(total);
+}
+
+
+/**
+ * virNumaPlacementHostUpdateLoad:
+ * @host: host data
+ *
+ * Reads the CPU times of the host and stores the average busy share of the
+ * CPUs of each node in @host. The load is measured over the time since the
+ * CPU times were last read by any caller in this process, which saves
+ * sampling the CPUs for a while on every placement. The first call after
+ * start uses the CPU times accumulated since boot.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaPlacementHostUpdateLoad(virNumaPlacementHostPtr host)
+{
+    g_autofree unsigned long long *busy = NULL;
+    g_autofree unsigned long long *total = NULL;
+    size_t ncpus = 0;
+    size_t i;
+
+    for (i = 0; i < host->nnodes; i++) {
+        ssize_t last;
+
+        if (host->nodes[i].cpus &&
+            (last = virBitmapLastSetBit(host->nodes[i].cpus)) >= 0)
+            ncpus = MAX(ncpus, last + 1);
+    }
+
+    if (ncpus == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(busy, ncpus) < 0 ||
+        VIR_ALLOC_N(total, ncpus) < 0)
+        return -1;
+
+    if (virNumaPlacementReadCPUTimes(ncpus, busy, total) < 0)
+        return -1;
+
+    virMutexLock(&virNumaPlacementLoadLock);
+
+    virNumaPlacementLoadUpdate(ncpus, &busy, &total);
+
+    for (i = 0; i < host->nnodes; i++) {
+        virNumaPlacementNodePtr node = &host->nodes[i];
+        double load = 0;
+        size_t count = 0;
+        ssize_t cpu = -1;
+
+        while (node->cpus &&
+               (cpu = virBitmapNextSetBit(node->cpus, cpu)) >= 0) {
+            load += virNumaPlacementLoad[cpu];
+            count++;
+        }
+
+        node->load = count ? load / count : 0;
+    }
+
+    virMutexUnlock(&virNumaPlacementLoadLock);
+
+    return 0;
+}
+
+
+static int
+virNumaPlacementHostAddPin(void *payload,
+                           const void *name,
+                           void *opaque)
+{
+    virNumaPlacementPinPtr pin = payload;
+    void **data = opaque;
+    virNumaPlacementHostPtr host = data[0];
+    const char *skip = data[1];
+    size_t count = virBitmapCountBits(pin->nodeset);
+    ssize_t id = -1;
+
+    if ((skip && STREQ(name, skip)) || count == 0)
+        return 0;
+
+    while ((id = virBitmapNextSetBit(pin->nodeset, id)) >= 0) {
+        virNumaPlacementNodePtr node = virNumaPlacementHostGetNode(host, id);
+
+        if (node)
+            node->pinned += (double) pin->vcpus / count;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virNumaPlacementHostAddPins:
+ * @host: host data
+ * @pins: placement of running domains
+ * @skip: ID of a domain to ignore, or NULL
+ *
+ * Accounts the vCPUs of the domains recorded in @pins to the nodes they
+ * were placed on, splitting them evenly among the nodes of each domain.
+ */
+void
+virNumaPlacementHostAddPins(virNumaPlacementHostPtr host,
+                            virNumaPlacementPinsPtr pins,
+                            const char *skip)
+{
+    void *data[] = { host, (void *) skip };
+
+    virObjectLock(pins);
+    virHashForEach(pins->pins, virNumaPlacementHostAddPin, data);
+    virObjectUnlock(pins);
+}
+
+
+/**
+ * virNumaPlacementHostReleaseDomain:
+ * @host: host data
+ * @nodeset: nodes a running domain is placed on
+ * @memory: memory of the domain in KiB
+ *
+ * Modifies @host as if the domain wasn't running, to see how it would be
+ * placed afresh. The memory is assumed to be spread evenly over @nodeset.
+ * The vCPUs of the domain are released by skipping it in
+ * virNumaPlacementHostAddPins().
+ */
+void
+virNumaPlacementHostReleaseDomain(virNumaPlacementHostPtr host,
+                                  virBitmapPtr nodeset,
+                                  unsigned long long memory)
+{
+    size_t count = 0;
+    ssize_t id = -1;
+
+    while ((id = virBitmapNextSetBit(nodeset, id)) >= 0) {
+        virNumaPlacementNodePtr node = virNumaPlacementHostGetNode(host, id);
+
+        if (node && node->memTotal > 0)
+            count++;
+    }
+
+    if (count == 0)
+        return;
+
+    while ((id = virBitmapNextSetBit(nodeset, id)) >= 0) {
+        virNumaPlacementNodePtr node = virNumaPlacementHostGetNode(host, id);
+
+        if (!node || node->memTotal == 0)
+            continue;
+
+        node->memFree = MIN(node->memTotal, node->memFree + memory / count);
+    }
+}
+
+
+/* Scores how well suited @node is for new work. Free memory and free CPU
+ * capacity are weighted the same, the latter goes negative if the node is
+ * overcommitted. */
+static double
+virNumaPlacementNodeScore(virNumaPlacementNodePtr node)
+{
+    double mem = 0;
+    double cpu = -0.5;
+
+    if (node->memTotal > 0)
+        mem = (double) node->memFree / node->memTotal;
+
+    if (node->ncpus > 0) {
+        cpu = (node->ncpus * (1 - node->load) - node->pinned) / node->ncpus;
+        cpu = MAX(cpu, -1);
+    }
+
+    return (mem + cpu) / 2;
+}
+
+
+static double
+virNumaPlacementNodesetScore(virNumaPlacementHostPtr host,
+                             virBitmapPtr nodeset)
+{
+    double score = 0;
+    size_t count = 0;
+    ssize_t id = -1;
+
+    while ((id = virBitmapNextSetBit(nodeset, id)) >= 0) {
+        virNumaPlacementNodePtr node = virNumaPlacementHostGetNode(host, id);
+
+        if (!node)
+            continue;
+
+        score += virNumaPlacementNodeScore(node);
+        count++;
+    }
+
+    return count ? score / count : -1;
+}
+
+
+static int
+virNumaPlacementDistance(virNumaPlacementNodePtr from,
+                         virNumaPlacementNodePtr to)
+{
+    if (to->id < from->ndistances && from->distances[to->id] > 0)
+        return from->distances[to->id];
+
+    if (from->id == to->id)
+        return NUMA_PLACEMENT_DISTANCE_LOCAL;
+    return NUMA_PLACEMENT_DISTANCE_REMOTE;
+}
+
+
+/**
+ * virNumaPlacementAdvise:
+ * @host: host data
+ * @vcpus: number of vCPUs of the domain
+ * @memory: memory of the domain in KiB
+ *
+ * Picks the nodes a domain with @vcpus and @memory should be placed on.
+ * The best scoring node which can hold the whole domain is preferred. If
+ * there's no such node, the best scoring node with CPUs is extended by its
+ * nearest neighbours until the domain fits or all nodes are used.
+ *
+ * Returns the nodeset or NULL on error.
+ */
+virBitmapPtr
+virNumaPlacementAdvise(virNumaPlacementHostPtr host,
+                       unsigned int vcpus,
+                       unsigned long long memory)
+{
+    g_autoptr(virBitmap) nodeset = NULL;
+    virNumaPlacementNodePtr best = NULL;
+    double bestScore = 0;
+    unsigned long long memFree;
+    unsigned int ncpus;
+    int maxNode = 0;
+    size_t i;
+
+    for (i = 0; i < host->nnodes; i++) {
+        virNumaPlacementNodePtr node = &host->nodes[i];
+        double score = virNumaPlacementNodeScore(node);
+
+        maxNode = MAX(maxNode, node->id);
+
+        if (node->ncpus < vcpus || node->memFree < memory)
+            continue;
+
+        if (!best || score > bestScore) {
+            best = node;
+            bestScore = score;
+        }
+    }
+
+    if (!(nodeset = virBitmapNew(maxNode + 1)))
+        return NULL;
+
+    if (best) {
+        ignore_value(virBitmapSetBit(nodeset, best->id));
+        VIR_DEBUG("Placing %u vCPUs and %llu KiB on node %d, score %.3f",
+                  vcpus, memory, best->id, bestScore);
+        return g_steal_pointer(&nodeset);
+    }
+
+    /* No single node is large enough, start with the best node having both
+     * CPUs and memory and grow towards the closest nodes */
+    for (i = 0; i < host->nnodes; i++) {
+        virNumaPlacementNodePtr node = &host->nodes[i];
+        double score = virNumaPlacementNodeScore(node);
+
+        if (node->ncpus == 0 || node->memTotal == 0)
+            continue;
+
+        if (!best || score > bestScore) {
+            best = node;
+            bestScore = score;
+        }
+    }
+
+    if (!best) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                       _("no usable NUMA node found on this host"));
+        return NULL;
+    }
+
+    ignore_value(virBitmapSetBit(nodeset, best->id));
+    memFree = best->memFree;
+    ncpus = best->ncpus;
+
+    while (memFree < memory || ncpus < vcpus) {
+        virNumaPlacementNodePtr next = NULL;
+        unsigned long long nextDistance = 0;
+        double nextScore = 0;
+
+        for (i = 0; i < host->nnodes; i++) {
+            virNumaPlacementNodePtr node = &host->nodes[i];
+            unsigned long long distance = 0;
+            double score;
+            ssize_t id = -1;
+
+            if (virBitmapIsBitSet(nodeset, node->id))
+                continue;
+
+            while ((id = virBitmapNextSetBit(nodeset, id)) >= 0)
+                distance += virNumaPlacementDistance(virNumaPlacementHostGetNode(host, id),
+                                                     node);
+            score = virNumaPlacementNodeScore(node);
+
+            if (!next || distance < nextDistance ||
+                (distance == nextDistance && score > nextScore)) {
+                next = node;
+                nextDistance = distance;
+                nextScore = score;
+            }
+        }
+
+        if (!next)
+            break;
+
+        ignore_value(virBitmapSetBit(nodeset, next->id));
+        memFree += next->memFree;
+        ncpus += next->ncpus;
+    }
+
+    VIR_DEBUG("Placing %u vCPUs and %llu KiB on %zu nodes starting with "
+              "node %d, score %.3f", vcpus, memory,
+              virBitmapCountBits(nodeset), best->id, bestScore);
+
+    return g_steal_pointer(&nodeset);
+}
+
+
+/**
+ * virNumaPlacementRecommend:
+ * @host: host data, see virNumaPlacementHostReleaseDomain()
+ * @current: nodes the domain is currently placed on
+ * @vcpus: number of vCPUs of the domain
+ * @memory: memory of the domain in KiB
+ * @nodeset: filled with the recommended nodes
+ *
+ * Checks whether a running domain would be placed notably better than on
+ * its @current nodes.
+ *
+ * Returns 1 if a new placement is recommended and @nodeset was filled, 0
+ * if the domain should stay where it is, -1 on error.
+ */
+int
+virNumaPlacementRecommend(virNumaPlacementHostPtr host,
+                          virBitmapPtr current,
+                          unsigned int vcpus,
+                          unsigned long long memory,
+                          virBitmapPtr *nodeset)
+{
+    g_autoptr(virBitmap) advice = NULL;
+    double currentScore;
+    double adviceScore;
+
+    if (!(advice = virNumaPlacementAdvise(host, vcpus, memory)))
+        return -1;
+
+    if (virBitmapEqual(advice, current))
+        return 0;
+
+    currentScore = virNumaPlacementNodesetScore(host, current);
+    adviceScore = virNumaPlacementNodesetScore(host, advice);
+
+    VIR_DEBUG("Current placement score %.3f, advised %.3f",
+              currentScore, adviceScore);
+
+    if (adviceScore - currentScore < NUMA_PLACEMENT_REPLACE_THRESHOLD)
+        return 0;
+
+    *nodeset = g_steal_pointer(&advice);
+    return 1;
+}
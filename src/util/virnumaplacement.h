@@ -0,0 +1,81 @@
+/*
+ * virnumaplacement.h: automatic NUMA placement of domains
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "virbitmap.h"
+#include "virobject.h"
+
+typedef struct _virNumaPlacementNode virNumaPlacementNode;
+typedef virNumaPlacementNode *virNumaPlacementNodePtr;
+struct _virNumaPlacementNode {
+    int id;
+    unsigned long long memTotal; /* in KiB */
+    unsigned long long memFree; /* in KiB */
+    virBitmapPtr cpus;
+    unsigned int ncpus;
+    double load; /* busy share of the node's CPUs, 0 to 1 */
+    double pinned; /* vCPUs of other domains placed on the node */
+    int *distances;
+    int ndistances;
+};
+
+typedef struct _virNumaPlacementHost virNumaPlacementHost;
+typedef virNumaPlacementHost *virNumaPlacementHostPtr;
+struct _virNumaPlacementHost {
+    virNumaPlacementNodePtr nodes;
+    size_t nnodes;
+};
+
+typedef struct _virNumaPlacementPins virNumaPlacementPins;
+typedef virNumaPlacementPins *virNumaPlacementPinsPtr;
+
+virNumaPlacementHostPtr virNumaPlacementHostNew(void);
+void virNumaPlacementHostFree(virNumaPlacementHostPtr host);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virNumaPlacementHost, virNumaPlacementHostFree);
+
+int virNumaPlacementHostUpdateLoad(virNumaPlacementHostPtr host);
+
+void virNumaPlacementHostAddPins(virNumaPlacementHostPtr host,
+                                 virNumaPlacementPinsPtr pins,
+                                 const char *skip);
+
+void virNumaPlacementHostReleaseDomain(virNumaPlacementHostPtr host,
+                                       virBitmapPtr nodeset,
+                                       unsigned long long memory);
+
+virBitmapPtr virNumaPlacementAdvise(virNumaPlacementHostPtr host,
+                                    unsigned int vcpus,
+                                    unsigned long long memory);
+
+int virNumaPlacementRecommend(virNumaPlacementHostPtr host,
+                              virBitmapPtr current,
+                              unsigned int vcpus,
+                              unsigned long long memory,
+                              virBitmapPtr *nodeset);
+
+virNumaPlacementPinsPtr virNumaPlacementPinsNew(void);
+
+int virNumaPlacementPinsAdd(virNumaPlacementPinsPtr pins,
+                            const char *id,
+                            virBitmapPtr nodeset,
+                            unsigned int vcpus);
+
+void virNumaPlacementPinsRemove(virNumaPlacementPinsPtr pins,
+                                const char *id);
@@ -38,6 +38,10 @@
 #if HAVE_SCHED_SETSCHEDULER
 # include <sched.h>
 #endif
+#ifdef __linux__
+# include <poll.h>
+# include <sys/socket.h>
+#endif
 
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__) || HAVE_BSD_CPU_AFFINITY
 # include <sys/param.h>
@@ -65,6 +69,8 @@
 #include "virutil.h"
 #include "virstring.h"
 #include "vircommand.h"
+#include "virobject.h"
+#include "virsocket.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -1065,15 +1071,14 @@ struct _virProcessNamespaceHelperData {
     void *opaque;
 };
 
-static int virProcessNamespaceHelper(pid_t pid G_GNUC_UNUSED,
-                                     void *opaque)
+static int
+virProcessEnterMountNamespace(pid_t pid)
 {
-    virProcessNamespaceHelperData *data = opaque;
     int fd = -1;
     int ret = -1;
     g_autofree char *path = NULL;
 
-    path = g_strdup_printf("/proc/%lld/ns/mnt", (long long)data->pid);
+    path = g_strdup_printf("/proc/%lld/ns/mnt", (long long)pid);
 
     if ((fd = open(path, O_RDONLY)) < 0) {
         virReportSystemError(errno, "%s",
@@ -1087,13 +1092,23 @@ static int virProcessNamespaceHelper(pid_t pid G_GNUC_UNUSED,
         goto cleanup;
     }
 
-    ret = data->cb(data->pid, data->opaque);
-
+    ret = 0;
  cleanup:
     VIR_FORCE_CLOSE(fd);
     return ret;
 }
 
+static int virProcessNamespaceHelper(pid_t pid G_GNUC_UNUSED,
+                                     void *opaque)
+{
+    virProcessNamespaceHelperData *data = opaque;
+
+    if (virProcessEnterMountNamespace(data->pid) < 0)
+        return -1;
+
+    return data->cb(data->pid, data->opaque);
+}
+
 /* Run cb(opaque) in the mount namespace of pid.  Return -1 with error
  * message raised if we fail to run the child, if the child dies from
  * a signal, or if the child has status EXIT_CANCELED; otherwise return
@@ -1143,6 +1158,41 @@ typedef union {
     char bindata[sizeof(errorData)];
 } errorDataBin;
 
+static void
+virProcessErrorDataFromError(errorDataBin *bin,
+                             virErrorPtr err)
+{
+    bin->data.code = err->code;
+    bin->data.domain = err->domain;
+    ignore_value(virStrcpy(bin->data.message, err->message, sizeof(bin->data.message)));
+    bin->data.level = err->level;
+    if (err->str1)
+        ignore_value(virStrcpy(bin->data.str1, err->str1, sizeof(bin->data.str1)));
+    if (err->str2)
+        ignore_value(virStrcpy(bin->data.str2, err->str2, sizeof(bin->data.str2)));
+    if (err->str3)
+        ignore_value(virStrcpy(bin->data.str3, err->str3, sizeof(bin->data.str3)));
+    bin->data.int1 = err->int1;
+    bin->data.int2 = err->int2;
+}
+
+
+static void
+virProcessErrorDataRaise(const errorDataBin *bin)
+{
+    virRaiseErrorFull(__FILE__, __FUNCTION__, __LINE__,
+                      bin->data.domain,
+                      bin->data.code,
+                      bin->data.level,
+                      bin->data.str1,
+                      bin->data.str2,
+                      bin->data.str3,
+                      bin->data.int1,
+                      bin->data.int2,
+                      "%s", bin->data.message);
+}
+
+
 static int
 virProcessRunInForkHelper(int errfd,
                           pid_t ppid,
@@ -1155,18 +1205,7 @@ virProcessRunInForkHelper(int errfd,
         if (err) {
             g_autofree errorDataBin *bin = g_new0(errorDataBin, 1);
 
-            bin->data.code = err->code;
-            bin->data.domain = err->domain;
-            ignore_value(virStrcpy(bin->data.message, err->message, sizeof(bin->data.message)));
-            bin->data.level = err->level;
-            if (err->str1)
-                ignore_value(virStrcpy(bin->data.str1, err->str1, sizeof(bin->data.str1)));
-            if (err->str2)
-                ignore_value(virStrcpy(bin->data.str2, err->str2, sizeof(bin->data.str2)));
-            if (err->str3)
-                ignore_value(virStrcpy(bin->data.str3, err->str3, sizeof(bin->data.str3)));
-            bin->data.int1 = err->int1;
-            bin->data.int2 = err->int2;
+            virProcessErrorDataFromError(bin, err);
 
             ignore_value(safewrite(errfd, bin->bindata, sizeof(*bin)));
         }
@@ -1237,16 +1276,7 @@ virProcessRunInFork(virProcessForkCallback cb,
                                    _("child reported (status=%d): %s"),
                                    status, NULLSTR(bin->data.message));
 
-                    virRaiseErrorFull(__FILE__, __FUNCTION__, __LINE__,
-                                      bin->data.domain,
-                                      bin->data.code,
-                                      bin->data.level,
-                                      bin->data.str1,
-                                      bin->data.str2,
-                                      bin->data.str3,
-                                      bin->data.int1,
-                                      bin->data.int2,
-                                      "%s", bin->data.message);
+                    virProcessErrorDataRaise(bin);
                 } else {
                     virReportError(VIR_ERR_INTERNAL_ERROR,
                                    _("child didn't write error (status=%d)"),
@@ -1276,6 +1306,604 @@ virProcessRunInFork(virProcessForkCallback cb G_GNUC_UNUSED,
 #endif /* WIN32 */
 
 
+#if defined(__linux__)
+/*
+ * Entering the mount namespace of a domain through
+ * virProcessRunInMountNamespace() costs a fork() of the whole daemon
+ * and a setns() for every single operation. A namespace helper enters
+ * the mount namespace only once per domain and then serves requests
+ * sent over a socket for as long as the domain runs.
+ *
+ * Helpers are not forked from the daemon itself, which is
+ * multithreaded and whose heap would be kept alive by every helper.
+ * Instead, the daemon forks a zygote by virProcessNSHelperZygoteStart()
+ * early on, before any thread is created or driver module loaded. The
+ * zygote forks the helpers on request. A helper therefore shares code
+ * addresses with the daemon, as long as the code is not part of a
+ * driver module, and a callback can be passed to it by its pointer.
+ * Data has to be serialized by the caller, though.
+ */
+
+# define VIR_PROCESS_NS_HELPER_MAX_REQUEST (16 * 1024 * 1024)
+
+/* How long to wait for a helper to reply, in milliseconds. A helper
+ * stuck for longer is killed. */
+# define VIR_PROCESS_NS_HELPER_TIMEOUT (60 * 1000)
+
+typedef struct {
+    virProcessNamespaceBatchCallback cb;
+    size_t len;
+} virProcessNSHelperRequest;
+
+typedef struct {
+    pid_t pid;      /* of the helper */
+    int ret;
+    bool hasError;
+    errorDataBin err;
+} virProcessNSHelperReply;
+
+struct _virProcessNSHelper {
+    virObjectLockable parent;
+
+    pid_t pid;      /* process whose namespace is served */
+    pid_t child;    /* the helper itself */
+    int fd;
+    bool broken;
+};
+
+static virClassPtr virProcessNSHelperClass;
+
+static virMutex virProcessNSHelperListLock = VIR_MUTEX_INITIALIZER;
+static virProcessNSHelperPtr *virProcessNSHelperList;
+static size_t virProcessNSHelperListCount;
+
+/* Socket to the zygote, requests are serialized by the lock */
+static virMutex virProcessNSHelperZygoteLock = VIR_MUTEX_INITIALIZER;
+static int virProcessNSHelperZygoteFD = -1;
+
+static void virProcessNSHelperDispose(void *obj);
+
+static int
+virProcessNSHelperOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(virProcessNSHelper, virClassForObjectLockable()))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virProcessNSHelper);
+
+
+static void
+virProcessNSHelperDispose(void *obj)
+{
+    virProcessNSHelperPtr helper = obj;
+
+    /* Closing the socket makes the helper leave its loop. There's no
+     * request in flight as nobody holds a reference anymore, and a
+     * helper which timed out was killed already. */
+    VIR_FORCE_CLOSE(helper->fd);
+}
+
+
+/* The helper is not a child of the daemon but of the zygote, which
+ * reaps it. */
+static void
+virProcessNSHelperBreak(virProcessNSHelperPtr helper)
+{
+    helper->broken = true;
+
+    if (helper->child > 0)
+        ignore_value(virProcessKill(helper->child, SIGKILL));
+}
+
+
+static void
+virProcessNSHelperReplyFill(virProcessNSHelperReply *reply,
+                            int ret)
+{
+    virErrorPtr err;
+
+    memset(reply, 0, sizeof(*reply));
+    reply->pid = getpid();
+    reply->ret = ret < 0 ? -1 : ret;
+
+    if (ret < 0 && (err = virGetLastError())) {
+        reply->hasError = true;
+        virProcessErrorDataFromError(&reply->err, err);
+    }
+}
+
+
+/* Drop every FD inherited from the parent but @fd. The zygote and the
+ * helpers live for long and must not keep pipes or sockets of
+ * unrelated objects open. */
+static int
+virProcessNSHelperCloseFDs(int *fd)
+{
+    int keep = STDERR_FILENO + 1;
+    long openmax;
+    int i;
+
+    if (*fd != keep) {
+        if (dup2(*fd, keep) < 0)
+            return -1;
+        VIR_FORCE_CLOSE(*fd);
+        *fd = keep;
+    }
+
+    if (virCloseRange(keep + 1, ~0U) == 0)
+        return 0;
+
+    if ((openmax = sysconf(_SC_OPEN_MAX)) < 0)
+        return -1;
+
+    for (i = keep + 1; i < openmax; i++) {
+        int tmpfd = i;
+        VIR_FORCE_CLOSE(tmpfd);
+    }
+
+    return 0;
+}
+
+
+/* Main loop of the helper. The first reply tells the daemon whether
+ * the namespace was entered successfully, every other one answers a
+ * request. A request is only run once it was read completely. Returns
+ * when the daemon closes its end of the socket. */
+static int
+virProcessNSHelperServe(int fd,
+                        pid_t pid)
+{
+    virProcessNSHelperReply reply;
+
+    if (virProcessEnterMountNamespace(pid) < 0) {
+        virProcessNSHelperReplyFill(&reply, -1);
+        ignore_value(safewrite(fd, &reply, sizeof(reply)));
+        return -1;
+    }
+
+    virProcessNSHelperReplyFill(&reply, 0);
+    if (safewrite(fd, &reply, sizeof(reply)) != sizeof(reply))
+        return -1;
+
+    while (true) {
+        virProcessNSHelperRequest req;
+        g_autofree char *data = NULL;
+        ssize_t got;
+
+        if ((got = saferead(fd, &req, sizeof(req))) != sizeof(req))
+            return got == 0 ? 0 : -1;
+
+        if (req.len > VIR_PROCESS_NS_HELPER_MAX_REQUEST)
+            return -1;
+
+        data = g_new0(char, req.len + 1);
+        if (saferead(fd, data, req.len) != req.len)
+            return -1;
+
+        virProcessNSHelperReplyFill(&reply, req.cb(pid, data, req.len));
+        virResetLastError();
+
+        if (safewrite(fd, &reply, sizeof(reply)) != sizeof(reply))
+            return -1;
+    }
+}
+
+
+/* Main loop of the zygote. Each request is the pid whose namespace
+ * is to be entered followed by the socket the helper serves. Returns
+ * when the daemon goes away. */
+static void
+virProcessNSHelperZygoteServe(int ctl)
+{
+    struct sigaction sa = { .sa_handler = SIG_IGN };
+
+    /* Let the kernel reap the helpers */
+    ignore_value(sigaction(SIGCHLD, &sa, NULL));
+
+    while (true) {
+        pid_t pid;
+        pid_t child;
+        int fd;
+
+        if (saferead(ctl, &pid, sizeof(pid)) != sizeof(pid) ||
+            (fd = virSocketRecvFD(ctl, 0)) < 0)
+            return;
+
+        if ((child = virFork()) < 0) {
+            virProcessNSHelperReply reply;
+
+            virProcessNSHelperReplyFill(&reply, -1);
+            reply.pid = 0;
+            ignore_value(safewrite(fd, &reply, sizeof(reply)));
+            virResetLastError();
+        } else if (child == 0) {
+            int ret;
+
+            VIR_FORCE_CLOSE(ctl);
+            if (virProcessNSHelperCloseFDs(&fd) < 0)
+                _exit(EXIT_CANCELED);
+
+            ret = virProcessNSHelperServe(fd, pid);
+            _exit(ret < 0 ? EXIT_CANCELED : 0);
+        }
+
+        VIR_FORCE_CLOSE(fd);
+    }
+}
+
+
+/**
+ * virProcessNSHelperZygoteStart:
+ *
+ * Forks the process which forks namespace helpers later on. It must be
+ * called by the daemon before it creates any thread or loads any
+ * driver module. The zygote exits once the daemon does.
+ *
+ * Returns 0 on success, -1 with error reported otherwise.
+ */
+int
+virProcessNSHelperZygoteStart(void)
+{
+    int pair[2] = { -1, -1 };
+    pid_t child;
+
+    if (virProcessNSHelperZygoteFD >= 0)
+        return 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create socket pair"));
+        return -1;
+    }
+
+    if (virSetCloseExec(pair[0]) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set close-on-exec flag"));
+        goto error;
+    }
+
+    if ((child = virFork()) < 0)
+        goto error;
+
+    if (child == 0) {
+        VIR_FORCE_CLOSE(pair[0]);
+        if (virProcessNSHelperCloseFDs(&pair[1]) < 0)
+            _exit(EXIT_CANCELED);
+
+        virProcessNSHelperZygoteServe(pair[1]);
+        _exit(0);
+    }
+
+    VIR_FORCE_CLOSE(pair[1]);
+    virProcessNSHelperZygoteFD = pair[0];
+
+    VIR_DEBUG("Started namespace helper zygote %lld", (long long)child);
+
+    return 0;
+
+ error:
+    VIR_FORCE_CLOSE(pair[0]);
+    VIR_FORCE_CLOSE(pair[1]);
+    return -1;
+}
+
+
+/**
+ * virProcessNSHelperAvailable:
+ *
+ * Returns true if namespace helpers can be started.
+ */
+bool
+virProcessNSHelperAvailable(void)
+{
+    return virProcessNSHelperZygoteFD >= 0;
+}
+
+
+/* Returns -1 with error reported and the helper killed if it can't be
+ * talked to anymore or didn't reply in time, otherwise the value
+ * returned by the callback or -1 with the error it reported. */
+static int
+virProcessNSHelperReadReply(virProcessNSHelperPtr helper)
+{
+    struct pollfd pfd = { .fd = helper->fd, .events = POLLIN };
+    virProcessNSHelperReply reply;
+    ssize_t got = -1;
+    int rc;
+
+    while ((rc = poll(&pfd, 1, VIR_PROCESS_NS_HELPER_TIMEOUT)) < 0 &&
+           errno == EINTR)
+        ;
+
+    if (rc == 0) {
+        virReportError(VIR_ERR_OPERATION_TIMEOUT,
+                       _("Namespace helper of process %lld didn't reply in time"),
+                       (long long)helper->pid);
+        virProcessNSHelperBreak(helper);
+        return -1;
+    }
+
+    /* Not a system error, callers fall back to the host namespace on
+     * those, which would run the request for the second time. */
+    if (rc < 0 ||
+        (got = saferead(helper->fd, &reply, sizeof(reply))) != sizeof(reply)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to read reply from namespace helper of process %lld: %s"),
+                       (long long)helper->pid,
+                       got < 0 ? g_strerror(errno) : _("unexpected end of data"));
+        virProcessNSHelperBreak(helper);
+        return -1;
+    }
+
+    if (helper->child == 0)
+        helper->child = reply.pid;
+
+    if (reply.ret < 0) {
+        if (reply.hasError)
+            virProcessErrorDataRaise(&reply.err);
+        else
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("namespace helper didn't report error"));
+        return -1;
+    }
+
+    return reply.ret;
+}
+
+
+/**
+ * virProcessNSHelperNew:
+ * @pid: process to enter the mount namespace of
+ *
+ * Starts a helper which enters the mount namespace of @pid and stays
+ * there serving virProcessRunInMountNamespaceBatch() requests for
+ * @pid until virProcessNSHelperFree() is called. The helper is forked
+ * by the zygote, see virProcessNSHelperZygoteStart().
+ *
+ * Returns the helper on success, NULL with error reported otherwise.
+ */
+virProcessNSHelperPtr
+virProcessNSHelperNew(pid_t pid)
+{
+    virProcessNSHelperPtr helper = NULL;
+    int pair[2] = { -1, -1 };
+
+    if (virProcessNSHelperInitialize() < 0)
+        return NULL;
+
+    if (!(helper = virObjectLockableNew(virProcessNSHelperClass)))
+        return NULL;
+
+    helper->pid = pid;
+    helper->fd = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create socket pair"));
+        goto error;
+    }
+
+    if (virSetCloseExec(pair[0]) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set close-on-exec flag"));
+        goto error;
+    }
+
+    virMutexLock(&virProcessNSHelperZygoteLock);
+    if (virProcessNSHelperZygoteFD < 0) {
+        virMutexUnlock(&virProcessNSHelperZygoteLock);
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("namespace helpers are not available"));
+        goto error;
+    }
+
+    if (safewrite(virProcessNSHelperZygoteFD, &pid, sizeof(pid)) != sizeof(pid) ||
+        virSocketSendFD(virProcessNSHelperZygoteFD, pair[1]) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to send request to namespace helper zygote"));
+        /* Don't leave the next request misaligned */
+        VIR_FORCE_CLOSE(virProcessNSHelperZygoteFD);
+        virMutexUnlock(&virProcessNSHelperZygoteLock);
+        goto error;
+    }
+    virMutexUnlock(&virProcessNSHelperZygoteLock);
+
+    VIR_FORCE_CLOSE(pair[1]);
+    helper->fd = pair[0];
+    pair[0] = -1;
+
+    if (virProcessNSHelperReadReply(helper) < 0)
+        goto error;
+
+    virMutexLock(&virProcessNSHelperListLock);
+    if (VIR_APPEND_ELEMENT_COPY(virProcessNSHelperList,
+                                virProcessNSHelperListCount, helper) < 0) {
+        virMutexUnlock(&virProcessNSHelperListLock);
+        goto error;
+    }
+    virMutexUnlock(&virProcessNSHelperListLock);
+
+    VIR_DEBUG("Started namespace helper %lld for process %lld",
+              (long long)helper->child, (long long)pid);
+
+    return helper;
+
+ error:
+    VIR_FORCE_CLOSE(pair[0]);
+    VIR_FORCE_CLOSE(pair[1]);
+    virObjectUnref(helper);
+    return NULL;
+}
+
+
+/**
+ * virProcessNSHelperFree:
+ * @helper: namespace helper
+ *
+ * Stops serving requests through @helper and terminates it. Requests
+ * which are already in flight finish first.
+ */
+void
+virProcessNSHelperFree(virProcessNSHelperPtr helper)
+{
+    size_t i;
+
+    if (!helper)
+        return;
+
+    virMutexLock(&virProcessNSHelperListLock);
+    for (i = 0; i < virProcessNSHelperListCount; i++) {
+        if (virProcessNSHelperList[i] == helper) {
+            VIR_DELETE_ELEMENT(virProcessNSHelperList, i,
+                               virProcessNSHelperListCount);
+            break;
+        }
+    }
+    virMutexUnlock(&virProcessNSHelperListLock);
+
+    virObjectUnref(helper);
+}
+
+
+static virProcessNSHelperPtr
+virProcessNSHelperLookup(pid_t pid)
+{
+    virProcessNSHelperPtr ret = NULL;
+    size_t i;
+
+    virMutexLock(&virProcessNSHelperListLock);
+    for (i = 0; i < virProcessNSHelperListCount; i++) {
+        if (virProcessNSHelperList[i]->pid == pid) {
+            ret = virObjectRef(virProcessNSHelperList[i]);
+            break;
+        }
+    }
+    virMutexUnlock(&virProcessNSHelperListLock);
+
+    return ret;
+}
+
+
+/* Returns -2 if the request was not handed over, see
+ * virProcessRunInMountNamespaceBatch(). */
+static int
+virProcessNSHelperCall(virProcessNSHelperPtr helper,
+                       virProcessNamespaceBatchCallback cb,
+                       const char *data,
+                       size_t len)
+{
+    virProcessNSHelperRequest req = { .cb = cb, .len = len };
+
+    if (helper->broken)
+        return -2;
+
+    if (safewrite(helper->fd, &req, sizeof(req)) != sizeof(req) ||
+        safewrite(helper->fd, data, len) != len) {
+        /* The helper runs complete requests only, and it is killed
+         * before it could read the rest of this one. */
+        VIR_WARN("Unable to send request to namespace helper of process %lld: %s",
+                 (long long)helper->pid, g_strerror(errno));
+        virProcessNSHelperBreak(helper);
+        return -2;
+    }
+
+    /* Once sent, the request must not be run again by the caller,
+     * the callback might not be idempotent. */
+    return virProcessNSHelperReadReply(helper);
+}
+
+
+/**
+ * virProcessRunInMountNamespaceBatch:
+ * @pid: process to run @cb in the mount namespace of
+ * @cb: callback to run
+ * @data: serialized operations for @cb
+ * @len: length of @data
+ *
+ * Run @cb(@data) in the mount namespace of @pid through the namespace
+ * helper started for @pid. @cb must not be part of a driver module,
+ * see virProcessNSHelperZygoteStart().
+ *
+ * Returns -2 without error reported if no helper serves @pid or the
+ * request could not be handed over to it, in which case @cb was not
+ * run and the caller should fall back to
+ * virProcessRunInMountNamespace(). Otherwise -1 with error reported on
+ * failure or the value returned by @cb.
+ */
+int
+virProcessRunInMountNamespaceBatch(pid_t pid,
+                                   virProcessNamespaceBatchCallback cb,
+                                   const char *data,
+                                   size_t len)
+{
+    virProcessNSHelperPtr helper;
+    int rc;
+
+    if (len > VIR_PROCESS_NS_HELPER_MAX_REQUEST) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("namespace request too large: %zu bytes"), len);
+        return -1;
+    }
+
+    if (!(helper = virProcessNSHelperLookup(pid)))
+        return -2;
+
+    virObjectLock(helper);
+    rc = virProcessNSHelperCall(helper, cb, data, len);
+    virObjectUnlock(helper);
+    virObjectUnref(helper);
+
+    return rc;
+}
+
+#else /* ! __linux__ */
+
+int
+virProcessNSHelperZygoteStart(void)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Namespaces are not supported on this platform"));
+    return -1;
+}
+
+
+bool
+virProcessNSHelperAvailable(void)
+{
+    return false;
+}
+
+
+virProcessNSHelperPtr
+virProcessNSHelperNew(pid_t pid G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Namespaces are not supported on this platform"));
+    return NULL;
+}
+
+
+void
+virProcessNSHelperFree(virProcessNSHelperPtr helper G_GNUC_UNUSED)
+{
+}
+
+
+int
+virProcessRunInMountNamespaceBatch(pid_t pid G_GNUC_UNUSED,
+                                   virProcessNamespaceBatchCallback cb G_GNUC_UNUSED,
+                                   const char *data G_GNUC_UNUSED,
+                                   size_t len G_GNUC_UNUSED)
+{
+    return -2;
+}
+
+#endif /* ! __linux__ */
+
+
 #if defined(__linux__)
 int
 virProcessSetupPrivateMountNS(void)
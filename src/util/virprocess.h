@@ -92,6 +92,29 @@ int virProcessRunInMountNamespace(pid_t pid,
                                   virProcessNamespaceCallback cb,
                                   void *opaque);
 
+/* Callback to run a batch of operations serialized into @data within
+ * the mount namespace tied to the given pid.  It is run by a long
+ * lived namespace helper which doesn't share any data with the
+ * daemon, so it must not rely on anything but @data.  A negative
+ * return value means an error was reported.  */
+typedef int (*virProcessNamespaceBatchCallback)(pid_t pid,
+                                                const char *data,
+                                                size_t len);
+
+typedef struct _virProcessNSHelper virProcessNSHelper;
+typedef virProcessNSHelper *virProcessNSHelperPtr;
+
+int virProcessNSHelperZygoteStart(void);
+bool virProcessNSHelperAvailable(void);
+
+virProcessNSHelperPtr virProcessNSHelperNew(pid_t pid);
+void virProcessNSHelperFree(virProcessNSHelperPtr helper);
+
+int virProcessRunInMountNamespaceBatch(pid_t pid,
+                                       virProcessNamespaceBatchCallback cb,
+                                       const char *data,
+                                       size_t len);
+
 /**
  * virProcessForkCallback:
  * @ppid: parent's pid
@@ -0,0 +1,224 @@
+/*
+ * virpsi.c: helper APIs for pressure stall information
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virpsi.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.psi");
+
+#define PROC_PRESSURE_PATH "/proc/pressure"
+
+VIR_ENUM_IMPL(virPSIResource,
+              VIR_PSI_RESOURCE_LAST,
+              "cpu", "memory", "io",
+);
+
+
+/*
+ * Parses one line of a pressure file after the "some"/"full" keyword:
+ *
+ *   avg10=0.12 avg60=0.05 avg300=0.01 total=123456
+ */
+static int
+virPSIParseLine(const char *str,
+                virPSILinePtr line)
+{
+    char *end;
+
+    if (!(str = STRSKIP(str, "avg10=")) ||
+        virStrToDouble(str, &end, &line->avg10) < 0 ||
+        !(str = STRSKIP(end, " avg60=")) ||
+        virStrToDouble(str, &end, &line->avg60) < 0 ||
+        !(str = STRSKIP(end, " avg300=")) ||
+        virStrToDouble(str, &end, &line->avg300) < 0 ||
+        !(str = STRSKIP(end, " total=")) ||
+        virStrToLong_ull(str, &end, 10, &line->total) < 0)
+        return -1;
+
+    /* the kernel reports microseconds */
+    line->total *= 1000;
+
+    return 0;
+}
+
+
+/**
+ * virPSIParse:
+ * @str: contents of a pressure file
+ * @stats: filled with the parsed values
+ *
+ * Parses the contents of a pressure stall information file, either the host
+ * wide /proc/pressure/<resource> or a cgroup v2 <resource>.pressure one.
+ * Lines not known to this function are ignored.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virPSIParse(const char *str,
+            virPSIStatsPtr stats)
+{
+    VIR_AUTOSTRINGLIST lines = NULL;
+    bool haveSome = false;
+    size_t i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    if (!(lines = virStringSplit(str, "\n", 0)))
+        return -1;
+
+    for (i = 0; lines[i]; i++) {
+        const char *tmp;
+        virPSILinePtr line = NULL;
+
+        if ((tmp = STRSKIP(lines[i], "some "))) {
+            line = &stats->some;
+            haveSome = true;
+        } else if ((tmp = STRSKIP(lines[i], "full "))) {
+            line = &stats->full;
+        } else {
+            continue;
+        }
+
+        if (virPSIParseLine(tmp, line) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to parse pressure stall line '%s'"),
+                           lines[i]);
+            return -1;
+        }
+    }
+
+    if (!haveSome) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Missing 'some' line in pressure stall data '%s'"),
+                       str);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virPSIGetHostStats:
+ * @resource: resource to query
+ * @stats: filled with the host wide pressure of @resource
+ *
+ * Returns 0 on success, -2 if the host kernel does not provide pressure
+ * stall information (no error is reported in that case), -1 on error.
+ */
+int
+virPSIGetHostStats(virPSIResource resource,
+                   virPSIStatsPtr stats)
+{
+    g_autofree char *str = NULL;
+    int rc;
+
+    if ((rc = virFileReadValueString(&str, PROC_PRESSURE_PATH "/%s",
+                                     virPSIResourceTypeToString(resource))) < 0)
+        return rc;
+
+    return virPSIParse(str, stats);
+}
+
+
+/**
+ * virPSIAddParams:
+ * @list: typed parameter list to append to
+ * @stats: pressure stall information to add
+ * @prefix: prefix of the parameter names, e.g. "cpu"
+ *
+ * Adds the "<prefix>.some.*" and "<prefix>.full.*" parameters describing
+ * @stats to @list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virPSIAddParams(virTypedParamListPtr list,
+                const virPSIStats *stats,
+                const char *prefix)
+{
+    if (virTypedParamListAddDouble(list, stats->some.avg10,
+                                   "%s.some.avg10", prefix) < 0 ||
+        virTypedParamListAddDouble(list, stats->some.avg60,
+                                   "%s.some.avg60", prefix) < 0 ||
+        virTypedParamListAddDouble(list, stats->some.avg300,
+                                   "%s.some.avg300", prefix) < 0 ||
+        virTypedParamListAddULLong(list, stats->some.total,
+                                   "%s.some.total", prefix) < 0 ||
+        virTypedParamListAddDouble(list, stats->full.avg10,
+                                   "%s.full.avg10", prefix) < 0 ||
+        virTypedParamListAddDouble(list, stats->full.avg60,
+                                   "%s.full.avg60", prefix) < 0 ||
+        virTypedParamListAddDouble(list, stats->full.avg300,
+                                   "%s.full.avg300", prefix) < 0 ||
+        virTypedParamListAddULLong(list, stats->full.total,
+                                   "%s.full.total", prefix) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virPSIGetHostParams:
+ * @params: filled with the host wide pressure stall information
+ * @nparams: filled with the number of items in @params
+ *
+ * Reports the pressure of all resources the host kernel provides pressure
+ * stall information for as "<resource>.some.*" and "<resource>.full.*"
+ * typed parameters. The caller must free @params.
+ *
+ * Returns 0 on success, -1 on error or if the host provides no pressure
+ * stall information at all.
+ */
+int
+virPSIGetHostParams(virTypedParameterPtr *params,
+                    int *nparams)
+{
+    g_autoptr(virTypedParamList) list = g_new0(virTypedParamList, 1);
+    size_t i;
+
+    for (i = 0; i < VIR_PSI_RESOURCE_LAST; i++) {
+        virPSIStats stats;
+        int rc;
+
+        if ((rc = virPSIGetHostStats(i, &stats)) == -2)
+            continue;
+
+        if (rc < 0 ||
+            virPSIAddParams(list, &stats, virPSIResourceTypeToString(i)) < 0)
+            return -1;
+    }
+
+    if (list->npar == 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("pressure stall information is not available "
+                         "on this host"));
+        return -1;
+    }
+
+    *nparams = virTypedParamListStealParams(list, params);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * virpsi.h: helper APIs for pressure stall information
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "virenum.h"
+#include "virtypedparam.h"
+
+typedef enum {
+    VIR_PSI_RESOURCE_CPU,
+    VIR_PSI_RESOURCE_MEMORY,
+    VIR_PSI_RESOURCE_IO,
+
+    VIR_PSI_RESOURCE_LAST
+} virPSIResource;
+
+VIR_ENUM_DECL(virPSIResource);
+
+typedef struct _virPSILine virPSILine;
+typedef virPSILine *virPSILinePtr;
+struct _virPSILine {
+    /* share of wall time stalled over the last 10, 60 and 300 seconds,
+     * in percent */
+    double avg10;
+    double avg60;
+    double avg300;
+    /* cumulative stall time in nanoseconds */
+    unsigned long long total;
+};
+
+typedef struct _virPSIStats virPSIStats;
+typedef virPSIStats *virPSIStatsPtr;
+struct _virPSIStats {
+    /* at least one task stalled on the resource */
+    virPSILine some;
+    /* all non-idle tasks stalled on the resource, all zero if the kernel
+     * does not report it (e.g. CPU pressure before Linux 5.13) */
+    virPSILine full;
+};
+
+int virPSIParse(const char *str,
+                virPSIStatsPtr stats);
+
+int virPSIGetHostStats(virPSIResource resource,
+                       virPSIStatsPtr stats);
+
+int virPSIAddParams(virTypedParamListPtr list,
+                    const virPSIStats *stats,
+                    const char *prefix);
+
+int virPSIGetHostParams(virTypedParameterPtr *params,
+                        int *nparams);
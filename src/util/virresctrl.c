@@ -2497,6 +2497,414 @@ virResctrlAllocRemove(virResctrlAllocPtr alloc)
 }
 
 
+
+/* Resizing of existing allocations
+ *
+ * The sizes and bandwidths stored in virResctrlAlloc are what was requested
+ * for the allocation and they are used as the lower bound when it is being
+ * resized.  The current state of the group is always read from its schemata
+ * file so that it survives daemon restarts. */
+static virResctrlAllocPerTypePtr
+virResctrlAllocLookupType(virResctrlAllocPtr alloc,
+                          unsigned int level,
+                          virCacheType type)
+{
+    if (level >= alloc->nlevels || !alloc->levels[level])
+        return NULL;
+
+    return alloc->levels[level]->types[type];
+}
+
+
+static virBitmapPtr
+virResctrlAllocLookupMask(virResctrlAllocPtr alloc,
+                          unsigned int level,
+                          virCacheType type,
+                          unsigned int cache)
+{
+    virResctrlAllocPerTypePtr a_type = virResctrlAllocLookupType(alloc, level, type);
+
+    if (!a_type || cache >= a_type->nmasks)
+        return NULL;
+
+    return a_type->masks[cache];
+}
+
+
+static virResctrlInfoPerTypePtr
+virResctrlInfoLookupType(virResctrlInfoPtr resctrl,
+                         unsigned int level,
+                         virCacheType type)
+{
+    virResctrlInfoPerTypePtr i_type = NULL;
+
+    if (level < resctrl->nlevels && resctrl->levels[level])
+        i_type = resctrl->levels[level]->types[type];
+
+    if (!i_type) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Cache level %d does not support tuning for "
+                         "scope type '%s'"),
+                       level, virCacheTypeToString(type));
+    }
+
+    return i_type;
+}
+
+
+/* Reads the allocation of the group of @alloc currently set in the kernel */
+static virResctrlAllocPtr
+virResctrlAllocGetCurrent(virResctrlInfoPtr resctrl,
+                          virResctrlAllocPtr alloc)
+{
+    virResctrlAllocPtr ret = NULL;
+    g_autofree char *group = NULL;
+    int rv;
+
+    if (!alloc->path || STREQ(alloc->path, SYSFS_RESCTRL_PATH)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Resctrl allocation '%s' has no group to resize"),
+                       NULLSTR(alloc->id));
+        return NULL;
+    }
+
+    group = g_path_get_basename(alloc->path);
+
+    rv = virResctrlAllocGetGroup(resctrl, group, &ret);
+    if (rv == -2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Could not read schemata file for group %s"),
+                       group);
+    }
+
+    return ret;
+}
+
+
+/*
+ * Prepares resizing of the cache allocation of @alloc for @level, @type and
+ * @cache by @delta granules.  The allocation is kept between the size
+ * requested in @alloc and @max percent of the cache.  In order for the group
+ * not to lose what it has in the cache it is only resized in place, it can
+ * only grow into unused space adjacent to it.
+ *
+ * Returns 1 and fills @update with an allocation containing just the new mask
+ * if it should be changed, 0 if there is nothing to change (the cache is not
+ * allocated explicitly, the allocation is at its limits or there is no room
+ * for it to grow) and -1 on error.
+ */
+int
+virResctrlAllocPrepareCacheResize(virResctrlInfoPtr resctrl,
+                                  virResctrlAllocPtr alloc,
+                                  unsigned int level,
+                                  virCacheType type,
+                                  unsigned int cache,
+                                  int delta,
+                                  unsigned int max,
+                                  virResctrlAllocPtr *update)
+{
+    virResctrlAllocPerTypePtr a_type = virResctrlAllocLookupType(alloc, level, type);
+    virResctrlInfoPerTypePtr i_type = NULL;
+    g_autoptr(virResctrlAlloc) current = NULL;
+    g_autoptr(virResctrlAlloc) unused = NULL;
+    g_autoptr(virResctrlAlloc) ret = NULL;
+    g_autoptr(virBitmap) mask = NULL;
+    virBitmapPtr cur_mask = NULL;
+    virBitmapPtr free_mask = NULL;
+    ssize_t cur_start;
+    ssize_t run_start;
+    ssize_t run_end;
+    ssize_t cur_bits;
+    ssize_t min_bits;
+    ssize_t max_bits;
+    ssize_t bits;
+    ssize_t start;
+    ssize_t i;
+
+    *update = NULL;
+
+    if (!a_type || cache >= a_type->nsizes || !a_type->sizes[cache])
+        return 0;
+
+    if (!(i_type = virResctrlInfoLookupType(resctrl, level, type)))
+        return -1;
+
+    if (!(current = virResctrlAllocGetCurrent(resctrl, alloc)) ||
+        !(unused = virResctrlAllocGetUnused(resctrl)))
+        return -1;
+
+    cur_mask = virResctrlAllocLookupMask(current, level, type, cache);
+    free_mask = virResctrlAllocLookupMask(unused, level, type, cache);
+
+    if (!cur_mask || !free_mask ||
+        (cur_start = virBitmapNextSetBit(cur_mask, -1)) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Missing allocation of cache level %u id %u "
+                         "scope type '%s' in group '%s'"),
+                       level, cache, virCacheTypeToString(type),
+                       alloc->path);
+        return -1;
+    }
+
+    cur_bits = virBitmapCountBits(cur_mask);
+    min_bits = MAX(*a_type->sizes[cache] / i_type->control.granularity,
+                   i_type->min_cbm_bits);
+    max_bits = MIN(i_type->bits * max / 100, i_type->bits - 1);
+    max_bits = MAX(max_bits, min_bits);
+
+    bits = MIN(MAX(cur_bits + delta, min_bits), max_bits);
+    if (bits == cur_bits)
+        return 0;
+
+    if (virBitmapUnion(free_mask, cur_mask) < 0)
+        return -1;
+
+    run_start = cur_start;
+    while (run_start > 0 && virBitmapIsBitSet(free_mask, run_start - 1))
+        run_start--;
+
+    run_end = virBitmapNextClearBit(free_mask, cur_start);
+    if (run_end < 0 || run_end > i_type->bits)
+        run_end = i_type->bits;
+
+    if (run_end - run_start < bits) {
+        VIR_DEBUG("No room to grow cache level %u id %u of group '%s' "
+                  "to %zd bits", level, cache, alloc->path, bits);
+        return 0;
+    }
+
+    start = MIN(cur_start, run_end - bits);
+
+    if (!(mask = virBitmapNew(i_type->bits)))
+        return -1;
+
+    for (i = start; i < start + bits; i++)
+        ignore_value(virBitmapSetBit(mask, i));
+
+    if (!(ret = virResctrlAllocNew()) ||
+        virResctrlAllocUpdateMask(ret, level, type, cache, mask) < 0)
+        return -1;
+
+    *update = g_steal_pointer(&ret);
+    return 1;
+}
+
+
+/*
+ * Prepares changing the memory bandwidth limit of @alloc for node @id by
+ * @delta steps of the bandwidth granularity.  The limit is kept between the
+ * bandwidth requested in @alloc and 100 percent.
+ *
+ * Returns 1 and fills @update with an allocation containing just the new
+ * limit if it should be changed, 0 if there is nothing to change and -1 on
+ * error.
+ */
+int
+virResctrlAllocPrepareMemoryBandwidthResize(virResctrlInfoPtr resctrl,
+                                            virResctrlAllocPtr alloc,
+                                            unsigned int id,
+                                            int delta,
+                                            virResctrlAllocPtr *update)
+{
+    virResctrlAllocMemBWPtr a_membw = alloc->mem_bw;
+    virResctrlInfoMemBWPtr i_membw = resctrl->membw_info;
+    g_autoptr(virResctrlAlloc) current = NULL;
+    g_autoptr(virResctrlAlloc) ret = NULL;
+    int cur;
+    int min;
+    int bandwidth;
+
+    *update = NULL;
+
+    if (!a_membw || id >= a_membw->nbandwidths || !a_membw->bandwidths[id])
+        return 0;
+
+    if (!i_membw) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("RDT Memory Bandwidth allocation unsupported"));
+        return -1;
+    }
+
+    if (!(current = virResctrlAllocGetCurrent(resctrl, alloc)))
+        return -1;
+
+    if (!current->mem_bw || id >= current->mem_bw->nbandwidths ||
+        !current->mem_bw->bandwidths[id]) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Missing memory bandwidth allocation of node %u "
+                         "in group '%s'"),
+                       id, alloc->path);
+        return -1;
+    }
+
+    cur = *current->mem_bw->bandwidths[id];
+    min = MAX(*a_membw->bandwidths[id], i_membw->min_bandwidth);
+    bandwidth = cur + delta * (int) i_membw->bandwidth_granularity;
+    bandwidth = MIN(MAX(bandwidth, min), 100);
+
+    if (bandwidth == cur)
+        return 0;
+
+    if (!(ret = virResctrlAllocNew()) ||
+        virResctrlAllocSetMemoryBandwidth(ret, id, bandwidth) < 0)
+        return -1;
+
+    *update = g_steal_pointer(&ret);
+    return 1;
+}
+
+
+static int
+virResctrlAllocWriteUpdate(virResctrlAllocPtr alloc,
+                           virResctrlAllocPtr update)
+{
+    g_autofree char *schemata_path = NULL;
+    g_autofree char *update_str = NULL;
+
+    if (!(update_str = virResctrlAllocFormat(update)))
+        return -1;
+
+    schemata_path = g_strdup_printf("%s/schemata", alloc->path);
+
+    /* The kernel only changes the entries which are written */
+    VIR_DEBUG("Writing resctrl schemata '%s' into '%s'",
+              update_str, schemata_path);
+    if (virFileWriteStr(schemata_path, update_str, 0) < 0) {
+        virReportSystemError(errno,
+                             _("Cannot write into schemata file '%s'"),
+                             schemata_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Resizes the allocation of @alloc for @level, @type and @cache by @delta
+ * granules, see virResctrlAllocPrepareCacheResize().
+ *
+ * Returns 1 if the allocation was changed, 0 if not, -1 on error. */
+int
+virResctrlAllocResizeCache(virResctrlInfoPtr resctrl,
+                           virResctrlAllocPtr alloc,
+                           unsigned int level,
+                           virCacheType type,
+                           unsigned int cache,
+                           int delta,
+                           unsigned int max)
+{
+    g_autoptr(virResctrlAlloc) update = NULL;
+    int lockfd = -1;
+    int ret = -1;
+
+    if ((lockfd = virResctrlLockWrite()) < 0)
+        return -1;
+
+    if ((ret = virResctrlAllocPrepareCacheResize(resctrl, alloc, level, type,
+                                                 cache, delta, max,
+                                                 &update)) <= 0)
+        goto cleanup;
+
+    if (virResctrlAllocWriteUpdate(alloc, update) < 0 ||
+        virResctrlAllocCopyMasks(alloc, update) < 0)
+        ret = -1;
+
+ cleanup:
+    virResctrlUnlock(lockfd);
+    return ret;
+}
+
+
+/* Changes the memory bandwidth limit of @alloc for node @id by @delta steps,
+ * see virResctrlAllocPrepareMemoryBandwidthResize().
+ *
+ * Returns 1 if the limit was changed, 0 if not, -1 on error. */
+int
+virResctrlAllocResizeMemoryBandwidth(virResctrlInfoPtr resctrl,
+                                     virResctrlAllocPtr alloc,
+                                     unsigned int id,
+                                     int delta)
+{
+    g_autoptr(virResctrlAlloc) update = NULL;
+    int lockfd = -1;
+    int ret = -1;
+
+    if ((lockfd = virResctrlLockWrite()) < 0)
+        return -1;
+
+    if ((ret = virResctrlAllocPrepareMemoryBandwidthResize(resctrl, alloc, id,
+                                                           delta, &update)) <= 0)
+        goto cleanup;
+
+    if (virResctrlAllocWriteUpdate(alloc, update) < 0)
+        ret = -1;
+
+ cleanup:
+    virResctrlUnlock(lockfd);
+    return ret;
+}
+
+
+/* Reads the size of the cache allocation of @alloc for @level, @type and
+ * @cache currently set in the kernel. */
+int
+virResctrlAllocGetCurrentCacheSize(virResctrlInfoPtr resctrl,
+                                   virResctrlAllocPtr alloc,
+                                   unsigned int level,
+                                   virCacheType type,
+                                   unsigned int cache,
+                                   unsigned long long *size)
+{
+    virResctrlInfoPerTypePtr i_type = NULL;
+    g_autoptr(virResctrlAlloc) current = NULL;
+    virBitmapPtr mask = NULL;
+
+    if (!(i_type = virResctrlInfoLookupType(resctrl, level, type)))
+        return -1;
+
+    if (!(current = virResctrlAllocGetCurrent(resctrl, alloc)))
+        return -1;
+
+    if (!(mask = virResctrlAllocLookupMask(current, level, type, cache))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Missing allocation of cache level %u id %u "
+                         "scope type '%s' in group '%s'"),
+                       level, cache, virCacheTypeToString(type),
+                       alloc->path);
+        return -1;
+    }
+
+    *size = virBitmapCountBits(mask) * i_type->control.granularity;
+    return 0;
+}
+
+
+/* Reads the memory bandwidth limit of @alloc for node @id currently set in
+ * the kernel. */
+int
+virResctrlAllocGetCurrentMemoryBandwidth(virResctrlInfoPtr resctrl,
+                                         virResctrlAllocPtr alloc,
+                                         unsigned int id,
+                                         unsigned int *bandwidth)
+{
+    g_autoptr(virResctrlAlloc) current = NULL;
+
+    if (!(current = virResctrlAllocGetCurrent(resctrl, alloc)))
+        return -1;
+
+    if (!current->mem_bw || id >= current->mem_bw->nbandwidths ||
+        !current->mem_bw->bandwidths[id]) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Missing memory bandwidth allocation of node %u "
+                         "in group '%s'"),
+                       id, alloc->path);
+        return -1;
+    }
+
+    *bandwidth = *current->mem_bw->bandwidths[id];
+    return 0;
+}
+
 /* virResctrlMonitor-related definitions */
 
 virResctrlMonitorPtr
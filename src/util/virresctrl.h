@@ -180,6 +180,35 @@ virResctrlAllocAddPID(virResctrlAllocPtr alloc,
 int
 virResctrlAllocRemove(virResctrlAllocPtr alloc);
 
+int
+virResctrlAllocResizeCache(virResctrlInfoPtr resctrl,
+                           virResctrlAllocPtr alloc,
+                           unsigned int level,
+                           virCacheType type,
+                           unsigned int cache,
+                           int delta,
+                           unsigned int max);
+
+int
+virResctrlAllocResizeMemoryBandwidth(virResctrlInfoPtr resctrl,
+                                     virResctrlAllocPtr alloc,
+                                     unsigned int id,
+                                     int delta);
+
+int
+virResctrlAllocGetCurrentCacheSize(virResctrlInfoPtr resctrl,
+                                   virResctrlAllocPtr alloc,
+                                   unsigned int level,
+                                   virCacheType type,
+                                   unsigned int cache,
+                                   unsigned long long *size);
+
+int
+virResctrlAllocGetCurrentMemoryBandwidth(virResctrlInfoPtr resctrl,
+                                         virResctrlAllocPtr alloc,
+                                         unsigned int id,
+                                         unsigned int *bandwidth);
+
 void
 virResctrlInfoMonFree(virResctrlInfoMonPtr mon);
 
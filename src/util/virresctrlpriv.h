@@ -26,3 +26,20 @@
 
 virResctrlAllocPtr
 virResctrlAllocGetUnused(virResctrlInfoPtr resctrl);
+
+int
+virResctrlAllocPrepareCacheResize(virResctrlInfoPtr resctrl,
+                                  virResctrlAllocPtr alloc,
+                                  unsigned int level,
+                                  virCacheType type,
+                                  unsigned int cache,
+                                  int delta,
+                                  unsigned int max,
+                                  virResctrlAllocPtr *update);
+
+int
+virResctrlAllocPrepareMemoryBandwidthResize(virResctrlInfoPtr resctrl,
+                                            virResctrlAllocPtr alloc,
+                                            unsigned int id,
+                                            int delta,
+                                            virResctrlAllocPtr *update);
@@ -75,6 +75,11 @@ struct virOnceControl {
         .lock = PTHREAD_MUTEX_INITIALIZER \
     }
 
+#define VIR_RWLOCK_INITIALIZER \
+    { \
+        .lock = PTHREAD_RWLOCK_INITIALIZER \
+    }
+
 #define VIR_ONCE_CONTROL_INITIALIZER \
     { \
         .once = PTHREAD_ONCE_INIT \
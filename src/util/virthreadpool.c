@@ -26,9 +26,12 @@
 #include "viralloc.h"
 #include "virthread.h"
 #include "virerror.h"
+#include "virlog.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+VIR_LOG_INIT("util.threadpool");
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 typedef virThreadPoolJob *virThreadPoolJobPtr;
 
@@ -483,3 +486,133 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
     virMutexUnlock(&pool->mutex);
     return -1;
 }
+
+
+typedef struct _virThreadPoolParallelData virThreadPoolParallelData;
+typedef virThreadPoolParallelData *virThreadPoolParallelDataPtr;
+struct _virThreadPoolParallelData {
+    virMutex lock;
+    size_t nitems;
+    size_t next; /* index of the next item to be processed */
+    bool stopOnError;
+    virErrorPtr err; /* error of the failed item with the lowest index */
+    size_t erridx;
+
+    virThreadPoolParallelFunc func;
+    void *opaque;
+};
+
+
+static void
+virThreadPoolParallelWorker(void *opaque)
+{
+    virThreadPoolParallelDataPtr data = opaque;
+
+    while (1) {
+        size_t i;
+
+        virMutexLock(&data->lock);
+        if (data->stopOnError && data->err)
+            i = data->nitems;
+        else
+            i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->nitems)
+            break;
+
+        if (data->func(i, data->opaque) < 0) {
+            virMutexLock(&data->lock);
+            if (!data->err || i < data->erridx) {
+                virFreeError(data->err);
+                data->err = virSaveLastError();
+                data->erridx = i;
+            }
+            virMutexUnlock(&data->lock);
+        }
+    }
+}
+
+
+/**
+ * virThreadPoolRunParallel:
+ * @nitems: number of items to process
+ * @maxWorkers: maximum number of threads processing the items
+ * @name: name of the worker threads
+ * @func: function processing a single item
+ * @opaque: opaque data passed to @func
+ * @flags: bitwise-OR of virThreadPoolParallelFlags
+ *
+ * Calls @func for each item from 0 to @nitems - 1 from up to @maxWorkers
+ * threads, the calling one included, and waits for all of them to finish.
+ * This is meant for operations which mostly wait for I/O or other
+ * processes, so that a long list of them finishes sooner. The items are
+ * not processed in any particular order; @func is responsible for
+ * locking any data shared between items.
+ *
+ * If a thread can't be started, the remaining threads process its items.
+ * With VIR_THREAD_POOL_PARALLEL_STOP_ON_ERROR no more items are started
+ * once an item failed; items which were not started are not reported in
+ * any way, @func has to track them itself if the caller needs to know.
+ *
+ * Returns 0 if all items succeeded, -1 otherwise with the error of the
+ * failed item with the lowest index set.
+ */
+int
+virThreadPoolRunParallel(size_t nitems,
+                         size_t maxWorkers,
+                         const char *name,
+                         virThreadPoolParallelFunc func,
+                         void *opaque,
+                         unsigned int flags)
+{
+    virThreadPoolParallelData data = {
+        .nitems = nitems,
+        .stopOnError = !!(flags & VIR_THREAD_POOL_PARALLEL_STOP_ON_ERROR),
+        .func = func,
+        .opaque = opaque,
+    };
+    g_autofree virThread *workers = NULL;
+    size_t nworkers = MIN(nitems, maxWorkers);
+    size_t nstarted = 0;
+    size_t i;
+
+    virCheckFlags(VIR_THREAD_POOL_PARALLEL_STOP_ON_ERROR, -1);
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        return -1;
+    }
+
+    /* The calling thread processes items too */
+    if (nworkers > 1)
+        workers = g_new0(virThread, nworkers - 1);
+
+    for (nstarted = 0; nstarted + 1 < nworkers; nstarted++) {
+        if (virThreadCreateFull(&workers[nstarted], true,
+                                virThreadPoolParallelWorker,
+                                name, false, &data) < 0) {
+            /* Not fatal, the remaining threads pick up the work */
+            VIR_WARN("Failed to start %s thread: %s",
+                     name, virGetLastErrorMessage());
+            virResetLastError();
+            break;
+        }
+    }
+
+    virThreadPoolParallelWorker(&data);
+
+    for (i = 0; i < nstarted; i++)
+        virThreadJoin(&workers[i]);
+
+    virMutexDestroy(&data.lock);
+
+    if (data.err) {
+        virSetError(data.err);
+        virFreeError(data.err);
+        return -1;
+    }
+
+    return 0;
+}
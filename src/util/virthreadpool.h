@@ -56,3 +56,25 @@ int virThreadPoolSetParameters(virThreadPoolPtr pool,
                                long long int minWorkers,
                                long long int maxWorkers,
                                long long int prioWorkers);
+
+typedef enum {
+    VIR_THREAD_POOL_PARALLEL_STOP_ON_ERROR = 1 << 0,
+} virThreadPoolParallelFlags;
+
+/**
+ * virThreadPoolParallelFunc:
+ * @item: index of the item to process
+ * @opaque: opaque data
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise, with error reported.
+ */
+typedef int (*virThreadPoolParallelFunc)(size_t item,
+                                         void *opaque);
+
+int virThreadPoolRunParallel(size_t nitems,
+                             size_t maxWorkers,
+                             const char *name,
+                             virThreadPoolParallelFunc func,
+                             void *opaque,
+                             unsigned int flags) ATTRIBUTE_NONNULL(4);
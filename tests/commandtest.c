@@ -1300,6 +1300,96 @@ test28(const void *unused G_GNUC_UNUSED)
 }
 
 
+/*
+ * Run program, no args, inherit all ENV, keep CWD.
+ * stdin/out/err + extra FD open in the parent, none passed.
+ * The extra FD must not leak into the child.
+ */
+static int test29(const void *unused G_GNUC_UNUSED)
+{
+    g_autoptr(virCommand) cmd = virCommandNew(abs_builddir "/commandhelper");
+    int newfd = dup(STDERR_FILENO);
+    int ret = -1;
+
+    if (newfd < 0) {
+        perror("dup");
+        return -1;
+    }
+
+    if (virCommandRun(cmd, NULL) < 0) {
+        printf("Cannot run child %s\n", virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if (fcntl(newfd, F_GETFL) < 0) {
+        puts("extra fd is not open anymore");
+        goto cleanup;
+    }
+
+    ret = checkoutput("test2", NULL);
+
+ cleanup:
+    VIR_FORCE_CLOSE(newfd);
+    return ret;
+}
+
+
+static int
+test30Hook(void *opaque G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+
+# define TEST30_RUNS 200
+
+static int
+test30RunLoop(bool hook,
+              unsigned long long *duration)
+{
+    unsigned long long start = g_get_monotonic_time();
+    size_t i;
+
+    for (i = 0; i < TEST30_RUNS; i++) {
+        g_autoptr(virCommand) cmd = virCommandNew("true");
+        int status;
+
+        /* a pre-exec hook has to run in the child, which requires fork */
+        if (hook)
+            virCommandSetPreExecHook(cmd, test30Hook, NULL);
+
+        if (virCommandRun(cmd, &status) < 0 || status != 0) {
+            printf("Cannot run child %s\n", virGetLastErrorMessage());
+            return -1;
+        }
+    }
+
+    *duration = g_get_monotonic_time() - start;
+    return 0;
+}
+
+
+/*
+ * Compare the time needed to run a trivial program, with and without
+ * the need to fork the test process.
+ */
+static int
+test30(const void *unused G_GNUC_UNUSED)
+{
+    unsigned long long spawnTime;
+    unsigned long long forkTime;
+
+    if (test30RunLoop(false, &spawnTime) < 0 ||
+        test30RunLoop(true, &forkTime) < 0)
+        return -1;
+
+    VIR_TEST_DEBUG("%d runs: %llu us without fork, %llu us with fork",
+                   TEST30_RUNS, spawnTime, forkTime);
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -1398,6 +1488,8 @@ mymain(void)
     DO_TEST(test26);
     DO_TEST(test27);
     DO_TEST(test28);
+    DO_TEST(test29);
+    DO_TEST(test30);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
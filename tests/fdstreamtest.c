@@ -19,6 +19,7 @@
 #include <config.h>
 
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include "testutils.h"
 
@@ -310,6 +311,120 @@ static int testFDStreamWriteNonblock(const void *data)
     return testFDStreamWriteCommon(data, false);
 }
 
+
+/* Aborting a stream backed by a worker thread must stop the worker
+ * in the middle of the transfer. */
+static int testFDStreamAbortCommon(const char *scratchdir, bool doRead)
+{
+    int fd = -1;
+    char *file = NULL;
+    int ret = -1;
+    char *pattern = NULL;
+    virStreamPtr st = NULL;
+    size_t i;
+    virConnectPtr conn = NULL;
+    struct stat sb;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (VIR_ALLOC_N(pattern, PATTERN_LEN) < 0)
+        goto cleanup;
+
+    for (i = 0; i < PATTERN_LEN; i++)
+        pattern[i] = i;
+
+    file = g_strdup_printf("%s/abort.data", scratchdir);
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        goto cleanup;
+
+    if (doRead) {
+        /* far more than the pipe to the worker can hold */
+        if ((fd = open(file, O_CREAT|O_WRONLY|O_EXCL, 0600)) < 0)
+            goto cleanup;
+
+        for (i = 0; i < 16 * 1024; i++) {
+            if (safewrite(fd, pattern, PATTERN_LEN) != PATTERN_LEN)
+                goto cleanup;
+        }
+
+        if (VIR_CLOSE(fd) < 0)
+            goto cleanup;
+
+        if (virFDStreamOpenFile(st, file, 0, 0, O_RDONLY) < 0)
+            goto cleanup;
+
+        while (true) {
+            int got = st->driver->streamRecv(st, pattern, PATTERN_LEN);
+
+            if (got == -2) {
+                g_usleep(20 * 1000);
+                continue;
+            }
+            if (got <= 0) {
+                fprintf(stderr, "Failed to read stream: %s\n",
+                        virGetLastErrorMessage());
+                goto cleanup;
+            }
+            break;
+        }
+    } else {
+        if (virFDStreamCreateFile(st, file, 0, 0, O_WRONLY, 0600) < 0)
+            goto cleanup;
+
+        for (i = 0; i < 10; i++) {
+            int got;
+
+            while ((got = st->driver->streamSend(st, pattern,
+                                                 PATTERN_LEN)) == -2)
+                g_usleep(20 * 1000);
+
+            if (got != PATTERN_LEN) {
+                fprintf(stderr, "Failed to write stream: %s\n",
+                        virGetLastErrorMessage());
+                goto cleanup;
+            }
+        }
+    }
+
+    if (st->driver->streamAbort(st) != 0) {
+        fprintf(stderr, "Failed to abort stream: %s\n",
+                virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    /* nothing but what was sent may end up in the file */
+    if (!doRead &&
+        (stat(file, &sb) < 0 || sb.st_size > PATTERN_LEN * 10)) {
+        fprintf(stderr, "Unexpected size of the written file\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    VIR_FORCE_CLOSE(fd);
+    if (file != NULL)
+        unlink(file);
+    if (conn)
+        virConnectClose(conn);
+    VIR_FREE(file);
+    VIR_FREE(pattern);
+    return ret;
+}
+
+
+static int testFDStreamReadAbort(const void *data)
+{
+    return testFDStreamAbortCommon(data, true);
+}
+static int testFDStreamWriteAbort(const void *data)
+{
+    return testFDStreamAbortCommon(data, false);
+}
+
 #define SCRATCHDIRTEMPLATE abs_builddir "/fdstreamdir-XXXXXX"
 
 static int
@@ -331,6 +446,10 @@ mymain(void)
         ret = -1;
     if (virTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
+    if (virTestRun("Stream read abort ", testFDStreamReadAbort, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Stream write abort ", testFDStreamWriteAbort, scratchdir) < 0)
+        ret = -1;
 
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
@@ -25,6 +25,7 @@
 #include "nwfilter/nwfilter_ebiptables_driver.h"
 #include "virbuffer.h"
 #include "virfirewall.h"
+#include "virthreadpool.h"
 
 #define LIBVIRT_VIRFIREWALLPRIV_H_ALLOW
 #include "virfirewallpriv.h"
@@ -496,6 +497,131 @@ testNWFilterEBIPTablesApplyDropAllRules(const void *opaque G_GNUC_UNUSED)
     return ret;
 }
 
+/*
+ * Rebuilding the filters of many interfaces, with the time spent in
+ * each run of the tools simulated by the dry run callback. The rules
+ * of different interfaces are applied concurrently when the daemon is
+ * configured with more than one instantiate worker.
+ */
+#define TEST_BENCH_IFACES 64
+#define TEST_BENCH_COMMAND_USEC 100
+
+struct testBenchData {
+    virMutex lock;
+    virCond cond;
+    size_t ncommands;
+    size_t nfailed;
+    size_t ndone;
+};
+
+static void
+testBenchDryRun(const char *const*args G_GNUC_UNUSED,
+                const char *const*env G_GNUC_UNUSED,
+                const char *input G_GNUC_UNUSED,
+                char **output G_GNUC_UNUSED,
+                char **error G_GNUC_UNUSED,
+                int *status G_GNUC_UNUSED,
+                void *opaque)
+{
+    struct testBenchData *data = opaque;
+
+    virMutexLock(&data->lock);
+    data->ncommands++;
+    virMutexUnlock(&data->lock);
+
+    g_usleep(TEST_BENCH_COMMAND_USEC);
+}
+
+
+static void
+testBenchWorker(void *jobdata, void *opaque)
+{
+    char *ifname = jobdata;
+    struct testBenchData *data = opaque;
+
+    bool failed = ebiptables_driver.tearOldRules(ifname) < 0 ||
+                  ebiptables_driver.allTeardown(ifname) < 0;
+
+    virMutexLock(&data->lock);
+    if (failed)
+        data->nfailed++;
+    data->ndone++;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+
+    VIR_FREE(ifname);
+}
+
+
+static int
+testNWFilterEBIPTablesBenchRebuild(const void *opaque)
+{
+    size_t workers = *(const size_t *)opaque;
+    struct testBenchData data = { 0 };
+    virThreadPoolPtr pool = NULL;
+    unsigned long long start;
+    size_t expected;
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    /* the commands needed by a single interface */
+    virCommandSetDryRun(NULL, testBenchDryRun, &data);
+    if (ebiptables_driver.tearOldRules("vnet0") < 0 ||
+        ebiptables_driver.allTeardown("vnet0") < 0)
+        goto cleanup;
+    expected = data.ncommands * TEST_BENCH_IFACES;
+    data.ncommands = 0;
+
+    if (!(pool = virThreadPoolNew(0, workers, 0, testBenchWorker, &data)))
+        goto cleanup;
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < TEST_BENCH_IFACES; i++) {
+        char *ifname = g_strdup_printf("vnet%zu", i);
+
+        if (virThreadPoolSendJob(pool, 0, ifname) < 0) {
+            VIR_FREE(ifname);
+            goto cleanup;
+        }
+    }
+
+    virMutexLock(&data.lock);
+    while (data.ndone < TEST_BENCH_IFACES)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    virMutexUnlock(&data.lock);
+
+    VIR_TEST_DEBUG("%d interfaces, %zu workers: %llu ms",
+                   TEST_BENCH_IFACES, workers,
+                   (g_get_monotonic_time() - start) / 1000);
+
+    if (data.nfailed > 0) {
+        VIR_TEST_DEBUG("%zu interfaces failed", data.nfailed);
+        goto cleanup;
+    }
+
+    if (data.ncommands != expected) {
+        VIR_TEST_DEBUG("expected %zu commands, got %zu",
+                       expected, data.ncommands);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virThreadPoolFree(pool);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
 static bool
 hasNetfilterTools(void)
 {
@@ -509,6 +635,8 @@ static int
 mymain(void)
 {
     int ret = 0;
+    size_t workers[] = { 1, 8 };
+    size_t i;
 
     virFirewallSetLockOverride(true);
 
@@ -556,6 +684,15 @@ mymain(void)
                    NULL) < 0)
         ret = -1;
 
+    for (i = 0; i < G_N_ELEMENTS(workers); i++) {
+        g_autofree char *name = g_strdup_printf("ebiptablesBenchRebuild workers=%zu",
+                                                workers[i]);
+
+        if (virTestRun(name, testNWFilterEBIPTablesBenchRebuild,
+                       &workers[i]) < 0)
+            ret = -1;
+    }
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,29 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+#include "virnetdev.h"
+
+int
+virNetDevValidateConfig(const char *ifname G_GNUC_UNUSED,
+                        const virMacAddr *macaddr G_GNUC_UNUSED,
+                        int ifindex G_GNUC_UNUSED)
+{
+    /* the interfaces of the tests don't exist, but never go away */
+    return 1;
+}
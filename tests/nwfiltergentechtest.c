@@ -0,0 +1,287 @@
+/*
+ * nwfiltergentechtest.c: Test which interfaces get their rules rebuilt
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#if defined(__linux__)
+
+# include "nwfilter/nwfilter_ebiptables_driver.h"
+# include "nwfilter/nwfilter_learnipaddr.h"
+# define LIBVIRT_NWFILTER_GENTECH_DRIVERPRIV_H_ALLOW
+# include "nwfilter/nwfilter_gentech_driverpriv.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Interfaces the test technology driver applied new rules to */
+static virBuffer applied = VIR_BUFFER_INITIALIZER;
+
+static int
+testApplyNewRules(const char *ifname,
+                  virNWFilterRuleInstPtr *rules G_GNUC_UNUSED,
+                  size_t nrules G_GNUC_UNUSED)
+{
+    virBufferAsprintf(&applied, "%s\n", ifname);
+    return 0;
+}
+
+static int
+testTeardown(const char *ifname G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+static int
+testApplyBasicRules(const char *ifname G_GNUC_UNUSED,
+                    const virMacAddr *macaddr G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+static int
+testApplyDHCPOnlyRules(const char *ifname G_GNUC_UNUSED,
+                       const virMacAddr *macaddr G_GNUC_UNUSED,
+                       virNWFilterVarValuePtr dhcpsrvs G_GNUC_UNUSED,
+                       bool leaveTemporary G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+static virNWFilterTechDriver testDriver = {
+    .name = "test",
+    .flags = TECHDRV_FLAG_INITIALIZED,
+
+    .applyNewRules = testApplyNewRules,
+    .tearNewRules = testTeardown,
+    .tearOldRules = testTeardown,
+    .allTeardown = testTeardown,
+
+    .applyBasicRules = testApplyBasicRules,
+    .applyDHCPOnlyRules = testApplyDHCPOnlyRules,
+    .applyDropAllRules = testTeardown,
+};
+
+static const virMacAddr testMac = { { 0x52, 0x54, 0x00, 0x00, 0x00, 0x01 } };
+
+# define TEST_FILTER(srcmac) \
+    "<filter name='test' chain='root'>" \
+    "  <rule action='accept' direction='out' priority='500'>" \
+    "    <mac srcmacaddr='" srcmac "'/>" \
+    "  </rule>" \
+    "</filter>"
+
+static virNWFilterDefPtr filterOld;
+static virNWFilterDefPtr filterNew;
+
+
+/* Instantiates the single rule of @filter on @ifname. If @update is true,
+ * a filter was changed and the new rules are left pending, otherwise they
+ * are applied right away. */
+static int
+testApply(const char *ifname,
+          virNWFilterDefPtr filter,
+          bool update)
+{
+    virNWFilterRuleInst rule = {
+        .chainSuffix = filter->chainsuffix,
+        .chainPriority = filter->chainPriority,
+        .def = filter->filterEntries[0]->rule,
+        .priority = filter->filterEntries[0]->rule->priority,
+    };
+    virNWFilterRuleInstPtr rules[] = { &rule };
+    virNWFilterInst inst = { .rules = rules, .nrules = 1 };
+    bool foundNewFilter = true;
+    int ret;
+
+    if (!(rule.vars = virNWFilterHashTableCreate(0)))
+        return -1;
+
+    ret = virNWFilterInstApply(&testDriver, ifname, -1, &inst,
+                               update ? INSTANTIATE_FOLLOW_NEWFILTER :
+                                        INSTANTIATE_ALWAYS,
+                               &foundNewFilter, !update, NULL);
+
+    virHashFree(rule.vars);
+    return ret;
+}
+
+
+static int
+testCheckApplied(const char *expect)
+{
+    g_autofree char *actual = virBufferContentAndReset(&applied);
+
+    if (STRNEQ_NULLABLE(actual, expect)) {
+        VIR_TEST_DEBUG("expected rules applied to '%s', got '%s'",
+                       NULLSTR(expect), NULLSTR(actual));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testUpdateUnchanged(const void *opaque G_GNUC_UNUSED)
+{
+    if (testApply("vnet0", filterOld, false) < 0 ||
+        testApply("vnet1", filterOld, false) < 0 ||
+        testCheckApplied("vnet0\nvnet1\n") < 0)
+        return -1;
+
+    /* only the rules of vnet0 are affected by the update */
+    if (testApply("vnet0", filterNew, true) < 0 ||
+        testApply("vnet1", filterOld, true) < 0 ||
+        testCheckApplied("vnet0\n") < 0)
+        return -1;
+
+    virNWFilterAppliedRulesSwitch("vnet0", true);
+    virNWFilterAppliedRulesSwitch("vnet1", true);
+
+    if (testApply("vnet0", filterNew, true) < 0 ||
+        testApply("vnet1", filterOld, true) < 0 ||
+        testCheckApplied(NULL) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testUpdateRollback(const void *opaque G_GNUC_UNUSED)
+{
+    if (testApply("vnet2", filterOld, false) < 0 ||
+        testApply("vnet2", filterNew, true) < 0 ||
+        testCheckApplied("vnet2\nvnet2\n") < 0)
+        return -1;
+
+    /* the old rules stay active */
+    virNWFilterAppliedRulesSwitch("vnet2", false);
+
+    if (testApply("vnet2", filterOld, true) < 0 ||
+        testCheckApplied(NULL) < 0)
+        return -1;
+
+    /* but the new ones are still to be applied */
+    if (testApply("vnet2", filterNew, true) < 0 ||
+        testCheckApplied("vnet2\n") < 0)
+        return -1;
+
+    return 0;
+}
+
+
+typedef int (*testInstallFunc)(const char *ifname);
+
+static int
+testInstallBasic(const char *ifname)
+{
+    return virNWFilterInstallBasicRules(&testDriver, ifname, &testMac);
+}
+
+static int
+testInstallDHCPOnly(const char *ifname)
+{
+    return virNWFilterInstallDHCPOnlyRules(&testDriver, ifname, &testMac,
+                                           NULL, false);
+}
+
+static int
+testInstallDropAll(const char *ifname)
+{
+    return virNWFilterInstallDropAllRules(&testDriver, ifname);
+}
+
+
+/* The rules installed while learning the IP address of an interface
+ * replace the ones of its filter, which must then be rebuilt by the next
+ * update even if the filter rules did not change. */
+static int
+testLearnInvalidates(const void *opaque)
+{
+    testInstallFunc install = opaque;
+
+    if (testApply("vnet3", filterOld, false) < 0 ||
+        testApply("vnet3", filterOld, true) < 0 ||
+        testCheckApplied("vnet3\n") < 0)
+        return -1;
+
+    if (install("vnet3") < 0)
+        return -1;
+
+    if (testApply("vnet3", filterOld, true) < 0 ||
+        testCheckApplied("vnet3\n") < 0)
+        return -1;
+
+    virNWFilterAppliedRulesSwitch("vnet3", true);
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virNWFilterTechDriversInit(false, EBIPTABLES_DRIVER_ID, 1) < 0 ||
+        virNWFilterLearnInit() < 0)
+        return EXIT_FAILURE;
+
+    if (!(filterOld = virNWFilterDefParseString(TEST_FILTER("52:54:00:00:00:01"))) ||
+        !(filterNew = virNWFilterDefParseString(TEST_FILTER("52:54:00:00:00:02")))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virTestRun("update unchanged", testUpdateUnchanged, NULL) < 0)
+        ret = -1;
+    if (virTestRun("update rollback", testUpdateRollback, NULL) < 0)
+        ret = -1;
+    if (virTestRun("learn basic rules", testLearnInvalidates,
+                   testInstallBasic) < 0)
+        ret = -1;
+    if (virTestRun("snoop DHCP only rules", testLearnInvalidates,
+                   testInstallDHCPOnly) < 0)
+        ret = -1;
+    if (virTestRun("learn drop all rules", testLearnInvalidates,
+                   testInstallDropAll) < 0)
+        ret = -1;
+
+ cleanup:
+    virNWFilterDefFree(filterOld);
+    virNWFilterDefFree(filterNew);
+    virBufferFreeAndReset(&applied);
+    virNWFilterLearnShutdown();
+    virNWFilterTechDriversShutdown();
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("nwfiltergentech"))
+
+#else /* ! defined (__linux__) */
+
+int main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* ! defined (__linux__) */
@@ -0,0 +1,455 @@
+/*
+ * nwfilternftablestest.c: Test nftables rule generation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "nwfilter/nwfilter_nftables_driver.h"
+#include "virbuffer.h"
+
+#define LIBVIRT_VIRCOMMANDPRIV_H_ALLOW
+#include "vircommandpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define T "bridge libvirt-nwfilter "
+
+/* what 'nft list chains bridge' reports for an interface that has an
+ * active filter and a new one that was not committed yet */
+static const char *listChains =
+    "table bridge libvirt-nwfilter {\n"
+    "\tchain prerouting {\n"
+    "\t\ttype filter hook prerouting priority -300; policy accept;\n"
+    "\t}\n"
+    "\tchain l2-in-vnet0 {\n\t}\n"
+    "\tchain l2-out-vnet0 {\n\t}\n"
+    "\tchain fwd-in-vnet0 {\n\t}\n"
+    "\tchain fwd-out-vnet0 {\n\t}\n"
+    "\tchain host-in-vnet0 {\n\t}\n"
+    "\tchain libvirt-I-vnet0 {\n\t}\n"
+    "\tchain I-vnet0/arp {\n\t}\n"
+    "\tchain libvirt-O-vnet0 {\n\t}\n"
+    "\tchain FI-vnet0 {\n\t}\n"
+    "\tchain FO-vnet0 {\n\t}\n"
+    "\tchain HI-vnet0 {\n\t}\n"
+    "\tchain libvirt-J-vnet0 {\n\t}\n"
+    "\tchain J-vnet0/arp {\n\t}\n"
+    "\tchain libvirt-P-vnet0 {\n\t}\n"
+    "\tchain FJ-vnet0 {\n\t}\n"
+    "\tchain FP-vnet0 {\n\t}\n"
+    "\tchain HJ-vnet0 {\n\t}\n"
+    "\tchain l2-in-vnet01 {\n\t}\n"
+    "\tchain libvirt-I-vnet01 {\n\t}\n"
+    "}\n"
+    "table bridge filter {\n"
+    "\tchain libvirt-I-vnet0 {\n\t}\n"
+    "}\n";
+
+#define VIR_NWFILTER_LIST \
+    "nft list chains bridge\n" \
+    "nft -f -\n"
+
+#define VIR_NWFILTER_BASE_CHAINS \
+    "add table " T "\n" \
+    "add map " T "l2-in { type ifname : verdict; }\n" \
+    "add map " T "l2-out { type ifname : verdict; }\n" \
+    "add map " T "fwd-in { type ifname : verdict; }\n" \
+    "add map " T "fwd-out { type ifname : verdict; }\n" \
+    "add map " T "host-in { type ifname : verdict; }\n" \
+    "add chain " T "prerouting { type filter hook prerouting priority -300; policy accept; }\n" \
+    "add chain " T "input { type filter hook input priority 0; policy accept; }\n" \
+    "add chain " T "forward { type filter hook forward priority 0; policy accept; }\n" \
+    "add chain " T "postrouting { type filter hook postrouting priority 300; policy accept; }\n" \
+    "flush chain " T "prerouting\n" \
+    "add rule " T "prerouting iifname vmap @l2-in\n" \
+    "flush chain " T "input\n" \
+    "add rule " T "input iifname vmap @host-in\n" \
+    "flush chain " T "forward\n" \
+    "add rule " T "forward iifname vmap @fwd-in\n" \
+    "add rule " T "forward oifname vmap @fwd-out\n" \
+    "flush chain " T "postrouting\n" \
+    "add rule " T "postrouting oifname vmap @l2-out\n"
+
+#define VIR_NWFILTER_DISPATCH_PREPARE(map) \
+    "add chain " T map "-vnet0\n" \
+    "add element " T map " { \"vnet0\" : jump " map "-vnet0 }\n" \
+    "flush chain " T map "-vnet0\n"
+
+#define VIR_NWFILTER_DISPATCH_FLUSH \
+    "flush chain " T "l2-in-vnet0\n" \
+    "flush chain " T "l2-out-vnet0\n" \
+    "flush chain " T "fwd-in-vnet0\n" \
+    "flush chain " T "fwd-out-vnet0\n" \
+    "flush chain " T "host-in-vnet0\n"
+
+#define VIR_NWFILTER_ACTIVE_REMOVE \
+    "flush chain " T "libvirt-I-vnet0\n" \
+    "flush chain " T "I-vnet0/arp\n" \
+    "flush chain " T "libvirt-O-vnet0\n" \
+    "flush chain " T "FI-vnet0\n" \
+    "flush chain " T "FO-vnet0\n" \
+    "flush chain " T "HI-vnet0\n" \
+    "delete chain " T "libvirt-I-vnet0\n" \
+    "delete chain " T "I-vnet0/arp\n" \
+    "delete chain " T "libvirt-O-vnet0\n" \
+    "delete chain " T "FI-vnet0\n" \
+    "delete chain " T "FO-vnet0\n" \
+    "delete chain " T "HI-vnet0\n"
+
+#define VIR_NWFILTER_STAGED_REMOVE \
+    "flush chain " T "libvirt-J-vnet0\n" \
+    "flush chain " T "J-vnet0/arp\n" \
+    "flush chain " T "libvirt-P-vnet0\n" \
+    "flush chain " T "FJ-vnet0\n" \
+    "flush chain " T "FP-vnet0\n" \
+    "flush chain " T "HJ-vnet0\n" \
+    "delete chain " T "libvirt-J-vnet0\n" \
+    "delete chain " T "J-vnet0/arp\n" \
+    "delete chain " T "libvirt-P-vnet0\n" \
+    "delete chain " T "FJ-vnet0\n" \
+    "delete chain " T "FP-vnet0\n" \
+    "delete chain " T "HJ-vnet0\n"
+
+#define VIR_NWFILTER_BASIC_PREPARE(in, out) \
+    VIR_NWFILTER_LIST \
+    VIR_NWFILTER_BASE_CHAINS \
+    VIR_NWFILTER_DISPATCH_PREPARE("l2-in") \
+    VIR_NWFILTER_DISPATCH_PREPARE("l2-out") \
+    VIR_NWFILTER_DISPATCH_PREPARE("fwd-in") \
+    VIR_NWFILTER_DISPATCH_PREPARE("fwd-out") \
+    VIR_NWFILTER_DISPATCH_PREPARE("host-in") \
+    VIR_NWFILTER_STAGED_REMOVE \
+    VIR_NWFILTER_ACTIVE_REMOVE \
+    "add chain " T in "\n" \
+    "add rule " T "l2-in-vnet0 jump " in "\n" \
+    "add chain " T out "\n" \
+    "add rule " T "l2-out-vnet0 jump " out "\n"
+
+
+static void
+testNWFilterNFTablesDryRun(const char *const*args G_GNUC_UNUSED,
+                           const char *const*env G_GNUC_UNUSED,
+                           const char *input,
+                           char **output,
+                           char **error G_GNUC_UNUSED,
+                           int *status G_GNUC_UNUSED,
+                           void *opaque)
+{
+    virBufferPtr buf = opaque;
+
+    if (input)
+        virBufferAdd(buf, input, -1);
+
+    if (output)
+        *output = g_strdup(listChains);
+}
+
+
+static int
+testNWFilterNFTablesCompare(virBufferPtr buf,
+                            const char *expected)
+{
+    g_autofree char *actual = virBufferContentAndReset(buf);
+
+    virTestClearCommandPath(actual);
+
+    if (STRNEQ_NULLABLE(actual, expected)) {
+        virTestDifference(stderr, expected, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testNWFilterNFTablesAllTeardown(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    const char *expected =
+        VIR_NWFILTER_LIST
+        "add element " T "l2-in { \"vnet0\" : jump l2-in-vnet0 }\n"
+        "delete element " T "l2-in { \"vnet0\" }\n"
+        "add element " T "l2-out { \"vnet0\" : jump l2-out-vnet0 }\n"
+        "delete element " T "l2-out { \"vnet0\" }\n"
+        "add element " T "fwd-in { \"vnet0\" : jump fwd-in-vnet0 }\n"
+        "delete element " T "fwd-in { \"vnet0\" }\n"
+        "add element " T "fwd-out { \"vnet0\" : jump fwd-out-vnet0 }\n"
+        "delete element " T "fwd-out { \"vnet0\" }\n"
+        "add element " T "host-in { \"vnet0\" : jump host-in-vnet0 }\n"
+        "delete element " T "host-in { \"vnet0\" }\n"
+        VIR_NWFILTER_DISPATCH_FLUSH
+        VIR_NWFILTER_ACTIVE_REMOVE
+        VIR_NWFILTER_STAGED_REMOVE
+        "delete chain " T "l2-in-vnet0\n"
+        "delete chain " T "l2-out-vnet0\n"
+        "delete chain " T "fwd-in-vnet0\n"
+        "delete chain " T "fwd-out-vnet0\n"
+        "delete chain " T "host-in-vnet0\n";
+    int ret;
+
+    virCommandSetDryRun(&buf, testNWFilterNFTablesDryRun, &buf);
+
+    if ((ret = nftables_driver.allTeardown("vnet0")) == 0)
+        ret = testNWFilterNFTablesCompare(&buf, expected);
+
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesTearOldRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    const char *expected =
+        VIR_NWFILTER_LIST
+        VIR_NWFILTER_ACTIVE_REMOVE
+        "rename chain " T "libvirt-J-vnet0 libvirt-I-vnet0\n"
+        "rename chain " T "J-vnet0/arp I-vnet0/arp\n"
+        "rename chain " T "libvirt-P-vnet0 libvirt-O-vnet0\n"
+        "rename chain " T "FJ-vnet0 FI-vnet0\n"
+        "rename chain " T "FP-vnet0 FO-vnet0\n"
+        "rename chain " T "HJ-vnet0 HI-vnet0\n";
+    int ret;
+
+    virCommandSetDryRun(&buf, testNWFilterNFTablesDryRun, &buf);
+
+    if ((ret = nftables_driver.tearOldRules("vnet0")) == 0)
+        ret = testNWFilterNFTablesCompare(&buf, expected);
+
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesTearNewRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    const char *expected =
+        VIR_NWFILTER_LIST
+        VIR_NWFILTER_DISPATCH_FLUSH
+        "add rule " T "l2-in-vnet0 jump libvirt-I-vnet0\n"
+        "add rule " T "l2-out-vnet0 jump libvirt-O-vnet0\n"
+        "add rule " T "fwd-in-vnet0 jump FI-vnet0\n"
+        "add rule " T "fwd-out-vnet0 jump FO-vnet0\n"
+        "add rule " T "host-in-vnet0 jump HI-vnet0\n"
+        VIR_NWFILTER_STAGED_REMOVE;
+    int ret;
+
+    virCommandSetDryRun(&buf, testNWFilterNFTablesDryRun, &buf);
+
+    if ((ret = nftables_driver.tearNewRules("vnet0")) == 0)
+        ret = testNWFilterNFTablesCompare(&buf, expected);
+
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesApplyBasicRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    const char *expected =
+        VIR_NWFILTER_BASIC_PREPARE("libvirt-I-vnet0", "libvirt-O-vnet0")
+        "add rule " T "libvirt-I-vnet0 ether saddr != 10:20:30:40:50:60 drop\n"
+        "add rule " T "libvirt-I-vnet0 ether type ip accept\n"
+        "add rule " T "libvirt-I-vnet0 ether type arp accept\n"
+        "add rule " T "libvirt-I-vnet0 drop\n";
+    virMacAddr mac = { .addr = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 } };
+    int ret;
+
+    virCommandSetDryRun(&buf, testNWFilterNFTablesDryRun, &buf);
+
+    if ((ret = nftables_driver.applyBasicRules("vnet0", &mac)) == 0)
+        ret = testNWFilterNFTablesCompare(&buf, expected);
+
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesApplyDHCPOnlyRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    const char *expected =
+        VIR_NWFILTER_BASIC_PREPARE("libvirt-J-vnet0", "libvirt-P-vnet0")
+        "add rule " T "libvirt-J-vnet0 ether saddr 10:20:30:40:50:60 ether type ip ip protocol udp th sport 68 th dport 67 accept\n"
+        "add rule " T "libvirt-J-vnet0 drop\n"
+        "add rule " T "libvirt-P-vnet0 ether daddr 10:20:30:40:50:60 ether type ip ip protocol udp ip saddr 192.168.122.1 th sport 67 th dport 68 accept\n"
+        "add rule " T "libvirt-P-vnet0 ether daddr ff:ff:ff:ff:ff:ff ether type ip ip protocol udp ip saddr 192.168.122.1 th sport 67 th dport 68 accept\n"
+        "add rule " T "libvirt-P-vnet0 ether daddr 10:20:30:40:50:60 ether type ip ip protocol udp ip saddr 10.0.0.1 th sport 67 th dport 68 accept\n"
+        "add rule " T "libvirt-P-vnet0 ether daddr ff:ff:ff:ff:ff:ff ether type ip ip protocol udp ip saddr 10.0.0.1 th sport 67 th dport 68 accept\n"
+        "add rule " T "libvirt-P-vnet0 ether daddr 10:20:30:40:50:60 ether type ip ip protocol udp ip saddr 10.0.0.2 th sport 67 th dport 68 accept\n"
+        "add rule " T "libvirt-P-vnet0 ether daddr ff:ff:ff:ff:ff:ff ether type ip ip protocol udp ip saddr 10.0.0.2 th sport 67 th dport 68 accept\n"
+        "add rule " T "libvirt-P-vnet0 drop\n";
+    virMacAddr mac = { .addr = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 } };
+    const char *servers[] = { "192.168.122.1", "10.0.0.1", "10.0.0.2" };
+    virNWFilterVarValue val = {
+        .valType = NWFILTER_VALUE_TYPE_ARRAY,
+        .u = {
+            .array = {
+                .values = (char **)servers,
+                .nValues = 3,
+            }
+        }
+    };
+    int ret;
+
+    virCommandSetDryRun(&buf, testNWFilterNFTablesDryRun, &buf);
+
+    if ((ret = nftables_driver.applyDHCPOnlyRules("vnet0", &mac, &val, true)) == 0)
+        ret = testNWFilterNFTablesCompare(&buf, expected);
+
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesApplyDropAllRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    const char *expected =
+        VIR_NWFILTER_BASIC_PREPARE("libvirt-I-vnet0", "libvirt-O-vnet0")
+        "add rule " T "libvirt-I-vnet0 drop\n"
+        "add rule " T "libvirt-O-vnet0 drop\n";
+    int ret;
+
+    virCommandSetDryRun(&buf, testNWFilterNFTablesDryRun, &buf);
+
+    if ((ret = nftables_driver.applyDropAllRules("vnet0")) == 0)
+        ret = testNWFilterNFTablesCompare(&buf, expected);
+
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
+
+/* committing a new filter uses the chains the filter was built with
+ * instead of listing the table again */
+static int
+testNWFilterNFTablesTransaction(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    const char *expected =
+        VIR_NWFILTER_LIST
+        VIR_NWFILTER_BASE_CHAINS
+        VIR_NWFILTER_DISPATCH_PREPARE("l2-in")
+        VIR_NWFILTER_DISPATCH_PREPARE("l2-out")
+        VIR_NWFILTER_DISPATCH_PREPARE("fwd-in")
+        VIR_NWFILTER_DISPATCH_PREPARE("fwd-out")
+        VIR_NWFILTER_DISPATCH_PREPARE("host-in")
+        VIR_NWFILTER_STAGED_REMOVE
+        "add chain " T "libvirt-J-vnet0\n"
+        "add chain " T "libvirt-P-vnet0\n"
+        "add chain " T "FJ-vnet0\n"
+        "add chain " T "FP-vnet0\n"
+        "add chain " T "HJ-vnet0\n"
+        "nft -f -\n"
+        VIR_NWFILTER_ACTIVE_REMOVE
+        "rename chain " T "libvirt-J-vnet0 libvirt-I-vnet0\n"
+        "rename chain " T "libvirt-P-vnet0 libvirt-O-vnet0\n"
+        "rename chain " T "FJ-vnet0 FI-vnet0\n"
+        "rename chain " T "FP-vnet0 FO-vnet0\n"
+        "rename chain " T "HJ-vnet0 HI-vnet0\n";
+    int ret;
+
+    virCommandSetDryRun(&buf, testNWFilterNFTablesDryRun, &buf);
+
+    if ((ret = nftables_driver.applyNewRules("vnet0", NULL, 0)) == 0 &&
+        (ret = nftables_driver.tearOldRules("vnet0")) == 0)
+        ret = testNWFilterNFTablesCompare(&buf, expected);
+
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesBadName(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    int ret = 0;
+
+    virCommandSetDryRun(&buf, testNWFilterNFTablesDryRun, &buf);
+
+    /* the name ends up in the nft script unquoted */
+    if (nftables_driver.allTeardown("vnet0;flush") == 0 ||
+        virBufferUse(&buf) != 0)
+        ret = -1;
+
+    virResetLastError();
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("nftablesAllTeardown",
+                   testNWFilterNFTablesAllTeardown,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesTearOldRules",
+                   testNWFilterNFTablesTearOldRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesTearNewRules",
+                   testNWFilterNFTablesTearNewRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesApplyBasicRules",
+                   testNWFilterNFTablesApplyBasicRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesApplyDHCPOnlyRules",
+                   testNWFilterNFTablesApplyDHCPOnlyRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesApplyDropAllRules",
+                   testNWFilterNFTablesApplyDropAllRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesTransaction",
+                   testNWFilterNFTablesTransaction,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesBadName",
+                   testNWFilterNFTablesBadName,
+                   NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -25,7 +25,9 @@
 
 # include "testutils.h"
 # include "nwfilter/nwfilter_ebiptables_driver.h"
+# include "nwfilter/nwfilter_nftables_driver.h"
 # include "virbuffer.h"
+# include "virthreadpool.h"
 
 # define LIBVIRT_VIRFIREWALLPRIV_H_ALLOW
 # include "virfirewallpriv.h"
@@ -57,6 +59,34 @@ struct _virNWFilterInst {
  */
 
 static const char *commonRules[] = {
+    /* Creating iptables base chains */
+    "iptables -N libvirt-in\n"
+    "iptables -N libvirt-out\n"
+    "iptables -N libvirt-in-post\n"
+    "iptables -N libvirt-host-in\n"
+    "iptables -D FORWARD -j libvirt-in\n"
+    "iptables -D FORWARD -j libvirt-out\n"
+    "iptables -D FORWARD -j libvirt-in-post\n"
+    "iptables -D INPUT -j libvirt-host-in\n"
+    "iptables -I FORWARD 1 -j libvirt-in\n"
+    "iptables -I FORWARD 2 -j libvirt-out\n"
+    "iptables -I FORWARD 3 -j libvirt-in-post\n"
+    "iptables -I INPUT 1 -j libvirt-host-in\n",
+
+    /* Creating ip6tables base chains */
+    "ip6tables -N libvirt-in\n"
+    "ip6tables -N libvirt-out\n"
+    "ip6tables -N libvirt-in-post\n"
+    "ip6tables -N libvirt-host-in\n"
+    "ip6tables -D FORWARD -j libvirt-in\n"
+    "ip6tables -D FORWARD -j libvirt-out\n"
+    "ip6tables -D FORWARD -j libvirt-in-post\n"
+    "ip6tables -D INPUT -j libvirt-host-in\n"
+    "ip6tables -I FORWARD 1 -j libvirt-in\n"
+    "ip6tables -I FORWARD 2 -j libvirt-out\n"
+    "ip6tables -I FORWARD 3 -j libvirt-in-post\n"
+    "ip6tables -I INPUT 1 -j libvirt-host-in\n",
+
     /* Dropping ebtables rules */
     "ebtables -t nat -D PREROUTING -i vnet0 -j libvirt-J-vnet0\n"
     "ebtables -t nat -D POSTROUTING -o vnet0 -j libvirt-P-vnet0\n"
@@ -84,18 +114,6 @@ static const char *commonRules[] = {
     "iptables -X HJ-vnet0\n",
 
     /* Creating iptables chains */
-    "iptables -N libvirt-in\n"
-    "iptables -N libvirt-out\n"
-    "iptables -N libvirt-in-post\n"
-    "iptables -N libvirt-host-in\n"
-    "iptables -D FORWARD -j libvirt-in\n"
-    "iptables -D FORWARD -j libvirt-out\n"
-    "iptables -D FORWARD -j libvirt-in-post\n"
-    "iptables -D INPUT -j libvirt-host-in\n"
-    "iptables -I FORWARD 1 -j libvirt-in\n"
-    "iptables -I FORWARD 2 -j libvirt-out\n"
-    "iptables -I FORWARD 3 -j libvirt-in-post\n"
-    "iptables -I INPUT 1 -j libvirt-host-in\n"
     "iptables -N FP-vnet0\n"
     "iptables -N FJ-vnet0\n"
     "iptables -N HJ-vnet0\n"
@@ -118,18 +136,6 @@ static const char *commonRules[] = {
     "ip6tables -X HJ-vnet0\n",
 
     /* Creating ip6tables chains */
-    "ip6tables -N libvirt-in\n"
-    "ip6tables -N libvirt-out\n"
-    "ip6tables -N libvirt-in-post\n"
-    "ip6tables -N libvirt-host-in\n"
-    "ip6tables -D FORWARD -j libvirt-in\n"
-    "ip6tables -D FORWARD -j libvirt-out\n"
-    "ip6tables -D FORWARD -j libvirt-in-post\n"
-    "ip6tables -D INPUT -j libvirt-host-in\n"
-    "ip6tables -I FORWARD 1 -j libvirt-in\n"
-    "ip6tables -I FORWARD 2 -j libvirt-out\n"
-    "ip6tables -I FORWARD 3 -j libvirt-in-post\n"
-    "ip6tables -I INPUT 1 -j libvirt-host-in\n"
     "ip6tables -N FP-vnet0\n"
     "ip6tables -N FJ-vnet0\n"
     "ip6tables -N HJ-vnet0\n"
@@ -364,9 +370,29 @@ static int testSetDefaultParameters(virHashTablePtr vars)
     return 0;
 }
 
+static void
+testCommandDryRunInput(const char *const*args G_GNUC_UNUSED,
+                       const char *const*env G_GNUC_UNUSED,
+                       const char *input,
+                       char **output G_GNUC_UNUSED,
+                       char **error G_GNUC_UNUSED,
+                       int *status G_GNUC_UNUSED,
+                       void *opaque)
+{
+    virBufferPtr buf = opaque;
+
+    if (input)
+        virBufferAdd(buf, input, -1);
+}
+
+
 static int testCompareXMLToArgvFiles(const char *xml,
-                                     const char *cmdline)
+                                     const char *cmdline,
+                                     bool batch,
+                                     bool nft)
 {
+    virNWFilterTechDriverPtr techdriver = nft ? &nftables_driver
+                                              : &ebiptables_driver;
     char *actualargv = NULL;
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     virHashTablePtr vars = virNWFilterHashTableCreate(0);
@@ -375,7 +401,8 @@ static int testCompareXMLToArgvFiles(const char *xml,
 
     memset(&inst, 0, sizeof(inst));
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    virFirewallSetBatchOverride(batch);
+    virCommandSetDryRun(&buf, testCommandDryRunInput, &buf);
 
     if (!vars)
         goto cleanup;
@@ -388,14 +415,16 @@ static int testCompareXMLToArgvFiles(const char *xml,
                              &inst) < 0)
         goto cleanup;
 
-    if (ebiptables_driver.applyNewRules("vnet0", inst.rules, inst.nrules) < 0)
+    if (techdriver->applyNewRules("vnet0", inst.rules, inst.nrules) < 0)
         goto cleanup;
 
     actualargv = virBufferContentAndReset(&buf);
     virTestClearCommandPath(actualargv);
     virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallSetBatchOverride(false);
 
-    testRemoveCommonRules(actualargv);
+    if (!nft)
+        testRemoveCommonRules(actualargv);
 
     if (virTestCompareToFile(actualargv, cmdline) < 0)
         goto cleanup;
@@ -403,6 +432,8 @@ static int testCompareXMLToArgvFiles(const char *xml,
     ret = 0;
 
  cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallSetBatchOverride(false);
     virBufferFreeAndReset(&buf);
     VIR_FREE(actualargv);
     virNWFilterInstReset(&inst);
@@ -412,6 +443,8 @@ static int testCompareXMLToArgvFiles(const char *xml,
 
 struct testInfo {
     const char *name;
+    bool batch;
+    bool nft;
 };
 
 
@@ -425,16 +458,168 @@ testCompareXMLToIPTablesHelper(const void *data)
 
     xml = g_strdup_printf("%s/nwfilterxml2firewalldata/%s.xml",
                           abs_srcdir, info->name);
-    args = g_strdup_printf("%s/nwfilterxml2firewalldata/%s-%s.args",
-                           abs_srcdir, info->name, RULESTYPE);
+    args = g_strdup_printf("%s/nwfilterxml2firewalldata/%s-%s.%s",
+                           abs_srcdir, info->name, RULESTYPE,
+                           info->nft ? "nft" :
+                           info->batch ? "batch" : "args");
 
-    result = testCompareXMLToArgvFiles(xml, args);
+    result = testCompareXMLToArgvFiles(xml, args, info->batch, info->nft);
 
     VIR_FREE(xml);
     VIR_FREE(args);
     return result;
 }
 
+/*
+ * The rules of each interface are computed by the calling thread and
+ * applied by a pool of workers, like virNWFilterBuildAll does with
+ * more than one instantiate worker. All the commands of every interface
+ * must be run.
+ */
+# define TEST_PARALLEL_IFACES 16
+# define TEST_PARALLEL_WORKERS 4
+
+struct testParallelData {
+    virMutex lock;
+    virCond cond;
+    size_t ncommands;
+    size_t nfailed;
+    size_t ndone;
+};
+
+struct testParallelJob {
+    char *ifname;
+    virNWFilterInst inst;
+};
+
+
+static void
+testParallelDryRun(const char *const*args G_GNUC_UNUSED,
+                   const char *const*env G_GNUC_UNUSED,
+                   const char *input G_GNUC_UNUSED,
+                   char **output G_GNUC_UNUSED,
+                   char **error G_GNUC_UNUSED,
+                   int *status G_GNUC_UNUSED,
+                   void *opaque)
+{
+    struct testParallelData *data = opaque;
+
+    virMutexLock(&data->lock);
+    data->ncommands++;
+    virMutexUnlock(&data->lock);
+}
+
+
+static void
+testParallelWorker(void *jobdata, void *opaque)
+{
+    struct testParallelJob *job = jobdata;
+    struct testParallelData *data = opaque;
+    bool failed;
+
+    failed = ebiptables_driver.applyNewRules(job->ifname,
+                                             job->inst.rules,
+                                             job->inst.nrules) < 0;
+
+    virMutexLock(&data->lock);
+    if (failed)
+        data->nfailed++;
+    data->ndone++;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+static int
+testCompareXMLToParallelApply(const void *opaque)
+{
+    const char *name = opaque;
+    g_autofree char *xml = NULL;
+    struct testParallelData data = { 0 };
+    struct testParallelJob jobs[TEST_PARALLEL_IFACES];
+    virHashTablePtr vars = virNWFilterHashTableCreate(0);
+    virThreadPoolPtr pool = NULL;
+    size_t expected;
+    size_t i;
+    int ret = -1;
+
+    memset(jobs, 0, sizeof(jobs));
+
+    xml = g_strdup_printf("%s/nwfilterxml2firewalldata/%s.xml",
+                          abs_srcdir, name);
+
+    if (!vars || virMutexInit(&data.lock) < 0) {
+        virHashFree(vars);
+        return -1;
+    }
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        virHashFree(vars);
+        return -1;
+    }
+
+    virCommandSetDryRun(NULL, testParallelDryRun, &data);
+
+    if (testSetDefaultParameters(vars) < 0)
+        goto cleanup;
+
+    for (i = 0; i < TEST_PARALLEL_IFACES; i++) {
+        jobs[i].ifname = g_strdup_printf("vnet%zu", i);
+        if (virNWFilterDefToInst(xml, vars, &jobs[i].inst) < 0)
+            goto cleanup;
+    }
+
+    /* the commands needed by a single interface */
+    if (ebiptables_driver.applyNewRules(jobs[0].ifname,
+                                        jobs[0].inst.rules,
+                                        jobs[0].inst.nrules) < 0)
+        goto cleanup;
+    expected = data.ncommands * TEST_PARALLEL_IFACES;
+    data.ncommands = 0;
+
+    if (!(pool = virThreadPoolNew(0, TEST_PARALLEL_WORKERS, 0,
+                                  testParallelWorker, &data)))
+        goto cleanup;
+
+    for (i = 0; i < TEST_PARALLEL_IFACES; i++) {
+        if (virThreadPoolSendJob(pool, 0, &jobs[i]) < 0)
+            break;
+    }
+
+    virMutexLock(&data.lock);
+    while (data.ndone < i)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    virMutexUnlock(&data.lock);
+
+    if (i < TEST_PARALLEL_IFACES)
+        goto cleanup;
+
+    if (data.nfailed > 0) {
+        VIR_TEST_DEBUG("%zu interfaces failed", data.nfailed);
+        goto cleanup;
+    }
+
+    if (data.ncommands != expected) {
+        VIR_TEST_DEBUG("expected %zu commands, got %zu",
+                       expected, data.ncommands);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virThreadPoolFree(pool);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    for (i = 0; i < TEST_PARALLEL_IFACES; i++) {
+        VIR_FREE(jobs[i].ifname);
+        virNWFilterInstReset(&jobs[i].inst);
+    }
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    virHashFree(vars);
+    return ret;
+}
+
+
 static bool
 hasNetfilterTools(void)
 {
@@ -449,16 +634,20 @@ mymain(void)
 {
     int ret = 0;
 
-# define DO_TEST(name) \
+# define DO_TEST_FULL(name, suffix, batch, nft) \
     do { \
         static struct testInfo info = { \
-            name, \
+            name, batch, nft, \
         }; \
-        if (virTestRun("NWFilter XML-2-firewall " name, \
+        if (virTestRun("NWFilter XML-2-firewall " name suffix, \
                        testCompareXMLToIPTablesHelper, &info) < 0) \
             ret = -1; \
     } while (0)
 
+# define DO_TEST(name) DO_TEST_FULL(name, "", false, false)
+# define DO_TEST_BATCH(name) DO_TEST_FULL(name, " batch", true, false)
+# define DO_TEST_NFT(name) DO_TEST_FULL(name, " nft", false, true)
+
     virFirewallSetLockOverride(true);
 
     if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0) {
@@ -509,6 +698,16 @@ mymain(void)
     DO_TEST("udplite-ipv6");
     DO_TEST("vlan");
 
+    DO_TEST_BATCH("ipt-no-macspoof");
+    DO_TEST_BATCH("mac");
+
+    DO_TEST_NFT("example-1");
+    DO_TEST_NFT("mac");
+
+    if (virTestRun("NWFilter XML-2-firewall parallel apply",
+                   testCompareXMLToParallelApply, "example-1") < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
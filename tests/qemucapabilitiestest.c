@@ -19,6 +19,10 @@
 
 #include <config.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
+
 #include "testutils.h"
 #include "testutilsqemu.h"
 #include "qemumonitortestutils.h"
@@ -42,8 +46,16 @@ struct _testQemuData {
     const char *archName;
     const char *suffix;
     int ret;
+
+    /* time spent loading the capabilities and size of the data */
+    unsigned long long xmlLoadTime;
+    unsigned long long binaryLoadTime;
+    size_t xmlSize;
+    size_t binarySize;
 };
 
+#define TEST_QEMU_CAPS_LOAD_LOOPS 10
+
 
 static int
 testQemuDataInit(testQemuDataPtr data)
@@ -54,6 +66,10 @@ testQemuDataInit(testQemuDataPtr data)
     data->outputDir = TEST_QEMU_CAPS_PATH;
 
     data->ret = 0;
+    data->xmlLoadTime = 0;
+    data->binaryLoadTime = 0;
+    data->xmlSize = 0;
+    data->binarySize = 0;
 
     return 0;
 }
@@ -181,6 +197,176 @@ testQemuCapsCopy(const void *opaque)
 }
 
 
+static int
+testQemuCapsBinary(const void *opaque)
+{
+    testQemuData *data = (void *) opaque;
+    virArch arch = virArchFromString(data->archName);
+    g_autofree char *capsFile = NULL;
+    g_autofree char *binary = NULL;
+    g_autofree char *xml = NULL;
+    g_autofree char *actual = NULL;
+    g_autoptr(virQEMUCaps) orig = NULL;
+    g_autoptr(virQEMUCaps) loaded = NULL;
+    g_autoptr(GByteArray) buf = NULL;
+    g_autoptr(GByteArray) again = NULL;
+    unsigned long long start;
+    size_t i;
+
+    capsFile = g_strdup_printf("%s/%s_%s.%s.xml",
+                               data->outputDir, data->prefix, data->version,
+                               data->archName);
+    binary = g_strdup_printf("/usr/bin/qemu-system-%s", data->archName);
+
+    if (virTestLoadFile(capsFile, &xml) < 0)
+        return -1;
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < TEST_QEMU_CAPS_LOAD_LOOPS; i++) {
+        virObjectUnref(orig);
+        if (!(orig = qemuTestParseCapabilitiesArch(arch, capsFile)))
+            return -1;
+    }
+    data->xmlLoadTime += g_get_monotonic_time() - start;
+
+    buf = virQEMUCapsFormatCacheBinary(orig);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < TEST_QEMU_CAPS_LOAD_LOOPS; i++) {
+        virObjectUnref(loaded);
+        if (!(loaded = virQEMUCapsNewBinary(binary)) ||
+            virQEMUCapsLoadCacheBinary(arch, loaded,
+                                       (const char *)buf->data, buf->len) < 0)
+            return -1;
+    }
+    data->binaryLoadTime += g_get_monotonic_time() - start;
+
+    data->xmlSize += strlen(xml);
+    data->binarySize += buf->len;
+
+    if (!(actual = virQEMUCapsFormatCache(loaded)))
+        return -1;
+
+    if (virTestCompareToFile(actual, capsFile) < 0)
+        return -1;
+
+    /* anything missing in XML must survive the binary round trip too */
+    again = virQEMUCapsFormatCacheBinary(loaded);
+    if (again->len != buf->len ||
+        memcmp(again->data, buf->data, buf->len) != 0) {
+        VIR_TEST_DEBUG("binary capabilities differ after reloading them");
+        return -1;
+    }
+
+    /* truncated data must be refused */
+    virObjectUnref(loaded);
+    if (!(loaded = virQEMUCapsNewBinary(binary)))
+        return -1;
+
+    if (virQEMUCapsLoadCacheBinary(arch, loaded, (const char *)buf->data,
+                                   buf->len - 1) == 0) {
+        VIR_TEST_DEBUG("truncated binary capabilities were loaded");
+        return -1;
+    }
+    virResetLastError();
+
+    return 0;
+}
+
+
+static int
+testQemuCapsBinarySpeed(const void *opaque)
+{
+    const testQemuData *data = opaque;
+
+    /* Loading all the capabilities roughly corresponds to the work done
+     * by the daemon on startup */
+    VIR_TEST_DEBUG("Loading capabilities %d times: XML %zu bytes in %llu ms, "
+                   "binary %zu bytes in %llu ms",
+                   TEST_QEMU_CAPS_LOAD_LOOPS,
+                   data->xmlSize, data->xmlLoadTime / 1000,
+                   data->binarySize, data->binaryLoadTime / 1000);
+
+    if (data->binaryLoadTime >= data->xmlLoadTime) {
+        VIR_TEST_DEBUG("binary capabilities are not faster to load than XML");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+#ifdef HAVE_SYS_INOTIFY_H
+# define TEST_QEMU_CAPS_WATCH_TEMPLATE abs_builddir "/qemucapswatch-XXXXXX"
+
+static int
+testQemuCapsWatch(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *tmpdir = g_strdup(TEST_QEMU_CAPS_WATCH_TEMPLATE);
+    g_autofree char *binary = NULL;
+    g_autoptr(virQEMUCaps) qemuCaps = NULL;
+    virFileCachePtr cache = NULL;
+    void *priv;
+    struct stat sb;
+    int fd;
+    int ret = -1;
+
+    /* inotify may be unavailable even if it is compiled in */
+    if ((fd = inotify_init1(IN_CLOEXEC)) < 0)
+        return EXIT_AM_SKIP;
+    VIR_FORCE_CLOSE(fd);
+
+    if (!g_mkdtemp(tmpdir)) {
+        VIR_TEST_DEBUG("Cannot create %s", tmpdir);
+        VIR_FREE(tmpdir);
+        return -1;
+    }
+
+    binary = g_strdup_printf("%s/qemu-system-none", tmpdir);
+
+    if (virFileWriteStr(binary, "old", 0700) < 0 ||
+        stat(binary, &sb) < 0)
+        goto cleanup;
+
+    if (!(cache = virQEMUCapsCacheNew(tmpdir, tmpdir, geteuid(), getegid())) ||
+        !(qemuCaps = virQEMUCapsNewBinary(binary)))
+        goto cleanup;
+
+    priv = virFileCacheGetPriv(cache);
+    virQEMUCapsSetTimestamps(qemuCaps, sb.st_ctime);
+
+    if (!virQEMUCapsIsValid(qemuCaps, priv)) {
+        VIR_TEST_DEBUG("freshly probed capabilities are not valid");
+        goto cleanup;
+    }
+
+    /* The binary is watched now and it's not checked again until it
+     * changes, even though the capabilities claim a different ctime. */
+    virQEMUCapsSetTimestamps(qemuCaps, sb.st_ctime - 1);
+
+    if (!virQEMUCapsIsValid(qemuCaps, priv)) {
+        VIR_TEST_DEBUG("unchanged binary was checked again");
+        goto cleanup;
+    }
+
+    if (virFileWriteStr(binary, "new", 0700) < 0)
+        goto cleanup;
+
+    if (virQEMUCapsIsValid(qemuCaps, priv)) {
+        VIR_TEST_DEBUG("changed binary was not checked again");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(cache);
+    virFileDeleteTree(tmpdir);
+    return ret;
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+
 static int
 doCapsTest(const char *inputDir,
            const char *prefix,
@@ -192,9 +378,11 @@ doCapsTest(const char *inputDir,
     testQemuDataPtr data = (testQemuDataPtr) opaque;
     g_autofree char *title = NULL;
     g_autofree char *copyTitle = NULL;
+    g_autofree char *binaryTitle = NULL;
 
     title = g_strdup_printf("%s (%s)", version, archName);
     copyTitle = g_strdup_printf("copy %s (%s)", version, archName);
+    binaryTitle = g_strdup_printf("binary %s (%s)", version, archName);
 
     data->inputDir = inputDir;
     data->prefix = prefix;
@@ -208,6 +396,9 @@ doCapsTest(const char *inputDir,
     if (virTestRun(copyTitle, testQemuCapsCopy, data) < 0)
         data->ret = -1;
 
+    if (virTestRun(binaryTitle, testQemuCapsBinary, data) < 0)
+        data->ret = -1;
+
     return 0;
 }
 
@@ -225,6 +416,14 @@ mymain(void)
     if (testQemuCapsIterate(".replies", doCapsTest, &data) < 0)
         return EXIT_FAILURE;
 
+    if (virTestRun("binary load speed", testQemuCapsBinarySpeed, &data) < 0)
+        data.ret = -1;
+
+#ifdef HAVE_SYS_INOTIFY_H
+    if (virTestRun("binary change watch", testQemuCapsWatch, NULL) < 0)
+        data.ret = -1;
+#endif
+
     /*
      * Run "tests/qemucapsprobe /path/to/qemu/binary >foo.replies"
      * to generate updated or new *.replies data files.
@@ -0,0 +1,213 @@
+/*
+ * qemumigrationautotunetest.c: test migration auto-tuning decisions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "qemu/qemu_migration.h"
+#define LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+#include "qemu/qemu_migrationpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_PAGE_SIZE 4096
+#define TEST_BPS (100 * 1024 * 1024ull)
+
+/* One memory pass as seen by the auto-tuning code */
+typedef struct _testPass testPass;
+struct _testPass {
+    unsigned long long iteration;
+    unsigned long long remaining;
+    unsigned long long dirtyPages; /* pages dirtied per second */
+    bool stalled; /* expected result */
+};
+
+typedef struct _testStallData testStallData;
+struct _testStallData {
+    const testPass *passes;
+    size_t npasses;
+};
+
+
+static void
+testFillStats(qemuMonitorMigrationStatsPtr stats,
+              unsigned long long iteration,
+              unsigned long long remaining,
+              unsigned long long dirtyPages)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->status = QEMU_MONITOR_MIGRATION_STATUS_ACTIVE;
+    stats->ram_iteration = iteration;
+    stats->ram_remaining = remaining;
+    stats->ram_dirty_rate = dirtyPages;
+    stats->ram_page_size = TEST_PAGE_SIZE;
+    stats->ram_bps = TEST_BPS;
+}
+
+
+static int
+testStalled(const void *opaque)
+{
+    const testStallData *data = opaque;
+    qemuMigrationAutoTune tune = { 0 };
+    qemuMonitorMigrationStats stats;
+    size_t i;
+
+    for (i = 0; i < data->npasses; i++) {
+        const testPass *pass = data->passes + i;
+        bool stalled;
+
+        testFillStats(&stats, pass->iteration, pass->remaining,
+                      pass->dirtyPages);
+
+        stalled = qemuMigrationAutoTuneStalled(&tune, &stats);
+        if (stalled != pass->stalled) {
+            VIR_TEST_DEBUG("pass %zu: expected stalled=%d, got %d",
+                           i, pass->stalled, stalled);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+typedef struct _testDecideData testDecideData;
+struct _testDecideData {
+    unsigned long long downtime; /* current limit */
+    unsigned long long remaining;
+    bool postcopy;
+    qemuMigrationAutoTuneAction action;
+    unsigned long long needed;
+};
+
+
+static int
+testDecide(const void *opaque)
+{
+    const testDecideData *data = opaque;
+    qemuMigrationAutoTune tune = { .downtime = data->downtime };
+    qemuMonitorMigrationStats stats;
+    qemuMigrationAutoTuneAction action;
+    unsigned long long needed = 0;
+
+    testFillStats(&stats, 5, data->remaining, 0);
+
+    action = qemuMigrationAutoTuneDecide(&tune, &stats, data->postcopy,
+                                         &needed);
+
+    if (action != data->action) {
+        VIR_TEST_DEBUG("expected action %d, got %d", data->action, action);
+        return -1;
+    }
+
+    if (needed != data->needed) {
+        VIR_TEST_DEBUG("expected downtime %llu, got %llu",
+                       data->needed, needed);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Remaining memory which takes @ms milliseconds to send at TEST_BPS */
+#define REMAINING_MS(ms) (TEST_BPS * (ms) / 1000)
+
+/* A guest dirtying memory faster than it can be sent */
+#define FAST_DIRTY (TEST_BPS / TEST_PAGE_SIZE)
+
+static const testPass stallDirtyRate[] = {
+    { 1, REMAINING_MS(1000), FAST_DIRTY, false },
+    { 2, REMAINING_MS(1000), FAST_DIRTY, false },
+    { 3, REMAINING_MS(1000), FAST_DIRTY, true },
+    /* the counter starts over after reporting a stall */
+    { 4, REMAINING_MS(1000), FAST_DIRTY, false },
+};
+
+static const testPass stallRemaining[] = {
+    /* the first pass has nothing to compare remaining memory with */
+    { 1, REMAINING_MS(1000), 0, false },
+    { 2, REMAINING_MS(1000), 0, false },
+    { 3, REMAINING_MS(1100), 0, false },
+    { 4, REMAINING_MS(1100), 0, true },
+};
+
+static const testPass stallProgress[] = {
+    { 1, REMAINING_MS(1000), FAST_DIRTY, false },
+    { 2, REMAINING_MS(1000), FAST_DIRTY, false },
+    /* the guest slowed down and migration got closer to the end */
+    { 3, REMAINING_MS(500), 0, false },
+    { 4, REMAINING_MS(500), FAST_DIRTY, false },
+    { 5, REMAINING_MS(500), FAST_DIRTY, false },
+    { 6, REMAINING_MS(500), FAST_DIRTY, true },
+};
+
+static const testPass stallSamePass[] = {
+    { 1, REMAINING_MS(1000), FAST_DIRTY, false },
+    { 2, REMAINING_MS(1000), FAST_DIRTY, false },
+    /* statistics of a pass already accounted for */
+    { 2, REMAINING_MS(1000), FAST_DIRTY, false },
+    { 2, REMAINING_MS(1000), FAST_DIRTY, false },
+    { 3, REMAINING_MS(1000), FAST_DIRTY, true },
+};
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define DO_TEST_STALL(name, passes) \
+    do { \
+        testStallData data = { passes, G_N_ELEMENTS(passes) }; \
+        if (virTestRun("stall " name, testStalled, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_STALL("dirty rate", stallDirtyRate);
+    DO_TEST_STALL("remaining", stallRemaining);
+    DO_TEST_STALL("progress", stallProgress);
+    DO_TEST_STALL("same pass", stallSamePass);
+
+#define DO_TEST_DECIDE(name, downtime, ms, postcopy, action, needed) \
+    do { \
+        testDecideData data = { downtime, REMAINING_MS(ms), postcopy, \
+                                QEMU_MIGRATION_AUTO_TUNE_ ## action, \
+                                needed }; \
+        if (virTestRun("decide " name, testDecide, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* 25% reserve is added to the time needed to send remaining memory */
+    DO_TEST_DECIDE("converges", 300, 200, false, NONE, 250);
+    DO_TEST_DECIDE("at limit", 300, 240, false, NONE, 300);
+    DO_TEST_DECIDE("raise", 300, 800, false, DOWNTIME, 1000);
+    DO_TEST_DECIDE("raise postcopy", 300, 800, true, DOWNTIME, 1000);
+    DO_TEST_DECIDE("raise max", 1000,
+                   QEMU_MIGRATION_AUTO_TUNE_DOWNTIME_MAX * 4 / 5, false,
+                   DOWNTIME, QEMU_MIGRATION_AUTO_TUNE_DOWNTIME_MAX);
+    DO_TEST_DECIDE("postcopy", 300, 2000, true, POSTCOPY, 2500);
+    DO_TEST_DECIDE("give up", 300, 2000, false, GIVE_UP, 2500);
+    DO_TEST_DECIDE("give up raised", 2000, 2000, false, GIVE_UP, 2500);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
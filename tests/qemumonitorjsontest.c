@@ -1983,6 +1983,96 @@ testQemuMonitorJSONqemuMonitorJSONGetMigrationStats(const void *opaque)
     return ret;
 }
 
+static int
+testQemuMonitorJSONqemuMonitorJSONDirtyRate(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    qemuMonitorDirtyRateInfo info;
+    g_autoptr(qemuMonitorTest) test = NULL;
+
+    /* The newest QMP schema in qemucapabilitiesdata predates the dirty
+     * rate commands, so they cannot be validated against it */
+    if (!(test = qemuMonitorTestNewSchema(data->xmlopt, NULL)))
+        return -1;
+
+    if (qemuMonitorTestAddItemParams(test, "calc-dirty-rate",
+                                     "{\"return\":{}}",
+                                     "calc-time", "1",
+                                     NULL) < 0 ||
+        qemuMonitorTestAddItem(test, "query-dirty-rate",
+                               "{"
+                               "    \"return\": {"
+                               "        \"status\": \"measuring\","
+                               "        \"start-time\": 1234,"
+                               "        \"calc-time\": 1"
+                               "    },"
+                               "    \"id\": \"libvirt-2\""
+                               "}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-dirty-rate",
+                               "{"
+                               "    \"return\": {"
+                               "        \"status\": \"measured\","
+                               "        \"dirty-rate\": 42,"
+                               "        \"start-time\": 1234,"
+                               "        \"calc-time\": 1"
+                               "    },"
+                               "    \"id\": \"libvirt-3\""
+                               "}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-dirty-rate",
+                               "{"
+                               "    \"return\": {"
+                               "        \"status\": \"measured\","
+                               "        \"start-time\": 1234,"
+                               "        \"calc-time\": 1"
+                               "    },"
+                               "    \"id\": \"libvirt-4\""
+                               "}") < 0)
+        return -1;
+
+    if (qemuMonitorJSONStartDirtyRateCalc(qemuMonitorTestGetMonitor(test),
+                                          1) < 0)
+        return -1;
+
+    memset(&info, 0, sizeof(info));
+    if (qemuMonitorJSONQueryDirtyRate(qemuMonitorTestGetMonitor(test),
+                                      &info) < 0)
+        return -1;
+
+    if (info.status != VIR_DOMAIN_DIRTYRATE_MEASURING ||
+        info.startTime != 1234 ||
+        info.calcTime != 1 ||
+        info.dirtyRate != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "Invalid dirty rate of a running calculation");
+        return -1;
+    }
+
+    memset(&info, 0, sizeof(info));
+    if (qemuMonitorJSONQueryDirtyRate(qemuMonitorTestGetMonitor(test),
+                                      &info) < 0)
+        return -1;
+
+    if (info.status != VIR_DOMAIN_DIRTYRATE_MEASURED ||
+        info.startTime != 1234 ||
+        info.calcTime != 1 ||
+        info.dirtyRate != 42) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "Invalid measured dirty rate");
+        return -1;
+    }
+
+    /* A measured rate must come with the 'dirty-rate' field */
+    if (qemuMonitorJSONQueryDirtyRate(qemuMonitorTestGetMonitor(test),
+                                      &info) == 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "Missing dirty rate was accepted");
+        return -1;
+    }
+    virResetLastError();
+
+    return 0;
+}
+
 static int
 testHashEqualChardevInfo(const void *value1, const void *value2)
 {
@@ -3249,6 +3339,7 @@ mymain(void)
     DO_TEST(qemuMonitorJSONGetAllBlockStatsInfo);
     DO_TEST(qemuMonitorJSONGetMigrationCacheSize);
     DO_TEST(qemuMonitorJSONGetMigrationStats);
+    DO_TEST(qemuMonitorJSONDirtyRate);
     DO_TEST(qemuMonitorJSONGetChardevInfo);
     DO_TEST(qemuMonitorJSONSetBlockIoThrottle);
     DO_TEST(qemuMonitorJSONGetTargetArch);
@@ -0,0 +1,118 @@
+/*
+ * qemustartupstatstest.c: test formatting of domain startup stats
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "qemu/qemu_domain.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* The keys are part of the API, renaming a phase breaks users */
+static const char *startupKeys[] = {
+    "startup.time",
+    "startup.caps.time",
+    "startup.prepare-domain.time",
+    "startup.prepare-host.time",
+    "startup.command-line.time",
+    "startup.launch.time",
+    "startup.cgroup.time",
+    "startup.security.time",
+    "startup.monitor.time",
+    "startup.agent.time",
+    "startup.finish.time",
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(startupKeys) == QEMU_DOMAIN_START_PHASE_LAST + 1);
+
+
+static int
+testStartupStats(const void *opaque G_GNUC_UNUSED)
+{
+    qemuDomainStartTimes times = { .total = 1000 };
+    g_autoptr(virTypedParamList) params = g_new0(virTypedParamList, 1);
+    size_t i;
+
+    for (i = 0; i < QEMU_DOMAIN_START_PHASE_LAST; i++)
+        times.phases[i] = i + 1;
+
+    if (qemuDomainStartTimesFormatParams(&times, params) < 0)
+        return -1;
+
+    if (params->npar != G_N_ELEMENTS(startupKeys)) {
+        VIR_TEST_DEBUG("expected %zu stats, got %zu",
+                       G_N_ELEMENTS(startupKeys), params->npar);
+        return -1;
+    }
+
+    for (i = 0; i < params->npar; i++) {
+        virTypedParameterPtr par = params->par + i;
+        unsigned long long expected = i == 0 ? times.total : i;
+
+        if (STRNEQ(par->field, startupKeys[i])) {
+            VIR_TEST_DEBUG("stat %zu: expected '%s', got '%s'",
+                           i, startupKeys[i], par->field);
+            return -1;
+        }
+
+        if (par->type != VIR_TYPED_PARAM_ULLONG ||
+            par->value.ul != expected) {
+            VIR_TEST_DEBUG("'%s': expected %llu", par->field, expected);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Domains which weren't started via qemuProcessStart have no timings */
+static int
+testStartupStatsNone(const void *opaque G_GNUC_UNUSED)
+{
+    qemuDomainStartTimes times = { .phases = { 1, 2, 3 } };
+    g_autoptr(virTypedParamList) params = g_new0(virTypedParamList, 1);
+
+    if (qemuDomainStartTimesFormatParams(&times, params) < 0)
+        return -1;
+
+    if (params->npar != 0) {
+        VIR_TEST_DEBUG("expected no stats, got %zu", params->npar);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("startup stats", testStartupStats, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("startup stats none", testStartupStatsNone, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
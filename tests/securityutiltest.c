@@ -0,0 +1,494 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+
+#include "testutils.h"
+#include "virfile.h"
+#include "virthread.h"
+#include "security/security_util.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+
+struct testBatchData {
+    const char *virtDriver;
+    bool privileged;
+    bool lock;
+    const virSecurityTransactionBatchItem *items;
+    size_t nitems;
+};
+
+
+static int
+testBatchRoundTrip(const void *opaque)
+{
+    const struct testBatchData *data = opaque;
+    virSecurityTransactionBatch batch = {
+        .virtDriver = data->virtDriver,
+        .privileged = data->privileged,
+        .lock = data->lock,
+        .items = (virSecurityTransactionBatchItemPtr)data->items,
+        .nitems = data->nitems,
+    };
+    virSecurityTransactionBatch decoded;
+    g_autoptr(GByteArray) buf = NULL;
+    size_t i;
+    int ret = -1;
+
+    buf = virSecurityTransactionBatchEncode(&batch);
+
+    if (virSecurityTransactionBatchDecode((const char *)buf->data,
+                                          buf->len, &decoded) < 0)
+        return -1;
+
+    if (STRNEQ(decoded.virtDriver, batch.virtDriver) ||
+        decoded.privileged != batch.privileged ||
+        decoded.lock != batch.lock) {
+        VIR_TEST_DEBUG("header differs");
+        goto cleanup;
+    }
+
+    if (decoded.nitems != batch.nitems) {
+        VIR_TEST_DEBUG("expected %zu items, got %zu",
+                       batch.nitems, decoded.nitems);
+        goto cleanup;
+    }
+
+    for (i = 0; i < batch.nitems; i++) {
+        const virSecurityTransactionBatchItem *exp = &batch.items[i];
+        const virSecurityTransactionBatchItem *act = &decoded.items[i];
+
+        if (STRNEQ_NULLABLE(exp->path, act->path) ||
+            STRNEQ_NULLABLE(exp->label, act->label) ||
+            exp->remember != act->remember ||
+            exp->restore != act->restore) {
+            VIR_TEST_DEBUG("item %zu differs: path=%s label=%s "
+                           "remember=%d restore=%d",
+                           i, NULLSTR(act->path), NULLSTR(act->label),
+                           act->remember, act->restore);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(decoded.items);
+    return ret;
+}
+
+
+struct testBatchMalformedData {
+    const char *data;
+    size_t len;
+};
+
+
+static int
+testBatchMalformed(const void *opaque)
+{
+    const struct testBatchMalformedData *data = opaque;
+    virSecurityTransactionBatch decoded;
+
+    if (virSecurityTransactionBatchDecode(data->data, data->len,
+                                          &decoded) == 0) {
+        VIR_TEST_DEBUG("malformed transaction decoded with %zu items",
+                       decoded.nitems);
+        VIR_FREE(decoded.items);
+        return -1;
+    }
+
+    if (decoded.items || decoded.nitems) {
+        VIR_TEST_DEBUG("items left behind on failure");
+        return -1;
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+/* Every truncation of an encoded transaction within a string must be
+ * refused. Truncating exactly at an item boundary gives a valid
+ * transaction with fewer items, which is checked for as well. */
+static int
+testBatchTruncated(const void *opaque G_GNUC_UNUSED)
+{
+    const virSecurityTransactionBatchItem items[] = {
+        { "/dev/sda", "+107:+107", true, false },
+        { "/var/lib/libvirt/images/a.qcow2", "+0:+0", false, true },
+    };
+    virSecurityTransactionBatch batch = {
+        .virtDriver = "QEMU",
+        .items = (virSecurityTransactionBatchItemPtr)items,
+        .nitems = G_N_ELEMENTS(items),
+    };
+    g_autoptr(GByteArray) buf = virSecurityTransactionBatchEncode(&batch);
+    size_t header = strlen("QEMU") + 2;
+    size_t first = header + 1 + strlen(items[0].path) + 1 +
+                   strlen(items[0].label) + 1;
+    size_t len;
+
+    for (len = 0; len < buf->len; len++) {
+        virSecurityTransactionBatch decoded;
+        int rc;
+
+        rc = virSecurityTransactionBatchDecode((const char *)buf->data,
+                                               len, &decoded);
+
+        if (len == header || len == first) {
+            size_t exp = len == header ? 0 : 1;
+
+            if (rc < 0 || decoded.nitems != exp) {
+                VIR_TEST_DEBUG("length %zu: expected %zu items", len, exp);
+                VIR_FREE(decoded.items);
+                return -1;
+            }
+            VIR_FREE(decoded.items);
+        } else if (rc == 0) {
+            VIR_TEST_DEBUG("length %zu: truncated transaction decoded", len);
+            VIR_FREE(decoded.items);
+            return -1;
+        }
+        virResetLastError();
+    }
+
+    return 0;
+}
+
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/securityutildir-XXXXXX"
+#define TEST_PARALLEL_ITEMS_MAX 32
+
+struct testParallelData {
+    virMutex lock;
+    const char **paths;
+    size_t nitems;
+    int groups[TEST_PARALLEL_ITEMS_MAX]; /* -1 for unique items */
+    bool active[TEST_PARALLEL_ITEMS_MAX]; /* indexed by group */
+    ssize_t last[TEST_PARALLEL_ITEMS_MAX]; /* indexed by group */
+    bool fail[TEST_PARALLEL_ITEMS_MAX];
+    bool broken;
+};
+
+
+static int
+testParallelCallback(size_t item,
+                     void *opaque)
+{
+    struct testParallelData *data = opaque;
+    int group = data->groups[item];
+
+    virMutexLock(&data->lock);
+    if (group >= 0) {
+        if (data->active[group]) {
+            VIR_TEST_DEBUG("item %zu runs concurrently with item %zd",
+                           item, data->last[group]);
+            data->broken = true;
+        }
+        if (data->last[group] >= (ssize_t) item) {
+            VIR_TEST_DEBUG("item %zu runs after item %zd",
+                           item, data->last[group]);
+            data->broken = true;
+        }
+        data->active[group] = true;
+        data->last[group] = item;
+    }
+    virMutexUnlock(&data->lock);
+
+    /* Give other threads a chance to pick the rest of the group */
+    g_usleep(1000);
+
+    virMutexLock(&data->lock);
+    if (group >= 0)
+        data->active[group] = false;
+    virMutexUnlock(&data->lock);
+
+    if (data->fail[item]) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "item %zu failed", item);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testParallelRun(struct testParallelData *data,
+                int *results)
+{
+    size_t i;
+    int rc;
+
+    for (i = 0; i < TEST_PARALLEL_ITEMS_MAX; i++)
+        data->last[i] = -1;
+
+    if (virMutexInit(&data->lock) < 0)
+        return -1;
+
+    rc = virSecurityTransactionRunParallel(data->paths, data->nitems,
+                                           testParallelCallback, data,
+                                           results);
+    virMutexDestroy(&data->lock);
+
+    if (data->broken)
+        return -2;
+
+    return rc;
+}
+
+
+/* Items touching the same file through different paths must be
+ * processed in order and never concurrently. */
+static int
+testParallelGroups(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    g_autofree char *a = g_strdup_printf("%s/a", scratchdir);
+    g_autofree char *b = g_strdup_printf("%s/b", scratchdir);
+    g_autofree char *symlinkA = g_strdup_printf("%s/a-symlink", scratchdir);
+    g_autofree char *hardlinkA = g_strdup_printf("%s/a-hardlink", scratchdir);
+    g_autofree char *missing = g_strdup_printf("%s/missing", scratchdir);
+    const char *paths[] = {
+        a, b, symlinkA, missing, NULL, hardlinkA, missing, b, NULL, a,
+    };
+    const int groups[] = {
+        0, 1, 0, 2, -1, 0, 2, 1, -1, 0,
+    };
+    struct testParallelData data = { .paths = paths,
+                                     .nitems = G_N_ELEMENTS(paths) };
+    int results[G_N_ELEMENTS(paths)];
+    size_t i;
+
+    if (virFileTouch(a, 0600) < 0 ||
+        virFileTouch(b, 0600) < 0 ||
+        symlink(a, symlinkA) < 0 ||
+        link(a, hardlinkA) < 0) {
+        VIR_TEST_DEBUG("unable to create files in %s", scratchdir);
+        return -1;
+    }
+
+    memcpy(data.groups, groups, sizeof(groups));
+
+    if (testParallelRun(&data, results) < 0)
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(results); i++) {
+        if (results[i] != 0) {
+            VIR_TEST_DEBUG("item %zu: expected 0, got %d", i, results[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Once an item fails, the remaining items of its file must not be
+ * processed and reported as such so that only the items which succeeded
+ * are rolled back. The error of the failed item has to reach the caller
+ * even if it was reported by another thread. */
+static int
+testParallelFailure(const void *opaque G_GNUC_UNUSED)
+{
+    const char *paths[] = {
+        "/nonexistent/a", "/nonexistent/a", "/nonexistent/a",
+        "/nonexistent/a", NULL, NULL, NULL, NULL, NULL, NULL,
+    };
+    struct testParallelData data = { .paths = paths,
+                                     .nitems = G_N_ELEMENTS(paths) };
+    int results[G_N_ELEMENTS(paths)];
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(paths); i++)
+        data.groups[i] = paths[i] ? 0 : -1;
+    data.fail[1] = true;
+
+    if (testParallelRun(&data, results) != -1) {
+        VIR_TEST_DEBUG("expected the transaction to fail");
+        return -1;
+    }
+
+    if (STRNEQ_NULLABLE(virGetLastErrorMessage(),
+                        "internal error: item 1 failed")) {
+        VIR_TEST_DEBUG("unexpected error: %s", virGetLastErrorMessage());
+        return -1;
+    }
+    virResetLastError();
+
+    if (results[0] != 0 || results[1] >= 0 ||
+        results[2] != 1 || results[3] != 1) {
+        VIR_TEST_DEBUG("unexpected results %d %d %d %d",
+                       results[0], results[1], results[2], results[3]);
+        return -1;
+    }
+
+    for (i = 4; i < G_N_ELEMENTS(results); i++) {
+        if (results[i] != 0 && results[i] != 1) {
+            VIR_TEST_DEBUG("item %zu: unexpected result %d", i, results[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* With several items failing concurrently the caller must get the error
+ * of the failed item which comes first, not an error reset or overwritten
+ * by another thread. */
+static int
+testParallelFirstError(const void *opaque G_GNUC_UNUSED)
+{
+    const char *paths[TEST_PARALLEL_ITEMS_MAX] = { NULL };
+    struct testParallelData data = { .paths = paths,
+                                     .nitems = G_N_ELEMENTS(paths) };
+    int results[G_N_ELEMENTS(paths)];
+    g_autofree char *exp = NULL;
+    ssize_t first = -1;
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(paths); i++) {
+        data.groups[i] = -1;
+        data.fail[i] = true;
+    }
+
+    if (testParallelRun(&data, results) != -1) {
+        VIR_TEST_DEBUG("expected the transaction to fail");
+        return -1;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(results); i++) {
+        if (results[i] == 1)
+            continue;
+
+        if (results[i] >= 0) {
+            VIR_TEST_DEBUG("item %zu: unexpected result %d", i, results[i]);
+            return -1;
+        }
+
+        if (first < 0)
+            first = i;
+    }
+
+    if (first < 0) {
+        VIR_TEST_DEBUG("no item failed");
+        return -1;
+    }
+
+    exp = g_strdup_printf("internal error: item %zd failed", first);
+    if (STRNEQ_NULLABLE(virGetLastErrorMessage(), exp)) {
+        VIR_TEST_DEBUG("expected '%s', got '%s'",
+                       exp, virGetLastErrorMessage());
+        return -1;
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create securityutildir");
+        abort();
+    }
+
+#define DO_TEST_ROUND_TRIP(name, privileged, lock, items) \
+    do { \
+        static struct testBatchData data = { \
+            "QEMU", privileged, lock, items, G_N_ELEMENTS(items), \
+        }; \
+        if (virTestRun("Batch round trip " name, \
+                       testBatchRoundTrip, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+#define DO_TEST_MALFORMED(name, str) \
+    do { \
+        static struct testBatchMalformedData data = { \
+            str, sizeof(str) - 1, \
+        }; \
+        if (virTestRun("Batch malformed " name, \
+                       testBatchMalformed, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    {
+        static const virSecurityTransactionBatchItem dac[] = {
+            { "/dev/sda", "+107:+107", true, false },
+            { "/var/lib/libvirt/images/a.qcow2", "+0:+0", false, true },
+            { NULL, "+0:+0", false, false },
+        };
+        static const virSecurityTransactionBatchItem selinux[] = {
+            { "/dev/sda", "system_u:object_r:svirt_image_t:s0:c1,c2",
+              true, false },
+            { "/var/lib/libvirt/images/a.qcow2", NULL, true, true },
+            { "/tmp/empty-label", "", false, false },
+        };
+        static const virSecurityTransactionBatchItem none[] = {
+            { NULL, NULL, false, false },
+        };
+
+        DO_TEST_ROUND_TRIP("dac", true, true, dac);
+        DO_TEST_ROUND_TRIP("selinux", false, true, selinux);
+        DO_TEST_ROUND_TRIP("no strings", true, false, none);
+    }
+
+    {
+        static struct testBatchData empty = { "LXC", false, false, NULL, 0 };
+
+        if (virTestRun("Batch round trip empty",
+                       testBatchRoundTrip, &empty) < 0)
+            ret = -1;
+    }
+
+    DO_TEST_MALFORMED("empty", "");
+    DO_TEST_MALFORMED("unterminated driver", "QEMU");
+    DO_TEST_MALFORMED("missing flags", "QEMU\0");
+    DO_TEST_MALFORMED("unknown flags", "QEMU\0\x04");
+    DO_TEST_MALFORMED("unknown item flags", "QEMU\0\x00\x10");
+    DO_TEST_MALFORMED("missing path", "QEMU\0\x00\x04");
+    DO_TEST_MALFORMED("unterminated path", "QEMU\0\x00\x04/dev/sda");
+    DO_TEST_MALFORMED("missing label", "QEMU\0\x00\x0c/dev/sda\0");
+    DO_TEST_MALFORMED("unterminated label", "QEMU\0\x00\x08+107:+107");
+
+    if (virTestRun("Batch truncated", testBatchTruncated, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Parallel groups", testParallelGroups, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Parallel failure", testParallelFailure, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Parallel first error", testParallelFirstError, NULL) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -856,6 +856,197 @@ testCgroupGetMemoryStat(const void *args G_GNUC_UNUSED)
 }
 
 
+/* Statistics files which do not fit into the limit are opened for every
+ * read, the values must not change. */
+static int
+testCgroupStatFilesLimit(const void *args G_GNUC_UNUSED)
+{
+    size_t max[] = { 0, 1, 4096 };
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    for (i = 0; i < G_N_ELEMENTS(max); i++) {
+        virCgroupSetStatFilesMax(max[i]);
+
+        for (j = 0; j < 3; j++) {
+            if (testCgroupGetMemoryStat(NULL) < 0) {
+                VIR_TEST_DEBUG("read %zu with limit %zu failed", j, max[i]);
+                goto cleanup;
+            }
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCgroupSetStatFilesMax(4096);
+    return ret;
+}
+
+
+/* Within a snapshot a statistics file is read only once, changes show up
+ * after the snapshot ends. */
+static int
+testCgroupStatSnapshot(const void *args G_GNUC_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    unsigned long long usage = 0;
+    int ret = -1;
+
+    if (virCgroupNewPartition("/virtualmachines", true,
+                              (1 << VIR_CGROUP_CONTROLLER_CPU) |
+                              (1 << VIR_CGROUP_CONTROLLER_CPUACCT),
+                              &cgroup) < 0)
+        goto cleanup;
+
+    if (virCgroupSetValueStr(cgroup, VIR_CGROUP_CONTROLLER_CPUACCT,
+                             "cpuacct.usage", "1000") < 0)
+        goto cleanup;
+
+    virCgroupBeginStatSnapshot(cgroup);
+
+    if (virCgroupGetCpuacctUsage(cgroup, &usage) < 0 || usage != 1000) {
+        VIR_TEST_DEBUG("expected usage 1000, got %llu", usage);
+        goto endsnapshot;
+    }
+
+    if (virCgroupSetValueStr(cgroup, VIR_CGROUP_CONTROLLER_CPUACCT,
+                             "cpuacct.usage", "2000") < 0)
+        goto endsnapshot;
+
+    if (virCgroupGetCpuacctUsage(cgroup, &usage) < 0 || usage != 1000) {
+        VIR_TEST_DEBUG("expected snapshot usage 1000, got %llu", usage);
+        goto endsnapshot;
+    }
+
+    virCgroupEndStatSnapshot(cgroup);
+
+    if (virCgroupGetCpuacctUsage(cgroup, &usage) < 0 || usage != 2000) {
+        VIR_TEST_DEBUG("expected usage 2000, got %llu", usage);
+        goto cleanup;
+    }
+
+    ret = 0;
+    goto cleanup;
+
+ endsnapshot:
+    virCgroupEndStatSnapshot(cgroup);
+ cleanup:
+    if (cgroup)
+        ignore_value(virCgroupSetValueStr(cgroup,
+                                          VIR_CGROUP_CONTROLLER_CPUACCT,
+                                          "cpuacct.usage",
+                                          "2787788855799582"));
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
+/* A missing optional statistics file is not an error and is not looked
+ * for again. */
+static int
+testCgroupStatOptional(const void *args G_GNUC_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    g_autofree char *path = NULL;
+    g_autofree char *str = NULL;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    if (virCgroupNewPartition("/virtualmachines", true,
+                              (1 << VIR_CGROUP_CONTROLLER_CPU),
+                              &cgroup) < 0)
+        goto cleanup;
+
+    for (i = 0; i < 2; i++) {
+        if ((rc = virCgroupGetOptionalStatValueStr(cgroup,
+                                                   VIR_CGROUP_CONTROLLER_CPU,
+                                                   "cpu.pressure",
+                                                   &str)) != -2) {
+            VIR_TEST_DEBUG("read %zu: expected -2, got %d", i, rc);
+            goto cleanup;
+        }
+
+        /* Once known to be missing, the file is not opened again */
+        if (i == 0 &&
+            (virCgroupPathOfController(cgroup, VIR_CGROUP_CONTROLLER_CPU,
+                                       "cpu.pressure", &path) < 0 ||
+             virFileWriteStr(path, "some avg10=0.00\n", 0600) < 0))
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
+# define CGROUP_STAT_BENCH_LOOPS 100000
+
+static int
+testCgroupStatFilesBenchOne(size_t max,
+                            unsigned long long *duration)
+{
+    virCgroupPtr cgroup = NULL;
+    unsigned long long values[6];
+    unsigned long long start;
+    size_t i;
+    int ret = -1;
+
+    virCgroupSetStatFilesMax(max);
+
+    if (virCgroupNewPartition("/virtualmachines", true,
+                              (1 << VIR_CGROUP_CONTROLLER_MEMORY),
+                              &cgroup) < 0)
+        goto cleanup;
+
+    start = g_get_monotonic_time();
+
+    for (i = 0; i < CGROUP_STAT_BENCH_LOOPS; i++) {
+        if (virCgroupGetMemoryStat(cgroup, &values[0],
+                                   &values[1], &values[2],
+                                   &values[3], &values[4],
+                                   &values[5]) < 0)
+            goto cleanup;
+    }
+
+    *duration = g_get_monotonic_time() - start;
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
+/* Compares reading memory.stat through the kept open file with opening it
+ * for every read. */
+static int
+testCgroupStatFilesBench(const void *args G_GNUC_UNUSED)
+{
+    unsigned long long cached = 0;
+    unsigned long long uncached = 0;
+    int ret = -1;
+
+    if (testCgroupStatFilesBenchOne(4096, &cached) < 0 ||
+        testCgroupStatFilesBenchOne(0, &uncached) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%d reads: cached %llu us, uncached %llu us",
+                   CGROUP_STAT_BENCH_LOOPS, cached, uncached);
+
+    ret = 0;
+
+ cleanup:
+    virCgroupSetStatFilesMax(4096);
+    return ret;
+}
+
+
 static int testCgroupGetBlkioIoServiced(const void *args G_GNUC_UNUSED)
 {
     virCgroupPtr cgroup = NULL;
@@ -1089,6 +1280,19 @@ mymain(void)
     if (virTestRun("virCgroupGetMemoryStat works", testCgroupGetMemoryStat, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Cgroup statistics files limit", testCgroupStatFilesLimit, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Cgroup statistics snapshot", testCgroupStatSnapshot, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Cgroup optional statistics", testCgroupStatOptional, NULL) < 0)
+        ret = -1;
+
+    if (virTestGetExpensive() &&
+        virTestRun("Cgroup statistics files benchmark", testCgroupStatFilesBench, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("virCgroupGetPercpuStats works", testCgroupGetPercpuStats, NULL) < 0)
         ret = -1;
     cleanupFakeFS(fakerootdir);
@@ -23,6 +23,8 @@
 
 #include "virfile.h"
 #include "virfilecache.h"
+#include "virthread.h"
+#include "virtime.h"
 
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -195,6 +197,168 @@ testFileCache(const void *opaque)
 }
 
 
+/*
+ * Data for different names is created concurrently while lookups of
+ * the same name wait for the data being created.
+ */
+struct _testFileCacheConcurrentPriv {
+    virMutex lock;
+    virCond cond;
+    size_t nactive;     /* newData calls running right now */
+    size_t maxactive;   /* most newData calls running at once */
+    size_t ncalls;
+};
+typedef struct _testFileCacheConcurrentPriv testFileCacheConcurrentPriv;
+typedef testFileCacheConcurrentPriv *testFileCacheConcurrentPrivPtr;
+
+
+static bool
+testFileCacheConcurrentIsValid(void *data G_GNUC_UNUSED,
+                               void *priv G_GNUC_UNUSED)
+{
+    return true;
+}
+
+
+static void *
+testFileCacheConcurrentNewData(const char *name,
+                               void *priv)
+{
+    testFileCacheConcurrentPrivPtr testPriv = priv;
+    unsigned long long deadline;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        return NULL;
+    deadline += 5000;
+
+    virMutexLock(&testPriv->lock);
+    testPriv->ncalls++;
+    testPriv->nactive++;
+    testPriv->maxactive = MAX(testPriv->maxactive, testPriv->nactive);
+    virCondBroadcast(&testPriv->cond);
+
+    /* wait for the data of the other name to be created too */
+    while (testPriv->maxactive < 2) {
+        if (virCondWaitUntil(&testPriv->cond, &testPriv->lock, deadline) < 0)
+            break;
+    }
+
+    testPriv->nactive--;
+    virMutexUnlock(&testPriv->lock);
+
+    return testFileCacheObjNew(name);
+}
+
+
+static int
+testFileCacheConcurrentSaveFile(void *data G_GNUC_UNUSED,
+                                const char *filename G_GNUC_UNUSED,
+                                void *priv G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+
+virFileCacheHandlers testFileCacheConcurrentHandlers = {
+    .isValid = testFileCacheConcurrentIsValid,
+    .newData = testFileCacheConcurrentNewData,
+    .loadFile = testFileCacheLoadFile,
+    .saveFile = testFileCacheConcurrentSaveFile
+};
+
+
+struct _testFileCacheLookupData {
+    virFileCachePtr cache;
+    const char *name;
+    testFileCacheObjPtr obj;
+};
+typedef struct _testFileCacheLookupData testFileCacheLookupData;
+
+
+static void
+testFileCacheLookupThread(void *opaque)
+{
+    testFileCacheLookupData *data = opaque;
+
+    data->obj = virFileCacheLookup(data->cache, data->name);
+}
+
+
+static int
+testFileCacheConcurrent(const void *opaque G_GNUC_UNUSED)
+{
+    testFileCacheConcurrentPriv testPriv = { 0 };
+    virFileCachePtr cache = NULL;
+    testFileCacheLookupData lookups[] = {
+        { NULL, "concurrentA", NULL },
+        { NULL, "concurrentB", NULL },
+        { NULL, "concurrentA", NULL },
+    };
+    virThread threads[G_N_ELEMENTS(lookups)];
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&testPriv.lock) < 0)
+        return -1;
+    if (virCondInit(&testPriv.cond) < 0)
+        goto cleanup;
+
+    if (!(cache = virFileCacheNew(abs_srcdir "/virfilecachedata",
+                                  "cache", &testFileCacheConcurrentHandlers)))
+        goto cleanup;
+
+    virFileCacheSetPriv(cache, &testPriv);
+
+    for (nthreads = 0; nthreads < G_N_ELEMENTS(lookups); nthreads++) {
+        lookups[nthreads].cache = cache;
+        if (virThreadCreate(&threads[nthreads], true,
+                            testFileCacheLookupThread,
+                            &lookups[nthreads]) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+    nthreads = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(lookups); i++) {
+        if (!lookups[i].obj || STRNEQ_NULLABLE(lookups[i].obj->data,
+                                               lookups[i].name)) {
+            fprintf(stderr, "Wrong data for '%s'.\n", lookups[i].name);
+            goto cleanup;
+        }
+    }
+
+    if (testPriv.maxactive != 2) {
+        fprintf(stderr, "Expected data of 2 names to be created at once, got %zu.\n",
+                testPriv.maxactive);
+        goto cleanup;
+    }
+
+    if (testPriv.ncalls != 2) {
+        fprintf(stderr, "Expected data to be created 2 times, got %zu.\n",
+                testPriv.ncalls);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+    for (i = 0; i < G_N_ELEMENTS(lookups); i++)
+        virObjectUnref(lookups[i].obj);
+    /* the cache does not own the private data */
+    if (cache)
+        virFileCacheSetPriv(cache, NULL);
+    virObjectUnref(cache);
+    virCondDestroy(&testPriv.cond);
+    virMutexDestroy(&testPriv.lock);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -225,6 +389,9 @@ mymain(void)
 
     virObjectUnref(cache);
 
+    if (virTestRun("cacheConcurrent", testFileCacheConcurrent, NULL) < 0)
+        ret = -1;
+
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
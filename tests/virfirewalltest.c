@@ -1080,6 +1080,181 @@ testFirewallQuery(const void *opaque G_GNUC_UNUSED)
     return ret;
 }
 
+
+static void
+testFirewallBatchHook(const char *const*args,
+                      const char *const*env G_GNUC_UNUSED,
+                      const char *input,
+                      char **output G_GNUC_UNUSED,
+                      char **error G_GNUC_UNUSED,
+                      int *status,
+                      void *opaque)
+{
+    virBufferPtr buf = opaque;
+
+    if (!input)
+        return;
+
+    virBufferAdd(buf, input, -1);
+
+    /* Fake failure of the batch adding this IP addr */
+    if (STRNEQ(args[0], IPTABLES_PATH) &&
+        strstr(input, "-A INPUT --source-host 192.168.122.255"))
+        *status = 1;
+}
+
+
+static int
+testFirewallBatch(const void *opaque G_GNUC_UNUSED)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virFirewall) fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_PATH "-restore --noflush\n"
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "COMMIT\n"
+        EBTABLES_PATH "-restore --noflush\n"
+        "*nat\n"
+        "-A PREROUTING -i vnet0 -j libvirt-J-vnet0\n"
+        "COMMIT\n"
+        IPTABLES_PATH " -D INPUT --jump DROP\n"
+        IPTABLES_PATH "-restore --noflush\n"
+        "*filter\n"
+        "-A INPUT -m comment --comment \"a \\\"quoted\\\" comment\" --jump REJECT\n"
+        "COMMIT\n"
+        "*mangle\n"
+        "-A POSTROUTING --jump ACCEPT\n"
+        "COMMIT\n";
+
+    if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0)
+        goto cleanup;
+
+    virFirewallSetBatchOverride(true);
+    virCommandSetDryRun(&cmdbuf, testFirewallBatchHook, &cmdbuf);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_ETHERNET,
+                       "-t", "nat",
+                       "-A", "PREROUTING",
+                       "-i", "vnet0",
+                       "-j", "libvirt-J-vnet0", NULL);
+
+    virFirewallAddRuleFull(fw, VIR_FIREWALL_LAYER_IPV4,
+                           true, NULL, NULL,
+                           "-D", "INPUT",
+                           "--jump", "DROP", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "-m", "comment",
+                       "--comment", "a \"quoted\" comment",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "--table", "mangle",
+                       "-A", "POSTROUTING",
+                       "--jump", "ACCEPT", NULL);
+
+    if (virFirewallApply(fw) < 0)
+        goto cleanup;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&cmdbuf);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallSetBatchOverride(false);
+    return ret;
+}
+
+
+static int
+testFirewallBatchRollback(const void *opaque G_GNUC_UNUSED)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virFirewall) fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_PATH "-restore --noflush\n"
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "-A INPUT --source-host 192.168.122.255 --jump REJECT\n"
+        "COMMIT\n"
+        IPTABLES_PATH " -D INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        IPTABLES_PATH " -D INPUT --source-host 192.168.122.255 --jump REJECT\n";
+
+    if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0)
+        goto cleanup;
+
+    virFirewallSetBatchOverride(true);
+    virCommandSetDryRun(&cmdbuf, testFirewallBatchHook, &cmdbuf);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.255",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallStartRollback(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-D", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-D", "INPUT",
+                       "--source-host", "192.168.122.255",
+                       "--jump", "REJECT", NULL);
+
+    if (virFirewallApply(fw) == 0) {
+        fprintf(stderr, "Firewall apply unexpectedly worked\n");
+        goto cleanup;
+    }
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&cmdbuf);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallSetBatchOverride(false);
+    return ret;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -1150,6 +1325,11 @@ mymain(void)
     RUN_TEST("chained rollback", testFirewallChainedRollback);
     RUN_TEST("query transaction", testFirewallQuery);
 
+    if (virTestRun("batch transaction", testFirewallBatch, NULL) < 0)
+        ret = -1;
+    if (virTestRun("batch rollback", testFirewallBatchRollback, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
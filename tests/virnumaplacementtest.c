@@ -0,0 +1,395 @@
+/*
+ * virnumaplacementtest.c: Test automatic NUMA placement
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virfilewrapper.h"
+#include "virnumaplacement.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define MAX_NODES 4
+
+struct testNode {
+    unsigned long long memTotal; /* in GiB */
+    unsigned long long memFree; /* in GiB */
+    unsigned int ncpus;
+    double load;
+    double pinned;
+};
+
+struct testPlacementData {
+    const char *topology;
+    size_t nnodes;
+    unsigned int ncpus; /* of all nodes */
+    struct testNode nodes[MAX_NODES];
+    int distances[MAX_NODES][MAX_NODES];
+    unsigned int vcpus;
+    unsigned long long memory; /* in GiB */
+    const char *current;
+    const char *expect;
+};
+
+
+static virNumaPlacementHostPtr
+testPlacementHostNew(const struct testPlacementData *data)
+{
+    g_autoptr(virNumaPlacementHost) host = NULL;
+    size_t i;
+    size_t j;
+
+    if (VIR_ALLOC(host) < 0 ||
+        VIR_ALLOC_N(host->nodes, data->nnodes) < 0)
+        return NULL;
+
+    host->nnodes = data->nnodes;
+
+    for (i = 0; i < data->nnodes; i++) {
+        virNumaPlacementNodePtr node = &host->nodes[i];
+
+        node->id = i;
+        node->memTotal = data->nodes[i].memTotal * 1024 * 1024;
+        node->memFree = data->nodes[i].memFree * 1024 * 1024;
+        node->ncpus = data->nodes[i].ncpus;
+        node->load = data->nodes[i].load;
+        node->pinned = data->nodes[i].pinned;
+
+        if (data->distances[i][i] == 0)
+            continue;
+
+        if (VIR_ALLOC_N(node->distances, data->nnodes) < 0)
+            return NULL;
+        node->ndistances = data->nnodes;
+
+        for (j = 0; j < data->nnodes; j++)
+            node->distances[j] = data->distances[i][j];
+    }
+
+    return g_steal_pointer(&host);
+}
+
+
+static int
+testPlacementAdvise(const void *opaque)
+{
+    const struct testPlacementData *data = opaque;
+    g_autoptr(virNumaPlacementHost) host = NULL;
+    g_autoptr(virBitmap) nodeset = NULL;
+    g_autofree char *actual = NULL;
+
+    if (!(host = testPlacementHostNew(data)))
+        return -1;
+
+    if (!(nodeset = virNumaPlacementAdvise(host, data->vcpus,
+                                           data->memory * 1024 * 1024)) ||
+        !(actual = virBitmapFormat(nodeset)))
+        return -1;
+
+    if (STRNEQ(actual, data->expect)) {
+        VIR_TEST_DEBUG("expected nodeset '%s', got '%s'",
+                       data->expect, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Collects the host data from the sysfs of one of the vircaps2xmldata
+ * fixtures */
+static virNumaPlacementHostPtr
+testPlacementHostLoad(const char *topology)
+{
+    virNumaPlacementHostPtr host;
+    g_autofree char *system = NULL;
+
+    system = g_strdup_printf("%s/vircaps2xmldata/linux-%s/system",
+                             abs_srcdir, topology);
+
+    virFileWrapperAddPrefix("/sys/devices/system", system);
+    host = virNumaPlacementHostNew();
+    virFileWrapperClearPrefixes();
+
+    return host;
+}
+
+
+static int
+testPlacementHost(const void *opaque)
+{
+    const struct testPlacementData *data = opaque;
+    g_autoptr(virNumaPlacementHost) host = NULL;
+    g_autoptr(virBitmap) nodeset = NULL;
+    g_autofree char *actual = NULL;
+    unsigned int ncpus = 0;
+    size_t i;
+
+    if (!(host = testPlacementHostLoad(data->topology)))
+        return -1;
+
+    if (host->nnodes != data->nnodes) {
+        VIR_TEST_DEBUG("expected %zu nodes, got %zu",
+                       data->nnodes, host->nnodes);
+        return -1;
+    }
+
+    for (i = 0; i < host->nnodes; i++)
+        ncpus += host->nodes[i].ncpus;
+
+    if (ncpus != data->ncpus) {
+        VIR_TEST_DEBUG("expected %u CPUs, got %u", data->ncpus, ncpus);
+        return -1;
+    }
+
+    if (!(nodeset = virNumaPlacementAdvise(host, data->vcpus,
+                                           data->memory * 1024 * 1024)) ||
+        !(actual = virBitmapFormat(nodeset)))
+        return -1;
+
+    if (STRNEQ(actual, data->expect)) {
+        VIR_TEST_DEBUG("expected nodeset '%s', got '%s'",
+                       data->expect, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+struct testLoadStep {
+    const char *stat;
+    const char *expect;
+};
+
+struct testLoadData {
+    const char *topology;
+    const struct testLoadStep *steps;
+    size_t nsteps;
+};
+
+
+/* Places a domain after each of a series of CPU time samples, the load
+ * taken into account is the one between two consecutive samples */
+static int
+testPlacementLoad(const void *opaque)
+{
+    const struct testLoadData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < data->nsteps; i++) {
+        g_autoptr(virNumaPlacementHost) host = NULL;
+        g_autoptr(virBitmap) nodeset = NULL;
+        g_autofree char *stat = NULL;
+        g_autofree char *actual = NULL;
+        int rc;
+
+        if (!(host = testPlacementHostLoad(data->topology)))
+            return -1;
+
+        stat = g_strdup_printf("%s/virnumaplacementdata/%s.stat",
+                               abs_srcdir, data->steps[i].stat);
+
+        virFileWrapperAddPrefix("/proc/stat", stat);
+        rc = virNumaPlacementHostUpdateLoad(host);
+        virFileWrapperClearPrefixes();
+
+        if (rc < 0)
+            return -1;
+
+        if (!(nodeset = virNumaPlacementAdvise(host, 2, 0)) ||
+            !(actual = virBitmapFormat(nodeset)))
+            return -1;
+
+        if (STRNEQ(actual, data->steps[i].expect)) {
+            VIR_TEST_DEBUG("%s: expected nodeset '%s', got '%s'",
+                           data->steps[i].stat, data->steps[i].expect,
+                           actual);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testPlacementRecommend(const void *opaque)
+{
+    const struct testPlacementData *data = opaque;
+    g_autoptr(virNumaPlacementHost) host = NULL;
+    g_autoptr(virBitmap) current = NULL;
+    g_autoptr(virBitmap) nodeset = NULL;
+    g_autofree char *actual = NULL;
+    unsigned long long memory = data->memory * 1024 * 1024;
+    int rc;
+
+    if (!(host = testPlacementHostNew(data)))
+        return -1;
+
+    if (virBitmapParse(data->current, &current, MAX_NODES) < 0)
+        return -1;
+
+    virNumaPlacementHostReleaseDomain(host, current, memory);
+
+    if ((rc = virNumaPlacementRecommend(host, current, data->vcpus,
+                                        memory, &nodeset)) < 0)
+        return -1;
+
+    if (rc == 0) {
+        if (data->expect) {
+            VIR_TEST_DEBUG("expected nodeset '%s', got none", data->expect);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!(actual = virBitmapFormat(nodeset)))
+        return -1;
+
+    if (!data->expect || STRNEQ(actual, data->expect)) {
+        VIR_TEST_DEBUG("expected nodeset '%s', got '%s'",
+                       NULLSTR(data->expect), actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define DO_TEST(name, func, ...) \
+    do { \
+        struct testPlacementData data = { __VA_ARGS__ }; \
+        if (virTestRun(name, func, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+#define DO_TEST_ADVISE(name, ...) \
+    DO_TEST("Advise " name, testPlacementAdvise, __VA_ARGS__)
+#define DO_TEST_RECOMMEND(name, ...) \
+    DO_TEST("Recommend " name, testPlacementRecommend, __VA_ARGS__)
+#define DO_TEST_HOST(name, ...) \
+    DO_TEST("Host " name, testPlacementHost, .topology = name, __VA_ARGS__)
+
+    /* The virnuma mock reports (N + 1) GiB of memory on node N with 1 GiB
+     * free on each node and no distances */
+    DO_TEST_HOST("basic", .nnodes = 4, .ncpus = 16,
+                 .vcpus = 2, .memory = 0, .expect = "0");
+    DO_TEST_HOST("basic", .nnodes = 4, .ncpus = 16,
+                 .vcpus = 8, .memory = 3, .expect = "0-2");
+    DO_TEST_HOST("basic-dies", .nnodes = 1, .ncpus = 12,
+                 .vcpus = 16, .memory = 0, .expect = "0");
+    DO_TEST_HOST("caches", .nnodes = 1, .ncpus = 8,
+                 .vcpus = 4, .memory = 1, .expect = "0");
+    DO_TEST_HOST("resctrl", .nnodes = 2, .ncpus = 12,
+                 .vcpus = 4, .memory = 1, .expect = "0");
+    DO_TEST_HOST("resctrl", .nnodes = 2, .ncpus = 12,
+                 .vcpus = 8, .memory = 1, .expect = "0-1");
+    DO_TEST_HOST("resctrl", .nnodes = 2, .ncpus = 12,
+                 .vcpus = 2, .memory = 2, .expect = "0-1");
+    DO_TEST_HOST("resctrl-skx", .nnodes = 1, .ncpus = 1,
+                 .vcpus = 1, .memory = 1, .expect = "0");
+
+    /* Without any load node 0 of the resctrl host wins for having all of
+     * its memory free. Node 0 is busy in the second sample and idle in the
+     * last one, the third sample is too close to the second one to be
+     * used. */
+    {
+        const struct testLoadStep steps[] = {
+            { "resctrl-1", "0" },
+            { "resctrl-2", "1" },
+            { "resctrl-3", "1" },
+            { "resctrl-4", "0" },
+        };
+        struct testLoadData data = { "resctrl", steps, G_N_ELEMENTS(steps) };
+
+        if (virTestRun("Load resctrl", testPlacementLoad, &data) < 0)
+            ret = -1;
+    }
+
+    DO_TEST_ADVISE("least loaded node",
+                   .nnodes = 2,
+                   .nodes = { { 16, 8, 8, 0.5, 0 }, { 16, 8, 8, 0.1, 0 } },
+                   .vcpus = 4, .memory = 4, .expect = "1");
+
+    DO_TEST_ADVISE("most free memory",
+                   .nnodes = 2,
+                   .nodes = { { 16, 12, 8, 0, 0 }, { 16, 4, 8, 0, 0 } },
+                   .vcpus = 4, .memory = 2, .expect = "0");
+
+    DO_TEST_ADVISE("pinned vCPUs",
+                   .nnodes = 2,
+                   .nodes = { { 16, 8, 8, 0, 6 }, { 16, 8, 8, 0, 0 } },
+                   .vcpus = 4, .memory = 4, .expect = "1");
+
+    DO_TEST_ADVISE("only fitting node",
+                   .nnodes = 2,
+                   .nodes = { { 16, 2, 8, 0, 0 }, { 16, 6, 8, 0.8, 0 } },
+                   .vcpus = 4, .memory = 4, .expect = "1");
+
+    DO_TEST_ADVISE("span nearest node",
+                   .nnodes = 4,
+                   .nodes = { { 16, 10, 8, 0, 0 }, { 16, 10, 8, 0.2, 0 },
+                              { 16, 10, 8, 0.2, 0 }, { 16, 10, 8, 0.2, 0 } },
+                   .distances = { { 10, 21, 12, 21 }, { 21, 10, 21, 12 },
+                                  { 12, 21, 10, 21 }, { 21, 12, 21, 10 } },
+                   .vcpus = 8, .memory = 16, .expect = "0,2");
+
+    DO_TEST_ADVISE("span without distances",
+                   .nnodes = 3,
+                   .nodes = { { 16, 8, 4, 0.3, 0 }, { 16, 8, 4, 0, 0 },
+                              { 16, 8, 4, 0.5, 0 } },
+                   .vcpus = 6, .memory = 12, .expect = "0-1");
+
+    DO_TEST_ADVISE("memory only node",
+                   .nnodes = 2,
+                   .nodes = { { 16, 8, 8, 0, 0 }, { 64, 64, 0, 0, 0 } },
+                   .vcpus = 4, .memory = 32, .expect = "0-1");
+
+    DO_TEST_ADVISE("overcommit",
+                   .nnodes = 2,
+                   .nodes = { { 16, 8, 4, 0, 0 }, { 16, 8, 4, 0, 0 } },
+                   .vcpus = 16, .memory = 4, .expect = "0-1");
+
+    DO_TEST_RECOMMEND("stay",
+                      .nnodes = 2,
+                      .nodes = { { 16, 4, 8, 0.3, 0 }, { 16, 8, 8, 0.2, 0 } },
+                      .vcpus = 4, .memory = 4, .current = "0",
+                      .expect = NULL);
+
+    DO_TEST_RECOMMEND("move off busy node",
+                      .nnodes = 2,
+                      .nodes = { { 16, 4, 8, 0.9, 4 }, { 16, 12, 8, 0.1, 0 } },
+                      .vcpus = 4, .memory = 4, .current = "0",
+                      .expect = "1");
+
+    DO_TEST_RECOMMEND("consolidate",
+                      .nnodes = 2,
+                      .nodes = { { 16, 14, 8, 0, 0 }, { 16, 2, 8, 0.9, 8 } },
+                      .vcpus = 4, .memory = 4, .current = "0-1",
+                      .expect = "0");
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("virnuma"))
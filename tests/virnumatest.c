@@ -0,0 +1,201 @@
+/*
+ * virnumatest.c: Test moving memory of processes between NUMA nodes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virfilewrapper.h"
+#include "virnuma.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_PID 1234
+#define TEST_CHUNK (64 * 1024 * 1024)
+#define MAX_RANGES 8
+
+struct testRange {
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long pagesize;
+    size_t nchunks;
+};
+
+struct testRangesData {
+    const char *name;
+    const char *nodes;
+    size_t nranges;
+    struct testRange ranges[MAX_RANGES];
+};
+
+
+/* Splits @range into chunks the way the memory of a domain is moved and
+ * checks that each of them consists of whole pages. */
+static int
+testRangeChunks(const virNumaMemoryRange *range,
+                size_t *nchunks)
+{
+    unsigned long long start = range->start;
+
+    *nchunks = 0;
+
+    while (start < range->end) {
+        unsigned long long end;
+
+        end = virNumaMemoryRangeNextChunk(range, start, TEST_CHUNK);
+
+        if (end <= start || end > range->end ||
+            (end - start) % range->pagesize != 0 ||
+            end - start > MAX(TEST_CHUNK, range->pagesize)) {
+            VIR_TEST_DEBUG("bad chunk %llx-%llx of range %llx-%llx",
+                           start, end, range->start, range->end);
+            return -1;
+        }
+
+        start = end;
+        (*nchunks)++;
+    }
+
+    return 0;
+}
+
+
+static int
+testRanges(const void *opaque)
+{
+    const struct testRangesData *data = opaque;
+    g_autoptr(virBitmap) nodes = NULL;
+    g_autofree virNumaMemoryRangePtr ranges = NULL;
+    g_autofree char *proc = NULL;
+    size_t nranges = 0;
+    size_t i;
+    int rc;
+
+    if (virBitmapParse(data->nodes, &nodes, 8) < 0)
+        return -1;
+
+    proc = g_strdup_printf("%s/virnumadata/%s", abs_srcdir, data->name);
+
+    virFileWrapperAddPrefix("/proc/" G_STRINGIFY(TEST_PID), proc);
+    rc = virNumaGetProcessRanges(TEST_PID, nodes, &ranges, &nranges);
+    virFileWrapperClearPrefixes();
+
+    if (rc < 0)
+        return -1;
+
+    if (nranges != data->nranges) {
+        VIR_TEST_DEBUG("expected %zu ranges, got %zu",
+                       data->nranges, nranges);
+        return -1;
+    }
+
+    for (i = 0; i < nranges; i++) {
+        const struct testRange *exp = &data->ranges[i];
+        size_t nchunks;
+
+        if (ranges[i].start != exp->start ||
+            ranges[i].end != exp->end ||
+            ranges[i].pagesize != exp->pagesize) {
+            VIR_TEST_DEBUG("range %zu: expected %llx-%llx (%llu), "
+                           "got %llx-%llx (%llu)", i,
+                           exp->start, exp->end, exp->pagesize,
+                           ranges[i].start, ranges[i].end,
+                           ranges[i].pagesize);
+            return -1;
+        }
+
+        if (testRangeChunks(&ranges[i], &nchunks) < 0)
+            return -1;
+
+        if (nchunks != exp->nchunks) {
+            VIR_TEST_DEBUG("range %zu: expected %zu chunks, got %zu",
+                           i, exp->nchunks, nchunks);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* A chunk smaller than the page backing it must not be reported as moved
+ * successfully without anything being moved. */
+static int
+testMovePagesPartial(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virBitmap) from = NULL;
+    g_autoptr(virBitmap) to = NULL;
+    unsigned long long moved = 0;
+
+    if (virBitmapParse("0", &from, 8) < 0 ||
+        virBitmapParse("1", &to, 8) < 0)
+        return -1;
+
+    if (virNumaMovePages(TEST_PID, 0x7f0f00000000ULL,
+                         0x7f0f00000000ULL + TEST_CHUNK,
+                         1024 * 1024 * 1024, from, to, &moved) == 0) {
+        VIR_TEST_DEBUG("moving a part of a huge page succeeded");
+        return -1;
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define DO_TEST_RANGES(_name, _nodes, ...) \
+    do { \
+        static struct testRangesData data = { \
+            .name = _name, .nodes = _nodes, __VA_ARGS__ \
+        }; \
+        if (virTestRun("Ranges " _name " nodes " _nodes, \
+                       testRanges, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_RANGES("hugepages", "0",
+                   .nranges = 3,
+                   .ranges = {
+                       { 0x55d4c4a00000ULL, 0x55d4c5600000ULL, 4096, 1 },
+                       { 0x7f0e00000000ULL, 0x7f0e80000000ULL, 4096, 32 },
+                       { 0x7f0f00000000ULL, 0x7f0fc0000000ULL,
+                         1024 * 1024 * 1024, 3 },
+                   });
+
+    DO_TEST_RANGES("hugepages", "1",
+                   .nranges = 3,
+                   .ranges = {
+                       { 0x7f0e00000000ULL, 0x7f0e80000000ULL, 4096, 32 },
+                       { 0x7f1000000000ULL, 0x7f1000a00000ULL,
+                         2 * 1024 * 1024, 1 },
+                       { 0x7ffd8e7e0000ULL, 0x7ffd8e801000ULL, 4096, 1 },
+                   });
+
+    DO_TEST_RANGES("hugepages", "2", .nranges = 0);
+
+    if (virTestRun("Move part of a huge page", testMovePagesPartial, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,168 @@
+/*
+ * virpsitest.c: Test pressure stall information parsing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virfilewrapper.h"
+#include "virpsi.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+struct testPSIData {
+    const char *str;
+    bool fail;
+    virPSIStats expect;
+};
+
+
+static int
+testPSILineCompare(const char *name,
+                   const virPSILine *actual,
+                   const virPSILine *expect)
+{
+    if (actual->avg10 != expect->avg10 ||
+        actual->avg60 != expect->avg60 ||
+        actual->avg300 != expect->avg300 ||
+        actual->total != expect->total) {
+        VIR_TEST_DEBUG("%s: expected %g %g %g %llu, got %g %g %g %llu",
+                       name,
+                       expect->avg10, expect->avg60, expect->avg300,
+                       expect->total,
+                       actual->avg10, actual->avg60, actual->avg300,
+                       actual->total);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testPSIParse(const void *opaque)
+{
+    const struct testPSIData *data = opaque;
+    virPSIStats stats;
+    int rc;
+
+    rc = virPSIParse(data->str, &stats);
+
+    if (data->fail) {
+        if (rc == 0) {
+            VIR_TEST_DEBUG("parsing '%s' should have failed", data->str);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (rc < 0)
+        return -1;
+
+    if (testPSILineCompare("some", &stats.some, &data->expect.some) < 0 ||
+        testPSILineCompare("full", &stats.full, &data->expect.full) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/* The host in virpsidata provides cpu and memory pressure, but not io */
+static int
+testPSIHostParams(const void *opaque G_GNUC_UNUSED)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned long long total;
+    double avg;
+    int ret = -1;
+
+    virFileWrapperAddPrefix("/proc/pressure",
+                            abs_srcdir "/virpsidata/pressure");
+
+    if (virPSIGetHostParams(&params, &nparams) < 0)
+        goto cleanup;
+
+    if (nparams != 16) {
+        VIR_TEST_DEBUG("expected 16 parameters, got %d", nparams);
+        goto cleanup;
+    }
+
+    if (virTypedParamsGetULLong(params, nparams, "cpu.some.total", &total) != 1 ||
+        total != 157656722000ULL) {
+        VIR_TEST_DEBUG("wrong cpu.some.total");
+        goto cleanup;
+    }
+
+    if (virTypedParamsGetDouble(params, nparams, "memory.full.avg60", &avg) != 1 ||
+        avg != 0.02) {
+        VIR_TEST_DEBUG("wrong memory.full.avg60");
+        goto cleanup;
+    }
+
+    if (virTypedParamsGet(params, nparams, "io.some.total")) {
+        VIR_TEST_DEBUG("io pressure should not be reported");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virFileWrapperClearPrefixes();
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define DO_TEST_FULL(name, s, f, ...) \
+    do { \
+        struct testPSIData data = { .str = s, .fail = f, .expect = __VA_ARGS__ }; \
+        if (virTestRun("PSI " name, testPSIParse, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+#define DO_TEST(name, s, ...) DO_TEST_FULL(name, s, false, __VA_ARGS__)
+#define DO_TEST_FAIL(name, s) DO_TEST_FULL(name, s, true, { { 0 } })
+
+    DO_TEST("some and full",
+            "some avg10=1.50 avg60=0.25 avg300=0.00 total=12345\n"
+            "full avg10=0.75 avg60=0.00 avg300=0.00 total=678\n",
+            { .some = { 1.5, 0.25, 0, 12345000 },
+              .full = { 0.75, 0, 0, 678000 } });
+
+    DO_TEST("some only",
+            "some avg10=0.00 avg60=0.00 avg300=0.00 total=0",
+            { .some = { 0, 0, 0, 0 } });
+
+    DO_TEST_FAIL("empty", "");
+    DO_TEST_FAIL("missing some",
+                 "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+    DO_TEST_FAIL("malformed",
+                 "some avg10=0.00 avg60=abc avg300=0.00 total=0\n");
+
+    if (virTestRun("PSI host parameters", testPSIHostParams, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
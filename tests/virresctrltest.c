@@ -75,6 +75,93 @@ test_virResctrlGetUnused(const void *opaque)
 }
 
 
+struct virResctrlResizeData {
+    bool memory;
+    unsigned int id;
+    int delta;
+    unsigned int max;
+    unsigned long long size; /* requested size in KiB or bandwidth */
+    const char *expect; /* NULL if nothing should change */
+};
+
+
+static int
+test_virResctrlResize(const void *opaque)
+{
+    const struct virResctrlResizeData *data = opaque;
+    g_autofree char *system_dir = NULL;
+    g_autofree char *resctrl_dir = NULL;
+    g_autofree char *actual = NULL;
+    g_autoptr(virResctrlAlloc) alloc = NULL;
+    g_autoptr(virResctrlAlloc) update = NULL;
+    virCapsPtr caps = NULL;
+    int rv = -1;
+    int ret = -1;
+
+    system_dir = g_strdup_printf("%s/vircaps2xmldata/linux-resctrl/system",
+                                 abs_srcdir);
+    resctrl_dir = g_strdup_printf("%s/virresctrldata/resize", abs_srcdir);
+
+    virFileWrapperAddPrefix("/sys/devices/system", system_dir);
+    virFileWrapperAddPrefix("/sys/fs/resctrl", resctrl_dir);
+
+    caps = virCapabilitiesNew(VIR_ARCH_X86_64, false, false);
+    if (!caps || virCapabilitiesInitCaches(caps) < 0)
+        goto cleanup;
+
+    if (!(alloc = virResctrlAllocNew()))
+        goto cleanup;
+
+    if (data->memory) {
+        if (virResctrlAllocSetMemoryBandwidth(alloc, data->id, data->size) < 0)
+            goto cleanup;
+    } else {
+        if (virResctrlAllocSetCacheSize(alloc, 3, VIR_CACHE_TYPE_BOTH,
+                                        data->id, data->size * 1024) < 0)
+            goto cleanup;
+    }
+
+    if (virResctrlAllocSetID(alloc, "vcpus_0") < 0 ||
+        virResctrlAllocDeterminePath(alloc, "qemu-1-test") < 0)
+        goto cleanup;
+
+    if (data->memory) {
+        rv = virResctrlAllocPrepareMemoryBandwidthResize(caps->host.resctrl,
+                                                         alloc, data->id,
+                                                         data->delta, &update);
+    } else {
+        rv = virResctrlAllocPrepareCacheResize(caps->host.resctrl, alloc, 3,
+                                               VIR_CACHE_TYPE_BOTH, data->id,
+                                               data->delta, data->max,
+                                               &update);
+    }
+
+    if (rv < 0)
+        goto cleanup;
+
+    if (rv == 0) {
+        if (data->expect) {
+            VIR_TEST_DEBUG("expected '%s', got no change", data->expect);
+            goto cleanup;
+        }
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(actual = virResctrlAllocFormat(update)))
+        goto cleanup;
+
+    if (virTestCompareToString(NULLSTR(data->expect), actual) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virFileWrapperClearPrefixes();
+    virObjectUnref(caps);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -93,6 +180,38 @@ mymain(void)
     DO_TEST_UNUSED("resctrl-skx");
     DO_TEST_UNUSED("resctrl-skx-twocaches");
 
+#define DO_TEST_RESIZE(_name, ...) \
+    do { \
+        struct virResctrlResizeData resize = { __VA_ARGS__ }; \
+        if (virTestRun("Resize: " _name, test_virResctrlResize, &resize) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* The group has bits 8-10 of both caches, bits 11-15 of cache 0 are
+     * unused while on cache 1 bit 11 belongs to another group. The
+     * granularity is 768 KiB. */
+    DO_TEST_RESIZE("grow", .id = 0, .delta = 1, .max = 50, .size = 1536,
+                   .expect = "L3:0=00f00\n");
+    DO_TEST_RESIZE("grow to free space", .id = 0, .delta = 5, .max = 100,
+                   .size = 1536, .expect = "L3:0=0ff00\n");
+    DO_TEST_RESIZE("grow beyond free space", .id = 0, .delta = 6, .max = 100,
+                   .size = 1536, .expect = NULL);
+    DO_TEST_RESIZE("grow beyond max", .id = 0, .delta = 5, .max = 25,
+                   .size = 1536, .expect = "L3:0=01f00\n");
+    DO_TEST_RESIZE("grow without adjacent space", .id = 1, .delta = 1,
+                   .max = 100, .size = 1536, .expect = NULL);
+    DO_TEST_RESIZE("shrink", .id = 1, .delta = -1, .max = 100,
+                   .size = 1536, .expect = "L3:1=00300\n");
+    DO_TEST_RESIZE("shrink below requested", .id = 0, .delta = -1,
+                   .max = 100, .size = 2304, .expect = NULL);
+
+    DO_TEST_RESIZE("bandwidth up", .memory = true, .id = 0, .delta = 1,
+                   .size = 30, .expect = "MB:0=60\n");
+    DO_TEST_RESIZE("bandwidth up to max", .memory = true, .id = 0,
+                   .delta = 10, .size = 30, .expect = "MB:0=100\n");
+    DO_TEST_RESIZE("bandwidth down to requested", .memory = true, .id = 1,
+                   .delta = -3, .size = 30, .expect = "MB:1=30\n");
+
     return ret;
 }
 
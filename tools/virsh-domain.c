@@ -6167,6 +6167,7 @@ VIR_ENUM_IMPL(virshDomainJobOperation,
               N_("Snapshot revert"),
               N_("Dump"),
               N_("Backup"),
+              N_("NUMA rebalance"),
 );
 
 static const char *
@@ -6225,6 +6226,7 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
     unsigned long long value;
     unsigned int flags = 0;
     int ivalue;
+    int bvalue;
     const char *svalue;
     int op;
     int rc;
@@ -6488,6 +6490,22 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
         vshPrint(ctl, "%-17s %-13d\n", _("Auto converge throttle:"), ivalue);
     }
 
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        vshPrint(ctl, "%-17s %-12llu ms\n", _("Auto tune downtime:"), value);
+    }
+
+    if ((rc = virTypedParamsGetBoolean(params, nparams,
+                                       VIR_DOMAIN_JOB_AUTO_TUNE_POSTCOPY,
+                                       &bvalue)) < 0) {
+        goto save_error;
+    } else if (rc && bvalue) {
+        vshPrint(ctl, "%-17s %s\n", _("Auto tune post-copy:"), _("yes"));
+    }
+
     if ((rc = virTypedParamsGetULLong(params, nparams,
                                       VIR_DOMAIN_JOB_DISK_TEMP_USED,
                                       &value)) < 0) {
@@ -6559,6 +6577,57 @@ cmdDomjobabort(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/*
+ * "domdirtyrate-calc" command
+ */
+static const vshCmdInfo info_domdirtyrate_calc[] = {
+    {.name = "help",
+     .data = N_("Calculate a vm's memory dirty rate")
+    },
+    {.name = "desc",
+     .data = N_("Calculate memory dirty rate of a domain in order to "
+                "decide whether it's proper to be migrated out or not.\n"
+                "The calculated dirty rate information is available by "
+                "calling 'domstats --dirtyrate'.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_domdirtyrate_calc[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(VIR_CONNECT_LIST_DOMAINS_ACTIVE),
+    {.name = "seconds",
+     .type = VSH_OT_INT,
+     .help = N_("calculate memory dirty rate within specified seconds, "
+                "the supported value range from 1 to 60, default to 1.")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDomDirtyRateCalc(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom = NULL;
+    int seconds = 1; /* the default value is 1 */
+    bool ret = false;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        return false;
+
+    if (vshCommandOptInt(ctl, cmd, "seconds", &seconds) < 0)
+        goto cleanup;
+
+    if (virDomainStartDirtyRateCalc(dom, seconds, 0) < 0)
+        goto cleanup;
+
+    vshPrintExtra(ctl, _("Start to calculate domain's memory "
+                         "dirty rate successfully.\n"));
+    ret = true;
+
+ cleanup:
+    virshDomainFree(dom);
+    return ret;
+}
+
 /*
  * "vcpucount" command
  */
@@ -9598,6 +9667,145 @@ cmdNumatune(vshControl * ctl, const vshCmd * cmd)
     goto cleanup;
 }
 
+/*
+ * "numa-rebalance" command
+ */
+static const vshCmdInfo info_numa_rebalance[] = {
+    {.name = "help",
+     .data = N_("move a running domain to other host NUMA nodes")
+    },
+    {.name = "desc",
+     .data = N_("Move vCPUs and memory of a running domain to other host "
+                "NUMA nodes.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_numa_rebalance[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(VIR_CONNECT_LIST_DOMAINS_ACTIVE),
+    {.name = "nodeset",
+     .type = VSH_OT_STRING,
+     .help = N_("host NUMA nodes to move the domain to, picked "
+                "automatically if omitted")
+    },
+    {.name = "bandwidth",
+     .type = VSH_OT_INT,
+     .help = N_("memory migration bandwidth limit in MiB/s")
+    },
+    {.name = "verbose",
+     .type = VSH_OT_BOOL,
+     .help = N_("display the progress of rebalancing")
+    },
+    {.name = NULL}
+};
+
+static void
+doNumaRebalance(void *opaque)
+{
+    virshCtrlData *data = opaque;
+    vshControl *ctl = data->ctl;
+    const vshCmd *cmd = data->cmd;
+    virDomainPtr dom = NULL;
+    const char *name = NULL;
+    const char *nodeset = NULL;
+    unsigned long long bandwidth = 0;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int maxparams = 0;
+    int rv;
+#ifndef WIN32
+    sigset_t sigmask, oldsigmask;
+
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGINT);
+    if (pthread_sigmask(SIG_BLOCK, &sigmask, &oldsigmask) < 0)
+        goto out_sig;
+#endif /* !WIN32 */
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, &name)))
+        goto out;
+
+    if (vshCommandOptStringReq(ctl, cmd, "nodeset", &nodeset) < 0)
+        goto out;
+
+    if (nodeset &&
+        virTypedParamsAddString(&params, &nparams, &maxparams,
+                                VIR_DOMAIN_NUMA_REBALANCE_NODESET,
+                                nodeset) < 0)
+        goto save_error;
+
+    if ((rv = vshCommandOptULongLong(ctl, cmd, "bandwidth", &bandwidth)) < 0)
+        goto out;
+
+    if (rv > 0 &&
+        virTypedParamsAddULLong(&params, &nparams, &maxparams,
+                                VIR_DOMAIN_NUMA_REBALANCE_BANDWIDTH,
+                                bandwidth) < 0)
+        goto save_error;
+
+    if (virDomainNumaRebalance(dom, params, nparams, 0) < 0) {
+        vshError(ctl, _("Failed to rebalance domain %s"), name);
+        goto out;
+    }
+
+    data->ret = 0;
+ out:
+#ifndef WIN32
+    pthread_sigmask(SIG_SETMASK, &oldsigmask, NULL);
+ out_sig:
+#endif /* !WIN32 */
+    virTypedParamsFree(params, nparams);
+    if (dom)
+        virshDomainFree(dom);
+    g_main_loop_quit(data->eventLoop);
+    return;
+
+ save_error:
+    vshSaveLibvirtError();
+    goto out;
+}
+
+static bool
+cmdNumaRebalance(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom;
+    bool verbose = false;
+    const char *name = NULL;
+    virThread workerThread;
+    g_autoptr(GMainContext) eventCtxt = g_main_context_new();
+    g_autoptr(GMainLoop) eventLoop = g_main_loop_new(eventCtxt, FALSE);
+    virshCtrlData data = {
+        .ctl = ctl,
+        .cmd = cmd,
+        .eventLoop = eventLoop,
+        .ret = -1,
+    };
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, &name)))
+        return false;
+
+    if (vshCommandOptBool(cmd, "verbose"))
+        verbose = true;
+
+    if (virThreadCreate(&workerThread,
+                        true,
+                        doNumaRebalance,
+                        &data) < 0)
+        goto cleanup;
+
+    virshWatchJob(ctl, dom, verbose, eventLoop,
+                  &data.ret, 0, NULL, NULL, _("NUMA rebalance"));
+
+    virThreadJoin(&workerThread);
+
+    if (!data.ret)
+        vshPrintExtra(ctl, _("\nDomain %s rebalanced\n"), name);
+
+ cleanup:
+    virshDomainFree(dom);
+    return !data.ret;
+}
+
 /*
  * "qemu-monitor-command" command
  */
@@ -10708,6 +10916,10 @@ static const vshCmdOptDef opts_migrate[] = {
      .type = VSH_OT_INT,
      .help = N_("number of connections for parallel migration")
     },
+    {.name = "auto-tune",
+     .type = VSH_OT_BOOL,
+     .help = N_("adjust migration parameters when migration does not converge")
+    },
     {.name = "bandwidth",
      .type = VSH_OT_INT,
      .help = N_("migration bandwidth limit in MiB/s")
@@ -10998,6 +11210,9 @@ doMigrate(void *opaque)
     if (vshCommandOptBool(cmd, "parallel"))
         flags |= VIR_MIGRATE_PARALLEL;
 
+    if (vshCommandOptBool(cmd, "auto-tune"))
+        flags |= VIR_MIGRATE_AUTO_TUNE;
+
     if (flags & VIR_MIGRATE_PEER2PEER || vshCommandOptBool(cmd, "direct")) {
         if (virDomainMigrateToURI3(dom, desturi, params, nparams, flags) == 0)
             data->ret = 0;
@@ -14462,6 +14677,12 @@ const vshCmdDef domManagementCmds[] = {
      .info = info_detach_interface,
      .flags = 0
     },
+    {.name = "domdirtyrate-calc",
+     .handler = cmdDomDirtyRateCalc,
+     .opts = opts_domdirtyrate_calc,
+     .info = info_domdirtyrate_calc,
+     .flags = 0
+    },
     {.name = "domdisplay",
      .handler = cmdDomDisplay,
      .opts = opts_domdisplay,
@@ -14738,6 +14959,12 @@ const vshCmdDef domManagementCmds[] = {
      .info = info_migrate_postcopy,
      .flags = 0
     },
+    {.name = "numa-rebalance",
+     .handler = cmdNumaRebalance,
+     .opts = opts_numa_rebalance,
+     .info = info_numa_rebalance,
+     .flags = 0
+    },
     {.name = "numatune",
      .handler = cmdNumatune,
      .opts = opts_numatune,
@@ -949,6 +949,46 @@ cmdNodeMemStats(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/*
+ * "nodepressure" command
+ */
+static const vshCmdInfo info_nodepressure[] = {
+    {.name = "help",
+     .data = N_("Prints pressure stall information of the node.")
+    },
+    {.name = "desc",
+     .data = N_("Returns how long tasks on the node were stalled waiting "
+                "for CPU, memory and I/O.")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdNodePressure(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    size_t i;
+    bool ret = false;
+    virshControlPtr priv = ctl->privData;
+
+    if (virNodeGetPressureStats(priv->conn, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to get node pressure stall information"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        g_autofree char *str = vshGetTypedParamValue(ctl, &params[i]);
+        vshPrint(ctl, "%-20s %s\n", params[i].field, str);
+    }
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
 /*
  * "nodesuspend" command
  */
@@ -1903,6 +1943,12 @@ const vshCmdDef hostAndHypervisorCmds[] = {
      .info = info_nodememstats,
      .flags = 0
     },
+    {.name = "nodepressure",
+     .handler = cmdNodePressure,
+     .opts = NULL,
+     .info = info_nodepressure,
+     .flags = 0
+    },
     {.name = "nodesuspend",
      .handler = cmdNodeSuspend,
      .opts = opts_node_suspend,